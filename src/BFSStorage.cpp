@@ -11,8 +11,15 @@
 #include <stdlib.h>  // For random number generation
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <Query.h>
 #include <fs_index.h>
+#include <Autolock.h>
+
+#include "ChatJournal.h"
+#include "ChatLog.h"
+#include "Tokenizer.h"
 
 BFSStorage* BFSStorage::sInstance = NULL;
 
@@ -25,6 +32,15 @@ BFSStorage* BFSStorage::GetInstance()
 }
 
 BFSStorage::BFSStorage()
+    : fLock("bfs storage")
+    , fJournal(NULL)
+    , fSearchIndexLoaded(false)
+    , fSearchIndexCaughtUp(false)
+    , fUsageCacheLock("usage cache")
+    , fUsageCacheValid(false)
+    , fCachedMonth(0)
+    , fCachedInput(0)
+    , fCachedOutput(0)
 {
     // Initialize random number generator
     srand(time(NULL));
@@ -44,6 +60,7 @@ BFSStorage::BFSStorage()
 
 BFSStorage::~BFSStorage()
 {
+    delete fJournal;
 }
 
 bool BFSStorage::Initialize()
@@ -74,9 +91,52 @@ bool BFSStorage::Initialize()
     if (status != B_OK)
         return false;
 
+    // Usage rollups; usage saved one file per request before them is
+    // folded in once
+    if (fUsage.Load(fStatsDir) == B_ENTRY_NOT_FOUND)
+        _ImportUsageFiles();
+
+    // Redo the saves a crash cut short. Without a journal, chats are
+    // still saved, just not as safely.
+    BPath journalPath(fBasePath);
+    journalPath.Append("Journal");
+    fJournal = new ChatJournal();
+    status = fJournal->Open(journalPath);
+    if (status == B_OK)
+        _ReplayJournal();
+    else {
+        printf("Opening the chat journal failed: %s\n", strerror(status));
+        delete fJournal;
+        fJournal = NULL;
+    }
+
     return true;
 }
 
+void BFSStorage::_ReplayJournal()
+{
+    BAutolock lock(fLock);
+
+    std::vector<ChatSnapshot> entries;
+    if (fJournal->Read(&entries) != B_OK || entries.empty())
+        return;
+
+    // Saving skips what a chat file already holds, so replaying the
+    // records that did make it is harmless
+    for (size_t i = 0; i < entries.size(); i++) {
+        status_t status = _SaveChat(entries[i]);
+        if (status == B_OK)
+            fDirtyChats.insert(entries[i].id);
+        else {
+            printf("Replaying the journal for chat %s failed: %s\n",
+                entries[i].id.String(), strerror(status));
+        }
+    }
+
+    printf("Replayed %d chat journal records\n", (int)entries.size());
+    _Checkpoint();
+}
+
 status_t BFSStorage::_CreateIndices(dev_t device)
 {
     // Create indices for fast queries
@@ -87,6 +147,7 @@ status_t BFSStorage::_CreateIndices(dev_t device)
     fs_create_index(device, ATTR_CHAT_CREATED, B_TIME_TYPE, 0);
     fs_create_index(device, ATTR_CHAT_UPDATED, B_TIME_TYPE, 0);
     fs_create_index(device, ATTR_CHAT_ID, B_STRING_TYPE, 0);
+    fs_create_index(device, ATTR_CHAT_MESSAGE_COUNT, B_INT32_TYPE, 0);
 
     // Create message indices
     fs_create_index(device, ATTR_MESSAGE_ROLE, B_INT32_TYPE, 0);
@@ -124,22 +185,208 @@ BString BFSStorage::_GenerateUniqueID() const
     return BString(buffer);
 }
 
+BString BFSStorage::NewChatID()
+{
+    BAutolock lock(fLock);
+    return _GenerateUniqueID();
+}
+
+void BFSStorage::PrepareSave(Chat* chat, ChatSnapshot* snapshot)
+{
+    // The ID is handed out right away, so saves queued for a chat whose
+    // file does not exist yet still refer to one chat
+    if (chat->ID().IsEmpty())
+        chat->SetID(NewChatID());
+
+    snapshot->id = chat->ID();
+    snapshot->title = chat->Title();
+    snapshot->createdAt = chat->CreatedAt();
+    snapshot->messages = chat->Snapshot();
+    snapshot->unloadedCount = chat->UnloadedCount();
+}
+
 status_t BFSStorage::SaveChat(Chat* chat)
 {
     if (chat == NULL)
         return B_BAD_VALUE;
 
+    ChatSnapshot snapshot;
+    PrepareSave(chat, &snapshot);
+    return SaveChat(snapshot);
+}
+
+status_t BFSStorage::SaveChat(const ChatSnapshot& chat)
+{
+    return SaveChats(std::vector<ChatSnapshot>(1, chat));
+}
+
+status_t BFSStorage::SaveChats(const std::vector<ChatSnapshot>& chats)
+{
+    BAutolock lock(fLock);
+
+    // Journal just the messages each chat adds to what is on disk
+    std::vector<ChatSnapshot> entries;
+    for (size_t i = 0; fJournal != NULL && i < chats.size(); i++) {
+        const ChatSnapshot& chat = chats[i];
+
+        int32 savedCount = 0;
+        ChatRecord* record;
+        if (_FindChat(chat.id, &record) == B_OK)
+            savedCount = record->savedCount;
+
+        int32 first = savedCount - chat.unloadedCount;
+        if (first < 0)
+            first = 0;
+        if (first >= chat.messages.CountItems())
+            continue;
+
+        ChatSnapshot entry;
+        entry.id = chat.id;
+        entry.title = chat.title;
+        entry.createdAt = chat.createdAt;
+        entry.unloadedCount = chat.unloadedCount + first;
+        for (int32 j = first; j < chat.messages.CountItems(); j++)
+            entry.messages.AddItem(const_cast<ChatMessage*>(chat.messages.ItemAt(j)));
+        entries.push_back(entry);
+    }
+
+    if (!entries.empty()) {
+        status_t status = fJournal->Append(entries);
+        if (status != B_OK)
+            printf("Writing the chat journal failed: %s\n", strerror(status));
+    }
+
+    // The chat files are synced at the next checkpoint
+    status_t result = B_OK;
+    for (size_t i = 0; i < chats.size(); i++) {
+        status_t status = _SaveChat(chats[i]);
+        if (status == B_OK)
+            fDirtyChats.insert(chats[i].id);
+        else {
+            printf("Saving chat %s failed: %s\n", chats[i].id.String(),
+                strerror(status));
+            result = status;
+        }
+    }
+
+    if (fJournal != NULL && fJournal->Size() > kCheckpointSize)
+        _Checkpoint();
+    else if (fSearchIndex.PendingDocuments() >= kSearchIndexFlushCount)
+        _SaveSearchIndex();
+
+    return result;
+}
+
+status_t BFSStorage::Checkpoint()
+{
+    BAutolock lock(fLock);
+    return _Checkpoint();
+}
+
+status_t BFSStorage::_Checkpoint()
+{
+    if (fJournal == NULL)
+        return B_NO_INIT;
+
+    bool unpackedChats = false;
+    for (std::set<BString>::iterator it = fDirtyChats.begin();
+            it != fDirtyChats.end(); it++) {
+        ChatRecord* record;
+        if (_FindChat(*it, &record) != B_OK)
+            continue;
+
+        if (record->packed) {
+            BFile chatFile(&record->ref, B_READ_WRITE);
+            if (chatFile.InitCheck() == B_OK)
+                chatFile.Sync();
+        } else
+            unpackedChats = true;
+    }
+
+    // Chats from before the packed format are spread over many files
+    if (unpackedChats)
+        sync();
+
+    fDirtyChats.clear();
+
+    // What the journal covered has to be findable without it
+    if (fSearchIndex.PendingDocuments() > 0)
+        _SaveSearchIndex();
+
+    return fJournal->Reset();
+}
+
+status_t BFSStorage::_SaveChat(const ChatSnapshot& chat)
+{
+    ChatRecord* record;
+    status_t status = _FindChat(chat.id, &record);
+    if (status == B_ENTRY_NOT_FOUND)
+        status = _CreateChatFile(chat, &record);
+    if (status != B_OK)
+        return status;
+
+    // The title may have changed since the last save
+    BNode chatNode(&record->ref);
+    if (chatNode.InitCheck() != B_OK)
+        return chatNode.InitCheck();
+
     time_t now = time(NULL);
+    chatNode.WriteAttr(ATTR_CHAT_TITLE, B_STRING_TYPE, 0, chat.title.String(), chat.title.Length() + 1);
+    chatNode.WriteAttr(ATTR_CHAT_UPDATED, B_TIME_TYPE, 0, &now, sizeof(time_t));
+
+    // Save the new messages
+    status = _SaveChatMessages(chat, record);
+
+    // Index what is saved now; messages the snapshot does not hold are
+    // left for the next search to catch up on
+    SearchIndex& index = _SearchIndex();
+    for (int32 i = index.IndexedCount(chat.id.String()); i < record->savedCount; i++) {
+        int32 at = i - chat.unloadedCount;
+        if (at < 0 || at >= chat.messages.CountItems())
+            break;
+        const BString& content = chat.messages.ItemAt(at)->Content();
+        index.Add(chat.id.String(), i, content.String(), content.Length());
+    }
+
+    // Keep what the chat list shows in attributes, so listing chats never
+    // reads any message
+    int32 messageCount = record->savedCount;
+    chatNode.WriteAttr(ATTR_CHAT_MESSAGE_COUNT, B_INT32_TYPE, 0, &messageCount, sizeof(int32));
+
+    BString preview = _Preview(chat.messages);
+    chatNode.WriteAttr(ATTR_CHAT_PREVIEW, B_STRING_TYPE, 0, preview.String(), preview.Length() + 1);
+
+    return status;
+}
 
+BString BFSStorage::_Preview(const ChatHistory& messages)
+{
+    // The start of the last message, on one line
+    BString preview;
+    if (messages.CountItems() == 0)
+        return preview;
+
+    preview = messages.ItemAt(messages.CountItems() - 1)->Content();
+    preview.ReplaceAll('\n', ' ');
+    preview.ReplaceAll('\t', ' ');
+    if (preview.CountChars() > kPreviewLength) {
+        preview.TruncateChars(kPreviewLength);
+        preview << "…";
+    }
+
+    return preview;
+}
+
+status_t BFSStorage::_CreateChatFile(const ChatSnapshot& chat, ChatRecord** record)
+{
     // Create a filename from the chat title
-    BString filename = chat->Title();
+    BString filename = chat.title;
     // Replace invalid filename characters
     filename.ReplaceAll("/", "_");
     filename.ReplaceAll(":", "_");
 
-    // Add a unique ID to the filename to avoid conflicts
-    BString uniqueID = _GenerateUniqueID();
-    filename << "_" << uniqueID;
+    // Add the chat ID to the filename to avoid conflicts
+    filename << "_" << chat.id;
 
     BPath chatPath(fChatsDir);
     chatPath.Append(filename);
@@ -153,64 +400,135 @@ status_t BFSStorage::SaveChat(Chat* chat)
     BNodeInfo nodeInfo(&chatFile);
     nodeInfo.SetType("application/x-vnd.Otto-chat");
 
-    // Add attributes to the file
-    chatFile.WriteAttr(ATTR_CHAT_TITLE, B_STRING_TYPE, 0, chat->Title().String(), chat->Title().Length() + 1);
-
-    time_t createdTime = chat->CreatedAt();
+    // Add the attributes that never change
+    time_t createdTime = chat.createdAt;
     chatFile.WriteAttr(ATTR_CHAT_CREATED, B_TIME_TYPE, 0, &createdTime, sizeof(time_t));
-
-    chatFile.WriteAttr(ATTR_CHAT_UPDATED, B_TIME_TYPE, 0, &now, sizeof(time_t));
-    chatFile.WriteAttr(ATTR_CHAT_ID, B_STRING_TYPE, 0, uniqueID.String(), uniqueID.Length() + 1);
+    chatFile.WriteAttr(ATTR_CHAT_ID, B_STRING_TYPE, 0, chat.id.String(), chat.id.Length() + 1);
 
     // Close the file
     chatFile.Unset();
 
     // Get entry_ref for the chat file
-    entry_ref chatRef;
+    ChatRecord newRecord;
     BEntry chatEntry(chatPath.Path());
-    chatEntry.GetRef(&chatRef);
+    status_t status = chatEntry.GetRef(&newRecord.ref);
+    if (status != B_OK)
+        return status;
 
-    // Save messages
-    return _SaveChatMessages(chatRef, chat->Messages());
+    // New chats keep their messages in the chat file itself
+    newRecord.packed = true;
+    newRecord.savedCount = 0;
+    *record = &(fChatRecords[chat.id] = newRecord);
+    return B_OK;
 }
 
-status_t BFSStorage::_SaveChatMessages(const entry_ref& chatRef, const BObjectList<ChatMessage, true>* messages)
+status_t BFSStorage::_FindChat(const BString& chatID, ChatRecord** record)
 {
-    if (messages == NULL)
-        return B_BAD_VALUE;
+    std::map<BString, ChatRecord>::iterator found = fChatRecords.find(chatID);
+    if (found != fChatRecords.end()) {
+        BEntry entry(&found->second.ref);
+        if (entry.Exists()) {
+            *record = &found->second;
+            return B_OK;
+        }
+        fChatRecords.erase(found);
+    }
+
+    // Not seen this session, or moved; look it up by its ID
+    BEntry chatsEntry(fChatsDir.Path());
+    BVolume volume;
+    chatsEntry.GetVolume(&volume);
+
+    BQuery query;
+    query.SetVolume(&volume);
+
+    BString expression;
+    expression << "((" ATTR_CHAT_ID " == \"" << chatID.String()
+        << "\")&&(BEOS:TYPE==\"application/x-vnd.Otto-chat\"))";
+    query.SetPredicate(expression.String());
+
+    status_t status = query.Fetch();
+    if (status != B_OK)
+        return status;
+
+    ChatRecord newRecord;
+    BEntry entry;
+    if (query.GetNextEntry(&entry) != B_OK)
+        return B_ENTRY_NOT_FOUND;
+
+    status = entry.GetRef(&newRecord.ref);
+    if (status != B_OK)
+        return status;
+
+    // Whatever is on disk already is saved
+    status = _CountMessages(newRecord.ref, &newRecord.packed, &newRecord.savedCount);
+    if (status != B_OK)
+        return status;
+
+    *record = &(fChatRecords[chatID] = newRecord);
+    return B_OK;
+}
 
-    // First, remove any existing message files for this chat
+status_t BFSStorage::_CountMessages(const entry_ref& chatRef, bool* packed, int32* count)
+{
+    // Chats without a messages directory keep their messages in the chat
+    // file
     BString chatDirName(chatRef.name);
     chatDirName << "_messages";
+    BPath messagesPath(fChatsDir);
+    messagesPath.Append(chatDirName);
+    BDirectory messagesDir(messagesPath.Path());
+
+    *packed = messagesDir.InitCheck() != B_OK;
+    if (*packed)
+        return ChatLog::CountMessages(chatRef, count);
+
+    *count = messagesDir.CountEntries();
+    return B_OK;
+}
+
+status_t BFSStorage::_SaveChatMessages(const ChatSnapshot& chat, ChatRecord* record)
+{
+    const ChatHistory& messages = chat.messages;
+
+    // The snapshot leaves out the messages the chat has not loaded, which
+    // all come before the unsaved ones
+    int32 totalCount = messages.CountItems() + chat.unloadedCount;
+    if (record->savedCount < chat.unloadedCount)
+        return B_BAD_DATA;
+
+    if (record->packed) {
+        status_t status = ChatLog::Append(record->ref, messages,
+            record->savedCount - chat.unloadedCount);
+        if (status == B_OK && totalCount > record->savedCount)
+            record->savedCount = totalCount;
+        return status;
+    }
+
+    // Chats from before the packed format get one file per message, until
+    // they are migrated
+
+    BString chatDirName(record->ref.name);
+    chatDirName << "_messages";
 
     BPath messagesPath(fChatsDir);
     messagesPath.Append(chatDirName);
 
-    // Check if directory exists
+    // Create the directory with the first message
     BEntry messagesEntry(messagesPath.Path());
-    if (messagesEntry.Exists()) {
-        // Delete existing files
-        BDirectory messagesDir(messagesPath.Path());
-        messagesDir.Rewind();
-        BEntry entry;
-        while (messagesDir.GetNextEntry(&entry) == B_OK) {
-            entry.Remove();
-        }
-    } else {
-        // Create directory
+    if (!messagesEntry.Exists()) {
         BDirectory baseDir(fChatsDir.Path());
-        baseDir.CreateDirectory(chatDirName, NULL);
+        status_t status = baseDir.CreateDirectory(chatDirName, NULL);
+        if (status != B_OK)
+            return status;
     }
 
-    // Save each message as a separate file
-    BString chatID;
-    BNode chatNode(&chatRef);
-    char buffer[B_PATH_NAME_LENGTH];
-    chatNode.ReadAttr(ATTR_CHAT_ID, B_STRING_TYPE, 0, buffer, sizeof(buffer));
-    chatID = buffer;
+    // Messages never change once added, so only the ones after the last
+    // save are written; each message keeps its own file
+    const BString& chatID = chat.id;
 
-    for (int32 i = 0; i < messages->CountItems(); i++) {
-        ChatMessage* message = messages->ItemAt(i);
+    for (int32 i = record->savedCount; i < totalCount; i++) {
+        const ChatMessage* message = messages.ItemAt(i - chat.unloadedCount);
 
         // Create message filename
         BString msgFilename;
@@ -219,10 +537,10 @@ status_t BFSStorage::_SaveChatMessages(const entry_ref& chatRef, const BObjectLi
         BPath msgPath(messagesPath);
         msgPath.Append(msgFilename);
 
-        // Create message file
+        // Create message file; stop here, so the next save retries
         BFile msgFile(msgPath.Path(), B_CREATE_FILE | B_WRITE_ONLY);
         if (msgFile.InitCheck() != B_OK)
-            continue;
+            return msgFile.InitCheck();
 
         // Write message content to file
         msgFile.Write(message->Content().String(), message->Content().Length());
@@ -245,14 +563,25 @@ status_t BFSStorage::_SaveChatMessages(const entry_ref& chatRef, const BObjectLi
         msgFile.WriteAttr(ATTR_MESSAGE_TOKENS_IN, B_INT32_TYPE, 0, &inputTokens, sizeof(int32));
         msgFile.WriteAttr(ATTR_MESSAGE_TOKENS_OUT, B_INT32_TYPE, 0, &outputTokens, sizeof(int32));
 
+        // Keep the token count, so the message is not tokenized again
+        // after the chat is reopened
+        const Tokenizer* tokenizer;
+        int32 tokenCount;
+        if (message->GetCachedTokenCount(&tokenizer, &tokenCount)) {
+            msgFile.WriteAttr(ATTR_MESSAGE_TOKEN_COUNT, B_INT32_TYPE, 0, &tokenCount, sizeof(int32));
+            msgFile.WriteAttr(ATTR_MESSAGE_TOKENIZER, B_STRING_TYPE, 0, tokenizer->Name().String(), tokenizer->Name().Length() + 1);
+        }
+
         // Set message order
         msgFile.WriteAttr(ATTR_MESSAGE_ORDER, B_INT32_TYPE, 0, &i, sizeof(int32));
+
+        record->savedCount = i + 1;
     }
 
     return B_OK;
 }
 
-status_t BFSStorage::LoadChat(const entry_ref& ref, Chat* chat)
+status_t BFSStorage::LoadChat(const entry_ref& ref, Chat* chat, int32 recentCount)
 {
     if (chat == NULL)
         return B_BAD_VALUE;
@@ -270,16 +599,96 @@ status_t BFSStorage::LoadChat(const entry_ref& ref, Chat* chat)
     node.ReadAttr(ATTR_CHAT_CREATED, B_TIME_TYPE, 0, &createdTime, sizeof(time_t));
     node.ReadAttr(ATTR_CHAT_UPDATED, B_TIME_TYPE, 0, &updatedTime, sizeof(time_t));
 
+    char idBuffer[B_PATH_NAME_LENGTH];
+    ssize_t idLength = node.ReadAttr(ATTR_CHAT_ID, B_STRING_TYPE, 0, idBuffer, sizeof(idBuffer) - 1);
+    if (idLength <= 0)
+        return B_BAD_DATA;
+    idBuffer[idLength] = '\0';
+
     // Set chat properties
     chat->SetTitle(titleBuffer);
     chat->SetCreatedAt(createdTime);
     chat->SetUpdatedAt(updatedTime);
+    chat->SetID(idBuffer);
+
+    // Keeps the writer thread from appending while the log is read
+    BAutolock lock(fLock);
+
+    ChatRecord record;
+    record.ref = ref;
+    status_t status = _CountMessages(ref, &record.packed, &record.savedCount);
+    if (status != B_OK)
+        return status;
+
+    // Everything loaded is already saved
+    fChatRecords[chat->ID()] = record;
+
+    // Chats that were never migrated are loaded whole
+    if (!record.packed) {
+        status = _LoadChatMessages(ref, chat->Messages());
+        if (status == B_ENTRY_NOT_FOUND)
+            status = B_OK;
+        fChatRecords[chat->ID()].savedCount = chat->Messages()->CountItems();
+        return status;
+    }
+
+    int32 total = record.savedCount;
+    if (recentCount < 0 || total <= recentCount + 1) {
+        status = ChatLog::Read(ref, chat->Messages());
+        return status == B_ENTRY_NOT_FOUND ? B_OK : status;
+    }
+
+    // The system prompt stays in front, even when it is not recent
+    int32 headCount = 0;
+    BObjectList<ChatMessage> head(1);
+    status = ChatLog::Read(ref, &head, 0, 1);
+    if (status != B_OK)
+        return status;
+    if (head.CountItems() == 1) {
+        if (head.ItemAt(0)->Role() == MESSAGE_ROLE_SYSTEM) {
+            chat->AddMessage(head.ItemAt(0));
+            headCount = 1;
+        } else
+            head.ItemAt(0)->ReleaseReference();
+    }
+
+    int32 first = total - recentCount;
+    status = ChatLog::Read(ref, chat->Messages(), first, recentCount);
+    if (status != B_OK)
+        return status;
+
+    chat->SetUnloaded(headCount, first - headCount);
+    return B_OK;
+}
+
+status_t BFSStorage::LoadMessages(const BString& chatID, int32 offset,
+                                  int32 count, BObjectList<ChatMessage>* messages)
+{
+    if (messages == NULL || offset < 0 || count <= 0)
+        return B_BAD_VALUE;
+
+    BAutolock lock(fLock);
+
+    ChatRecord* record;
+    status_t status = _FindChat(chatID, &record);
+    if (status != B_OK)
+        return status;
+
+    BObjectList<ChatMessage> loaded(count);
+    status = ChatLog::Read(record->ref, &loaded, offset, count);
+    if (status == B_OK && loaded.CountItems() != count)
+        status = B_BAD_DATA;
+    if (status != B_OK) {
+        for (int32 i = 0; i < loaded.CountItems(); i++)
+            loaded.ItemAt(i)->ReleaseReference();
+        return status;
+    }
 
-    // Load messages
-    return _LoadChatMessages(ref, chat->Messages());
+    messages->AddList(&loaded);
+    return B_OK;
 }
 
-status_t BFSStorage::_LoadChatMessages(const entry_ref& chatRef, BObjectList<ChatMessage, true>* messages)
+status_t BFSStorage::_LoadChatMessages(const entry_ref& chatRef, BObjectList<ChatMessage>* messages)
 {
     // Get chat ID
     BNode chatNode(&chatRef);
@@ -314,10 +723,14 @@ status_t BFSStorage::_LoadChatMessages(const entry_ref& chatRef, BObjectList<Cha
     if (status != B_OK)
         return status;
 
-    // Process each message file
+    // Process each message file; the query finds them in no particular
+    // order, so they are collected with their order first
+    std::vector<ChatLog::OrderedMessage> loaded;
+    BDirectory messagesDir(messagesPath.Path());
+    if (messagesDir.InitCheck() == B_OK)
+        loaded.reserve(messagesDir.CountEntries());
+
     BEntry entry;
-    int32 messageCount = 0;
-    BMessage orderedMessages;
 
     while (query.GetNextEntry(&entry) == B_OK) {
         // Get entry ref
@@ -350,33 +763,45 @@ status_t BFSStorage::_LoadChatMessages(const entry_ref& chatRef, BObjectList<Cha
         contentBuffer[fileSize] = '\0';
 
         // Create message
-        ChatMessage* message = new ChatMessage(contentBuffer, (MessageRole)role);
-        message->SetTimestamp(timestamp);
-        message->SetInputTokens(inputTokens);
-        message->SetOutputTokens(outputTokens);
+        ChatMessage* message = new ChatMessage(contentBuffer, (MessageRole)role,
+            timestamp, inputTokens, outputTokens);
+
+        int32 tokenCount;
+        char tokenizerName[64];
+        if (msgFile.ReadAttr(ATTR_MESSAGE_TOKEN_COUNT, B_INT32_TYPE, 0, &tokenCount, sizeof(int32)) == sizeof(int32)) {
+            ssize_t nameLength = msgFile.ReadAttr(ATTR_MESSAGE_TOKENIZER, B_STRING_TYPE, 0, tokenizerName, sizeof(tokenizerName) - 1);
+            if (nameLength > 0) {
+                tokenizerName[nameLength] = '\0';
+                const Tokenizer* tokenizer = Tokenizer::ForName(tokenizerName);
+                if (tokenizer != NULL)
+                    message->SetCachedTokenCount(tokenizer, tokenCount);
+            }
+        }
 
-        // We'll sort by order later
-        orderedMessages.AddPointer(BString().SetToFormat("%d", order).String(), message);
-        messageCount++;
+        ChatLog::OrderedMessage ordered = { order, message };
+        loaded.push_back(ordered);
 
         delete[] contentBuffer;
     }
 
-    // Add messages in order
-    for (int32 i = 0; i < messageCount; i++) {
-        void* ptr;
-        if (orderedMessages.FindPointer(BString().SetToFormat("%d", i).String(), &ptr) == B_OK) {
-            ChatMessage* message = static_cast<ChatMessage*>(ptr);
-            messages->AddItem(message);
-        }
-    }
+    ChatLog::SortByOrder(loaded);
+
+    for (size_t i = 0; i < loaded.size(); i++)
+        messages->AddItem(loaded[i].message);
 
     return B_OK;
 }
 
-BObjectList<Chat, true>* BFSStorage::LoadAllChats()
+static int _CompareSummaries(const ChatSummary* a, const ChatSummary* b)
 {
-    BObjectList<Chat, true>* chats = new BObjectList<Chat, true>(10);
+    if (a->updatedAt != b->updatedAt)
+        return a->updatedAt > b->updatedAt ? -1 : 1;
+    return 0;
+}
+
+BObjectList<ChatSummary, true>* BFSStorage::ListChats()
+{
+    BObjectList<ChatSummary, true>* chats = new BObjectList<ChatSummary, true>(20);
 
     // Create a query to find all chat files
     BQuery query;
@@ -395,27 +820,134 @@ BObjectList<Chat, true>* BFSStorage::LoadAllChats()
     if (status != B_OK)
         return chats;
 
-    // Process results
+    // Process results; only attributes are read
     BEntry entry;
     while (query.GetNextEntry(&entry) == B_OK) {
-        entry_ref ref;
-        entry.GetRef(&ref);
+        ChatSummary* summary = new ChatSummary;
+        if (entry.GetRef(&summary->ref) != B_OK) {
+            delete summary;
+            continue;
+        }
 
-        Chat* chat = new Chat("");
-        if (LoadChat(ref, chat) == B_OK) {
-            chats->AddItem(chat);
-        } else {
-            delete chat;
+        BNode node(&summary->ref);
+        if (node.InitCheck() != B_OK
+            || node.ReadAttrString(ATTR_CHAT_ID, &summary->id) != B_OK) {
+            delete summary;
+            continue;
         }
+
+        summary->createdAt = 0;
+        summary->updatedAt = 0;
+        node.ReadAttrString(ATTR_CHAT_TITLE, &summary->title);
+        node.ReadAttrString(ATTR_CHAT_PREVIEW, &summary->preview);
+        node.ReadAttr(ATTR_CHAT_CREATED, B_TIME_TYPE, 0, &summary->createdAt, sizeof(time_t));
+        node.ReadAttr(ATTR_CHAT_UPDATED, B_TIME_TYPE, 0, &summary->updatedAt, sizeof(time_t));
+
+        // Chats last saved before the count was kept are counted once
+        if (node.ReadAttr(ATTR_CHAT_MESSAGE_COUNT, B_INT32_TYPE, 0, &summary->messageCount, sizeof(int32)) != sizeof(int32)) {
+            bool packed;
+            if (_CountMessages(summary->ref, &packed, &summary->messageCount) != B_OK)
+                summary->messageCount = 0;
+            node.WriteAttr(ATTR_CHAT_MESSAGE_COUNT, B_INT32_TYPE, 0, &summary->messageCount, sizeof(int32));
+        }
+
+        chats->AddItem(summary);
     }
 
+    chats->SortItems(_CompareSummaries);
     return chats;
 }
 
-status_t BFSStorage::DeleteChat(const entry_ref& ref)
+status_t BFSStorage::MigrateChat(const entry_ref& ref)
+{
+    BAutolock lock(fLock);
+
+    int32 packedCount;
+    status_t status = ChatLog::CountMessages(ref, &packedCount);
+    if (status != B_OK)
+        return status;
+    if (packedCount > 0)
+        return B_OK;
+
+    BObjectList<ChatMessage> messages(20);
+    status = _LoadChatMessages(ref, &messages);
+    if (status == B_ENTRY_NOT_FOUND)
+        return B_OK;
+
+    ChatHistory history;
+    for (int32 i = 0; i < messages.CountItems(); i++) {
+        history.AddItem(messages.ItemAt(i));
+        messages.ItemAt(i)->ReleaseReference();
+    }
+
+    if (status == B_OK)
+        status = ChatLog::Append(ref, history, 0);
+
+    // Only drop the old files once the log reads back complete
+    if (status == B_OK) {
+        status = ChatLog::CountMessages(ref, &packedCount);
+        if (status == B_OK && packedCount != history.CountItems())
+            status = B_BAD_DATA;
+    }
+    if (status != B_OK) {
+        BFile chatFile(&ref, B_WRITE_ONLY);
+        chatFile.SetSize(0);
+        return status;
+    }
+
+    _RemoveMessagesDirectory(ref);
+
+    for (std::map<BString, ChatRecord>::iterator it = fChatRecords.begin();
+            it != fChatRecords.end(); it++) {
+        if (it->second.ref == ref) {
+            it->second.packed = true;
+            it->second.savedCount = packedCount;
+        }
+    }
+
+    return B_OK;
+}
+
+int32 BFSStorage::MigrateAllChats()
+{
+    BEntry chatsEntry(fChatsDir.Path());
+    BVolume volume;
+    chatsEntry.GetVolume(&volume);
+
+    BQuery query;
+    query.SetVolume(&volume);
+    query.SetPredicate("BEOS:TYPE == \"application/x-vnd.Otto-chat\"");
+    if (query.Fetch() != B_OK)
+        return 0;
+
+    int32 migrated = 0;
+    BEntry entry;
+    while (query.GetNextEntry(&entry) == B_OK) {
+        entry_ref ref;
+        if (entry.GetRef(&ref) != B_OK)
+            continue;
+
+        // Chats without a messages directory are packed already
+        BString chatDirName(ref.name);
+        chatDirName << "_messages";
+        BPath messagesPath(fChatsDir);
+        messagesPath.Append(chatDirName);
+        if (!BEntry(messagesPath.Path()).Exists())
+            continue;
+
+        status_t status = MigrateChat(ref);
+        if (status == B_OK)
+            migrated++;
+        else
+            printf("Migrating chat %s failed: %s\n", ref.name, strerror(status));
+    }
+
+    return migrated;
+}
+
+void BFSStorage::_RemoveMessagesDirectory(const entry_ref& chatRef)
 {
-    // First delete the messages directory
-    BString chatDirName(ref.name);
+    BString chatDirName(chatRef.name);
     chatDirName << "_messages";
 
     BPath messagesPath(fChatsDir);
@@ -431,8 +963,30 @@ status_t BFSStorage::DeleteChat(const entry_ref& ref)
         }
         messagesEntry.Remove();
     }
+}
+
+status_t BFSStorage::DeleteChat(const entry_ref& ref)
+{
+    // First delete the messages directory of an unmigrated chat
+    _RemoveMessagesDirectory(ref);
 
     // Then delete the chat file
+    {
+        BAutolock lock(fLock);
+
+        BString chatID;
+        if (BNode(&ref).ReadAttrString(ATTR_CHAT_ID, &chatID) == B_OK)
+            _SearchIndex().RemoveChat(chatID.String());
+
+        for (std::map<BString, ChatRecord>::iterator it = fChatRecords.begin();
+                it != fChatRecords.end(); it++) {
+            if (it->second.ref == ref) {
+                fChatRecords.erase(it);
+                break;
+            }
+        }
+    }
+
     BEntry chatEntry(&ref);
     return chatEntry.Remove();
 }
@@ -440,95 +994,277 @@ status_t BFSStorage::DeleteChat(const entry_ref& ref)
 status_t BFSStorage::SaveUsageStats(const BString& provider, const BString& model,
                                    int32 inputTokens, int32 outputTokens)
 {
+    BAutolock lock(fLock);
+
     time_t now = time(NULL);
+    status_t status = fUsage.Add(provider, model, now, inputTokens, outputTokens);
+
+    {
+        BAutolock cacheLock(fUsageCacheLock);
+        if (fUsageCacheValid) {
+            if (_MonthStart(now) == fCachedMonth) {
+                fCachedInput += inputTokens;
+                fCachedOutput += outputTokens;
+            } else
+                fUsageCacheValid = false;
+        }
+    }
 
-    // Create a filename from timestamp and a unique ID
-    BString filename;
-    filename.SetToFormat("usage_%ld_%s", now, _GenerateUniqueID().String());
+    _NotifyUsageWatchers();
+    return status;
+}
 
-    BPath usagePath(fStatsDir);
-    usagePath.Append(filename);
+status_t BFSStorage::GetTotalUsage(const BString& provider, const BString& model,
+                                  time_t startTime, time_t endTime,
+                                  int64* inputTokens, int64* outputTokens)
+{
+    if (inputTokens == NULL || outputTokens == NULL)
+        return B_BAD_VALUE;
 
-    // Create empty file to represent the usage record
-    BFile usageFile(usagePath.Path(), B_CREATE_FILE | B_WRITE_ONLY);
-    if (usageFile.InitCheck() != B_OK)
-        return usageFile.InitCheck();
+    BAutolock lock(fLock);
+    fUsage.GetTotal(provider, model, startTime, endTime, inputTokens, outputTokens);
+    return B_OK;
+}
 
-    // Set file MIME type
-    BNodeInfo nodeInfo(&usageFile);
-    nodeInfo.SetType("application/x-vnd.Otto-usage");
+status_t BFSStorage::GetMonthUsage(int64* inputTokens, int64* outputTokens)
+{
+    if (inputTokens == NULL || outputTokens == NULL)
+        return B_BAD_VALUE;
 
-    // Add attributes to the file
-    usageFile.WriteAttr(ATTR_USAGE_PROVIDER, B_STRING_TYPE, 0, provider.String(), provider.Length() + 1);
-    usageFile.WriteAttr(ATTR_USAGE_MODEL, B_STRING_TYPE, 0, model.String(), model.Length() + 1);
-    usageFile.WriteAttr(ATTR_USAGE_TIMESTAMP, B_TIME_TYPE, 0, &now, sizeof(time_t));
-    usageFile.WriteAttr(ATTR_USAGE_TOKENS_IN, B_INT32_TYPE, 0, &inputTokens, sizeof(int32));
-    usageFile.WriteAttr(ATTR_USAGE_TOKENS_OUT, B_INT32_TYPE, 0, &outputTokens, sizeof(int32));
+    BAutolock lock(fLock);
 
+    time_t now = time(NULL);
+    time_t monthStart = _MonthStart(now);
+    fUsage.GetTotal("", "", monthStart, now, inputTokens, outputTokens);
+
+    BAutolock cacheLock(fUsageCacheLock);
+    fUsageCacheValid = true;
+    fCachedMonth = monthStart;
+    fCachedInput = *inputTokens;
+    fCachedOutput = *outputTokens;
     return B_OK;
 }
 
-status_t BFSStorage::GetTotalUsage(const BString& provider, const BString& model,
-                                  time_t startTime, time_t endTime,
-                                  int32* inputTokens, int32* outputTokens)
+bool BFSStorage::GetCachedMonthUsage(int64* inputTokens, int64* outputTokens)
 {
-    if (inputTokens == NULL || outputTokens == NULL)
-        return B_BAD_VALUE;
+    BAutolock cacheLock(fUsageCacheLock);
+    if (!fUsageCacheValid || _MonthStart(time(NULL)) != fCachedMonth)
+        return false;
+
+    *inputTokens = fCachedInput;
+    *outputTokens = fCachedOutput;
+    return true;
+}
+
+void BFSStorage::StartWatchingUsage(const BMessenger& watcher)
+{
+    BAutolock cacheLock(fUsageCacheLock);
+    fUsageWatchers.push_back(watcher);
+}
+
+void BFSStorage::StopWatchingUsage(const BMessenger& watcher)
+{
+    BAutolock cacheLock(fUsageCacheLock);
+    for (size_t i = 0; i < fUsageWatchers.size(); i++) {
+        if (fUsageWatchers[i] == watcher) {
+            fUsageWatchers.erase(fUsageWatchers.begin() + i);
+            break;
+        }
+    }
+}
 
-    // Reset totals
-    *inputTokens = 0;
-    *outputTokens = 0;
+void BFSStorage::_NotifyUsageWatchers()
+{
+    BMessage notice(MSG_USAGE_CHANGED);
+    int64 inputTokens, outputTokens;
+    if (GetCachedMonthUsage(&inputTokens, &outputTokens)) {
+        notice.AddInt64("input", inputTokens);
+        notice.AddInt64("output", outputTokens);
+    }
+
+    // Called on the writer thread, which must not wait for a busy window
+    BAutolock cacheLock(fUsageCacheLock);
+    for (size_t i = 0; i < fUsageWatchers.size(); i++)
+        fUsageWatchers[i].SendMessage(&notice, (BHandler*)NULL, 0);
+}
+
+time_t BFSStorage::_MonthStart(time_t when)
+{
+    struct tm date;
+    localtime_r(&when, &date);
+    date.tm_sec = 0;
+    date.tm_min = 0;
+    date.tm_hour = 0;
+    date.tm_mday = 1;
+    date.tm_isdst = -1;
+    return mktime(&date);
+}
+
+status_t BFSStorage::CompactUsage()
+{
+    BAutolock lock(fLock);
+    return fUsage.Compact();
+}
+
+int32 BFSStorage::PendingUsageEvents()
+{
+    BAutolock lock(fLock);
+    return fUsage.PendingEvents();
+}
 
-    // Create a query to find usage records matching the criteria
+void BFSStorage::_ImportUsageFiles()
+{
+    // Find the usage records of earlier versions
     BQuery query;
 
-    // Get volume containing the stats directory
     BEntry statsEntry(fStatsDir.Path());
     BVolume volume;
     statsEntry.GetVolume(&volume);
 
     query.SetVolume(&volume);
+    query.SetPredicate("BEOS:TYPE == \"application/x-vnd.Otto-usage\"");
 
-    // Build query expression
-    BString expression = "BEOS:TYPE == \"application/x-vnd.Otto-usage\"";
+    BObjectList<BEntry, true> imported(20);
+    if (query.Fetch() == B_OK) {
+        BEntry entry;
+        while (query.GetNextEntry(&entry) == B_OK) {
+            BNode node(&entry);
+            if (node.InitCheck() != B_OK)
+                continue;
+
+            BString provider, model;
+            time_t timestamp = 0;
+            int32 in = 0, out = 0;
+            node.ReadAttrString(ATTR_USAGE_PROVIDER, &provider);
+            node.ReadAttrString(ATTR_USAGE_MODEL, &model);
+            node.ReadAttr(ATTR_USAGE_TIMESTAMP, B_TIME_TYPE, 0, &timestamp, sizeof(time_t));
+            node.ReadAttr(ATTR_USAGE_TOKENS_IN, B_INT32_TYPE, 0, &in, sizeof(int32));
+            node.ReadAttr(ATTR_USAGE_TOKENS_OUT, B_INT32_TYPE, 0, &out, sizeof(int32));
+
+            fUsage.Add(provider, model, timestamp, in, out, false);
+            imported.AddItem(new BEntry(entry));
+        }
+    }
 
-    // Add provider criteria if specified
-    if (provider.Length() > 0) {
-        expression << " && " << ATTR_USAGE_PROVIDER << " == \"" << provider.String() << "\"";
+    // The files go only once the rollups holding them are written
+    status_t status = fUsage.Compact();
+    if (status != B_OK) {
+        printf("Writing the usage rollups failed: %s\n", strerror(status));
+        return;
     }
 
-    // Add model criteria if specified
-    if (model.Length() > 0) {
-        expression << " && " << ATTR_USAGE_MODEL << " == \"" << model.String() << "\"";
+    for (int32 i = 0; i < imported.CountItems(); i++)
+        imported.ItemAt(i)->Remove();
+
+    if (imported.CountItems() > 0)
+        printf("Imported %d usage records\n", (int)imported.CountItems());
+}
+
+SearchIndex& BFSStorage::_SearchIndex()
+{
+    if (!fSearchIndexLoaded) {
+        BPath path(fBasePath);
+        path.Append("SearchIndex");
+        fSearchIndex.Load(path.Path());
+        fSearchIndexLoaded = true;
     }
 
-    // Add time range
-    expression << " && " << ATTR_USAGE_TIMESTAMP << " >= " << startTime;
-    expression << " && " << ATTR_USAGE_TIMESTAMP << " <= " << endTime;
+    return fSearchIndex;
+}
 
-    query.SetPredicate(expression.String());
+void BFSStorage::_SaveSearchIndex()
+{
+    BPath path(fBasePath);
+    path.Append("SearchIndex");
+    if (!fSearchIndex.Save(path.Path()))
+        printf("Writing the search index failed\n");
+}
 
-    status_t status = query.Fetch();
-    if (status != B_OK)
-        return status;
+void BFSStorage::_CatchUpSearchIndex()
+{
+    if (fSearchIndexCaughtUp)
+        return;
+    fSearchIndexCaughtUp = true;
+
+    // The message counts of the chats are attributes, so only chats the
+    // index is behind on get read
+    SearchIndex& index = _SearchIndex();
+    BObjectList<ChatSummary, true>* chats = ListChats();
+    for (int32 i = 0; i < chats->CountItems(); i++) {
+        const ChatSummary* summary = chats->ItemAt(i);
+        int32 indexed = index.IndexedCount(summary->id.String());
+        if (summary->messageCount <= indexed)
+            continue;
 
-    // Process results
-    BEntry entry;
-    while (query.GetNextEntry(&entry) == B_OK) {
-        entry_ref ref;
-        entry.GetRef(&ref);
+        ChatRecord* record;
+        if (_FindChat(summary->id, &record) != B_OK)
+            continue;
+
+        BObjectList<ChatMessage> messages(20);
+        int32 first = indexed;
+        if (record->packed)
+            ChatLog::Read(record->ref, &messages, indexed);
+        else {
+            _LoadChatMessages(record->ref, &messages);
+            first = 0;
+        }
+
+        for (int32 j = 0; j < messages.CountItems(); j++) {
+            const BString& content = messages.ItemAt(j)->Content();
+            index.Add(summary->id.String(), first + j, content.String(),
+                content.Length());
+            messages.ItemAt(j)->ReleaseReference();
+        }
+    }
+    delete chats;
 
-        BNode node(&ref);
-        if (node.InitCheck() != B_OK)
+    if (index.PendingDocuments() > 0)
+        _SaveSearchIndex();
+}
+
+status_t BFSStorage::SearchMessages(const BString& query, int32 maxResults,
+                                    BObjectList<SearchResult, true>* results)
+{
+    if (results == NULL || maxResults <= 0)
+        return B_BAD_VALUE;
+
+    BAutolock lock(fLock);
+    _CatchUpSearchIndex();
+
+    std::vector<SearchIndex::Hit> hits;
+    fSearchIndex.Search(query.String(), maxResults, &hits);
+
+    for (size_t i = 0; i < hits.size(); i++) {
+        ChatRecord* record;
+        if (_FindChat(hits[i].chatID.c_str(), &record) != B_OK)
             continue;
 
-        int32 in = 0, out = 0;
-        node.ReadAttr(ATTR_USAGE_TOKENS_IN, B_INT32_TYPE, 0, &in, sizeof(int32));
-        node.ReadAttr(ATTR_USAGE_TOKENS_OUT, B_INT32_TYPE, 0, &out, sizeof(int32));
+        // The message itself, for the snippet
+        BObjectList<ChatMessage> messages(1);
+        ChatMessage* message = NULL;
+        if (record->packed) {
+            ChatLog::Read(record->ref, &messages, hits[i].message, 1);
+            message = messages.ItemAt(0);
+        } else {
+            _LoadChatMessages(record->ref, &messages);
+            message = messages.ItemAt(hits[i].message);
+        }
+
+        SearchResult* result = new SearchResult;
+        result->ref = record->ref;
+        result->chatID = hits[i].chatID.c_str();
+        result->message = hits[i].message;
+        result->score = hits[i].score;
+        BNode(&record->ref).ReadAttrString(ATTR_CHAT_TITLE, &result->title);
+        if (message != NULL) {
+            result->snippet = SearchIndex::Snippet(message->Content().String(),
+                message->Content().Length(), query.String(), kSnippetLength).c_str();
+        }
+        results->AddItem(result);
 
-        *inputTokens += in;
-        *outputTokens += out;
+        for (int32 j = 0; j < messages.CountItems(); j++)
+            messages.ItemAt(j)->ReleaseReference();
     }
 
     return B_OK;
-}
\ No newline at end of file
+}
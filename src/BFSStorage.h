@@ -11,7 +11,16 @@
 #include <fs_index.h>
 #include <Volume.h>
 #include <NodeInfo.h>
+#include <Entry.h>
+#include <Locker.h>
+#include <Messenger.h>
 #include "ChatMessage.h"
+#include "SearchIndex.h"
+#include "UsageRollup.h"
+
+#include <map>
+#include <set>
+#include <vector>
 
 // Data storage types
 #define ATTR_CHAT_TITLE "Otto:Title"
@@ -23,6 +32,10 @@
 #define ATTR_MESSAGE_TOKENS_OUT "Otto:TokensOut"
 #define ATTR_CHAT_ID "Otto:ChatID"
 #define ATTR_MESSAGE_ORDER "Otto:Order"
+#define ATTR_MESSAGE_TOKEN_COUNT "Otto:TokenCount"
+#define ATTR_MESSAGE_TOKENIZER "Otto:Tokenizer"
+#define ATTR_CHAT_MESSAGE_COUNT "Otto:MessageCount"
+#define ATTR_CHAT_PREVIEW "Otto:Preview"
 
 // Usage stats types
 #define ATTR_USAGE_PROVIDER "Otto:Provider"
@@ -31,43 +44,191 @@
 #define ATTR_USAGE_TOKENS_OUT "Otto:TokensOut"
 #define ATTR_USAGE_TIMESTAMP "Otto:Timestamp"
 
+// Sent to usage watchers, with the month's "input" and "output" totals
+// if they are known
+const uint32 MSG_USAGE_CHANGED = 'usch';
+
+// What saving a chat needs of it, taken on the window thread so the save
+// can run on another thread while the chat keeps changing
+struct ChatSnapshot {
+    BString id;
+    BString title;
+    time_t createdAt;
+    ChatHistory messages;
+    // Older messages the chat has not loaded; they are on disk already
+    int32 unloadedCount;
+};
+
+// A chat as the chat list shows it, read from the chat file attributes
+// without loading any message
+struct ChatSummary {
+    entry_ref ref;
+    BString id;
+    BString title;
+    time_t createdAt;
+    time_t updatedAt;
+    int32 messageCount;
+    BString preview;
+};
+
+// A message found by BFSStorage::SearchMessages()
+struct SearchResult {
+    entry_ref ref;
+    BString chatID;
+    BString title;
+    int32 message;
+    float score;
+    BString snippet;
+};
+
+class ChatJournal;
+
 class BFSStorage {
 public:
     static BFSStorage* GetInstance();
 
     bool Initialize();
 
-    // Chat operations
+    // Chat operations. SaveChat() creates the chat file on the first call
+    // and afterwards only writes the messages added since the last save.
+    // Saving a snapshot is safe from any thread; PrepareSave() gives the
+    // chat its ID if it has none yet and must run where the chat lives.
+    // SaveChats() goes through the journal once for all of its chats.
     status_t SaveChat(Chat* chat);
-    status_t LoadChat(const entry_ref& ref, Chat* chat);
+    status_t SaveChat(const ChatSnapshot& chat);
+    status_t SaveChats(const std::vector<ChatSnapshot>& chats);
+    void PrepareSave(Chat* chat, ChatSnapshot* snapshot);
+    BString NewChatID();
     status_t DeleteChat(const entry_ref& ref);
-    BObjectList<Chat, true>* LoadAllChats();
 
-    // Usage statistics
+    // Lists all chats, newest first, from their attributes only
+    BObjectList<ChatSummary, true>* ListChats();
+
+    // Loads a chat with its first message, if that is the system prompt,
+    // and the recentCount newest ones; -1 loads all of them. The rest is
+    // left for LoadMessages().
+    status_t LoadChat(const entry_ref& ref, Chat* chat, int32 recentCount = -1);
+
+    // Adds count messages of a loaded chat, from the one at offset in the
+    // whole chat on, to messages, without touching the chat itself; this
+    // is how the messages it left out are read from another thread
+    status_t LoadMessages(const BString& chatID, int32 offset, int32 count,
+                          BObjectList<ChatMessage>* messages);
+
+    // Messages whose content matches query, best first; see SearchIndex
+    // for what a query can hold. The first search of a session indexes
+    // whatever messages the index is missing.
+    status_t SearchMessages(const BString& query, int32 maxResults,
+                            BObjectList<SearchResult, true>* results);
+
+    // Moves the messages of chats saved before the packed format from
+    // their per-message files into the chat file
+    status_t MigrateChat(const entry_ref& ref);
+    int32 MigrateAllChats();
+
+    // Usage statistics, kept as rollups; see UsageRollup
     status_t SaveUsageStats(const BString& provider, const BString& model,
                             int32 inputTokens, int32 outputTokens);
     status_t GetTotalUsage(const BString& provider, const BString& model,
                            time_t startTime, time_t endTime,
-                           int32* inputTokens, int32* outputTokens);
+                           int64* inputTokens, int64* outputTokens);
+
+    // Folds the usage events logged so far into the rollups
+    status_t CompactUsage();
+    int32 PendingUsageEvents();
+
+    // Usage of the current month. GetMonthUsage() adds it up and caches
+    // it; from then on, saving usage keeps the cached totals current, and
+    // reading them never waits for the storage lock.
+    status_t GetMonthUsage(int64* inputTokens, int64* outputTokens);
+    bool GetCachedMonthUsage(int64* inputTokens, int64* outputTokens);
+    void StartWatchingUsage(const BMessenger& watcher);
+    void StopWatchingUsage(const BMessenger& watcher);
+
+    // Syncs the chat files written since the last checkpoint and empties
+    // the journal; happens by itself whenever the journal grows too large
+    status_t Checkpoint();
 
     // Helper methods
     BPath GetChatsDirectory() const { return fChatsDir; }
     BPath GetStatsDirectory() const { return fStatsDir; }
 
 private:
+    struct ChatRecord;
+
     BFSStorage();
     ~BFSStorage();
 
     status_t _EnsureDirectoryExists(BPath& path);
     status_t _CreateIndices(dev_t device);
-    status_t _SaveChatMessages(const entry_ref& chatRef, const BObjectList<ChatMessage, true>* messages);
-    status_t _LoadChatMessages(const entry_ref& chatRef, BObjectList<ChatMessage, true>* messages);
     BString _GenerateUniqueID() const;
 
+    status_t _SaveChat(const ChatSnapshot& chat);
+    status_t _CreateChatFile(const ChatSnapshot& chat, ChatRecord** record);
+    status_t _FindChat(const BString& chatID, ChatRecord** record);
+    status_t _SaveChatMessages(const ChatSnapshot& chat, ChatRecord* record);
+    status_t _LoadChatMessages(const entry_ref& chatRef, BObjectList<ChatMessage>* messages);
+    status_t _CountMessages(const entry_ref& chatRef, bool* packed, int32* count);
+    void _RemoveMessagesDirectory(const entry_ref& chatRef);
+    static BString _Preview(const ChatHistory& messages);
+
+    status_t _Checkpoint();
+    void _ReplayJournal();
+
+    void _ImportUsageFiles();
+    void _NotifyUsageWatchers();
+    static time_t _MonthStart(time_t when);
+
+    SearchIndex& _SearchIndex();
+    void _CatchUpSearchIndex();
+    void _SaveSearchIndex();
+
+    struct ChatRecord {
+        entry_ref ref;
+        int32 savedCount;
+        bool packed;
+    };
+
+    // Characters of the last message kept as the chat preview
+    static const int32 kPreviewLength = 120;
+
+    // Journal size that triggers a checkpoint
+    static const off_t kCheckpointSize = 1024 * 1024;
+
+    // Unsaved documents that make the search index get written out
+    static const size_t kSearchIndexFlushCount = 2000;
+
+    // Characters of a message shown around a search hit
+    static const size_t kSnippetLength = 160;
+
     static BFSStorage* sInstance;
     BPath fBasePath;
     BPath fChatsDir;
     BPath fStatsDir;
+
+    // Chat files and how many of their messages are on disk, by chat ID,
+    // for the chats saved or loaded this session
+    BLocker fLock;
+    std::map<BString, ChatRecord> fChatRecords;
+
+    // Chats written since the last checkpoint
+    ChatJournal* fJournal;
+    std::set<BString> fDirtyChats;
+
+    UsageRollup fUsage;
+
+    // Loaded on first use; kept up to date as chats are saved
+    SearchIndex fSearchIndex;
+    bool fSearchIndexLoaded;
+    bool fSearchIndexCaughtUp;
+
+    // Taken after fLock, never before it
+    BLocker fUsageCacheLock;
+    bool fUsageCacheValid;
+    time_t fCachedMonth;
+    int64 fCachedInput;
+    int64 fCachedOutput;
+    std::vector<BMessenger> fUsageWatchers;
 };
 
 #endif // BFS_STORAGE_H
\ No newline at end of file
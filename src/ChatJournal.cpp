@@ -0,0 +1,239 @@
+// ChatJournal.cpp
+#include "ChatJournal.h"
+#include "ChatLog.h"
+
+#include <ByteOrder.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout, all numbers little endian:
+//   header:  "OTTOJRN" + version byte
+//   record:  uint32 payload size, uint32 checksum, payload
+//   payload: uint32 chat ID size, chat ID, uint32 title size, title,
+//            int64 creation time, int32 index of the first message in the
+//            chat, uint32 message count, message records as in ChatLog
+static const char kHeader[8] = { 'O', 'T', 'T', 'O', 'J', 'R', 'N', 1 };
+static const size_t kRecordHeaderSize = 8;
+
+static inline uint32 ReadUInt32(const uint8* data)
+{
+    uint32 value;
+    memcpy(&value, data, sizeof(value));
+    return B_LENDIAN_TO_HOST_INT32(value);
+}
+
+static inline uint64 ReadUInt64(const uint8* data)
+{
+    uint64 value;
+    memcpy(&value, data, sizeof(value));
+    return B_LENDIAN_TO_HOST_INT64(value);
+}
+
+static inline void WriteUInt32(std::vector<uint8>& buffer, uint32 value)
+{
+    value = B_HOST_TO_LENDIAN_INT32(value);
+    const uint8* bytes = (const uint8*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static inline void WriteUInt64(std::vector<uint8>& buffer, uint64 value)
+{
+    value = B_HOST_TO_LENDIAN_INT64(value);
+    const uint8* bytes = (const uint8*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static inline void WriteString(std::vector<uint8>& buffer, const BString& string)
+{
+    WriteUInt32(buffer, string.Length());
+    buffer.insert(buffer.end(), string.String(), string.String() + string.Length());
+}
+
+static inline bool ReadString(const uint8*& data, const uint8* end, BString* string)
+{
+    if (end - data < 4)
+        return false;
+    uint32 length = ReadUInt32(data);
+    data += 4;
+    if ((uint64)(end - data) < length)
+        return false;
+    string->SetTo((const char*)data, length);
+    data += length;
+    return true;
+}
+
+
+ChatJournal::ChatJournal()
+    : fFD(-1)
+    , fSize(0)
+{
+}
+
+ChatJournal::~ChatJournal()
+{
+    if (fFD >= 0)
+        close(fFD);
+}
+
+status_t ChatJournal::Open(const BPath& path)
+{
+    if (fFD >= 0)
+        close(fFD);
+
+    fFD = open(path.Path(), O_RDWR | O_CREAT, 0644);
+    if (fFD < 0)
+        return errno;
+
+    struct stat st;
+    if (fstat(fFD, &st) != 0)
+        return errno;
+    fSize = st.st_size;
+
+    // A journal without a valid header holds nothing worth replaying
+    char header[sizeof(kHeader)];
+    if (fSize < (off_t)sizeof(kHeader)
+        || pread(fFD, header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || memcmp(header, kHeader, sizeof(kHeader)) != 0) {
+        if (pwrite(fFD, kHeader, sizeof(kHeader), 0) != (ssize_t)sizeof(kHeader))
+            return errno;
+        fSize = sizeof(kHeader);
+        if (ftruncate(fFD, fSize) != 0 || fsync(fFD) != 0)
+            return errno;
+    }
+
+    return B_OK;
+}
+
+status_t ChatJournal::Append(const std::vector<ChatSnapshot>& snapshots)
+{
+    if (fFD < 0)
+        return B_NO_INIT;
+    if (snapshots.empty())
+        return B_OK;
+
+    std::vector<uint8> buffer;
+    for (size_t i = 0; i < snapshots.size(); i++)
+        _AppendSnapshot(buffer, snapshots[i]);
+
+    // One write and one sync for the whole batch
+    ssize_t written = pwrite(fFD, buffer.data(), buffer.size(), fSize);
+    status_t status = B_OK;
+    if (written != (ssize_t)buffer.size())
+        status = written < 0 ? errno : B_IO_ERROR;
+    else if (fsync(fFD) != 0)
+        status = errno;
+
+    if (status != B_OK) {
+        // Leave no partial record behind for the next append to follow
+        ftruncate(fFD, fSize);
+        return status;
+    }
+
+    fSize += buffer.size();
+    return B_OK;
+}
+
+status_t ChatJournal::Read(std::vector<ChatSnapshot>* snapshots)
+{
+    if (fFD < 0)
+        return B_NO_INIT;
+
+    std::vector<uint8> data(fSize);
+    if (fSize > 0 && pread(fFD, data.data(), fSize, 0) != (ssize_t)fSize)
+        return errno;
+
+    // Everything after the first damaged record is left out; it can only
+    // be the tail of a write that never finished
+    size_t offset = sizeof(kHeader);
+    while (offset + kRecordHeaderSize <= data.size()) {
+        uint32 payloadSize = ReadUInt32(&data[offset]);
+        uint32 checksum = ReadUInt32(&data[offset + 4]);
+        if (offset + kRecordHeaderSize + payloadSize > data.size())
+            break;
+
+        const uint8* payload = &data[offset + kRecordHeaderSize];
+        if (ChatLog::Checksum(payload, payloadSize) != checksum)
+            break;
+
+        ChatSnapshot snapshot;
+        if (!_ParseSnapshot(payload, payloadSize, &snapshot))
+            break;
+
+        snapshots->push_back(snapshot);
+        offset += kRecordHeaderSize + payloadSize;
+    }
+
+    return B_OK;
+}
+
+status_t ChatJournal::Reset()
+{
+    if (fFD < 0)
+        return B_NO_INIT;
+
+    if (ftruncate(fFD, sizeof(kHeader)) != 0 || fsync(fFD) != 0)
+        return errno;
+
+    fSize = sizeof(kHeader);
+    return B_OK;
+}
+
+void ChatJournal::_AppendSnapshot(std::vector<uint8>& buffer,
+    const ChatSnapshot& snapshot)
+{
+    size_t start = buffer.size();
+
+    // Size and checksum are filled in once the payload is there
+    WriteUInt32(buffer, 0);
+    WriteUInt32(buffer, 0);
+
+    WriteString(buffer, snapshot.id);
+    WriteString(buffer, snapshot.title);
+    WriteUInt64(buffer, (uint64)snapshot.createdAt);
+    WriteUInt32(buffer, (uint32)snapshot.unloadedCount);
+    WriteUInt32(buffer, snapshot.messages.CountItems());
+    for (int32 i = 0; i < snapshot.messages.CountItems(); i++)
+        ChatLog::AppendRecord(buffer, snapshot.messages.ItemAt(i));
+
+    size_t payloadStart = start + kRecordHeaderSize;
+    size_t payloadSize = buffer.size() - payloadStart;
+    uint32 header[2] = {
+        B_HOST_TO_LENDIAN_INT32((uint32)payloadSize),
+        B_HOST_TO_LENDIAN_INT32(ChatLog::Checksum(&buffer[payloadStart], payloadSize))
+    };
+    memcpy(&buffer[start], header, sizeof(header));
+}
+
+bool ChatJournal::_ParseSnapshot(const uint8* data, size_t size,
+    ChatSnapshot* snapshot)
+{
+    const uint8* end = data + size;
+    if (!ReadString(data, end, &snapshot->id)
+        || !ReadString(data, end, &snapshot->title)
+        || end - data < 16)
+        return false;
+
+    snapshot->createdAt = (time_t)ReadUInt64(data);
+    snapshot->unloadedCount = (int32)ReadUInt32(data + 8);
+    uint32 count = ReadUInt32(data + 12);
+    data += 16;
+
+    uint64 offset = 0;
+    size_t recordsSize = end - data;
+    for (uint32 i = 0; i < count; i++) {
+        ChatMessage* message = ChatLog::ParseRecord(data, recordsSize, offset,
+            &offset);
+        if (message == NULL)
+            return false;
+
+        // The history holds its own reference
+        snapshot->messages.AddItem(message);
+        message->ReleaseReference();
+    }
+
+    return true;
+}
@@ -0,0 +1,46 @@
+// ChatJournal.h
+#ifndef CHAT_JOURNAL_H
+#define CHAT_JOURNAL_H
+
+#include <Path.h>
+
+#include "BFSStorage.h"
+
+#include <vector>
+
+// Write-ahead journal for chat saves. Before BFSStorage touches any chat
+// file, the messages it is about to add go into the journal, all chats of
+// a batch in one sequential write followed by a single sync. The chat
+// files themselves are then written without waiting for the disk; only a
+// checkpoint syncs them, after which the journal is emptied. After a crash,
+// replaying the journal redoes whatever did not make it into the chat
+// files. Each record carries a checksum, so a torn last write is ignored.
+class ChatJournal {
+public:
+    ChatJournal();
+    ~ChatJournal();
+
+    status_t Open(const BPath& path);
+
+    // Returns once all snapshots are on disk
+    status_t Append(const std::vector<ChatSnapshot>& snapshots);
+
+    // Every intact record, oldest first
+    status_t Read(std::vector<ChatSnapshot>* snapshots);
+
+    // Drops all records, once the chat files hold what they describe
+    status_t Reset();
+
+    off_t Size() const { return fSize; }
+
+private:
+    static void _AppendSnapshot(std::vector<uint8>& buffer,
+        const ChatSnapshot& snapshot);
+    static bool _ParseSnapshot(const uint8* data, size_t size,
+        ChatSnapshot* snapshot);
+
+    int fFD;
+    off_t fSize;
+};
+
+#endif // CHAT_JOURNAL_H
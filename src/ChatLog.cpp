@@ -0,0 +1,597 @@
+// ChatLog.cpp
+#include "ChatLog.h"
+#include "Tokenizer.h"
+
+#include <ByteOrder.h>
+#include <Path.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// File layout, all numbers little endian:
+//   header:  "OTTOLOG" + version byte
+//   record:  uint32 payload size, uint32 checksum, payload
+//   payload: int32 role, int64 timestamp, int32 input tokens,
+//            int32 output tokens, int32 token count (-1 if none),
+//            uint16 tokenizer name size, name, uint32 content size, content
+//   index block: a record with kIndexBlockFlag set in its size, whose
+//            payload is a uint64 offset per record it covers, then the
+//            footer: uint64 offset of the block before it (0 if none),
+//            uint32 index of its first record, uint32 record count, "OIDB"
+// Every append writes its records and then a block for them, so the file
+// always ends with a footer. Blocks covering no more records than the new
+// one are merged into it, which keeps the chain short; the blocks it
+// replaces stay in the file unused. The full index is only rewritten when
+// a merge reaches the first block, or to compact a file that has no chain:
+// one from a torn append, or one of version 1, which ends in a single
+// index of uint64 offsets and the footer: uint64 index offset, uint32
+// record count, "OIDX".
+static const char kHeader[8] = { 'O', 'T', 'T', 'O', 'L', 'O', 'G', 2 };
+static const char kBlockMagic[4] = { 'O', 'I', 'D', 'B' };
+static const char kLegacyFooterMagic[4] = { 'O', 'I', 'D', 'X' };
+static const uint32 kIndexBlockFlag = 0x80000000;
+static const size_t kRecordHeaderSize = 8;
+static const size_t kBlockFooterSize = 20;
+static const size_t kLegacyFooterSize = 16;
+static const size_t kMinPayloadSize = 4 + 8 + 4 + 4 + 4 + 2 + 4;
+
+static bool HasHeader(const uint8* data, size_t size)
+{
+    // Version 1 files are read as well, and upgraded by the next append
+    return size >= sizeof(kHeader)
+        && memcmp(data, kHeader, sizeof(kHeader) - 1) == 0
+        && (data[sizeof(kHeader) - 1] == 1
+            || data[sizeof(kHeader) - 1] == kHeader[sizeof(kHeader) - 1]);
+}
+
+uint32 ChatLog::Checksum(const uint8* data, size_t size)
+{
+    // FNV-1a; only meant to spot torn or overwritten records
+    uint32 hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline uint16 ReadUInt16(const uint8* data)
+{
+    uint16 value;
+    memcpy(&value, data, sizeof(value));
+    return B_LENDIAN_TO_HOST_INT16(value);
+}
+
+static inline uint32 ReadUInt32(const uint8* data)
+{
+    uint32 value;
+    memcpy(&value, data, sizeof(value));
+    return B_LENDIAN_TO_HOST_INT32(value);
+}
+
+static inline uint64 ReadUInt64(const uint8* data)
+{
+    uint64 value;
+    memcpy(&value, data, sizeof(value));
+    return B_LENDIAN_TO_HOST_INT64(value);
+}
+
+static inline void WriteUInt16(std::vector<uint8>& buffer, uint16 value)
+{
+    value = B_HOST_TO_LENDIAN_INT16(value);
+    const uint8* bytes = (const uint8*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static inline void WriteUInt32(std::vector<uint8>& buffer, uint32 value)
+{
+    value = B_HOST_TO_LENDIAN_INT32(value);
+    const uint8* bytes = (const uint8*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static inline void WriteUInt64(std::vector<uint8>& buffer, uint64 value)
+{
+    value = B_HOST_TO_LENDIAN_INT64(value);
+    const uint8* bytes = (const uint8*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static inline void PatchUInt32(std::vector<uint8>& buffer, size_t at, uint32 value)
+{
+    value = B_HOST_TO_LENDIAN_INT32(value);
+    memcpy(&buffer[at], &value, sizeof(value));
+}
+
+
+// Read-only mapping of a whole file
+class ChatLog::Mapping {
+public:
+    Mapping(int fd)
+        : fData(NULL)
+        , fSize(0)
+        , fStatus(B_OK)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            fStatus = errno;
+            return;
+        }
+        if (st.st_size == 0)
+            return;
+
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fStatus = errno;
+            return;
+        }
+
+        fData = (const uint8*)data;
+        fSize = st.st_size;
+    }
+
+    ~Mapping()
+    {
+        if (fData != NULL)
+            munmap((void*)fData, fSize);
+    }
+
+    // An empty file maps fine, with a size of 0
+    status_t InitCheck() const { return fStatus; }
+    const uint8* Data() const { return fData; }
+    size_t Size() const { return fSize; }
+
+private:
+    const uint8* fData;
+    size_t fSize;
+    status_t fStatus;
+};
+
+
+status_t ChatLog::Read(const entry_ref& ref, BObjectList<ChatMessage>* messages,
+    int32 first, int32 count)
+{
+    BPath path(&ref);
+    int fd = open(path.Path(), O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    Mapping mapping(fd);
+    close(fd);
+
+    if (mapping.InitCheck() != B_OK)
+        return mapping.InitCheck();
+    if (mapping.Size() == 0)
+        return B_ENTRY_NOT_FOUND;
+
+    // An index left over from a torn append may point at damaged records;
+    // in that case, read whatever a scan of the records still finds
+    for (int32 attempt = 0; attempt < 2; attempt++) {
+        std::vector<uint64> offsets;
+        uint64 end;
+        status_t status = _Offsets(mapping, attempt == 0, &offsets, &end);
+        if (status != B_OK)
+            return status;
+
+        int32 total = offsets.size();
+        int32 start = first < 0 ? 0 : (first > total ? total : first);
+        int32 stop = (count < 0 || start + count > total) ? total : start + count;
+
+        BObjectList<ChatMessage> parsed(stop - start + 1);
+        for (int32 i = start; i < stop; i++) {
+            ChatMessage* message = ParseRecord(mapping.Data(), mapping.Size(),
+                offsets[i]);
+            if (message == NULL)
+                break;
+            parsed.AddItem(message);
+        }
+
+        if (parsed.CountItems() == stop - start || attempt == 1) {
+            messages->AddList(&parsed);
+            return B_OK;
+        }
+
+        for (int32 i = 0; i < parsed.CountItems(); i++)
+            parsed.ItemAt(i)->ReleaseReference();
+    }
+
+    return B_BAD_DATA;
+}
+
+status_t ChatLog::CountMessages(const entry_ref& ref, int32* count)
+{
+    BPath path(&ref);
+    int fd = open(path.Path(), O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    Mapping mapping(fd);
+    close(fd);
+
+    *count = 0;
+    if (mapping.InitCheck() != B_OK)
+        return mapping.InitCheck();
+    if (mapping.Size() == 0)
+        return B_OK;
+
+    // The last block knows how many records come before its own
+    std::vector<IndexBlock> blocks;
+    if (_Blocks(mapping, &blocks) == B_OK) {
+        *count = blocks.back().first + blocks.back().count;
+        return B_OK;
+    }
+
+    std::vector<uint64> offsets;
+    uint64 end;
+    status_t status = _Offsets(mapping, true, &offsets, &end);
+    if (status == B_OK)
+        *count = offsets.size();
+    return status;
+}
+
+status_t ChatLog::Append(const entry_ref& ref, const ChatHistory& history,
+    int32 first)
+{
+    if (first >= history.CountItems())
+        return B_OK;
+
+    BPath path(&ref);
+    int fd = open(path.Path(), O_RDWR);
+    if (fd < 0)
+        return errno;
+
+    // Offsets of the records the new block covers, starting with those of
+    // the blocks it replaces, and where it goes in the chain
+    std::vector<uint64> offsets;
+    uint64 previous = 0;
+    uint32 firstIndexed = 0;
+    uint64 writeAt = sizeof(kHeader);
+    bool upgrade = false;
+    std::vector<uint8> buffer;
+    {
+        Mapping mapping(fd);
+        if (mapping.InitCheck() != B_OK) {
+            close(fd);
+            return mapping.InitCheck();
+        }
+
+        std::vector<IndexBlock> blocks;
+        if (mapping.Size() == 0) {
+            buffer.insert(buffer.end(), kHeader, kHeader + sizeof(kHeader));
+            writeAt = 0;
+        } else if (_Blocks(mapping, &blocks) == B_OK) {
+            writeAt = mapping.Size();
+
+            size_t kept = blocks.size();
+            uint32 merged = history.CountItems() - first;
+            while (kept > 0 && blocks[kept - 1].count <= merged)
+                merged += blocks[--kept].count;
+
+            if (kept > 0) {
+                previous = blocks[kept - 1].offset;
+                firstIndexed = blocks[kept - 1].first + blocks[kept - 1].count;
+            }
+
+            offsets.reserve(merged);
+            for (size_t i = kept; i < blocks.size(); i++) {
+                const uint8* blockOffsets = mapping.Data() + blocks[i].offset
+                    + kRecordHeaderSize;
+                for (uint32 j = 0; j < blocks[i].count; j++)
+                    offsets.push_back(ReadUInt64(blockOffsets + j * 8));
+            }
+        } else {
+            // Every record gets into the new block; what follows the last
+            // one, an old index or a torn append, is overwritten
+            status_t status = _Offsets(mapping, true, &offsets, &writeAt);
+            if (status != B_OK) {
+                close(fd);
+                return status;
+            }
+            upgrade = mapping.Data()[sizeof(kHeader) - 1]
+                != kHeader[sizeof(kHeader) - 1];
+        }
+    }
+
+    uint64 offset = writeAt + buffer.size();
+    for (int32 i = first; i < history.CountItems(); i++) {
+        offsets.push_back(offset);
+        size_t before = buffer.size();
+        AppendRecord(buffer, history.ItemAt(i));
+        offset += buffer.size() - before;
+    }
+
+    size_t blockStart = buffer.size();
+    size_t payloadSize = offsets.size() * 8 + kBlockFooterSize;
+    WriteUInt32(buffer, kIndexBlockFlag | payloadSize);
+    WriteUInt32(buffer, 0);
+    for (size_t i = 0; i < offsets.size(); i++)
+        WriteUInt64(buffer, offsets[i]);
+    WriteUInt64(buffer, previous);
+    WriteUInt32(buffer, firstIndexed);
+    WriteUInt32(buffer, offsets.size());
+    buffer.insert(buffer.end(), kBlockMagic, kBlockMagic + sizeof(kBlockMagic));
+    PatchUInt32(buffer, blockStart + 4,
+        Checksum(&buffer[blockStart + kRecordHeaderSize], payloadSize));
+
+    status_t status = B_OK;
+    ssize_t written = pwrite(fd, buffer.data(), buffer.size(), writeAt);
+    if (written != (ssize_t)buffer.size())
+        status = written < 0 ? errno : B_IO_ERROR;
+    else if (ftruncate(fd, writeAt + buffer.size()) != 0)
+        status = errno;
+    else if (upgrade && pwrite(fd, kHeader, sizeof(kHeader), 0)
+            != (ssize_t)sizeof(kHeader))
+        status = errno;
+
+    close(fd);
+    return status;
+}
+
+status_t ChatLog::_Blocks(const Mapping& mapping, std::vector<IndexBlock>* blocks)
+{
+    const uint8* data = mapping.Data();
+    size_t size = mapping.Size();
+
+    if (!HasHeader(data, size)
+        || size < sizeof(kHeader) + kRecordHeaderSize + kBlockFooterSize)
+        return B_BAD_DATA;
+
+    // The footer at the end tells where the last block starts
+    uint32 lastCount = ReadUInt32(data + size - 8);
+    uint64 lastSize = (uint64)lastCount * 8 + kBlockFooterSize;
+    if (lastSize + kRecordHeaderSize + sizeof(kHeader) > size)
+        return B_BAD_DATA;
+    uint64 blockOffset = size - lastSize - kRecordHeaderSize;
+
+    // Walk the chain back to the block with the first record
+    while (true) {
+        if (blockOffset < sizeof(kHeader)
+            || blockOffset + kRecordHeaderSize + kBlockFooterSize > size)
+            return B_BAD_DATA;
+
+        uint32 sizeField = ReadUInt32(data + blockOffset);
+        uint64 payloadSize = sizeField & ~kIndexBlockFlag;
+        if ((sizeField & kIndexBlockFlag) == 0
+            || payloadSize < kBlockFooterSize
+            || blockOffset + kRecordHeaderSize + payloadSize > size)
+            return B_BAD_DATA;
+
+        const uint8* footer = data + blockOffset + kRecordHeaderSize
+            + payloadSize - kBlockFooterSize;
+        IndexBlock block;
+        block.offset = blockOffset;
+        block.first = ReadUInt32(footer + 8);
+        block.count = ReadUInt32(footer + 12);
+        uint64 previous = ReadUInt64(footer);
+        if (memcmp(footer + 16, kBlockMagic, sizeof(kBlockMagic)) != 0
+            || (uint64)block.count * 8 + kBlockFooterSize != payloadSize
+            || (!blocks->empty()
+                && block.first + block.count != blocks->back().first))
+            return B_BAD_DATA;
+
+        blocks->push_back(block);
+        if (previous == 0)
+            break;
+        if (block.first == 0 || previous >= blockOffset)
+            return B_BAD_DATA;
+        blockOffset = previous;
+    }
+
+    if (blocks->back().first != 0)
+        return B_BAD_DATA;
+
+    std::reverse(blocks->begin(), blocks->end());
+    return B_OK;
+}
+
+status_t ChatLog::_Offsets(const Mapping& mapping, bool useIndex,
+    std::vector<uint64>* offsets, uint64* end)
+{
+    const uint8* data = mapping.Data();
+    size_t size = mapping.Size();
+
+    if (!HasHeader(data, size))
+        return B_BAD_DATA;
+
+    // Normally the footer leads to the chain of index blocks
+    std::vector<IndexBlock> blocks;
+    if (useIndex && _Blocks(mapping, &blocks) == B_OK) {
+        offsets->reserve(blocks.back().first + blocks.back().count);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            const uint8* blockOffsets = data + blocks[i].offset
+                + kRecordHeaderSize;
+            for (uint32 j = 0; j < blocks[i].count; j++) {
+                uint64 offset = ReadUInt64(blockOffsets + j * 8);
+                if (offset < sizeof(kHeader) || offset >= blocks[i].offset)
+                    return B_BAD_DATA;
+                offsets->push_back(offset);
+            }
+        }
+        *end = size;
+        return B_OK;
+    }
+
+    // or, in a version 1 file, to its single index
+    if (useIndex && size >= sizeof(kHeader) + kLegacyFooterSize) {
+        const uint8* footer = data + size - kLegacyFooterSize;
+        uint64 indexOffset = ReadUInt64(footer);
+        uint32 count = ReadUInt32(footer + 8);
+        if (memcmp(footer + 12, kLegacyFooterMagic,
+                sizeof(kLegacyFooterMagic)) == 0
+            && indexOffset >= sizeof(kHeader)
+            && indexOffset + (uint64)count * 8 + kLegacyFooterSize == size) {
+            offsets->reserve(count);
+            for (uint32 i = 0; i < count; i++) {
+                uint64 offset = ReadUInt64(data + indexOffset + i * 8);
+                if (offset < sizeof(kHeader) || offset >= indexOffset)
+                    return B_BAD_DATA;
+                offsets->push_back(offset);
+            }
+            *end = indexOffset;
+            return B_OK;
+        }
+    }
+
+    // No usable index: walk the records up to the first damaged one,
+    // stepping over index blocks
+    uint64 offset = sizeof(kHeader);
+    while (offset + kRecordHeaderSize <= size) {
+        uint32 sizeField = ReadUInt32(data + offset);
+        uint32 payloadSize = sizeField & ~kIndexBlockFlag;
+        uint32 checksum = ReadUInt32(data + offset + 4);
+        bool isBlock = (sizeField & kIndexBlockFlag) != 0;
+        if (payloadSize < (isBlock ? kBlockFooterSize : kMinPayloadSize)
+            || offset + kRecordHeaderSize + payloadSize > size
+            || Checksum(data + offset + kRecordHeaderSize, payloadSize) != checksum)
+            break;
+
+        if (!isBlock)
+            offsets->push_back(offset);
+        offset += kRecordHeaderSize + payloadSize;
+    }
+
+    *end = offset;
+    return B_OK;
+}
+
+ChatMessage* ChatLog::ParseRecord(const uint8* data, size_t size, uint64 offset,
+    uint64* next)
+{
+    if (offset + kRecordHeaderSize > size)
+        return NULL;
+
+    // Index blocks have the flag set, which makes them far too large
+    uint32 payloadSize = ReadUInt32(data + offset);
+    if (payloadSize < kMinPayloadSize
+        || offset + kRecordHeaderSize + payloadSize > size)
+        return NULL;
+
+    const uint8* payload = data + offset + kRecordHeaderSize;
+    if (Checksum(payload, payloadSize) != ReadUInt32(data + offset + 4))
+        return NULL;
+
+    const uint8* end = payload + payloadSize;
+    int32 role = (int32)ReadUInt32(payload);
+    int64 timestamp = (int64)ReadUInt64(payload + 4);
+    int32 inputTokens = (int32)ReadUInt32(payload + 12);
+    int32 outputTokens = (int32)ReadUInt32(payload + 16);
+    int32 tokenCount = (int32)ReadUInt32(payload + 20);
+    uint16 nameSize = ReadUInt16(payload + 24);
+    const uint8* name = payload + 26;
+    if (name + nameSize + 4 > end)
+        return NULL;
+
+    uint32 contentSize = ReadUInt32(name + nameSize);
+    const uint8* content = name + nameSize + 4;
+    if (content + contentSize > end)
+        return NULL;
+
+    if (next != NULL)
+        *next = offset + kRecordHeaderSize + payloadSize;
+
+    ChatMessage* message = new ChatMessage(
+        BString((const char*)content, contentSize), (MessageRole)role,
+        (time_t)timestamp, inputTokens, outputTokens);
+
+    if (tokenCount >= 0 && nameSize > 0) {
+        BString tokenizerName((const char*)name, nameSize);
+        const Tokenizer* tokenizer = Tokenizer::ForName(tokenizerName.String());
+        if (tokenizer != NULL)
+            message->SetCachedTokenCount(tokenizer, tokenCount);
+    }
+
+    return message;
+}
+
+void ChatLog::AppendRecord(std::vector<uint8>& buffer, const ChatMessage* message)
+{
+    size_t start = buffer.size();
+
+    // Sizes and checksum are filled in once the payload is there
+    WriteUInt32(buffer, 0);
+    WriteUInt32(buffer, 0);
+
+    const Tokenizer* tokenizer = NULL;
+    int32 tokenCount = -1;
+    if (!message->GetCachedTokenCount(&tokenizer, &tokenCount)) {
+        tokenizer = NULL;
+        tokenCount = -1;
+    }
+
+    WriteUInt32(buffer, (uint32)message->Role());
+    WriteUInt64(buffer, (uint64)message->Timestamp());
+    WriteUInt32(buffer, (uint32)message->InputTokens());
+    WriteUInt32(buffer, (uint32)message->OutputTokens());
+    WriteUInt32(buffer, (uint32)tokenCount);
+
+    if (tokenizer != NULL) {
+        const BString& name = tokenizer->Name();
+        WriteUInt16(buffer, name.Length());
+        buffer.insert(buffer.end(), name.String(), name.String() + name.Length());
+    } else
+        WriteUInt16(buffer, 0);
+
+    const BString& content = message->Content();
+    WriteUInt32(buffer, content.Length());
+    buffer.insert(buffer.end(), content.String(), content.String() + content.Length());
+
+    size_t payloadStart = start + kRecordHeaderSize;
+    size_t payloadSize = buffer.size() - payloadStart;
+    PatchUInt32(buffer, start, payloadSize);
+    PatchUInt32(buffer, start + 4, Checksum(&buffer[payloadStart], payloadSize));
+}
+
+void ChatLog::SortByOrder(std::vector<OrderedMessage>& messages)
+{
+    auto comesBefore = [](const OrderedMessage& a, const OrderedMessage& b) {
+        if (a.order != b.order)
+            return a.order < b.order;
+        return a.message->Timestamp() < b.message->Timestamp();
+    };
+
+    // Orders are normally 0 to n - 1, maybe with a few missing or taken
+    // twice after a crash. That is placed by counting in linear time;
+    // anything else is sorted.
+    size_t count = messages.size();
+    int32 maxOrder = -1;
+    bool countable = true;
+    for (size_t i = 0; i < count && countable; i++) {
+        countable = messages[i].order >= 0
+            && (size_t)messages[i].order <= 2 * count + 16;
+        if (messages[i].order > maxOrder)
+            maxOrder = messages[i].order;
+    }
+
+    if (!countable) {
+        std::stable_sort(messages.begin(), messages.end(), comesBefore);
+        return;
+    }
+
+    // Where each order starts in the result
+    std::vector<size_t> starts(maxOrder + 2, 0);
+    for (size_t i = 0; i < count; i++)
+        starts[messages[i].order + 1]++;
+    for (int32 order = 0; order <= maxOrder; order++)
+        starts[order + 1] += starts[order];
+
+    std::vector<OrderedMessage> sorted(count);
+    std::vector<size_t> next(starts.begin(), starts.end() - 1);
+    for (size_t i = 0; i < count; i++)
+        sorted[next[messages[i].order]++] = messages[i];
+
+    // Messages that share an order go by time
+    for (int32 order = 0; order <= maxOrder; order++) {
+        if (starts[order + 1] - starts[order] > 1) {
+            std::stable_sort(sorted.begin() + starts[order],
+                sorted.begin() + starts[order + 1], comesBefore);
+        }
+    }
+
+    messages.swap(sorted);
+}
@@ -0,0 +1,72 @@
+// ChatLog.h
+#ifndef CHAT_LOG_H
+#define CHAT_LOG_H
+
+#include <Entry.h>
+#include <ObjectList.h>
+
+#include "ChatMessage.h"
+
+#include <vector>
+
+// Packed message storage: all messages of a chat live in the data of the
+// chat file, next to the chat attributes Tracker queries on. The file
+// holds a header and one length-prefixed and checksummed record per
+// message. Each append adds its records and an index block with their
+// offsets, chained to the blocks before it, so it costs about as much as
+// the records it writes, whatever the size of the chat. Reading maps the
+// file into memory; if the index is unusable (say, after a crash while
+// appending), the records are scanned instead, up to the first damaged
+// one, and the next append writes a full index again.
+class ChatLog {
+public:
+    // Adds count messages of the log in ref, starting with message first,
+    // to messages; a count of -1 reads to the end. Only the records asked
+    // for are parsed. Returns B_ENTRY_NOT_FOUND if the file holds no log.
+    static status_t Read(const entry_ref& ref, BObjectList<ChatMessage>* messages,
+        int32 first = 0, int32 count = -1);
+
+    // Appends the messages of history from index first on
+    static status_t Append(const entry_ref& ref, const ChatHistory& history,
+        int32 first);
+
+    // Number of messages in the log, without reading them
+    static status_t CountMessages(const entry_ref& ref, int32* count);
+
+    // A single message record, as stored in the log; ChatJournal keeps
+    // messages in the same form. ParseRecord() returns NULL for a damaged
+    // record and otherwise sets next to the offset after it.
+    static void AppendRecord(std::vector<uint8>& buffer, const ChatMessage* message);
+    static ChatMessage* ParseRecord(const uint8* data, size_t size, uint64 offset,
+        uint64* next = NULL);
+
+    static uint32 Checksum(const uint8* data, size_t size);
+
+    // A message of an unmigrated chat, stored in a file of its own, with
+    // its Otto:Order attribute
+    struct OrderedMessage {
+        int32 order;
+        ChatMessage* message;
+    };
+
+    // Puts messages read from their files, in no particular order, in the
+    // order of the chat
+    static void SortByOrder(std::vector<OrderedMessage>& messages);
+
+private:
+    class Mapping;
+
+    struct IndexBlock {
+        uint64 offset;
+        uint32 first;
+        uint32 count;
+    };
+
+    // The chain of index blocks, oldest first
+    static status_t _Blocks(const Mapping& mapping,
+        std::vector<IndexBlock>* blocks);
+    static status_t _Offsets(const Mapping& mapping, bool useIndex,
+        std::vector<uint64>* offsets, uint64* end);
+};
+
+#endif // CHAT_LOG_H
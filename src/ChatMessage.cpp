@@ -1,22 +1,101 @@
 // ChatMessage.cpp
 #include "ChatMessage.h"
+#include "Tokenizer.h"
+#include "JSONWriter.h"
 
 ChatMessage::ChatMessage(const BString& content, MessageRole role)
     : fContent(content)
     , fRole(role)
+    , fTimestamp(time(NULL))
     , fInputTokens(0)
     , fOutputTokens(0)
+    , fTokenCount(0)
+{
+}
+
+ChatMessage::ChatMessage(const BString& content, MessageRole role,
+    time_t timestamp, int32 inputTokens, int32 outputTokens)
+    : fContent(content)
+    , fRole(role)
+    , fTimestamp(timestamp)
+    , fInputTokens(inputTokens)
+    , fOutputTokens(outputTokens)
+    , fTokenCount(0)
 {
-    time(&fTimestamp);
 }
 
 ChatMessage::~ChatMessage()
 {
 }
 
+const BString& ChatMessage::JSONFragment() const
+{
+    // Requests on different workers may ask for it at the same time
+    std::call_once(fFragmentOnce, [this]() {
+        const char* role = "user";
+        if (fRole == MESSAGE_ROLE_ASSISTANT)
+            role = "assistant";
+        else if (fRole == MESSAGE_ROLE_SYSTEM)
+            role = "system";
+
+        fFragment << "{\"role\":\"" << role << "\",\"content\":\"";
+        JSONWriter::AppendEscaped(fFragment, fContent.String(), fContent.Length());
+        fFragment << "\"}";
+    });
+
+    return fFragment;
+}
+
+int32 ChatMessage::TokenCount(const Tokenizer* tokenizer) const
+{
+    const Tokenizer* cachedTokenizer;
+    int32 count;
+    if (GetCachedTokenCount(&cachedTokenizer, &count) && cachedTokenizer == tokenizer)
+        return count;
+
+    // Racing workers compute the same value, so no lock is needed
+    count = tokenizer->CountTokens(fContent.String(), fContent.Length());
+    SetCachedTokenCount(tokenizer, count);
+    return count;
+}
+
+bool ChatMessage::GetCachedTokenCount(const Tokenizer** tokenizer, int32* count) const
+{
+    int64 packed = fTokenCount.load(std::memory_order_relaxed);
+    if (packed == 0)
+        return false;
+
+    *tokenizer = Tokenizer::ForID((int32)(packed >> 32) - 1);
+    *count = (int32)(packed & 0xffffffff);
+    return *tokenizer != NULL;
+}
+
+void ChatMessage::SetCachedTokenCount(const Tokenizer* tokenizer, int32 count) const
+{
+    int64 packed = ((int64)(tokenizer->ID() + 1) << 32) | (uint32)count;
+    fTokenCount.store(packed, std::memory_order_relaxed);
+}
+
+ChatHistory::ChatHistory()
+    : fEstimatedTokens(0)
+    , fReplyTokens(0)
+    , fTrimmedMessages(0)
+{
+}
+
+void ChatHistory::SetPlan(int32 estimatedTokens, int32 replyTokens,
+    int32 trimmedMessages)
+{
+    fEstimatedTokens = estimatedTokens;
+    fReplyTokens = replyTokens;
+    fTrimmedMessages = trimmedMessages;
+}
+
 Chat::Chat(const BString& title)
     : fTitle(title)
-    , fMessages(10)  // true for owning pointers
+    , fMessages(10)
+    , fUnloadedAt(0)
+    , fUnloadedCount(0)
 {
     time(&fCreatedAt);
     fUpdatedAt = fCreatedAt;
@@ -24,5 +103,33 @@ Chat::Chat(const BString& title)
 
 Chat::~Chat()
 {
-    // BObjectList will handle deleting the messages
+    // Requests may still hold a snapshot; the last reference deletes
+    for (int32 i = 0; i < fMessages.CountItems(); i++)
+        fMessages.ItemAt(i)->ReleaseReference();
+}
+
+ChatHistory Chat::Snapshot() const
+{
+    ChatHistory history;
+    for (int32 i = 0; i < fMessages.CountItems(); i++)
+        history.AddItem(fMessages.ItemAt(i));
+
+    return history;
+}
+
+void Chat::SetUnloaded(int32 at, int32 count)
+{
+    fUnloadedAt = at;
+    fUnloadedCount = count > 0 ? count : 0;
+}
+
+void Chat::InsertUnloaded(BObjectList<ChatMessage>* messages)
+{
+    int32 count = messages->CountItems();
+    for (int32 i = 0; i < count; i++)
+        fMessages.AddItem(messages->ItemAt(i), fUnloadedAt + i);
+
+    fUnloadedCount -= count;
+    if (fUnloadedCount < 0)
+        fUnloadedCount = 0;
 }
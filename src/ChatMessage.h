@@ -4,36 +4,87 @@
 
 #include <String.h>
 #include <ObjectList.h>
+#include <Referenceable.h>
 #include <time.h>
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 typedef enum {
     MESSAGE_ROLE_USER,
     MESSAGE_ROLE_ASSISTANT,
     MESSAGE_ROLE_SYSTEM
 } MessageRole;
 
-class ChatMessage {
+class Tokenizer;
+
+// A chat message. Nothing but the cached token count changes after
+// construction, so a message can be shared by reference between the chat
+// and any number of in-flight requests.
+class ChatMessage : public BReferenceable {
 public:
+    // Stamped with the current time
     ChatMessage(const BString& content, MessageRole role);
+    // The token counts are the usage the provider reported for a reply
+    ChatMessage(const BString& content, MessageRole role, time_t timestamp,
+        int32 inputTokens = 0, int32 outputTokens = 0);
     ~ChatMessage();
 
-    BString Content() const { return fContent; }
+    const BString& Content() const { return fContent; }
     MessageRole Role() const { return fRole; }
     time_t Timestamp() const { return fTimestamp; }
-    void SetTimestamp(time_t timestamp) { fTimestamp = timestamp; }
-
     int32 InputTokens() const { return fInputTokens; }
-    void SetInputTokens(int32 tokens) { fInputTokens = tokens; }
-
     int32 OutputTokens() const { return fOutputTokens; }
-    void SetOutputTokens(int32 tokens) { fOutputTokens = tokens; }
+
+    // {"role":...,"content":...} object as the chat APIs expect it,
+    // serialized on first use and reused by every later request
+    const BString& JSONFragment() const;
+
+    // Tokens of the content under tokenizer. The count of the last
+    // tokenizer used is cached, and stored along with the message.
+    int32 TokenCount(const Tokenizer* tokenizer) const;
+    bool GetCachedTokenCount(const Tokenizer** tokenizer, int32* count) const;
+    void SetCachedTokenCount(const Tokenizer* tokenizer, int32 count) const;
 
 private:
-    BString fContent;
-    MessageRole fRole;
-    time_t fTimestamp;
-    int32 fInputTokens;
-    int32 fOutputTokens;
+    const BString fContent;
+    const MessageRole fRole;
+    const time_t fTimestamp;
+    const int32 fInputTokens;
+    const int32 fOutputTokens;
+
+    mutable std::once_flag fFragmentOnce;
+    mutable BString fFragment;
+    // Tokenizer ID + 1 in the upper half, count in the lower; 0 if unset
+    mutable std::atomic<int64> fTokenCount;
+};
+
+// Snapshot of a chat's messages at one point in time. It only holds
+// references, so taking or copying one never copies message content.
+class ChatHistory {
+public:
+    ChatHistory();
+
+    int32 CountItems() const { return fMessages.size(); }
+    const ChatMessage* ItemAt(int32 index) const { return fMessages[index].Get(); }
+
+    void AddItem(ChatMessage* message) { fMessages.emplace_back(message); }
+
+    // Filled in by ContextPlanner: estimated prompt tokens of the kept
+    // messages, the tokens reserved for the reply, which providers send as
+    // its limit, and how many messages were left out to fit the model's
+    // context window
+    int32 EstimatedTokens() const { return fEstimatedTokens; }
+    int32 ReplyTokens() const { return fReplyTokens; }
+    int32 TrimmedMessages() const { return fTrimmedMessages; }
+    void SetPlan(int32 estimatedTokens, int32 replyTokens, int32 trimmedMessages);
+
+private:
+    std::vector<BReference<ChatMessage> > fMessages;
+    int32 fEstimatedTokens;
+    int32 fReplyTokens;
+    int32 fTrimmedMessages;
 };
 
 class Chat {
@@ -44,20 +95,41 @@ public:
     BString Title() const { return fTitle; }
     void SetTitle(const BString& title) { fTitle = title; }
 
+    // Storage identity; empty until the chat is saved for the first time
+    const BString& ID() const { return fID; }
+    void SetID(const BString& id) { fID = id; }
+
     time_t CreatedAt() const { return fCreatedAt; }
     void SetCreatedAt(time_t time) { fCreatedAt = time; }
 
     time_t UpdatedAt() const { return fUpdatedAt; }
     void SetUpdatedAt(time_t time) { fUpdatedAt = time; }
 
+    // Takes over the caller's reference to message
     void AddMessage(ChatMessage* message) { fMessages.AddItem(message); }
-    BObjectList<ChatMessage, true>* Messages() { return &fMessages; }
+    BObjectList<ChatMessage>* Messages() { return &fMessages; }
+
+    ChatHistory Snapshot() const;
+
+    // A chat opened from storage may leave out a run of older messages,
+    // which is then loaded page by page. They belong in front of the
+    // message at UnloadedAt() in Messages().
+    int32 UnloadedAt() const { return fUnloadedAt; }
+    int32 UnloadedCount() const { return fUnloadedCount; }
+    void SetUnloaded(int32 at, int32 count);
+
+    // Takes over the references to messages, which are the newest of the
+    // unloaded ones, in order
+    void InsertUnloaded(BObjectList<ChatMessage>* messages);
 
 private:
     BString fTitle;
-    BObjectList<ChatMessage, true> fMessages;  // true for owning pointers
+    BString fID;
+    BObjectList<ChatMessage> fMessages;  // one reference held per message
+    int32 fUnloadedAt;
+    int32 fUnloadedCount;
     time_t fCreatedAt;
     time_t fUpdatedAt;
 };
 
-#endif // CHAT_MESSAGE_H
\ No newline at end of file
+#endif // CHAT_MESSAGE_H
@@ -7,38 +7,52 @@
 #include <Roster.h>
 #include <StringView.h>
 #include <SpaceLayoutItem.h>
+#include <MessageRunner.h>
 #include <cstdio>
+#include <cstring>
 #include "SettingsManager.h"
-#include "BFSStorage.h"
+#include "StorageWriter.h"
+#include "ContextPlanner.h"
+#include "Tokenizer.h"
 
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "ChatView"
 
+// Streamed text is shown at most this often, about once per frame
+static const bigtime_t kDeltaFlushInterval = 16667;
+
 ChatView::ChatView()
     : BView("chatView", B_WILL_DRAW)
     , fActiveChat(NULL)
     , fActiveProvider(NULL)
     , fActiveModel(NULL)
     , fIsBusy(false)
-    , fMessenger(this)
+    , fIsStreaming(false)
+    , fPendingRequest(-1)
+    , fLoadingEarlier(false)
+    , fSendWhenLoaded(false)
+    , fDeltaRunner(NULL)
 {
     _BuildLayout();
 }
 
 ChatView::~ChatView()
 {
+    // A closed chat has nobody to show its reply to
+    if (fIsBusy && fActiveProvider != NULL && fPendingRequest >= 0)
+        fActiveProvider->CancelRequest(fPendingRequest);
+
+    delete fDeltaRunner;
 }
 
 void ChatView::_BuildLayout()
 {
-    // Create chat display area (read-only text view with scroll bars)
-    fChatDisplay = new BTextView("chatDisplay");
-    fChatDisplay->SetWordWrap(true);
-    fChatDisplay->MakeEditable(false);
-    fChatDisplay->MakeSelectable(true);
+    // Create chat display area (transcript with a vertical scroll bar;
+    // it wraps its lines itself)
+    fChatDisplay = new TranscriptView("chatDisplay");
 
     fChatScrollView = new BScrollView("chatScrollView", fChatDisplay,
-        B_WILL_DRAW | B_FRAME_EVENTS, true, true);
+        B_WILL_DRAW | B_FRAME_EVENTS, false, true);
 
     // Create input field (text view with scroll bars)
     fInputField = new BTextView("inputField");
@@ -54,6 +68,10 @@ void ChatView::_BuildLayout()
         new BMessage(MSG_CANCEL_REQUEST));
     fCancelButton->SetEnabled(false);
 
+    fEarlierButton = new BButton("earlierButton", B_TRANSLATE("Earlier messages"),
+        new BMessage(MSG_LOAD_EARLIER));
+    fEarlierButton->SetEnabled(false);
+
     // Set up layout
     SetLayout(new BGroupLayout(B_VERTICAL));
 
@@ -65,6 +83,7 @@ void ChatView::_BuildLayout()
                 .Add(fSendButton)
                 .Add(fCancelButton)
                 .AddGlue()
+                .Add(fEarlierButton)
                 .End()
             .End()
         .SetInsets(B_USE_DEFAULT_SPACING)
@@ -75,8 +94,12 @@ void ChatView::AttachedToWindow()
 {
    BView::AttachedToWindow();
 
+   // Replies come to this view, through the window it is in now
+   fMessenger = BMessenger(this);
+
    fSendButton->SetTarget(this);
    fCancelButton->SetTarget(this);
+   fEarlierButton->SetTarget(this);
 
    // Focus the input field
    fInputField->MakeFocus(true);
@@ -91,29 +114,61 @@ void ChatView::MessageReceived(BMessage* message)
 
        case MSG_CANCEL_REQUEST:
            if (fActiveProvider != NULL && fIsBusy) {
-               fActiveProvider->CancelRequest();
+               // Returns at once; anything the request still sends is
+               // dropped by _IsStaleReply(). Requests of other chats
+               // using the same provider go on.
+               if (fPendingRequest >= 0)
+                   fActiveProvider->CancelRequest(fPendingRequest);
+               fPendingRequest = -1;
+               fSendWhenLoaded = false;
+               _FinishStreamingDisplay();
                fIsBusy = false;
                fCancelButton->SetEnabled(false);
                fSendButton->SetEnabled(true);
            }
            break;
 
+       case MSG_LOAD_EARLIER:
+           _LoadEarlierMessages();
+           break;
+
+       case MSG_MESSAGES_LOADED:
+           _EarlierMessagesLoaded(message);
+           break;
+
+       case MSG_FLUSH_DELTAS:
+           _FlushDeltas();
+           break;
+
+	case MSG_MESSAGE_DELTA: {
+		// Partial response from a streaming provider
+		if (_IsStaleReply(message))
+			break;
+
+		BString delta;
+		if (fIsBusy && message->FindString("content", &delta) == B_OK)
+			_AppendDeltaToDisplay(delta);
+		break;
+	}
+
 	case MSG_MESSAGE_RECEIVED: {
 		// Handle response from the LLM
+		if (_IsStaleReply(message))
+			break;
+
 		BString content;
 		printf("Received message from LLM provider\n");
 		if (message->FindString("content", &content) == B_OK) {
 			printf("Message content: %s\n", content.String());
-			// Create a new assistant message
-			ChatMessage* reply = new ChatMessage(content, MESSAGE_ROLE_ASSISTANT);
-
 			// Get token counts if available
 			int32 inputTokens = 0, outputTokens = 0;
 			message->FindInt32("input_tokens", &inputTokens);
 			message->FindInt32("output_tokens", &outputTokens);
 			printf("Tokens - Input: %d, Output: %d\n", inputTokens, outputTokens);
-			reply->SetInputTokens(inputTokens);
-			reply->SetOutputTokens(outputTokens);
+
+			// Create a new assistant message
+			ChatMessage* reply = new ChatMessage(content, MESSAGE_ROLE_ASSISTANT,
+				time(NULL), inputTokens, outputTokens);
 
 			// Add to chat and display
 			if (fActiveChat != NULL) {
@@ -121,12 +176,16 @@ void ChatView::MessageReceived(BMessage* message)
 				fActiveChat->AddMessage(reply);
 				fActiveChat->SetUpdatedAt(time(NULL));
 
-				// Save the chat
-				BFSStorage::GetInstance()->SaveChat(fActiveChat);
+				// Count the reply's tokens now, while it is still unsaved;
+				// it is part of the next prompt anyway
+				reply->TokenCount(Tokenizer::ForModel(fActiveModel));
+
+				// Save the new messages of the chat
+				StorageWriter::GetInstance()->SaveChat(fActiveChat);
 
 				// Save usage statistics
 				if (fActiveProvider != NULL && fActiveModel != NULL) {
-					BFSStorage::GetInstance()->SaveUsageStats(
+					StorageWriter::GetInstance()->SaveUsageStats(
 						fActiveProvider->Name(),
 						fActiveModel->Name(),
 						inputTokens,
@@ -135,11 +194,21 @@ void ChatView::MessageReceived(BMessage* message)
 				}
 			}
 
-			printf("Appending message to display\n");
-			_AppendMessageToDisplay(reply);
+			// Streamed replies are already on screen, once the last
+			// deltas are out
+			_FlushDeltas();
+			if (!fIsStreaming) {
+				printf("Appending message to display\n");
+				fChatDisplay->AddMessage(reply);
+				fChatDisplay->ScrollToBottom();
+			}
 		}
 
+		// Close off a streamed reply
+		_FinishStreamingDisplay();
+
 		// Update UI state
+		fPendingRequest = -1;
 		fIsBusy = false;
 		printf("Setting UI state back to ready\n");
 		fCancelButton->SetEnabled(false);
@@ -174,83 +243,132 @@ void ChatView::SetModel(LLMModel* model)
 
 void ChatView::_DisplayChat()
 {
-   // Clear the display
-   fChatDisplay->SetText("");
+   fEarlierButton->SetEnabled(fActiveChat != NULL
+       && fActiveChat->UnloadedCount() > 0 && !fLoadingEarlier);
 
-   if (fActiveChat == NULL)
+   if (fActiveChat == NULL) {
+       fChatDisplay->MakeEmpty();
        return;
-
-   // Display all messages in the chat
-   BObjectList<ChatMessage, true>* messages = fActiveChat->Messages();
-   for (int32 i = 0; i < messages->CountItems(); i++) {
-       _AppendMessageToDisplay(messages->ItemAt(i));
    }
 
+   // The transcript only lays out the messages that come into view
+   fChatDisplay->SetMessages(fActiveChat->Messages());
+
    // Scroll to the bottom
-   fChatDisplay->ScrollTo(0, fChatDisplay->TextHeight(0, fChatDisplay->CountLines()));
+   fChatDisplay->ScrollToBottom();
 }
 
-void ChatView::_AppendMessageToDisplay(ChatMessage* message)
+bool ChatView::_LoadEarlierMessages()
 {
-   if (message == NULL)
-       return;
-
-   // Get text insertion point at the end
-   int32 textLength = fChatDisplay->TextLength();
-
-   // Format based on role
-   BString formattedText;
-
-   switch (message->Role()) {
-       case MESSAGE_ROLE_USER:
-           formattedText = "\n🧑 ";  // User emoji
-           break;
-
-       case MESSAGE_ROLE_ASSISTANT:
-           formattedText = "\n🤖 ";  // AI emoji
-           break;
+   if (fActiveChat == NULL || fActiveChat->UnloadedCount() == 0)
+       return false;
+   if (fLoadingEarlier)
+       return true;
+
+   // The page right in front of what is loaded; the storage writer reads
+   // it and sends it back in a MSG_MESSAGES_LOADED
+   int32 gapEnd = fActiveChat->UnloadedAt() + fActiveChat->UnloadedCount();
+   int32 count = min_c(kHistoryPageSize, fActiveChat->UnloadedCount());
+   StorageWriter::GetInstance()->LoadMessages(fActiveChat->ID(),
+       gapEnd - count, count, fMessenger);
+
+   fLoadingEarlier = true;
+   fEarlierButton->SetEnabled(false);
+   return true;
+}
 
-       case MESSAGE_ROLE_SYSTEM:
-           formattedText = "\n⚙️ ";  // System emoji
-           break;
+void ChatView::_EarlierMessagesLoaded(BMessage* message)
+{
+   fLoadingEarlier = false;
+
+   BString chatID;
+   int32 offset = -1;
+   status_t status = B_ERROR;
+   BObjectList<ChatMessage>* messages = NULL;
+   message->FindString("chat", &chatID);
+   message->FindInt32("offset", &offset);
+   message->FindInt32("status", &status);
+   message->FindPointer("messages", (void**)&messages);
+
+   // Only a page that still ends where the loaded messages begin is used
+   bool inserted = false;
+   if (messages != NULL) {
+       if (fActiveChat != NULL && fActiveChat->ID() == chatID
+           && offset + messages->CountItems()
+               == fActiveChat->UnloadedAt() + fActiveChat->UnloadedCount()) {
+           fActiveChat->InsertUnloaded(messages);
+           inserted = true;
+       } else {
+           for (int32 i = 0; i < messages->CountItems(); i++)
+               messages->ItemAt(i)->ReleaseReference();
+       }
+       delete messages;
    }
 
-   // Add content
-   formattedText << message->Content();
-   formattedText << "\n";
+   if (status != B_OK)
+       printf("Loading earlier messages failed: %s\n", strerror(status));
 
-   // Insert the text
-   fChatDisplay->Insert(textLength, formattedText.String(), formattedText.Length());
+   if (fSendWhenLoaded) {
+       // Planning goes on with what is loaded now; should loading have
+       // failed, the rest of the chat counts as trimmed
+       fSendWhenLoaded = false;
+       if (inserted)
+           _DisplayChat();
+       _SendPlanned(inserted);
+       return;
+   }
 
-   // Apply styling based on role
-   BFont font;
-   fChatDisplay->GetFont(&font);
+   _DisplayChat();
 
-   rgb_color color;
+   // Show the messages that were just loaded
+   if (inserted)
+       fChatDisplay->ScrollToTop();
+}
 
-   switch (message->Role()) {
-       case MESSAGE_ROLE_USER:
-           color = {0, 0, 200};  // Blue for user
-           break;
+void ChatView::_AppendDeltaToDisplay(const BString& delta)
+{
+   // Deltas can arrive far faster than the screen refreshes; they are
+   // collected and shown once per frame
+   fPendingDelta << delta;
+   if (fDeltaRunner == NULL) {
+       BMessage flush(MSG_FLUSH_DELTAS);
+       fDeltaRunner = new BMessageRunner(BMessenger(this), &flush,
+           kDeltaFlushInterval, 1);
+       if (fDeltaRunner->InitCheck() != B_OK) {
+           delete fDeltaRunner;
+           fDeltaRunner = NULL;
+           _FlushDeltas();
+       }
+   }
+}
 
-       case MESSAGE_ROLE_ASSISTANT:
-           color = {0, 130, 0};  // Green for assistant
-           break;
+void ChatView::_FlushDeltas()
+{
+   delete fDeltaRunner;
+   fDeltaRunner = NULL;
 
-       case MESSAGE_ROLE_SYSTEM:
-           color = {130, 60, 0};  // Brown for system
-           break;
+   if (fPendingDelta.IsEmpty())
+       return;
 
-       default:
-           color = {0, 0, 0};  // Black default
+   // The first delta opens a new assistant message
+   if (!fIsStreaming) {
+       fChatDisplay->BeginStreaming(MESSAGE_ROLE_ASSISTANT);
+       fIsStreaming = true;
    }
+   fChatDisplay->AppendStreamed(fPendingDelta);
+   fPendingDelta.Truncate(0);
 
-   // Apply text color
-   fChatDisplay->SetFontAndColor(textLength, textLength + formattedText.Length(),
-                                &font, B_FONT_ALL, &color);
+   fChatDisplay->ScrollToBottom();
+}
 
-   // Scroll to the bottom
-   fChatDisplay->ScrollTo(0, fChatDisplay->TextHeight(0, fChatDisplay->CountLines()));
+void ChatView::_FinishStreamingDisplay()
+{
+   _FlushDeltas();
+   if (!fIsStreaming)
+       return;
+
+   fChatDisplay->EndStreaming();
+   fIsStreaming = false;
 }
 
 void ChatView::_SendMessage()
@@ -284,10 +402,14 @@ void ChatView::_SendMessage()
    // Add to chat and display
    fActiveChat->AddMessage(message);
    fActiveChat->SetUpdatedAt(time(NULL));
-   _AppendMessageToDisplay(message);
+   fChatDisplay->AddMessage(message);
+   fChatDisplay->ScrollToBottom();
 
-   // Save the chat (to preserve the user's message even if app crashes)
-   BFSStorage::GetInstance()->SaveChat(fActiveChat);
+   // Save the chat (to preserve the user's message even if app crashes).
+   // Planning needs its token count anyway, so it is counted now and
+   // stored with it.
+   message->TokenCount(Tokenizer::ForModel(fActiveModel));
+   StorageWriter::GetInstance()->SaveChat(fActiveChat);
 
    // Clear input field
    fInputField->SetText("");
@@ -297,9 +419,39 @@ void ChatView::_SendMessage()
    fSendButton->SetEnabled(false);
    fCancelButton->SetEnabled(true);
 
-   // Prepare history
-   BObjectList<ChatMessage, true>* history = fActiveChat->Messages();
+   fPendingText = messageText;
+   _SendPlanned(true);
+}
+
+void ChatView::_SendPlanned(bool loadEarlier)
+{
+   if (fActiveChat == NULL || !fIsBusy)
+       return;
+
+   // Snapshot the history; the messages themselves are shared, not copied.
+   // Only what fits the model's context window is sent. Older messages
+   // still on disk are loaded a page at a time, off this thread, for as
+   // long as all loaded ones fit; those left on disk count as trimmed.
+   int32 unloaded = fActiveChat->UnloadedCount();
+   ChatHistory history = ContextPlanner::Fit(fActiveChat->Snapshot(),
+       fActiveModel, unloaded);
+   if (loadEarlier && unloaded > 0 && history.TrimmedMessages() <= unloaded
+       && _LoadEarlierMessages()) {
+       fSendWhenLoaded = true;
+       return;
+   }
 
    // Send request
-   fActiveProvider->SendMessage(*history, messageText, &fMessenger);
+   fPendingRequest = fActiveProvider->SendMessage(history, fPendingText,
+       &fMessenger);
+}
+
+bool ChatView::_IsStaleReply(BMessage* message) const
+{
+   // Errors reported before a request was queued carry no ID
+   request_id id;
+   if (message->FindInt32("request_id", &id) != B_OK)
+       return false;
+
+   return !fIsBusy || id != fPendingRequest;
 }
@@ -7,16 +7,25 @@
 #include <ScrollView.h>
 #include <Button.h>
 #include <ObjectList.h>
+#include <MessageRunner.h>
 #include "ChatMessage.h"
 #include "ModelSelector.h"
 #include "LLMProvider.h"
+#include "TranscriptView.h"
 
 const uint32 MSG_SEND_MESSAGE = 'send';
 const uint32 MSG_MESSAGE_RECEIVED = 'rcvd';
 const uint32 MSG_CANCEL_REQUEST = 'cncl';
+const uint32 MSG_MESSAGE_DELTA = 'rdlt';
+const uint32 MSG_LOAD_EARLIER = 'lder';
+const uint32 MSG_FLUSH_DELTAS = 'fdlt';
 
 class ChatView : public BView {
 public:
+    // Newest messages a saved chat is opened with, and older ones loaded
+    // per click on "Earlier messages"
+    static const int32 kHistoryPageSize = 50;
+
     ChatView();
     virtual ~ChatView();
     
@@ -24,27 +33,49 @@ public:
     virtual void MessageReceived(BMessage* message);
     
     void SetActiveChat(Chat* chat);
+    Chat* ActiveChat() const { return fActiveChat; }
     void SetProvider(LLMProvider* provider);
+    LLMProvider* Provider() const { return fActiveProvider; }
     void SetModel(LLMModel* model);
+    LLMModel* Model() const { return fActiveModel; }
     
     bool IsBusy() const { return fIsBusy; }
     
 private:
     void _BuildLayout();
     void _DisplayChat();
+    bool _LoadEarlierMessages();
+    void _EarlierMessagesLoaded(BMessage* message);
     void _SendMessage();
-    void _AppendMessageToDisplay(ChatMessage* message);
+    void _SendPlanned(bool loadEarlier);
+    void _AppendDeltaToDisplay(const BString& delta);
+    void _FlushDeltas();
+    void _FinishStreamingDisplay();
+    bool _IsStaleReply(BMessage* message) const;
     
-    BTextView* fChatDisplay;
+    TranscriptView* fChatDisplay;
     BScrollView* fChatScrollView;
     BTextView* fInputField;
     BButton* fSendButton;
     BButton* fCancelButton;
+    BButton* fEarlierButton;
     
     Chat* fActiveChat;
     LLMProvider* fActiveProvider;
     LLMModel* fActiveModel;
     bool fIsBusy;
+    bool fIsStreaming;
+    request_id fPendingRequest;
+
+    // Older messages are read on the storage writer's thread; a message
+    // may be waiting for them before it can be sent
+    bool fLoadingEarlier;
+    bool fSendWhenLoaded;
+    BString fPendingText;
+
+    // Streamed text not shown yet, and the runner that will show it
+    BString fPendingDelta;
+    BMessageRunner* fDeltaRunner;
     BMessenger fMessenger;
 };
 
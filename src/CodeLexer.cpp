@@ -0,0 +1,349 @@
+// CodeLexer.cpp
+#include "CodeLexer.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+struct CodeLexer::Language {
+    // Names and keywords end with NULL; keywords and types are sorted
+    const char* const* names;
+    const char* const* keywords;
+    const char* const* types;
+    const char* lineComment;
+    const char* blockCommentStart;
+    const char* blockCommentEnd;
+    const char* quotes;
+    // Python strings may be in three quotes, and span lines
+    bool tripleQuotes;
+    // Lines starting with # are preprocessor directives
+    bool preprocessor;
+};
+
+// C and C++
+
+static const char* const kCNames[] = {
+    "c", "h", "cpp", "c++", "cc", "cxx", "hpp", "hh", "objc", "objective-c", NULL
+};
+
+static const char* const kCKeywords[] = {
+    "NULL", "auto", "break", "case", "catch", "class", "const", "const_cast",
+    "constexpr", "continue", "default", "delete", "do", "dynamic_cast", "else",
+    "enum", "explicit", "extern", "false", "final", "for", "friend", "goto",
+    "if", "inline", "mutable", "namespace", "new", "noexcept", "nullptr",
+    "operator", "override", "private", "protected", "public", "register",
+    "reinterpret_cast", "return", "sizeof", "static", "static_cast", "struct",
+    "switch", "template", "this", "throw", "true", "try", "typedef",
+    "typename", "union", "using", "virtual", "volatile", "while", NULL
+};
+
+static const char* const kCTypes[] = {
+    "bool", "char", "char16_t", "char32_t", "double", "float", "int", "int16",
+    "int16_t", "int32", "int32_t", "int64", "int64_t", "int8", "int8_t",
+    "long", "map", "off_t", "short", "signed", "size_t", "ssize_t", "status_t",
+    "std", "string", "uint16", "uint16_t", "uint32", "uint32_t", "uint64",
+    "uint64_t", "uint8", "uint8_t", "unsigned", "vector", "void", "wchar_t", NULL
+};
+
+
+// Python
+
+static const char* const kPythonNames[] = {
+    "python", "py", "python3", "py3", NULL
+};
+
+static const char* const kPythonKeywords[] = {
+    "False", "None", "True", "and", "as", "assert", "async", "await", "break",
+    "case", "class", "continue", "def", "del", "elif", "else", "except",
+    "finally", "for", "from", "global", "if", "import", "in", "is", "lambda",
+    "match", "nonlocal", "not", "or", "pass", "raise", "return", "self", "try",
+    "while", "with", "yield", NULL
+};
+
+static const char* const kPythonTypes[] = {
+    "bool", "bytes", "dict", "float", "frozenset", "int", "list", "object",
+    "set", "str", "tuple", NULL
+};
+
+
+// JavaScript and TypeScript
+
+static const char* const kJavaScriptNames[] = {
+    "javascript", "js", "jsx", "typescript", "ts", "tsx", "mjs", "node", NULL
+};
+
+static const char* const kJavaScriptKeywords[] = {
+    "as", "async", "await", "break", "case", "catch", "class", "const",
+    "continue", "debugger", "default", "delete", "do", "else", "enum",
+    "export", "extends", "false", "finally", "for", "from", "function", "if",
+    "implements", "import", "in", "instanceof", "interface", "let", "new",
+    "null", "of", "private", "protected", "public", "readonly", "return",
+    "static", "super", "switch", "this", "throw", "true", "try", "type",
+    "typeof", "undefined", "var", "void", "while", "with", "yield", NULL
+};
+
+static const char* const kJavaScriptTypes[] = {
+    "Array", "Boolean", "Date", "Error", "Map", "Number", "Object", "Promise",
+    "RegExp", "Set", "String", "any", "boolean", "never", "number", "string",
+    "unknown", NULL
+};
+
+
+// Java and Kotlin
+
+static const char* const kJavaNames[] = {
+    "java", "kotlin", "kt", NULL
+};
+
+static const char* const kJavaKeywords[] = {
+    "abstract", "assert", "break", "case", "catch", "class", "continue",
+    "default", "do", "else", "enum", "extends", "false", "final", "finally",
+    "for", "fun", "if", "implements", "import", "instanceof", "interface",
+    "native", "new", "null", "object", "override", "package", "private",
+    "protected", "public", "return", "static", "super", "switch",
+    "synchronized", "this", "throw", "throws", "transient", "true", "try",
+    "val", "var", "volatile", "when", "while", NULL
+};
+
+static const char* const kJavaTypes[] = {
+    "Integer", "List", "Long", "Map", "Object", "String", "boolean", "byte",
+    "char", "double", "float", "int", "long", "short", "void", NULL
+};
+
+
+// Go
+
+static const char* const kGoNames[] = {
+    "go", "golang", NULL
+};
+
+static const char* const kGoKeywords[] = {
+    "break", "case", "chan", "const", "continue", "default", "defer", "else",
+    "fallthrough", "false", "for", "func", "go", "goto", "if", "import",
+    "interface", "iota", "map", "nil", "package", "range", "return", "select",
+    "struct", "switch", "true", "type", "var", NULL
+};
+
+static const char* const kGoTypes[] = {
+    "bool", "byte", "complex128", "complex64", "error", "float32", "float64",
+    "int", "int16", "int32", "int64", "int8", "rune", "string", "uint",
+    "uint16", "uint32", "uint64", "uint8", "uintptr", NULL
+};
+
+
+// Rust
+
+static const char* const kRustNames[] = {
+    "rust", "rs", NULL
+};
+
+static const char* const kRustKeywords[] = {
+    "Self", "as", "async", "await", "break", "const", "continue", "crate",
+    "dyn", "else", "enum", "extern", "false", "fn", "for", "if", "impl", "in",
+    "let", "loop", "match", "mod", "move", "mut", "pub", "ref", "return",
+    "self", "static", "struct", "super", "trait", "true", "type", "unsafe",
+    "use", "where", "while", NULL
+};
+
+static const char* const kRustTypes[] = {
+    "Box", "Option", "Result", "String", "Vec", "bool", "char", "f32", "f64",
+    "i128", "i16", "i32", "i64", "i8", "isize", "str", "u128", "u16", "u32",
+    "u64", "u8", "usize", NULL
+};
+
+
+// Shell
+
+static const char* const kShellNames[] = {
+    "sh", "bash", "shell", "zsh", "console", "shellsession", NULL
+};
+
+static const char* const kShellKeywords[] = {
+    "case", "cd", "do", "done", "echo", "elif", "else", "esac", "exit",
+    "export", "fi", "for", "function", "if", "in", "local", "read", "return",
+    "set", "source", "then", "unset", "until", "while", NULL
+};
+
+static const char* const kShellTypes[] = {
+    NULL
+};
+
+
+// JSON
+
+static const char* const kJSONNames[] = {
+    "json", "jsonc", NULL
+};
+
+static const char* const kJSONKeywords[] = {
+    "false", "null", "true", NULL
+};
+
+static const char* const kJSONTypes[] = {
+    NULL
+};
+
+// Names, keywords, types, line comment, block comment, quotes, triple
+// quotes, preprocessor
+static const CodeLexer::Language kLanguages[] = {
+    { kCNames, kCKeywords, kCTypes,
+        "//", "/*", "*/", "\"'", false, true },
+    { kPythonNames, kPythonKeywords, kPythonTypes,
+        "#", NULL, NULL, "\"'", true, false },
+    { kJavaScriptNames, kJavaScriptKeywords, kJavaScriptTypes,
+        "//", "/*", "*/", "\"'`", false, false },
+    { kJavaNames, kJavaKeywords, kJavaTypes,
+        "//", "/*", "*/", "\"'", false, false },
+    { kGoNames, kGoKeywords, kGoTypes,
+        "//", "/*", "*/", "\"'`", false, false },
+    { kRustNames, kRustKeywords, kRustTypes,
+        "//", "/*", "*/", "\"", false, false },
+    { kShellNames, kShellKeywords, kShellTypes,
+        "#", NULL, NULL, "\"'", false, false },
+    { kJSONNames, kJSONKeywords, kJSONTypes,
+        "//", NULL, NULL, "\"", false, false },
+};
+
+static inline bool IsIdentifierStart(char c)
+{
+    return isalpha((unsigned char)c) || c == '_' || c == '$';
+}
+
+static inline bool IsIdentifierChar(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '$';
+}
+
+static inline bool StartsWith(const char* text, size_t length, size_t offset,
+    const char* prefix)
+{
+    size_t prefixLength = strlen(prefix);
+    return offset + prefixLength <= length
+        && memcmp(text + offset, prefix, prefixLength) == 0;
+}
+
+static bool Contains(const char* const* words, const char* word, size_t length)
+{
+    const char* const* end = words;
+    while (*end != NULL)
+        end++;
+
+    const char* const* found = std::lower_bound(words, end, word,
+        [length](const char* entry, const char* word) {
+            return strncmp(entry, word, length) < 0;
+        });
+    return found != end && strncmp(*found, word, length) == 0
+        && (*found)[length] == '\0';
+}
+
+const CodeLexer::Language* CodeLexer::FindLanguage(const std::string& name)
+{
+    std::string lower(name);
+    for (size_t i = 0; i < lower.size(); i++)
+        lower[i] = tolower((unsigned char)lower[i]);
+
+    for (size_t i = 0; i < sizeof(kLanguages) / sizeof(kLanguages[0]); i++) {
+        for (const char* const* alias = kLanguages[i].names; *alias != NULL;
+                alias++) {
+            if (lower == *alias)
+                return &kLanguages[i];
+        }
+    }
+
+    return NULL;
+}
+
+void CodeLexer::Lex(const Language* language, const char* text, size_t length,
+    std::vector<Token>* tokens)
+{
+    tokens->clear();
+    if (language == NULL)
+        return;
+
+    bool lineStart = true;
+    size_t i = 0;
+    while (i < length) {
+        char c = text[i];
+        if (c == '\n') {
+            lineStart = true;
+            i++;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r') {
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        int kind = -1;
+
+        if (language->lineComment != NULL
+            && StartsWith(text, length, i, language->lineComment)) {
+            while (i < length && text[i] != '\n')
+                i++;
+            kind = TOKEN_COMMENT;
+        } else if (language->blockCommentStart != NULL
+            && StartsWith(text, length, i, language->blockCommentStart)) {
+            // An unterminated comment runs to the end
+            i += strlen(language->blockCommentStart);
+            while (i < length
+                && !StartsWith(text, length, i, language->blockCommentEnd))
+                i++;
+            i = std::min(length, i + strlen(language->blockCommentEnd));
+            kind = TOKEN_COMMENT;
+        } else if (language->preprocessor && lineStart && c == '#') {
+            // Up to the end of the line, and of any lines continued
+            while (i < length && (text[i] != '\n' || text[i - 1] == '\\'))
+                i++;
+            kind = TOKEN_PREPROCESSOR;
+        } else if (strchr(language->quotes, c) != NULL) {
+            bool triple = language->tripleQuotes && i + 2 < length
+                && text[i + 1] == c && text[i + 2] == c;
+            i += triple ? 3 : 1;
+            while (i < length) {
+                if (text[i] == '\\' && c != '`') {
+                    i += 2;
+                    continue;
+                }
+                if (triple ? StartsWith(text, length, i, std::string(3, c).c_str())
+                        : text[i] == c) {
+                    i += triple ? 3 : 1;
+                    break;
+                }
+                // Only raw and triple quoted strings span lines
+                if (text[i] == '\n' && !triple && c != '`')
+                    break;
+                i++;
+            }
+            i = std::min(i, length);
+            kind = TOKEN_STRING;
+        } else if (isdigit((unsigned char)c)
+            || (c == '.' && i + 1 < length && isdigit((unsigned char)text[i + 1]))) {
+            // Digits, and whatever letters, dots and exponent signs follow
+            // them, for hex numbers and suffixes
+            while (i < length && (isalnum((unsigned char)text[i]) || text[i] == '.'
+                || text[i] == '_' || ((text[i] == '+' || text[i] == '-')
+                    && (text[i - 1] == 'e' || text[i - 1] == 'E'))))
+                i++;
+            kind = TOKEN_NUMBER;
+        } else if (IsIdentifierStart(c)) {
+            while (i < length && IsIdentifierChar(text[i]))
+                i++;
+            if (Contains(language->keywords, text + start, i - start))
+                kind = TOKEN_KEYWORD;
+            else if (Contains(language->types, text + start, i - start))
+                kind = TOKEN_TYPE;
+        } else
+            i++;
+
+        lineStart = false;
+        if (kind >= 0) {
+            Token token;
+            token.offset = start;
+            token.length = i - start;
+            token.kind = kind;
+            tokens->push_back(token);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+// CodeLexer.h
+#ifndef CODE_LEXER_H
+#define CODE_LEXER_H
+
+// Only standard C++ in here, like MarkdownDocument, so lexing can be
+// measured away from Haiku
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Splits source code into tokens for highlighting. One lexer serves all
+// languages; what differs between them, like keywords, comment markers
+// and string quotes, comes from a table per language.
+class CodeLexer {
+public:
+    enum TokenKind {
+        TOKEN_KEYWORD,
+        TOKEN_TYPE,
+        TOKEN_STRING,
+        TOKEN_NUMBER,
+        TOKEN_COMMENT,
+        TOKEN_PREPROCESSOR
+    };
+
+    // Text between tokens is plain
+    struct Token {
+        uint32_t offset;
+        uint32_t length;
+        uint8_t kind;
+    };
+
+    struct Language;
+
+    // By the name given after a code fence, like "cpp" or "python";
+    // returns NULL for languages without a table
+    static const Language* FindLanguage(const std::string& name);
+
+    static void Lex(const Language* language, const char* text, size_t length,
+                    std::vector<Token>* tokens);
+};
+
+#endif // CODE_LEXER_H
@@ -0,0 +1,91 @@
+// ContextPlanner.cpp
+#include "ContextPlanner.h"
+#include "Tokenizer.h"
+
+#include <vector>
+
+ChatHistory ContextPlanner::Fit(const ChatHistory& history, const LLMModel* model,
+                                int32 unloadedMessages)
+{
+    int32 count = history.CountItems();
+    int32 budget = PromptBudget(model);
+    const Tokenizer* tokenizer = Tokenizer::ForModel(model);
+
+    std::vector<bool> keep(count, false);
+    int32 used = 0;
+
+    // System prompts are sent no matter what
+    for (int32 i = 0; i < count; i++) {
+        const ChatMessage* message = history.ItemAt(i);
+        if (message->Role() == MESSAGE_ROLE_SYSTEM) {
+            keep[i] = true;
+            used += message->TokenCount(tokenizer) + kMessageOverhead;
+        }
+    }
+
+    // Then walk back from the newest message until one no longer fits;
+    // everything older than that is left out, so the kept part of the
+    // conversation has no holes
+    int32 newest = -1;
+    int32 oldest = count;
+    for (int32 i = count - 1; i >= 0; i--) {
+        const ChatMessage* message = history.ItemAt(i);
+        if (message->Role() == MESSAGE_ROLE_SYSTEM)
+            continue;
+
+        int32 tokens = message->TokenCount(tokenizer) + kMessageOverhead;
+        if (newest >= 0 && used + tokens > budget)
+            break;
+
+        keep[i] = true;
+        used += tokens;
+        oldest = i;
+        if (newest < 0)
+            newest = i;
+    }
+
+    // The conversation has to start with a user message; replies cut off
+    // from the question they answer go as well
+    for (int32 i = oldest; i < newest; i++) {
+        const ChatMessage* message = history.ItemAt(i);
+        if (message->Role() == MESSAGE_ROLE_SYSTEM)
+            continue;
+        if (message->Role() == MESSAGE_ROLE_USER)
+            break;
+
+        keep[i] = false;
+        used -= message->TokenCount(tokenizer) + kMessageOverhead;
+    }
+
+    // Messages left out are only counted; tokenizing them would cost more
+    // than what they are reported for
+    ChatHistory result;
+    int32 trimmedMessages = unloadedMessages;
+    for (int32 i = 0; i < count; i++) {
+        if (keep[i])
+            result.AddItem(const_cast<ChatMessage*>(history.ItemAt(i)));
+        else
+            trimmedMessages++;
+    }
+
+    result.SetPlan(used, ReplyTokens(model), trimmedMessages);
+    return result;
+}
+
+int32 ContextPlanner::PromptBudget(const LLMModel* model)
+{
+    if (model == NULL)
+        return 0;
+
+    // The reply has to fit in the same window
+    int32 budget = model->ContextWindow() - ReplyTokens(model);
+    return budget > 0 ? budget : 0;
+}
+
+int32 ContextPlanner::ReplyTokens(const LLMModel* model)
+{
+    if (model == NULL || model->MaxTokens() <= 0)
+        return kDefaultReplyTokens;
+
+    return model->MaxTokens();
+}
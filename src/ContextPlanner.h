@@ -0,0 +1,38 @@
+// ContextPlanner.h
+#ifndef CONTEXT_PLANNER_H
+#define CONTEXT_PLANNER_H
+
+#include <String.h>
+
+#include "ChatMessage.h"
+#include "LLMModel.h"
+
+// Decides which part of a chat history is sent with a request. System
+// prompts are always kept; of the other messages, the longest run of
+// most recent ones that fits the model's context window, minus the
+// tokens reserved for the reply, is sent. That run starts with a user
+// message, as the Anthropic API requires. The newest message is kept even
+// when it does not fit on its own, so the API can report the error.
+// Token counts come from the model's Tokenizer and are cached per message.
+class ContextPlanner {
+public:
+    // Returns the messages of history to send to model, with the trim
+    // counters of the returned history set. unloadedMessages older ones
+    // are still on disk; they count as trimmed.
+    static ChatHistory Fit(const ChatHistory& history, const LLMModel* model,
+                           int32 unloadedMessages = 0);
+
+    // Token budget for the prompt of a request to model
+    static int32 PromptBudget(const LLMModel* model);
+
+    // Tokens reserved for the reply; providers send this as its limit
+    static int32 ReplyTokens(const LLMModel* model);
+
+    // Role and separator tokens every message costs on top of its content
+    static const int32 kMessageOverhead = 4;
+
+    // Reply limit when there is no model to take it from
+    static const int32 kDefaultReplyTokens = 1000;
+};
+
+#endif // CONTEXT_PLANNER_H
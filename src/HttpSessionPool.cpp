@@ -0,0 +1,88 @@
+// HttpSessionPool.cpp
+#include "HttpSessionPool.h"
+
+#include <Autolock.h>
+#include <OS.h>
+
+using namespace BPrivate::Network;
+
+// Sessions idle for longer than this are dropped on the next lookup
+static const bigtime_t kSessionIdleTimeout = 5 * 60 * 1000000LL;
+
+// Concurrent connections a single session opens to its host
+static const size_t kMaxConnectionsPerHost = 4;
+
+HttpSessionPool* HttpSessionPool::sInstance = NULL;
+
+HttpSessionPool* HttpSessionPool::GetInstance()
+{
+    if (sInstance == NULL)
+        sInstance = new HttpSessionPool();
+
+    return sInstance;
+}
+
+HttpSessionPool::HttpSessionPool()
+    : fLock("http session pool")
+    , fSessionReuses(0)
+    , fSessionCreations(0)
+{
+}
+
+HttpSessionPool::~HttpSessionPool()
+{
+}
+
+BString HttpSessionPool::_HostKey(const BUrl& url)
+{
+    BString key(url.Protocol());
+    key << "://" << url.Host();
+    if (url.HasPort())
+        key << ":" << url.Port();
+    return key;
+}
+
+BHttpSession HttpSessionPool::SessionFor(const BUrl& url)
+{
+    BAutolock lock(fLock);
+
+    bigtime_t now = system_time();
+    BString key = _HostKey(url);
+
+    auto it = fSessions.find(key);
+    if (it != fSessions.end()) {
+        fSessionReuses++;
+        it->second.lastUsed = now;
+        return it->second.session;
+    }
+
+    // New host: opportunistically get rid of stale hosts before adding one
+    fSessionCreations++;
+    PruneIdle(kSessionIdleTimeout);
+
+    Entry entry;
+    entry.session.SetMaxConnectionsPerHost(kMaxConnectionsPerHost);
+    entry.lastUsed = now;
+    auto inserted = fSessions.emplace(key, entry);
+    return inserted.first->second.session;
+}
+
+void HttpSessionPool::PruneIdle(bigtime_t maxIdle)
+{
+    BAutolock lock(fLock);
+
+    // Requests still running keep their own copy of the session alive
+    bigtime_t now = system_time();
+    for (auto it = fSessions.begin(); it != fSessions.end();) {
+        if (now - it->second.lastUsed > maxIdle)
+            it = fSessions.erase(it);
+        else
+            ++it;
+    }
+}
+
+int32 HttpSessionPool::CountSessions()
+{
+    BAutolock lock(fLock);
+    return fSessions.size();
+}
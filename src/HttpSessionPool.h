@@ -0,0 +1,53 @@
+// HttpSessionPool.h
+#ifndef HTTP_SESSION_POOL_H
+#define HTTP_SESSION_POOL_H
+
+#include <String.h>
+#include <Locker.h>
+#include <HttpSession.h>
+#include <Url.h>
+
+#include <atomic>
+#include <map>
+
+// Process-wide cache of BHttpSession objects, one per scheme/host/port.
+// A BHttpSession owns its own control and data threads plus the host
+// connection bookkeeping, so creating one per request throws all of that
+// away; providers take a shared session from here instead.
+class HttpSessionPool {
+public:
+    static HttpSessionPool* GetInstance();
+
+    // Returns the session for the host of url; BHttpSession copies share
+    // the same underlying session.
+    BPrivate::Network::BHttpSession SessionFor(const BUrl& url);
+
+    // Drops sessions that have not been used for maxIdle microseconds
+    void PruneIdle(bigtime_t maxIdle);
+
+    // Lookups answered with an existing session, and sessions created.
+    // These count sessions, not connections: netservices2 reuses its
+    // keep-alive connections inside a session without telling.
+    int64 SessionReuses() const { return fSessionReuses; }
+    int64 SessionCreations() const { return fSessionCreations; }
+    int32 CountSessions();
+
+private:
+    HttpSessionPool();
+    ~HttpSessionPool();
+
+    static BString _HostKey(const BUrl& url);
+
+    struct Entry {
+        BPrivate::Network::BHttpSession session;
+        bigtime_t lastUsed;
+    };
+
+    static HttpSessionPool* sInstance;
+    BLocker fLock;
+    std::map<BString, Entry> fSessions;
+    std::atomic<int64> fSessionReuses;
+    std::atomic<int64> fSessionCreations;
+};
+
+#endif // HTTP_SESSION_POOL_H
@@ -0,0 +1,213 @@
+// JSONExtractor.cpp
+#include "JSONExtractor.h"
+
+#include "external/json.hpp"
+
+using json = nlohmann::json;
+
+// SAX handler that keeps track of the dotted path of the current value
+// and hands scalars at interesting paths to the extractor
+class JSONExtractorHandler : public nlohmann::json_sax<json> {
+public:
+    JSONExtractorHandler(JSONExtractor* extractor)
+        : fExtractor(extractor)
+    {
+    }
+
+    virtual bool null()
+    {
+        _BeginValue();
+        return true;
+    }
+
+    virtual bool boolean(bool value)
+    {
+        _BeginValue();
+        JSONExtractor::Field* field = fExtractor->_FieldAt(fPath, JSONExtractor::FIELD_BOOL);
+        if (field != NULL) {
+            *static_cast<bool*>(field->target) = value;
+            field->found = true;
+        }
+        return true;
+    }
+
+    virtual bool number_integer(number_integer_t value)
+    {
+        _BeginValue();
+        _SetInt(value);
+        return true;
+    }
+
+    virtual bool number_unsigned(number_unsigned_t value)
+    {
+        _BeginValue();
+        _SetInt(value);
+        return true;
+    }
+
+    virtual bool number_float(number_float_t value, const string_t& string)
+    {
+        _BeginValue();
+        return true;
+    }
+
+    virtual bool string(string_t& value)
+    {
+        _BeginValue();
+        JSONExtractor::Field* field = fExtractor->_FieldAt(fPath, JSONExtractor::FIELD_STRING);
+        if (field != NULL) {
+            static_cast<BString*>(field->target)->SetTo(value.data(), value.size());
+            field->found = true;
+        }
+        return true;
+    }
+
+    virtual bool binary(binary_t& value)
+    {
+        _BeginValue();
+        return true;
+    }
+
+    virtual bool start_object(std::size_t elements)
+    {
+        _BeginValue();
+        fScopes.push_back(Scope(false, fPath.Length()));
+        return true;
+    }
+
+    virtual bool key(string_t& value)
+    {
+        Scope& scope = fScopes.back();
+        fPath.Truncate(scope.pathLength);
+        if (scope.pathLength > 0)
+            fPath << '.';
+        fPath.Append(value.data(), value.size());
+        return true;
+    }
+
+    virtual bool end_object()
+    {
+        _EndScope();
+        return true;
+    }
+
+    virtual bool start_array(std::size_t elements)
+    {
+        _BeginValue();
+        fScopes.push_back(Scope(true, fPath.Length()));
+        return true;
+    }
+
+    virtual bool end_array()
+    {
+        _EndScope();
+        return true;
+    }
+
+    virtual bool parse_error(std::size_t position, const std::string& lastToken,
+                             const nlohmann::detail::exception& error)
+    {
+        return false;
+    }
+
+private:
+    struct Scope {
+        Scope(bool isArray, int32 pathLength)
+            : isArray(isArray)
+            , pathLength(pathLength)
+            , index(0)
+        {
+        }
+
+        bool isArray;
+        int32 pathLength;
+        int32 index;
+    };
+
+    void _BeginValue()
+    {
+        // Array elements are addressed by their index
+        if (fScopes.empty() || !fScopes.back().isArray)
+            return;
+
+        Scope& scope = fScopes.back();
+        fPath.Truncate(scope.pathLength);
+        if (scope.pathLength > 0)
+            fPath << '.';
+        fPath << scope.index++;
+    }
+
+    void _EndScope()
+    {
+        fPath.Truncate(fScopes.back().pathLength);
+        fScopes.pop_back();
+    }
+
+    void _SetInt(int64 value)
+    {
+        JSONExtractor::Field* field = fExtractor->_FieldAt(fPath, JSONExtractor::FIELD_INT);
+        if (field != NULL) {
+            *static_cast<int64*>(field->target) = value;
+            field->found = true;
+        }
+    }
+
+    JSONExtractor* fExtractor;
+    BString fPath;
+    std::vector<Scope> fScopes;
+};
+
+JSONExtractor::JSONExtractor()
+{
+}
+
+JSONExtractor::~JSONExtractor()
+{
+}
+
+int32 JSONExtractor::AddString(const char* path, BString* target)
+{
+    return _AddField(path, FIELD_STRING, target);
+}
+
+int32 JSONExtractor::AddInt(const char* path, int64* target)
+{
+    return _AddField(path, FIELD_INT, target);
+}
+
+int32 JSONExtractor::AddBool(const char* path, bool* target)
+{
+    return _AddField(path, FIELD_BOOL, target);
+}
+
+bool JSONExtractor::Parse(const char* data, size_t length)
+{
+    for (size_t i = 0; i < fFields.size(); i++)
+        fFields[i].found = false;
+
+    JSONExtractorHandler handler(this);
+    return json::sax_parse(data, data + length, &handler);
+}
+
+int32 JSONExtractor::_AddField(const char* path, FieldType type, void* target)
+{
+    Field field;
+    field.path = path;
+    field.type = type;
+    field.target = target;
+    field.found = false;
+    fFields.push_back(field);
+    return fFields.size() - 1;
+}
+
+JSONExtractor::Field* JSONExtractor::_FieldAt(const BString& path, FieldType type)
+{
+    // Only a few fields are ever registered, a linear scan is fine
+    for (size_t i = 0; i < fFields.size(); i++) {
+        Field& field = fFields[i];
+        if (field.type == type && field.path == path)
+            return &field;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,52 @@
+// JSONExtractor.h
+#ifndef JSON_EXTRACTOR_H
+#define JSON_EXTRACTOR_H
+
+#include <String.h>
+
+#include <vector>
+
+// Picks a handful of fields out of a JSON document in a single pass,
+// without building a DOM. Fields are addressed by dotted paths, with
+// array elements given by their index, e.g. "choices.0.message.content".
+// An extractor can be reused; every Parse() resets the found flags, but
+// leaves the targets of fields that are absent untouched.
+class JSONExtractor {
+public:
+    JSONExtractor();
+    ~JSONExtractor();
+
+    // Each returns a field index for Found()
+    int32 AddString(const char* path, BString* target);
+    int32 AddInt(const char* path, int64* target);
+    int32 AddBool(const char* path, bool* target);
+
+    // Returns false if the input is not valid JSON; fields seen before
+    // the error are still filled in
+    bool Parse(const char* data, size_t length);
+
+    bool Found(int32 field) const { return fFields[field].found; }
+
+private:
+    friend class JSONExtractorHandler;
+
+    enum FieldType {
+        FIELD_STRING,
+        FIELD_INT,
+        FIELD_BOOL
+    };
+
+    struct Field {
+        BString path;
+        FieldType type;
+        void* target;
+        bool found;
+    };
+
+    int32 _AddField(const char* path, FieldType type, void* target);
+    Field* _FieldAt(const BString& path, FieldType type);
+
+    std::vector<Field> fFields;
+};
+
+#endif // JSON_EXTRACTOR_H
@@ -0,0 +1,159 @@
+// JSONWriter.cpp
+#include "JSONWriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Allocation granularity of the output buffer; request bodies with long
+// histories easily reach hundreds of KB
+static const size_t kOutputBlockSize = 16 * 1024;
+
+JSONWriter::JSONWriter(BMallocIO* output)
+    : fOutput(output)
+{
+    fOutput->SetBlockSize(kOutputBlockSize);
+}
+
+void JSONWriter::BeginObject(const char* key)
+{
+    _Key(key);
+    _Write("{", 1);
+    fFirstInScope.push_back(true);
+}
+
+void JSONWriter::EndObject()
+{
+    fFirstInScope.pop_back();
+    _Write("}", 1);
+}
+
+void JSONWriter::BeginArray(const char* key)
+{
+    _Key(key);
+    _Write("[", 1);
+    fFirstInScope.push_back(true);
+}
+
+void JSONWriter::EndArray()
+{
+    fFirstInScope.pop_back();
+    _Write("]", 1);
+}
+
+void JSONWriter::String(const char* key, const char* value, int32 length)
+{
+    _Key(key);
+
+    BString escaped("\"");
+    AppendEscaped(escaped, value, length);
+    escaped << "\"";
+    _Write(escaped.String(), escaped.Length());
+}
+
+void JSONWriter::Int(const char* key, int64 value)
+{
+    _Key(key);
+
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%" B_PRId64, value);
+    _Write(buffer, length);
+}
+
+void JSONWriter::Double(const char* key, double value)
+{
+    _Key(key);
+
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%.17g", value);
+    _Write(buffer, length);
+}
+
+void JSONWriter::Bool(const char* key, bool value)
+{
+    _Key(key);
+
+    if (value)
+        _Write("true", 4);
+    else
+        _Write("false", 5);
+}
+
+void JSONWriter::Raw(const char* key, const BString& json)
+{
+    _Key(key);
+    _Write(json.String(), json.Length());
+}
+
+void JSONWriter::AppendEscaped(BString& out, const char* value, int32 length)
+{
+    if (length < 0)
+        length = strlen(value);
+
+    // Worst case every byte becomes a \u00XX escape; reserve the common
+    // case and let BString grow for the rest
+    int32 outLength = out.Length();
+    char* buffer = out.LockBuffer(outLength + length + 16);
+    int32 capacity = outLength + length + 16;
+    int32 position = outLength;
+
+    for (int32 i = 0; i < length; i++) {
+        unsigned char c = value[i];
+        char escape[7];
+        int32 escapeLength = 0;
+
+        switch (c) {
+            case '"':  memcpy(escape, "\\\"", 2); escapeLength = 2; break;
+            case '\\': memcpy(escape, "\\\\", 2); escapeLength = 2; break;
+            case '\n': memcpy(escape, "\\n", 2); escapeLength = 2; break;
+            case '\r': memcpy(escape, "\\r", 2); escapeLength = 2; break;
+            case '\t': memcpy(escape, "\\t", 2); escapeLength = 2; break;
+            case '\b': memcpy(escape, "\\b", 2); escapeLength = 2; break;
+            case '\f': memcpy(escape, "\\f", 2); escapeLength = 2; break;
+            default:
+                if (c < 0x20) {
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    escapeLength = 6;
+                }
+                break;
+        }
+
+        int32 needed = escapeLength > 0 ? escapeLength : 1;
+        if (position + needed > capacity) {
+            // Grow by half again, keeping what was written so far
+            out.UnlockBuffer(position);
+            capacity = position + needed + (length - i) + capacity / 2;
+            buffer = out.LockBuffer(capacity);
+        }
+
+        // UTF-8 multibyte sequences pass through unchanged
+        if (escapeLength > 0) {
+            memcpy(buffer + position, escape, escapeLength);
+            position += escapeLength;
+        } else
+            buffer[position++] = c;
+    }
+
+    out.UnlockBuffer(position);
+}
+
+void JSONWriter::_Key(const char* key)
+{
+    if (!fFirstInScope.empty()) {
+        if (!fFirstInScope.back())
+            _Write(",", 1);
+        fFirstInScope.back() = false;
+    }
+
+    if (key == NULL)
+        return;
+
+    BString escaped("\"");
+    AppendEscaped(escaped, key);
+    escaped << "\":";
+    _Write(escaped.String(), escaped.Length());
+}
+
+void JSONWriter::_Write(const char* data, size_t length)
+{
+    fOutput->Write(data, length);
+}
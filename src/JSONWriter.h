@@ -0,0 +1,43 @@
+// JSONWriter.h
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <DataIO.h>
+#include <String.h>
+
+#include <vector>
+
+// Writes JSON text straight into an output buffer, without building a
+// document first. Keys may be NULL for values inside arrays. The caller
+// is responsible for balancing Begin/End calls.
+class JSONWriter {
+public:
+    JSONWriter(BMallocIO* output);
+
+    void BeginObject(const char* key = NULL);
+    void EndObject();
+    void BeginArray(const char* key = NULL);
+    void EndArray();
+
+    void String(const char* key, const char* value, int32 length = -1);
+    void Int(const char* key, int64 value);
+    void Double(const char* key, double value);
+    void Bool(const char* key, bool value);
+
+    // Appends an already serialized JSON value, e.g. a cached fragment
+    void Raw(const char* key, const BString& json);
+
+    size_t Length() const { return fOutput->BufferLength(); }
+
+    // Appends value to out as the inside of a JSON string literal
+    static void AppendEscaped(BString& out, const char* value, int32 length = -1);
+
+private:
+    void _Key(const char* key);
+    void _Write(const char* data, size_t length);
+
+    BMallocIO* fOutput;
+    std::vector<bool> fFirstInScope;
+};
+
+#endif // JSON_WRITER_H
@@ -1,11 +1,134 @@
 // LLMProvider.cpp
 #include "LLMProvider.h"
 
+#include <Autolock.h>
+
+#include "ChatView.h"
+#include "JSONExtractor.h"
+
+using namespace BPrivate::Network;
+
+LLMRequest::LLMRequest(const BString& group)
+    : RequestJob(group)
+    , fTransferLock("llm request transfer")
+    , fTransferID(-1)
+{
+}
+
+LLMRequest::~LLMRequest()
+{
+}
+
+void LLMRequest::Cancel()
+{
+    RequestJob::Cancel();
+
+    // Aborting the transfer makes the blocked Status()/Body() call in
+    // Run() return right away
+    BAutolock lock(fTransferLock);
+    if (fTransferID >= 0)
+        fSession.Cancel(fTransferID);
+}
+
+BHttpResult LLMRequest::Execute(BHttpSession& session, BHttpRequest&& request,
+                                BBorrow<BDataIO> target)
+{
+    BAutolock lock(fTransferLock);
+
+    BHttpResult result = session.Execute(std::move(request), std::move(target));
+    fSession = session;
+    fTransferID = result.Identity();
+
+    // Cancel() may have run before there was anything to abort
+    if (IsCancelled())
+        fSession.Cancel(fTransferID);
+
+    return result;
+}
+
+status_t LLMRequest::Post(BMessage* message)
+{
+    // Nobody is waiting for the results of a cancelled request
+    if (IsCancelled())
+        return B_CANCELED;
+
+    message->AddInt32("request_id", ID());
+    if (message->what == MSG_MESSAGE_RECEIVED) {
+        message->AddInt32("context_tokens", history.EstimatedTokens());
+        message->AddInt32("trimmed_messages", history.TrimmedMessages());
+    }
+
+    return messenger.SendMessage(message);
+}
+
 LLMProvider::LLMProvider(const BString& name)
     : fName(name)
+    , fRequestLock("llm provider requests")
 {
+    // Requests of one provider share a concurrency limit, high enough for
+    // a few chats to stream their replies at the same time
+    RequestExecutor::GetInstance()->SetConcurrencyLimit(name, 4);
 }
 
 LLMProvider::~LLMProvider()
 {
 }
+
+void LLMProvider::CancelRequest(request_id id)
+{
+    BAutolock lock(fRequestLock);
+
+    for (size_t i = 0; i < fRequests.size(); i++) {
+        if (fRequests[i] == id) {
+            fRequests.erase(fRequests.begin() + i);
+            break;
+        }
+    }
+
+    // A queued job is dropped, a running one aborts its transfer and is
+    // deleted by its worker as soon as it returns
+    RequestExecutor::GetInstance()->Cancel(id);
+}
+
+void LLMProvider::CancelAllRequests()
+{
+    BAutolock lock(fRequestLock);
+    RequestExecutor* executor = RequestExecutor::GetInstance();
+
+    for (size_t i = 0; i < fRequests.size(); i++)
+        executor->Cancel(fRequests[i]);
+
+    fRequests.clear();
+}
+
+request_id LLMProvider::_SubmitRequest(RequestJob* job)
+{
+    BAutolock lock(fRequestLock);
+    RequestExecutor* executor = RequestExecutor::GetInstance();
+
+    // Forget handles of requests that have finished in the meantime
+    for (size_t i = fRequests.size(); i-- > 0;) {
+        if (!executor->IsActive(fRequests[i]))
+            fRequests.erase(fRequests.begin() + i);
+    }
+
+    request_id id = executor->Submit(job);
+    if (id >= 0)
+        fRequests.push_back(id);
+
+    return id;
+}
+
+BString LLMProvider::_HTTPError(int32 code, const BString& body)
+{
+    BString message;
+    JSONExtractor extractor;
+    extractor.AddString("error.message", &message);
+    extractor.Parse(body.String(), body.Length());
+
+    BString error("HTTP Error: ");
+    error << code;
+    if (!message.IsEmpty())
+        error << " (" << message << ")";
+    return error;
+}
@@ -5,8 +5,44 @@
 #include <String.h>
 #include <ObjectList.h>
 #include <Messenger.h>
+#include <Locker.h>
+#include <ExclusiveBorrow.h>
+#include <HttpRequest.h>
+#include <HttpResult.h>
+#include <HttpSession.h>
 #include "LLMModel.h"
 #include "ChatMessage.h"
+#include "RequestExecutor.h"
+
+#include <vector>
+
+// Common base of the providers' request jobs. Cancel() aborts the HTTP
+// transfer in flight, and Post() tags every reply with the request ID and
+// drops it once the request has been cancelled. The final reply also gets
+// the context planning figures of history ("context_tokens" and
+// "trimmed_messages").
+class LLMRequest : public RequestJob {
+public:
+    LLMRequest(const BString& group);
+    virtual ~LLMRequest();
+
+    virtual void Cancel();
+
+    // Executes request on session and remembers the transfer for Cancel()
+    BPrivate::Network::BHttpResult Execute(BPrivate::Network::BHttpSession& session,
+        BPrivate::Network::BHttpRequest&& request,
+        BPrivate::Network::BBorrow<BDataIO> target = nullptr);
+
+    status_t Post(BMessage* message);
+
+    ChatHistory history;
+    BMessenger messenger;
+
+private:
+    BLocker fTransferLock;
+    BPrivate::Network::BHttpSession fSession;
+    int32 fTransferID;
+};
 
 class LLMProvider {
 public:
@@ -22,16 +58,34 @@ public:
 
     // Non-pure virtual methods with default implementations
     virtual BObjectList<LLMModel>* GetModels() { return nullptr; }
-    virtual void SendMessage(const BObjectList<ChatMessage, true>& history,
+    // Replies carry the returned ID as "request_id"
+    virtual request_id SendMessage(const ChatHistory& history,
                             const BString& message,
-                            BMessenger* messenger) {}
+                            BMessenger* messenger) { return B_NOT_SUPPORTED; }
+
+    // Cancels one request, queued or in flight, without waiting for it.
+    // Other requests of this provider, from other chats, go on.
+    virtual void CancelRequest(request_id id);
 
-    virtual void CancelRequest() {}
+    // Cancels every request this provider has queued or in flight
+    void CancelAllRequests();
 
 protected:
+    // Queues job on the shared RequestExecutor and keeps its handle
+    request_id _SubmitRequest(RequestJob* job);
+
+    // "HTTP Error: <code>", followed by the error.message of body if it
+    // has one, as OpenAI and Anthropic error responses do
+    static BString _HTTPError(int32 code, const BString& body);
+
     BString fName;
     BString fApiBase;
     BString fApiKey;
+
+    // Handles of the requests of all chats using this provider; chats in
+    // other windows send and cancel from their own threads
+    BLocker fRequestLock;
+    std::vector<request_id> fRequests;
 };
 
 #endif // LLM_PROVIDER_H
\ No newline at end of file
@@ -6,13 +6,40 @@
 #include <MenuItem.h>
 #include <Catalog.h>
 
+#include <stdio.h>
+#include <string.h>
+
 #include "BFSStorage.h"
+#include "RequestExecutor.h"
+#include "SearchWindow.h"
+#include "StorageWriter.h"
+#include "SyntaxHighlighter.h"
 #include "SettingsWindow.h"
 #include "ModelManager.h"
 
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "MainWindow"
 
+// Saved chats offered in File > Open Chat, newest first
+static const int32 kOpenChatMenuCount = 20;
+
+// Tells the window whenever another chat comes to the front, so the model
+// selector can show that chat's provider and model
+class ChatTabView : public BTabView {
+public:
+    ChatTabView(const char* name)
+        : BTabView(name, B_WIDTH_FROM_LABEL)
+    {
+    }
+
+    virtual void Select(int32 index)
+    {
+        BTabView::Select(index);
+        if (Window() != NULL)
+            Window()->PostMessage(MSG_CHAT_SELECTED);
+    }
+};
+
 MainWindow::MainWindow()
     : BWindow(BRect(100, 100, 900, 700), B_TRANSLATE("Otto"), B_TITLED_WINDOW,
         B_AUTO_UPDATE_SIZE_LIMITS)
@@ -20,14 +47,8 @@ MainWindow::MainWindow()
     _BuildMenu();
     _InitLayout();
 
-    // Create and set a default chat
-    Chat* defaultChat = new Chat("New Chat");
-    ChatMessage* sysMsg = new ChatMessage("You are chatting with an AI assistant.", MESSAGE_ROLE_SYSTEM);
-    defaultChat->AddMessage(sysMsg);
-    fChatView->SetActiveChat(defaultChat);
-
-    // Save the new chat
-    BFSStorage::GetInstance()->SaveChat(defaultChat);
+    // Start with a default chat
+    _NewChat();
 
     CenterOnScreen();
 }
@@ -38,10 +59,22 @@ MainWindow::~MainWindow()
 
 bool MainWindow::QuitRequested()
 {
+    // Abort the replies still streaming in rather than wait for them
+    RequestExecutor::GetInstance()->Shutdown();
+
+    // Write out every queued save before the app goes away
+    StorageWriter::GetInstance()->Shutdown();
+    SyntaxHighlighter::GetInstance()->Shutdown();
+
     be_app->PostMessage(B_QUIT_REQUESTED);
     return true;
 }
 
+void MainWindow::MenusBeginning()
+{
+    _UpdateOpenChatMenu();
+}
+
 void MainWindow::_BuildMenu()
 {
     fMenuBar = new BMenuBar("menubar");
@@ -49,6 +82,10 @@ void MainWindow::_BuildMenu()
     // File menu
     BMenu* fileMenu = new BMenu(B_TRANSLATE("File"));
     fileMenu->AddItem(new BMenuItem(B_TRANSLATE("New Chat"), new BMessage(MSG_NEW_CHAT), 'N'));
+    fOpenChatMenu = new BMenu(B_TRANSLATE("Open Chat"));
+    fileMenu->AddItem(fOpenChatMenu);
+    fileMenu->AddItem(new BMenuItem(B_TRANSLATE("Find in Chats…"), new BMessage(MSG_FIND_IN_CHATS), 'F'));
+    fileMenu->AddItem(new BMenuItem(B_TRANSLATE("Close Chat"), new BMessage(MSG_CLOSE_CHAT), 'W'));
     fileMenu->AddItem(new BMenuItem(B_TRANSLATE("Save Chat"), new BMessage(MSG_SAVE_CHAT), 'S'));
     fileMenu->AddItem(new BMenuItem(B_TRANSLATE("Export Chat"), new BMessage(MSG_EXPORT_CHAT), 'E'));
     fileMenu->AddSeparatorItem();
@@ -59,6 +96,7 @@ void MainWindow::_BuildMenu()
     BMenu* editMenu = new BMenu(B_TRANSLATE("Edit"));
     editMenu->AddItem(new BMenuItem(B_TRANSLATE("Copy"), new BMessage(B_COPY), 'C'));
     editMenu->AddItem(new BMenuItem(B_TRANSLATE("Paste"), new BMessage(B_PASTE), 'V'));
+    editMenu->AddItem(new BMenuItem(B_TRANSLATE("Select All"), new BMessage(B_SELECT_ALL), 'A'));
     fMenuBar->AddItem(editMenu);
 
     // View menu
@@ -76,10 +114,11 @@ void MainWindow::_BuildMenu()
 void MainWindow::_InitLayout()
 {
     fModelSelector = new ModelSelector();
-    fChatView = new ChatView();
+    fChatTabs = new ChatTabView("chatTabs");
     fSettingsView = new SettingsView();
 
-    // Create a split view with model selector on left and chat view on right
+    // Create a split view with model selector on left and the chat tabs on
+    // right
     fMainSplitView = new BSplitView(B_HORIZONTAL);
     fMainSplitView->SetCollapsible(true);
 
@@ -90,30 +129,220 @@ void MainWindow::_InitLayout()
                 .Add(fModelSelector)
                 .SetInsets(B_USE_DEFAULT_SPACING)
                 .End()
-            .Add(fChatView)
+            .Add(fChatTabs)
             .SetInsets(B_USE_DEFAULT_SPACING)
             .End()
         .End();
 }
 
+void MainWindow::_NewChat()
+{
+    // Create a new chat with a default title
+    Chat* newChat = new Chat("New Chat");
+    // Add system message for context (optional)
+    ChatMessage* sysMsg = new ChatMessage("You are chatting with an AI assistant.", MESSAGE_ROLE_SYSTEM);
+    newChat->AddMessage(sysMsg);
+
+    _AddChat(newChat);
+
+    // Save the new chat
+    StorageWriter::GetInstance()->SaveChat(newChat);
+}
+
+void MainWindow::_OpenChat(BMessage* message)
+{
+    entry_ref ref;
+    BString chatID;
+    if (message->FindRef("refs", &ref) != B_OK
+        || message->FindString("id", &chatID) != B_OK)
+        return;
+
+    // A chat that is open already is only brought to the front
+    for (int32 i = 0; i < fChatTabs->CountTabs(); i++) {
+        ChatView* chatView = dynamic_cast<ChatView*>(fChatTabs->ViewForTab(i));
+        if (chatView != NULL && chatView->ActiveChat() != NULL
+            && chatView->ActiveChat()->ID() == chatID) {
+            fChatTabs->Select(i);
+            return;
+        }
+    }
+
+    // Only the newest messages are loaded; older ones are paged in on
+    // demand
+    Chat* chat = new Chat("");
+    status_t status = BFSStorage::GetInstance()->LoadChat(ref, chat,
+        ChatView::kHistoryPageSize);
+    if (status != B_OK) {
+        printf("Opening chat failed: %s\n", strerror(status));
+        delete chat;
+        return;
+    }
+
+    _AddChat(chat);
+}
+
+void MainWindow::_AddChat(Chat* chat)
+{
+    ChatView* chatView = new ChatView();
+
+    // A new chat starts out with the provider and model selected now
+    if (fModelSelector->SelectedProvider() != NULL)
+        chatView->SetProvider(fModelSelector->SelectedProvider());
+    if (fModelSelector->SelectedModel() != NULL)
+        chatView->SetModel(fModelSelector->SelectedModel());
+
+    BTab* tab = new BTab();
+    fChatTabs->AddTab(chatView, tab);
+    tab->SetLabel(chat->Title());
+    fChatTabs->Select(fChatTabs->CountTabs() - 1);
+
+    chatView->SetActiveChat(chat);
+}
+
+void MainWindow::_CloseCurrentChat()
+{
+    // The last chat stays open
+    if (fChatTabs->CountTabs() <= 1)
+        return;
+
+    int32 index = fChatTabs->Selection();
+    ChatView* chatView = _CurrentChatView();
+    if (chatView == NULL)
+        return;
+
+    // Deleting the tab deletes its ChatView, which cancels the request
+    // of the chat, if any. The chat has been saved with every message.
+    Chat* chat = chatView->ActiveChat();
+    delete fChatTabs->RemoveTab(index);
+    delete chat;
+
+    fChatTabs->Select(index < fChatTabs->CountTabs() ? index : index - 1);
+}
+
+void MainWindow::_UpdateOpenChatMenu()
+{
+    fOpenChatMenu->RemoveItems(0, fOpenChatMenu->CountItems(), true);
+
+    // Read from the chat file attributes; no message is loaded
+    BObjectList<ChatSummary, true>* chats = BFSStorage::GetInstance()->ListChats();
+    int32 count = chats != NULL ? min_c(chats->CountItems(), kOpenChatMenuCount) : 0;
+    for (int32 i = 0; i < count; i++) {
+        ChatSummary* summary = chats->ItemAt(i);
+
+        BMessage* message = new BMessage(MSG_OPEN_CHAT);
+        message->AddRef("refs", &summary->ref);
+        message->AddString("id", summary->id);
+        fOpenChatMenu->AddItem(new BMenuItem(summary->title.String(), message));
+    }
+    delete chats;
+
+    if (count == 0) {
+        BMenuItem* item = new BMenuItem(B_TRANSLATE("No saved chats"), NULL);
+        item->SetEnabled(false);
+        fOpenChatMenu->AddItem(item);
+    }
+}
+
+ChatView* MainWindow::_CurrentChatView() const
+{
+    int32 index = fChatTabs->Selection();
+    if (index < 0)
+        return NULL;
+
+    return dynamic_cast<ChatView*>(fChatTabs->ViewForTab(index));
+}
+
+ChatView* MainWindow::_ChatViewFor(void* owner) const
+{
+    // The chat may have been closed since
+    for (int32 i = 0; i < fChatTabs->CountTabs(); i++) {
+        if (fChatTabs->ViewForTab(i) == owner)
+            return dynamic_cast<ChatView*>(fChatTabs->ViewForTab(i));
+    }
+
+    return NULL;
+}
+
+void MainWindow::_SyncModelSelector()
+{
+    ChatView* chatView = _CurrentChatView();
+    if (chatView == NULL)
+        return;
+
+    // A chat without a provider takes whatever is selected now
+    if (chatView->Provider() == NULL) {
+        chatView->SetProvider(fModelSelector->SelectedProvider());
+        chatView->SetModel(fModelSelector->SelectedModel());
+    }
+
+    fModelSelector->SetSelection(chatView->Provider(), chatView->Model(),
+        chatView);
+}
+
+void MainWindow::_SelectionChanged(BMessage* message)
+{
+    // Provider and model selection apply to the chat the selector showed
+    // when they were made, which need not be the one in front any more
+    void* owner = NULL;
+    message->FindPointer("owner", &owner);
+    ChatView* chatView = _ChatViewFor(owner);
+    if (chatView == NULL)
+        return;
+
+    // Handle provider selection change
+    BString providerName;
+    if (message->FindString("provider_selected", &providerName) == B_OK) {
+        LLMProvider* provider = ModelManager::GetInstance()->GetProvider(providerName);
+        if (provider != NULL) {
+            chatView->SetProvider(provider);
+
+            // Auto-select default model if available
+            BObjectList<LLMModel>* models = provider->GetModels();
+            if (models != NULL && models->CountItems() > 0) {
+                chatView->SetModel(models->ItemAt(0));
+            }
+        }
+    }
+
+    // Handle model selection change, which comes along with a provider
+    // change as well
+    BString modelName;
+    if (message->FindString("model_selected", &modelName) == B_OK
+        && chatView->Provider() != NULL) {
+        BObjectList<LLMModel>* models = chatView->Provider()->GetModels();
+        for (int32 i = 0; i < models->CountItems(); i++) {
+            if (models->ItemAt(i)->Name() == modelName) {
+                chatView->SetModel(models->ItemAt(i));
+                break;
+            }
+        }
+    }
+}
+
 void MainWindow::MessageReceived(BMessage* message)
 {
     switch (message->what) {
         case MSG_NEW_CHAT:
-            // Handle new chat
+            // Open a new chat in a tab of its own; chats in other tabs
+            // keep their requests going
+            _NewChat();
+            break;
+
+        case MSG_OPEN_CHAT:
+            _OpenChat(message);
+            break;
+
+        case MSG_FIND_IN_CHATS:
             {
-                // Create a new chat with a default title
-                Chat* newChat = new Chat("New Chat");
-                // Add system message for context (optional)
-                ChatMessage* sysMsg = new ChatMessage("You are chatting with an AI assistant.", MESSAGE_ROLE_SYSTEM);
-                newChat->AddMessage(sysMsg);
-                // Set as active chat
-                fChatView->SetActiveChat(newChat);
-                // Save the new chat
-                BFSStorage::GetInstance()->SaveChat(newChat);
+                SearchWindow* window = new SearchWindow(BMessenger(this));
+                window->Show();
             }
             break;
 
+        case MSG_CLOSE_CHAT:
+            _CloseCurrentChat();
+            break;
+
         case MSG_SAVE_CHAT:
             // Trigger chat save (already handled in ChatView when messages are sent)
             break;
@@ -133,37 +362,12 @@ void MainWindow::MessageReceived(BMessage* message)
             // Show statistics window
             break;
 
+        case MSG_CHAT_SELECTED:
+            _SyncModelSelector();
+            break;
+
         case B_OBSERVER_NOTICE_CHANGE:
-            {
-                // Handle provider selection change
-                BString providerName;
-                if (message->FindString("provider_selected", &providerName) == B_OK) {
-                    LLMProvider* provider = ModelManager::GetInstance()->GetProvider(providerName);
-                    if (provider != NULL) {
-                        fChatView->SetProvider(provider);
-
-                        // Auto-select default model if available
-                        BObjectList<LLMModel>* models = provider->GetModels();
-                        if (models != NULL && models->CountItems() > 0) {
-                            fChatView->SetModel(models->ItemAt(0));
-                        }
-                    }
-                }
-
-                // Handle model selection change
-                BString modelName;
-                if (message->FindString("model_selected", &modelName) == B_OK) {
-                    if (fModelSelector->SelectedProvider() != NULL) {
-                        BObjectList<LLMModel>* models = fModelSelector->SelectedProvider()->GetModels();
-                        for (int32 i = 0; i < models->CountItems(); i++) {
-                            if (models->ItemAt(i)->Name() == modelName) {
-                                fChatView->SetModel(models->ItemAt(i));
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
+            _SelectionChanged(message);
             break;
 
         default:
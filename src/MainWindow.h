@@ -6,16 +6,21 @@
 #include <MenuBar.h>
 #include <Layout.h>
 #include <SplitView.h>
+#include <TabView.h>
 #include "ChatView.h"
 #include "ModelSelector.h"
 #include "SettingsView.h"
 
 // Message constants
 const uint32 MSG_NEW_CHAT = 'newc';
+const uint32 MSG_CLOSE_CHAT = 'clsc';
+const uint32 MSG_OPEN_CHAT = 'opnc';
+const uint32 MSG_FIND_IN_CHATS = 'fndc';
 const uint32 MSG_SAVE_CHAT = 'savc';
 const uint32 MSG_EXPORT_CHAT = 'expc';
 const uint32 MSG_SHOW_SETTINGS = 'shst';
 const uint32 MSG_SHOW_STATS = 'shss';
+const uint32 MSG_CHAT_SELECTED = 'chsl';
 
 class MainWindow : public BWindow {
 public:
@@ -23,15 +28,29 @@ public:
     virtual ~MainWindow();
     virtual bool QuitRequested() override;
 	virtual void MessageReceived(BMessage *message) override;
+    virtual void MenusBeginning() override;
 
 private:
     void _BuildMenu();
     void _InitLayout();
 
+    // Every chat has a tab with a ChatView of its own, which keeps its
+    // own request going while other tabs send theirs
+    void _NewChat();
+    void _OpenChat(BMessage* message);
+    void _AddChat(Chat* chat);
+    void _CloseCurrentChat();
+    ChatView* _CurrentChatView() const;
+    ChatView* _ChatViewFor(void* owner) const;
+    void _SyncModelSelector();
+    void _SelectionChanged(BMessage* message);
+    void _UpdateOpenChatMenu();
+
     BMenuBar* fMenuBar;
+    BMenu* fOpenChatMenu;
     BSplitView* fMainSplitView;
     ModelSelector* fModelSelector;
-    ChatView* fChatView;
+    BTabView* fChatTabs;
     SettingsView* fSettingsView;
 };
 
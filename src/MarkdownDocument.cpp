@@ -0,0 +1,483 @@
+// MarkdownDocument.cpp
+#include "MarkdownDocument.h"
+
+#include <ctype.h>
+#include <string.h>
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsWordChar(char c)
+{
+    return isalnum((unsigned char)c) || (c & 0x80) != 0;
+}
+
+MarkdownDocument::MarkdownDocument(bool markdown)
+    : fMarkdown(markdown)
+    , fCodeOpen(false)
+    , fCodeEnd(0)
+    , fCodeLength(0)
+    , fCodeLines(false)
+{
+}
+
+void MarkdownDocument::SetText(const char* text, size_t length)
+{
+    fSource.assign(text, length);
+    fBlocks.clear();
+    _Parse(0);
+}
+
+size_t MarkdownDocument::Append(const char* text, size_t length)
+{
+    size_t lastLine = fSource.rfind('\n');
+    lastLine = lastLine == std::string::npos ? 0 : lastLine + 1;
+    fSource.append(text, length);
+
+    if (fCodeOpen && _AppendToOpenCode())
+        return fBlocks.size() - 1;
+
+    // The last line may have been cut short, and what it turns out to be
+    // decides whether the block before it goes on; both are parsed again
+    size_t first = fBlocks.size();
+    while (first > 0 && fBlocks[first - 1].sourceStart >= lastLine)
+        first--;
+    if (first > 0)
+        first--;
+
+    _Parse(first);
+    return first;
+}
+
+void MarkdownDocument::_Parse(size_t firstBlock)
+{
+    size_t position = 0;
+    if (firstBlock < fBlocks.size())
+        position = fBlocks[firstBlock].sourceStart;
+    fBlocks.resize(firstBlock);
+
+    Block block;
+    std::string content;
+    bool open = false;
+    bool codeLines = false;
+    fCodeOpen = false;
+
+    while (position < fSource.size()) {
+        size_t end = fSource.find('\n', position);
+        if (end == std::string::npos)
+            end = fSource.size();
+        size_t next = end < fSource.size() ? end + 1 : end;
+
+        if (!fMarkdown) {
+            block = Block();
+            block.kind = BLOCK_PARAGRAPH;
+            block.level = 0;
+            block.sourceStart = position;
+            _FinishBlock(block, fSource.substr(position, end - position));
+            position = next;
+            continue;
+        }
+
+        LineInfo info;
+        _ClassifyLine(position, end, &info);
+
+        // Inside a code block, everything up to the closing fence is text
+        if (open && block.kind == BLOCK_CODE) {
+            if (info.fence && info.contentStart == end) {
+                _FinishBlock(block, content);
+                open = false;
+            } else {
+                if (codeLines)
+                    content += '\n';
+                content.append(fSource, position, end - position);
+                codeLines = true;
+                if (next > end) {
+                    fCodeEnd = next;
+                    fCodeLength = content.size();
+                    fCodeLines = true;
+                }
+            }
+            position = next;
+            continue;
+        }
+
+        if (info.blank) {
+            if (open)
+                _FinishBlock(block, content);
+            open = false;
+            position = next;
+            continue;
+        }
+
+        std::string lineContent = fSource.substr(info.contentStart,
+            end - info.contentStart);
+
+        // Text without a marker goes on the paragraph, list item or quote
+        // before it
+        if (info.kind == BLOCK_PARAGRAPH && !info.fence && open
+            && block.kind != BLOCK_CODE) {
+            content += ' ';
+            content += lineContent;
+            position = next;
+            continue;
+        }
+
+        // Quote lines at the same depth make one quote
+        if (info.kind == BLOCK_QUOTE && open && block.kind == BLOCK_QUOTE
+            && block.level == info.level) {
+            content += ' ';
+            content += lineContent;
+            position = next;
+            continue;
+        }
+
+        if (open)
+            _FinishBlock(block, content);
+
+        block = Block();
+        block.kind = info.fence ? BLOCK_CODE : info.kind;
+        block.level = info.level;
+        block.sourceStart = position;
+        content.clear();
+        open = true;
+
+        if (info.fence) {
+            // The info string, up to the first space
+            size_t infoEnd = lineContent.find_first_of(" \t\r");
+            block.info = lineContent.substr(0, infoEnd);
+            codeLines = false;
+
+            // Its info string may still grow until the line is complete
+            fCodeOpen = next > end;
+            fCodeEnd = next;
+            fCodeLength = 0;
+            fCodeLines = false;
+        } else if (info.kind == BLOCK_LIST_ITEM) {
+            block.info = info.ordered
+                ? fSource.substr(position, fSource.find_first_of(".)", position)
+                    - position + 1)
+                : std::string("•");
+            size_t markerStart = block.info.find_first_not_of(" \t");
+            if (markerStart != std::string::npos)
+                block.info.erase(0, markerStart);
+            content = lineContent;
+        } else if (info.kind == BLOCK_HEADING || info.kind == BLOCK_RULE) {
+            // One line each
+            _FinishBlock(block, lineContent);
+            open = false;
+        } else
+            content = lineContent;
+
+        position = next;
+    }
+
+    if (open)
+        _FinishBlock(block, content);
+    fCodeOpen = fCodeOpen && open && block.kind == BLOCK_CODE;
+}
+
+bool MarkdownDocument::_AppendToOpenCode()
+{
+    // Lines added to an open code block are text until a closing fence.
+    // Without one, they go on the end of the block, which is far cheaper
+    // than parsing the block again on every delta of a long listing.
+    size_t position = fCodeEnd;
+    while (position < fSource.size()) {
+        size_t end = fSource.find('\n', position);
+        if (end == std::string::npos)
+            end = fSource.size();
+
+        LineInfo info;
+        _ClassifyLine(position, end, &info);
+        if (info.fence && info.contentStart == end)
+            return false;
+        position = end + 1;
+    }
+
+    Block& block = fBlocks.back();
+    std::string& text = block.text;
+    text.resize(fCodeLength);
+
+    bool lines = fCodeLines;
+    position = fCodeEnd;
+    while (position < fSource.size()) {
+        size_t end = fSource.find('\n', position);
+        if (end == std::string::npos)
+            end = fSource.size();
+
+        if (lines)
+            text += '\n';
+        text.append(fSource, position, end - position);
+        lines = true;
+
+        if (end < fSource.size()) {
+            fCodeEnd = end + 1;
+            fCodeLength = text.size();
+            fCodeLines = true;
+        }
+        position = end + 1;
+    }
+
+    block.runs.clear();
+    _AddRun(block, 0, STYLE_CODE);
+    block.runs.back().length = text.size();
+    if (text.empty())
+        block.runs.pop_back();
+    return true;
+}
+
+void MarkdownDocument::_ClassifyLine(size_t start, size_t end,
+    LineInfo* info) const
+{
+    const char* line = fSource.data() + start;
+    size_t length = end - start;
+
+    info->kind = BLOCK_PARAGRAPH;
+    info->level = 0;
+    info->blank = false;
+    info->fence = false;
+    info->ordered = false;
+
+    size_t indent = 0;
+    size_t i = 0;
+    for (; i < length && IsSpace(line[i]); i++)
+        indent += line[i] == '\t' ? 4 : 1;
+    info->contentStart = start + i;
+
+    if (i == length) {
+        info->blank = true;
+        return;
+    }
+
+    // Markers other than for list items may be indented by three spaces
+    // at most
+    bool markerIndent = indent <= 3;
+    char c = line[i];
+
+    if (markerIndent && (c == '`' || c == '~') && i + 2 < length
+        && line[i + 1] == c && line[i + 2] == c) {
+        size_t j = i;
+        while (j < length && line[j] == c)
+            j++;
+        while (j < length && IsSpace(line[j]))
+            j++;
+        info->fence = true;
+        info->contentStart = start + j;
+        return;
+    }
+
+    if (markerIndent && c == '#') {
+        size_t j = i;
+        while (j < length && line[j] == '#')
+            j++;
+        if (j - i <= 6 && (j == length || IsSpace(line[j]))) {
+            info->kind = BLOCK_HEADING;
+            info->level = j - i;
+            while (j < length && IsSpace(line[j]))
+                j++;
+            info->contentStart = start + j;
+            return;
+        }
+    }
+
+    if (markerIndent && (c == '-' || c == '*' || c == '_')) {
+        size_t count = 0;
+        size_t j = i;
+        for (; j < length; j++) {
+            if (line[j] == c)
+                count++;
+            else if (!IsSpace(line[j]))
+                break;
+        }
+        if (j == length && count >= 3) {
+            info->kind = BLOCK_RULE;
+            info->contentStart = start + length;
+            return;
+        }
+    }
+
+    if ((c == '-' || c == '*' || c == '+') && i + 1 < length
+        && IsSpace(line[i + 1])) {
+        info->kind = BLOCK_LIST_ITEM;
+        info->level = indent / 2;
+        info->contentStart = start + i + 2;
+        return;
+    }
+
+    if (isdigit((unsigned char)c)) {
+        size_t j = i;
+        while (j < length && j - i < 9 && isdigit((unsigned char)line[j]))
+            j++;
+        if (j + 1 < length && (line[j] == '.' || line[j] == ')')
+            && IsSpace(line[j + 1])) {
+            info->kind = BLOCK_LIST_ITEM;
+            info->level = indent / 2;
+            info->ordered = true;
+            info->contentStart = start + j + 2;
+            return;
+        }
+    }
+
+    if (markerIndent && c == '>') {
+        size_t j = i;
+        int32_t level = 0;
+        while (j < length && (line[j] == '>' || IsSpace(line[j]))) {
+            if (line[j] == '>')
+                level++;
+            j++;
+        }
+        info->kind = BLOCK_QUOTE;
+        info->level = level;
+        info->contentStart = start + j;
+        return;
+    }
+}
+
+void MarkdownDocument::_FinishBlock(Block& block, const std::string& content)
+{
+    block.text.clear();
+    block.runs.clear();
+
+    if (!fMarkdown) {
+        block.text = content;
+        _AddRun(block, 0, 0);
+    } else if (block.kind == BLOCK_CODE) {
+        block.text = content;
+        _AddRun(block, 0, STYLE_CODE);
+    } else if (block.kind == BLOCK_LIST_ITEM) {
+        block.text = block.info;
+        block.text += ' ';
+        _AddRun(block, 0, 0);
+        _ParseInline(content, block);
+    } else if (block.kind == BLOCK_HEADING) {
+        // Closing hashes are not part of the heading
+        std::string heading(content);
+        heading.erase(heading.find_last_not_of(" \t\r") + 1);
+        size_t hashes = heading.find_last_not_of('#');
+        if (hashes == std::string::npos)
+            heading.clear();
+        else if (hashes + 1 < heading.size() && IsSpace(heading[hashes]))
+            heading.erase(heading.find_last_not_of(" \t\r", hashes) + 1);
+        _ParseInline(heading, block);
+    } else if (block.kind != BLOCK_RULE)
+        _ParseInline(content, block);
+
+    // Runs only knew where they start
+    for (size_t i = 0; i < block.runs.size(); i++) {
+        size_t end = i + 1 < block.runs.size()
+            ? block.runs[i + 1].offset : block.text.size();
+        block.runs[i].length = end - block.runs[i].offset;
+    }
+    if (!block.runs.empty() && block.runs.back().length == 0)
+        block.runs.pop_back();
+
+    fBlocks.push_back(block);
+}
+
+void MarkdownDocument::_ParseInline(const std::string& content, Block& block)
+{
+    std::string& text = block.text;
+    size_t length = content.size();
+    uint8_t style = 0;
+    _AddRun(block, text.size(), style);
+
+    size_t i = 0;
+    while (i < length) {
+        char c = content[i];
+
+        if (c == '\\' && i + 1 < length && ispunct((unsigned char)content[i + 1])) {
+            text += content[i + 1];
+            i += 2;
+            continue;
+        }
+
+        // A code span ends at the next run of as many backticks; without
+        // one, the backticks are text
+        if (c == '`') {
+            size_t count = 0;
+            while (i + count < length && content[i + count] == '`')
+                count++;
+            size_t close = content.find(std::string(count, '`'), i + count);
+            if (close != std::string::npos) {
+                _AddRun(block, text.size(), style | STYLE_CODE);
+                text.append(content, i + count, close - i - count);
+                _AddRun(block, text.size(), style);
+                i = close + count;
+            } else {
+                text.append(count, '`');
+                i += count;
+            }
+            continue;
+        }
+
+        // Links show their text only
+        if (c == '[') {
+            size_t close = content.find(']', i + 1);
+            if (close != std::string::npos && close + 1 < length
+                && content[close + 1] == '(') {
+                size_t paren = content.find(')', close + 2);
+                if (paren != std::string::npos) {
+                    _AddRun(block, text.size(), style | STYLE_LINK);
+                    text.append(content, i + 1, close - i - 1);
+                    _AddRun(block, text.size(), style);
+                    i = paren + 1;
+                    continue;
+                }
+            }
+        }
+
+        // Emphasis opens before a non-space and closes after one; two
+        // markers are bold, one italic, three both
+        if (c == '*' || c == '_') {
+            size_t count = 0;
+            while (i + count < length && content[i + count] == c)
+                count++;
+
+            char before = i > 0 ? content[i - 1] : ' ';
+            char after = i + count < length ? content[i + count] : ' ';
+            bool intraword = c == '_' && IsWordChar(before) && IsWordChar(after);
+
+            uint8_t toggle = 0;
+            if (count >= 2)
+                toggle |= STYLE_BOLD;
+            if (count % 2 == 1)
+                toggle |= STYLE_ITALIC;
+
+            bool opening = (style & toggle) == 0;
+            bool valid = count <= 3 && !intraword
+                && (opening ? !IsSpace(after) : !IsSpace(before));
+            if (valid) {
+                style ^= toggle;
+                _AddRun(block, text.size(), style);
+            } else
+                text.append(count, c);
+            i += count;
+            continue;
+        }
+
+        text += c;
+        i++;
+    }
+}
+
+void MarkdownDocument::_AddRun(Block& block, size_t offset, uint8_t style)
+{
+    std::vector<Run>& runs = block.runs;
+
+    // A run that would be empty takes the new style instead
+    if (!runs.empty() && runs.back().offset == offset) {
+        runs.pop_back();
+        if (!runs.empty() && runs.back().style == style)
+            return;
+    }
+    if (!runs.empty() && runs.back().style == style)
+        return;
+
+    Run run;
+    run.offset = offset;
+    run.length = 0;
+    run.style = style;
+    runs.push_back(run);
+}
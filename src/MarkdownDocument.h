@@ -0,0 +1,104 @@
+// MarkdownDocument.h
+#ifndef MARKDOWN_DOCUMENT_H
+#define MARKDOWN_DOCUMENT_H
+
+// Only standard C++ in here, like SearchIndex, so parsing can be measured
+// away from Haiku
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// The Markdown of a chat message, parsed into blocks of text as shown,
+// with style runs. It covers what replies use: paragraphs, ATX headings,
+// fenced code blocks, list items, block quotes and rules, with bold,
+// italic, code spans and links inside.
+//
+// Text can be appended, as it streams in. Only the blocks from the one
+// the last line started in are parsed again; the blocks before it cannot
+// change, and keep their text and runs. Lines that go on a code block
+// still open are added to its text as they are.
+class MarkdownDocument {
+public:
+    enum BlockKind {
+        BLOCK_PARAGRAPH,
+        BLOCK_HEADING,
+        BLOCK_CODE,
+        BLOCK_LIST_ITEM,
+        BLOCK_QUOTE,
+        BLOCK_RULE
+    };
+
+    // Style flags of a run
+    enum {
+        STYLE_BOLD = 0x01,
+        STYLE_ITALIC = 0x02,
+        STYLE_CODE = 0x04,
+        STYLE_LINK = 0x08
+    };
+
+    struct Run {
+        uint32_t offset;
+        uint32_t length;
+        uint8_t style;
+    };
+
+    struct Block {
+        BlockKind kind;
+        // Heading level, or nesting depth of a list item or quote
+        int32_t level;
+        // Language of a code block, as given after the fence
+        std::string info;
+        // The text as shown, and its runs, which cover all of it
+        std::string text;
+        std::vector<Run> runs;
+        // Where the block starts in the source
+        size_t sourceStart;
+    };
+
+    // Without markdown, every line is a paragraph of plain text
+    MarkdownDocument(bool markdown = true);
+
+    void SetText(const char* text, size_t length);
+
+    // Returns the index of the first block that changed; blocks before it
+    // are as they were
+    size_t Append(const char* text, size_t length);
+
+    const std::vector<Block>& Blocks() const { return fBlocks; }
+    const std::string& Source() const { return fSource; }
+    bool IsMarkdown() const { return fMarkdown; }
+
+private:
+    struct LineInfo {
+        BlockKind kind;
+        int32_t level;
+        // Where the content starts, after the marker
+        size_t contentStart;
+        bool blank;
+        bool fence;
+        bool ordered;
+    };
+
+    void _Parse(size_t sourceStart);
+    bool _AppendToOpenCode();
+    void _ClassifyLine(size_t start, size_t end, LineInfo* info) const;
+    void _FinishBlock(Block& block, const std::string& content);
+    static void _ParseInline(const std::string& content, Block& block);
+    static void _AddRun(Block& block, size_t offset, uint8_t style);
+
+    bool fMarkdown;
+    std::string fSource;
+    std::vector<Block> fBlocks;
+
+    // When the source ends inside a code block, the last block: where its
+    // complete lines end in the source and in its text, and whether it has
+    // any
+    bool fCodeOpen;
+    size_t fCodeEnd;
+    size_t fCodeLength;
+    bool fCodeLines;
+};
+
+#endif // MARKDOWN_DOCUMENT_H
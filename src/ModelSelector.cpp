@@ -15,6 +15,7 @@ ModelSelector::ModelSelector()
     : BView("modelSelector", B_WILL_DRAW)
     , fSelectedProvider(NULL)
     , fSelectedModel(NULL)
+    , fOwner(NULL)
 {
     _BuildLayout();
     _LoadProviders();
@@ -84,21 +85,16 @@ void ModelSelector::MessageReceived(BMessage* message)
                 // Update model menu
                 _UpdateModelMenu();
 
-                // [NEW] Directly notify the parent window
+                // [NEW] Directly notify the parent window, with the model
+                // the menu switched to along with the provider
                 BMessage notifyMsg(B_OBSERVER_NOTICE_CHANGE);
+                notifyMsg.AddPointer("owner", fOwner);
                 notifyMsg.AddString("provider_selected", providerName);
+                if (fSelectedModel != NULL)
+                    notifyMsg.AddString("model_selected", fSelectedModel->Name());
                 Window()->PostMessage(&notifyMsg);
 
-                // API key check (existing code)
-                SettingsManager* settings = SettingsManager::GetInstance();
-                BString apiKey = settings->GetApiKey(providerName);
-
-                if (apiKey.IsEmpty()) {
-                    fStatusView->SetText(B_TRANSLATE("Please set API key in settings"));
-                    fStatusView->SetHighColor(255, 0, 0);
-                } else {
-                    fStatusView->SetText("");
-                }
+                _UpdateStatus();
             }
             break;
         }
@@ -115,6 +111,7 @@ void ModelSelector::MessageReceived(BMessage* message)
 
 						// [NEW] Notify the parent window about model selection
 						BMessage notifyMsg(B_OBSERVER_NOTICE_CHANGE);
+						notifyMsg.AddPointer("owner", fOwner);
 						notifyMsg.AddString("model_selected", modelName);
 						Window()->PostMessage(&notifyMsg);
 						break;
@@ -143,6 +140,22 @@ void ModelSelector::MessageReceived(BMessage* message)
     }
 }
 
+void ModelSelector::SetSelection(LLMProvider* provider, LLMModel* model,
+    void* owner)
+{
+    fOwner = owner;
+    fSelectedProvider = provider;
+
+    BMenu* menu = fProviderMenu->Menu();
+    for (int32 i = 0; i < menu->CountItems(); i++) {
+        BMenuItem* item = menu->ItemAt(i);
+        item->SetMarked(provider != NULL && provider->Name() == item->Label());
+    }
+
+    _UpdateModelMenu(model);
+    _UpdateStatus();
+}
+
 void ModelSelector::_LoadProviders()
 {
     // Get providers from the model manager
@@ -162,11 +175,14 @@ void ModelSelector::_LoadProviders()
     }
 }
 
-void ModelSelector::_UpdateModelMenu()
+void ModelSelector::_UpdateModelMenu(LLMModel* selected)
 {
     // Clear existing items
     BMenu* menu = fModelMenu->Menu(); // Changed BPopUpMenu* to BMenu*
-    menu->RemoveItems(0, menu->CountItems());
+    menu->RemoveItems(0, menu->CountItems(), true);
+
+    // The model of another provider is no choice any more
+    fSelectedModel = NULL;
 
     // No provider selected
     if (fSelectedProvider == NULL)
@@ -175,9 +191,11 @@ void ModelSelector::_UpdateModelMenu()
     // Get models from the provider
     BObjectList<LLMModel>* models = fSelectedProvider->GetModels();
 
-    // Get default model from settings
+    // Get default model from settings, unless a model is given
     SettingsManager* settings = SettingsManager::GetInstance();
     BString defaultModel = settings->GetDefaultModel(fSelectedProvider->Name());
+    if (selected != NULL)
+        defaultModel = selected->Name();
 
     // Add models to menu
     for (int32 i = 0; i < models->CountItems(); i++) {
@@ -196,6 +214,9 @@ void ModelSelector::_UpdateModelMenu()
         }
     }
 
+    // Items added after AttachedToWindow() would go to the window
+    menu->SetTargetForItems(this);
+
     // If no default model was marked, mark the first one
     if (fSelectedModel == NULL && menu->CountItems() > 0) {
         menu->ItemAt(0)->SetMarked(true);
@@ -210,4 +231,23 @@ void ModelSelector::_UpdateModelMenu()
             }
         }
     }
-}
\ No newline at end of file
+}
+
+void ModelSelector::_UpdateStatus()
+{
+    // API key check
+    if (fSelectedProvider == NULL) {
+        fStatusView->SetText("");
+        return;
+    }
+
+    SettingsManager* settings = SettingsManager::GetInstance();
+    BString apiKey = settings->GetApiKey(fSelectedProvider->Name());
+
+    if (apiKey.IsEmpty()) {
+        fStatusView->SetText(B_TRANSLATE("Please set API key in settings"));
+        fStatusView->SetHighColor(255, 0, 0);
+    } else {
+        fStatusView->SetText("");
+    }
+}
@@ -24,11 +24,18 @@ public:
     
     LLMProvider* SelectedProvider() const { return fSelectedProvider; }
     LLMModel* SelectedModel() const { return fSelectedModel; }
+
+    // Shows the provider and model of owner, without notifying anyone.
+    // The B_OBSERVER_NOTICE_CHANGE sent for a later selection carries
+    // owner as its "owner" pointer, so the window can apply it to the
+    // chat it belongs to.
+    void SetSelection(LLMProvider* provider, LLMModel* model, void* owner);
     
 private:
     void _BuildLayout();
     void _LoadProviders();
-    void _UpdateModelMenu();
+    void _UpdateModelMenu(LLMModel* selected = NULL);
+    void _UpdateStatus();
     
     BMenuField* fProviderMenu;
     BMenuField* fModelMenu;
@@ -37,6 +44,7 @@ private:
     
     LLMProvider* fSelectedProvider;
     LLMModel* fSelectedModel;
+    void* fOwner;
 };
 
 #endif // MODEL_SELECTOR_H
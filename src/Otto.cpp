@@ -1,26 +1,77 @@
 #include <Application.h>
 #include <Window.h>
+#include <stdio.h>
+#include <string.h>
+#include "BFSStorage.h"
 #include "MainWindow.h"
+#include "RequestExecutor.h"
+#include "Tokenizer.h"
 
 class OttoApp : public BApplication {
 public:
     OttoApp();
     virtual ~OttoApp();
+
+private:
+    static int32 _LoadTokenizersThread(void* data);
+
+    thread_id fTokenizerThread;
 };
 
 OttoApp::OttoApp()
     : BApplication("application/x-vnd.Otto")
 {
+    // Decoding the tokenizer tables takes a while; until they are there,
+    // prompt tokens are estimated
+    fTokenizerThread = spawn_thread(_LoadTokenizersThread, "tokenizer loader",
+        B_LOW_PRIORITY, NULL);
+    if (fTokenizerThread >= 0)
+        resume_thread(fTokenizerThread);
+
     MainWindow* mainWindow = new MainWindow();
     mainWindow->Show();
 }
 
 OttoApp::~OttoApp()
 {
+    // The tables must not go away while they are being filled
+    if (fTokenizerThread >= 0) {
+        status_t result;
+        wait_for_thread(fTokenizerThread, &result);
+    }
+
+    // The workers are gone by now, MainWindow shut them down
+    RequestExecutor::DeleteInstance();
+}
+
+int32 OttoApp::_LoadTokenizersThread(void* data)
+{
+    Tokenizer::LoadAll();
+    return 0;
 }
 
-int main()
+// "Otto --migrate-chats" converts chats stored one file per message to
+// the packed format and exits
+static int MigrateChats()
 {
+    BApplication app("application/x-vnd.Otto");
+
+    BFSStorage* storage = BFSStorage::GetInstance();
+    if (!storage->Initialize()) {
+        fprintf(stderr, "Could not open the chat storage\n");
+        return 1;
+    }
+
+    int32 migrated = storage->MigrateAllChats();
+    printf("Migrated %d chats\n", (int)migrated);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--migrate-chats") == 0)
+        return MigrateChats();
+
     OttoApp app;
     app.Run();
     return 0;
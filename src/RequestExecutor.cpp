@@ -0,0 +1,255 @@
+// RequestExecutor.cpp
+#include "RequestExecutor.h"
+
+#include <Autolock.h>
+
+// Jobs of a group without an explicit limit never run more than this
+// many at a time
+static const int32 kDefaultConcurrencyLimit = 2;
+
+RequestJob::RequestJob(const BString& group)
+    : fID(-1)
+    , fGroup(group)
+    , fCancelled(false)
+{
+}
+
+RequestJob::~RequestJob()
+{
+}
+
+void RequestJob::Cancel()
+{
+    fCancelled = true;
+}
+
+RequestExecutor* RequestExecutor::sInstance = NULL;
+
+RequestExecutor* RequestExecutor::GetInstance()
+{
+    if (sInstance == NULL)
+        sInstance = new RequestExecutor();
+
+    return sInstance;
+}
+
+void RequestExecutor::DeleteInstance()
+{
+    delete sInstance;
+    sInstance = NULL;
+}
+
+RequestExecutor::RequestExecutor()
+    : fLock("request executor")
+    , fWakeSem(create_sem(0, "request executor wake"))
+    , fQueue(20)
+    , fRunning(kWorkerCount)
+    , fNextID(1)
+    , fInitStatus(B_NO_MORE_THREADS)
+    , fQuitting(false)
+{
+    if (fWakeSem < 0) {
+        fInitStatus = fWakeSem;
+        for (int32 i = 0; i < kWorkerCount; i++)
+            fWorkers[i] = -1;
+        return;
+    }
+
+    // A smaller pool still works; only without any worker at all is
+    // every Submit() turned down
+    for (int32 i = 0; i < kWorkerCount; i++) {
+        BString name;
+        name.SetToFormat("request worker %" B_PRId32, i);
+        fWorkers[i] = spawn_thread(_WorkerThread, name.String(),
+                                   B_NORMAL_PRIORITY, this);
+        if (fWorkers[i] >= 0) {
+            resume_thread(fWorkers[i]);
+            fInitStatus = B_OK;
+        }
+    }
+}
+
+RequestExecutor::~RequestExecutor()
+{
+    Shutdown();
+}
+
+void RequestExecutor::Shutdown()
+{
+    {
+        BAutolock lock(fLock);
+        if (fQuitting)
+            return;
+        fQuitting = true;
+
+        // Queued jobs never get to run
+        while (RequestJob* job = fQueue.RemoveItemAt(0))
+            delete job;
+
+        // Running ones would keep their workers until the reply is
+        // complete; this aborts their transfers instead
+        for (int32 i = 0; i < fRunning.CountItems(); i++)
+            fRunning.ItemAt(i)->Cancel();
+    }
+
+    release_sem_etc(fWakeSem, kWorkerCount, 0);
+
+    for (int32 i = 0; i < kWorkerCount; i++) {
+        if (fWorkers[i] >= 0) {
+            status_t result;
+            wait_for_thread(fWorkers[i], &result);
+        }
+    }
+
+    if (fWakeSem >= 0)
+        delete_sem(fWakeSem);
+}
+
+status_t RequestExecutor::InitCheck() const
+{
+    return fInitStatus;
+}
+
+request_id RequestExecutor::Submit(RequestJob* job)
+{
+    if (job == NULL)
+        return B_BAD_VALUE;
+
+    BAutolock lock(fLock);
+
+    if (fInitStatus != B_OK || fQuitting) {
+        delete job;
+        return fQuitting ? B_NOT_ALLOWED : fInitStatus;
+    }
+
+    job->fID = fNextID++;
+    request_id id = job->fID;
+    fQueue.AddItem(job);
+
+    release_sem(fWakeSem);
+    return id;
+}
+
+status_t RequestExecutor::Cancel(request_id id)
+{
+    BAutolock lock(fLock);
+
+    for (int32 i = 0; i < fQueue.CountItems(); i++) {
+        if (fQueue.ItemAt(i)->ID() == id) {
+            delete fQueue.RemoveItemAt(i);
+            return B_OK;
+        }
+    }
+
+    // The worker deletes the job as soon as Run() notices
+    for (int32 i = 0; i < fRunning.CountItems(); i++) {
+        if (fRunning.ItemAt(i)->ID() == id) {
+            fRunning.ItemAt(i)->Cancel();
+            return B_OK;
+        }
+    }
+
+    return B_BAD_VALUE;
+}
+
+bool RequestExecutor::IsActive(request_id id)
+{
+    BAutolock lock(fLock);
+    return _FindJob(id) != NULL;
+}
+
+void RequestExecutor::SetConcurrencyLimit(const BString& group, int32 limit)
+{
+    BAutolock lock(fLock);
+    fLimits[group] = limit > 0 ? limit : 1;
+
+    // A raised limit may unblock queued jobs
+    release_sem(fWakeSem);
+}
+
+int32 RequestExecutor::CountQueued()
+{
+    BAutolock lock(fLock);
+    return fQueue.CountItems();
+}
+
+int32 RequestExecutor::CountRunning()
+{
+    BAutolock lock(fLock);
+    return fRunning.CountItems();
+}
+
+RequestJob* RequestExecutor::_FindJob(request_id id)
+{
+    for (int32 i = 0; i < fQueue.CountItems(); i++) {
+        if (fQueue.ItemAt(i)->ID() == id)
+            return fQueue.ItemAt(i);
+    }
+
+    for (int32 i = 0; i < fRunning.CountItems(); i++) {
+        if (fRunning.ItemAt(i)->ID() == id)
+            return fRunning.ItemAt(i);
+    }
+
+    return NULL;
+}
+
+RequestJob* RequestExecutor::_NextRunnableJob()
+{
+    // Oldest job whose group is still below its concurrency limit
+    for (int32 i = 0; i < fQueue.CountItems(); i++) {
+        RequestJob* job = fQueue.ItemAt(i);
+
+        int32 limit = kDefaultConcurrencyLimit;
+        auto limitIt = fLimits.find(job->Group());
+        if (limitIt != fLimits.end())
+            limit = limitIt->second;
+
+        if (fRunningPerGroup[job->Group()] < limit)
+            return fQueue.RemoveItemAt(i);
+    }
+
+    return NULL;
+}
+
+int32 RequestExecutor::_WorkerThread(void* data)
+{
+    static_cast<RequestExecutor*>(data)->_WorkerLoop();
+    return 0;
+}
+
+void RequestExecutor::_WorkerLoop()
+{
+    while (true) {
+        if (acquire_sem(fWakeSem) == B_BAD_SEM_ID)
+            return;
+
+        RequestJob* job;
+        {
+            BAutolock lock(fLock);
+            if (fQuitting)
+                return;
+
+            job = _NextRunnableJob();
+            if (job == NULL)
+                continue;
+
+            fRunning.AddItem(job);
+            fRunningPerGroup[job->Group()]++;
+        }
+
+        job->Run();
+
+        {
+            BAutolock lock(fLock);
+            fRunning.RemoveItem(job);
+            fRunningPerGroup[job->Group()]--;
+            delete job;
+
+            // Either more work is queued, or a job held back by its
+            // group limit can run now
+            if (!fQueue.IsEmpty())
+                release_sem(fWakeSem);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+// RequestExecutor.h
+#ifndef REQUEST_EXECUTOR_H
+#define REQUEST_EXECUTOR_H
+
+#include <String.h>
+#include <Locker.h>
+#include <ObjectList.h>
+#include <OS.h>
+
+#include <atomic>
+#include <map>
+
+typedef int32 request_id;
+
+// A unit of work run by the RequestExecutor. Jobs are owned by the
+// executor from Submit() on and deleted once they have run (or have been
+// dropped from the queue), so the destructor is the place to free any
+// per-request data.
+class RequestJob {
+public:
+    RequestJob(const BString& group);
+    virtual ~RequestJob();
+
+    virtual void Run() = 0;
+
+    // Called from another thread while Run() is in progress; must not
+    // block. Subclasses extend it to abort whatever Run() waits on.
+    virtual void Cancel();
+    bool IsCancelled() const { return fCancelled; }
+
+    request_id ID() const { return fID; }
+    const BString& Group() const { return fGroup; }
+
+private:
+    friend class RequestExecutor;
+
+    request_id fID;
+    BString fGroup;
+    std::atomic<bool> fCancelled;
+};
+
+// Fixed pool of long-lived worker threads fed by a job queue. Jobs are
+// grouped (one group per provider) and every group can be given a limit
+// on how many of its jobs run at the same time.
+class RequestExecutor {
+public:
+    static RequestExecutor* GetInstance();
+    static void DeleteInstance();
+
+    // B_OK unless not a single worker could be started
+    status_t InitCheck() const;
+
+    // Takes ownership of job; returns its handle or an error code
+    request_id Submit(RequestJob* job);
+
+    // Drops a queued job, or asks a running one to stop, without waiting
+    // for it. Returns B_BAD_VALUE if the job is unknown or finished.
+    status_t Cancel(request_id id);
+
+    bool IsActive(request_id id);
+
+    void SetConcurrencyLimit(const BString& group, int32 limit);
+
+    int32 CountQueued();
+    int32 CountRunning();
+
+    // Drops the queued jobs, cancels the running ones and waits for the
+    // workers to finish them; Submit() fails from then on
+    void Shutdown();
+
+private:
+    RequestExecutor();
+    ~RequestExecutor();
+
+    static int32 _WorkerThread(void* data);
+    void _WorkerLoop();
+    RequestJob* _NextRunnableJob();
+    RequestJob* _FindJob(request_id id);
+
+    static const int32 kWorkerCount = 8;
+
+    static RequestExecutor* sInstance;
+
+    BLocker fLock;
+    sem_id fWakeSem;
+    BObjectList<RequestJob> fQueue;
+    BObjectList<RequestJob> fRunning;
+    std::map<BString, int32> fLimits;
+    std::map<BString, int32> fRunningPerGroup;
+    thread_id fWorkers[kWorkerCount];
+    request_id fNextID;
+    status_t fInitStatus;
+    bool fQuitting;
+};
+
+#endif // REQUEST_EXECUTOR_H
@@ -0,0 +1,724 @@
+// SearchIndex.cpp
+#include "SearchIndex.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+
+// File layout; numbers are unsigned LEB128 varints unless noted:
+//   header:  "OTTOFTS" + version byte
+//   chats:   count, then per chat: ID size, ID, indexed message count
+//   docs:    count, then per document: chat, message, length in tokens
+//   terms:   count, then in sorted order: term size, term, document
+//            count, last document, posting size, postings
+//   posting: document delta, frequency, position deltas
+//   footer:  uint32 checksum of everything before it, little endian
+static const char kHeader[8] = { 'O', 'T', 'T', 'O', 'F', 'T', 'S', 1 };
+
+// Longer tokens are mostly encoded data, nothing anyone searches for
+static const size_t kMaxTermLength = 64;
+
+// BM25 parameters
+static const double kK1 = 1.2;
+static const double kB = 0.75;
+
+static uint32_t Checksum(const uint8_t* data, size_t size)
+{
+    // FNV-1a, as in the chat log
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline void WriteVarint(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((uint8_t)value);
+}
+
+static inline bool ReadVarint(const uint8_t*& data, const uint8_t* end,
+                              uint64_t* value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline void WriteBytes(std::vector<uint8_t>& buffer, const std::string& bytes)
+{
+    WriteVarint(buffer, bytes.size());
+    buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+}
+
+static inline bool ReadBytes(const uint8_t*& data, const uint8_t* end,
+                             std::string* bytes)
+{
+    uint64_t size;
+    if (!ReadVarint(data, end, &size) || (uint64_t)(end - data) < size)
+        return false;
+    bytes->assign((const char*)data, size);
+    data += size;
+    return true;
+}
+
+
+SearchIndex::SearchIndex()
+    : fSavedDocuments(0)
+    , fTotalLength(0)
+{
+}
+
+bool SearchIndex::Load(const std::string& path)
+{
+    _Clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    std::vector<uint8_t> buffer;
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + read);
+    fclose(file);
+
+    if (buffer.size() < sizeof(kHeader) + 4
+        || memcmp(buffer.data(), kHeader, sizeof(kHeader)) != 0)
+        return false;
+
+    size_t checksummed = buffer.size() - 4;
+    const uint8_t* footer = buffer.data() + checksummed;
+    uint32_t checksum = footer[0] | footer[1] << 8 | footer[2] << 16
+        | (uint32_t)footer[3] << 24;
+    if (Checksum(buffer.data(), checksummed) != checksum)
+        return false;
+
+    const uint8_t* data = buffer.data() + sizeof(kHeader);
+    const uint8_t* end = buffer.data() + checksummed;
+    bool valid = true;
+
+    uint64_t count;
+    valid = ReadVarint(data, end, &count);
+    for (uint64_t i = 0; valid && i < count; i++) {
+        Chat chat;
+        uint64_t indexedCount = 0;
+        valid = ReadBytes(data, end, &chat.id)
+            && ReadVarint(data, end, &indexedCount);
+        chat.indexedCount = (int32_t)indexedCount;
+        chat.removed = false;
+        fChatsByID[chat.id] = fChats.size();
+        fChats.push_back(chat);
+    }
+
+    valid = valid && ReadVarint(data, end, &count);
+    for (uint64_t i = 0; valid && i < count; i++) {
+        uint64_t chat = 0, message = 0, length = 0;
+        valid = ReadVarint(data, end, &chat) && ReadVarint(data, end, &message)
+            && ReadVarint(data, end, &length) && chat < fChats.size();
+        Document document = { (uint32_t)chat, (int32_t)message, (uint32_t)length };
+        fDocuments.push_back(document);
+        fTotalLength += length;
+    }
+
+    valid = valid && ReadVarint(data, end, &count);
+    for (uint64_t i = 0; valid && i < count; i++) {
+        std::string term;
+        uint64_t documentCount, lastDocument, size;
+        valid = ReadBytes(data, end, &term)
+            && ReadVarint(data, end, &documentCount)
+            && ReadVarint(data, end, &lastDocument)
+            && ReadVarint(data, end, &size) && (uint64_t)(end - data) >= size;
+        if (!valid)
+            break;
+
+        PostingList& list = fPostings[term];
+        list.data.assign(data, data + size);
+        list.documentCount = documentCount;
+        list.lastDocument = lastDocument;
+        data += size;
+    }
+
+    if (!valid) {
+        _Clear();
+        return false;
+    }
+
+    fSavedDocuments = fDocuments.size();
+    return true;
+}
+
+void SearchIndex::_Clear()
+{
+    fChats.clear();
+    fChatsByID.clear();
+    fDocuments.clear();
+    fPostings.clear();
+    fSavedDocuments = 0;
+    fTotalLength = 0;
+}
+
+bool SearchIndex::Save(const std::string& path)
+{
+    // Drop removed chats, and renumber the documents that are left
+    bool compact = false;
+    for (size_t i = 0; i < fChats.size(); i++)
+        compact = compact || fChats[i].removed;
+
+    if (compact) {
+        std::vector<uint32_t> chatMap(fChats.size());
+        std::vector<Chat> chats;
+        fChatsByID.clear();
+        for (size_t i = 0; i < fChats.size(); i++) {
+            if (fChats[i].removed)
+                continue;
+            chatMap[i] = chats.size();
+            fChatsByID[fChats[i].id] = chats.size();
+            chats.push_back(fChats[i]);
+        }
+
+        std::vector<int64_t> documentMap(fDocuments.size(), -1);
+        std::vector<Document> documents;
+        fTotalLength = 0;
+        for (size_t i = 0; i < fDocuments.size(); i++) {
+            if (fChats[fDocuments[i].chat].removed)
+                continue;
+            documentMap[i] = documents.size();
+            documents.push_back(fDocuments[i]);
+            documents.back().chat = chatMap[fDocuments[i].chat];
+            fTotalLength += fDocuments[i].length;
+        }
+
+        std::map<std::string, PostingList>::iterator it = fPostings.begin();
+        while (it != fPostings.end()) {
+            Postings postings;
+            _DecodePostings(it->second.data.data(), it->second.data.size(), true,
+                &postings);
+
+            PostingList list = { std::vector<uint8_t>(), 0, 0 };
+            for (size_t i = 0; i < postings.documents.size(); i++) {
+                if (documentMap[postings.documents[i]] >= 0) {
+                    _AppendPosting(list, documentMap[postings.documents[i]],
+                        &postings.positions[postings.firstPositions[i]],
+                        postings.frequencies[i]);
+                }
+            }
+
+            if (list.documentCount == 0)
+                fPostings.erase(it++);
+            else
+                (it++)->second = list;
+        }
+
+        fChats.swap(chats);
+        fDocuments.swap(documents);
+    }
+
+    std::vector<uint8_t> buffer(kHeader, kHeader + sizeof(kHeader));
+
+    WriteVarint(buffer, fChats.size());
+    for (size_t i = 0; i < fChats.size(); i++) {
+        WriteBytes(buffer, fChats[i].id);
+        WriteVarint(buffer, fChats[i].indexedCount);
+    }
+
+    WriteVarint(buffer, fDocuments.size());
+    for (size_t i = 0; i < fDocuments.size(); i++) {
+        WriteVarint(buffer, fDocuments[i].chat);
+        WriteVarint(buffer, fDocuments[i].message);
+        WriteVarint(buffer, fDocuments[i].length);
+    }
+
+    WriteVarint(buffer, fPostings.size());
+    for (std::map<std::string, PostingList>::const_iterator it = fPostings.begin();
+            it != fPostings.end(); it++) {
+        WriteBytes(buffer, it->first);
+        WriteVarint(buffer, it->second.documentCount);
+        WriteVarint(buffer, it->second.lastDocument);
+        WriteVarint(buffer, it->second.data.size());
+        buffer.insert(buffer.end(), it->second.data.begin(), it->second.data.end());
+    }
+
+    uint32_t checksum = Checksum(buffer.data(), buffer.size());
+    for (int i = 0; i < 4; i++)
+        buffer.push_back((uint8_t)(checksum >> (i * 8)));
+
+    // Replace the old index only with a complete new one
+    std::string tempPath = path + ".new";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size()
+        && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    fSavedDocuments = fDocuments.size();
+    return true;
+}
+
+void SearchIndex::Add(const std::string& chatID, int32_t message, const char* text,
+                      size_t length)
+{
+    std::map<std::string, uint32_t>::iterator found = fChatsByID.find(chatID);
+    if (found == fChatsByID.end()) {
+        Chat chat = { chatID, 0, false };
+        found = fChatsByID.insert(std::make_pair(chatID, (uint32_t)fChats.size())).first;
+        fChats.push_back(chat);
+    }
+
+    Chat& chat = fChats[found->second];
+    if (chat.removed || message != chat.indexedCount)
+        return;
+
+    std::vector<Token> tokens;
+    _Tokenize(text, length, &tokens);
+
+    uint32_t document = fDocuments.size();
+    Document entry = { found->second, message, (uint32_t)tokens.size() };
+    fDocuments.push_back(entry);
+    fTotalLength += tokens.size();
+    chat.indexedCount++;
+
+    // Group the positions by term
+    std::map<std::string, std::vector<uint32_t> > positions;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (tokens[i].term.size() <= kMaxTermLength)
+            positions[tokens[i].term].push_back(i);
+    }
+
+    for (std::map<std::string, std::vector<uint32_t> >::iterator it
+            = positions.begin(); it != positions.end(); it++) {
+        std::map<std::string, PostingList>::iterator list = fPostings.find(it->first);
+        if (list == fPostings.end()) {
+            PostingList empty = { std::vector<uint8_t>(), 0, 0 };
+            list = fPostings.insert(std::make_pair(it->first, empty)).first;
+        }
+        _AppendPosting(list->second, document, it->second.data(),
+            it->second.size());
+    }
+}
+
+void SearchIndex::RemoveChat(const std::string& chatID)
+{
+    // The documents stay until the next Save()
+    std::map<std::string, uint32_t>::iterator found = fChatsByID.find(chatID);
+    if (found != fChatsByID.end())
+        fChats[found->second].removed = true;
+}
+
+int32_t SearchIndex::IndexedCount(const std::string& chatID) const
+{
+    std::map<std::string, uint32_t>::const_iterator found = fChatsByID.find(chatID);
+    if (found == fChatsByID.end())
+        return 0;
+    return fChats[found->second].indexedCount;
+}
+
+void SearchIndex::Search(const std::string& query, size_t maxHits,
+                         std::vector<Hit>* hits) const
+{
+    std::vector<Clause> clauses;
+    _ParseQuery(query, &clauses);
+    if (clauses.empty() || clauses.size() >= 0xffff || fDocuments.empty())
+        return;
+
+    // Every clause has to match, and each adds to the score. matched
+    // holds how many clauses in a row a document matched so far.
+    std::vector<double> scores(fDocuments.size(), 0);
+    std::vector<uint16_t> matched(fDocuments.size(), 0);
+    for (size_t i = 0; i < clauses.size(); i++)
+        _ScoreClause(clauses[i], i, scores, matched);
+
+    std::vector<std::pair<double, uint32_t> > ranked;
+    for (size_t i = 0; i < fDocuments.size(); i++) {
+        if (matched[i] == clauses.size() && !fChats[fDocuments[i].chat].removed)
+            ranked.push_back(std::make_pair(scores[i], (uint32_t)i));
+    }
+
+    // Best first; on a tie, the newer message
+    size_t count = std::min(maxHits, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+        std::greater<std::pair<double, uint32_t> >());
+
+    for (size_t i = 0; i < count; i++) {
+        const Document& document = fDocuments[ranked[i].second];
+        Hit hit = { fChats[document.chat].id, document.message, ranked[i].first };
+        hits->push_back(hit);
+    }
+}
+
+void SearchIndex::_ScoreClause(const Clause& clause, uint16_t clauseIndex,
+                               std::vector<double>& scores,
+                               std::vector<uint16_t>& matched) const
+{
+    if (!clause.phrase) {
+        // A word, or every word that starts with the prefix
+        std::vector<std::string> terms;
+        _Expand(clause, &terms);
+        for (size_t i = 0; i < terms.size(); i++) {
+            Postings postings;
+            _Postings(terms[i], false, &postings);
+
+            uint32_t documentFrequency = postings.documents.size();
+            for (size_t j = 0; j < postings.documents.size(); j++) {
+                uint32_t document = postings.documents[j];
+                if (matched[document] == clauseIndex)
+                    matched[document] = clauseIndex + 1;
+                else if (matched[document] != clauseIndex + 1)
+                    continue;
+
+                scores[document] += _Score(postings.frequencies[j],
+                    documentFrequency, document);
+            }
+        }
+        return;
+    }
+
+    // A phrase: documents with all of its words, in order, next to each
+    // other; counted like a single word
+    std::vector<Postings> lists(clause.terms.size());
+    for (size_t i = 0; i < clause.terms.size(); i++) {
+        _Postings(clause.terms[i], true, &lists[i]);
+        if (lists[i].documents.empty())
+            return;
+    }
+
+    std::vector<size_t> next(lists.size(), 0);
+    std::vector<std::pair<uint32_t, uint32_t> > matches;
+    const Postings& first = lists[0];
+    for (size_t j = 0; j < first.documents.size(); j++) {
+        uint32_t document = first.documents[j];
+        if (matched[document] != clauseIndex)
+            continue;
+
+        bool inAll = true;
+        for (size_t i = 1; i < lists.size() && inAll; i++) {
+            const std::vector<uint32_t>& documents = lists[i].documents;
+            while (next[i] < documents.size() && documents[next[i]] < document)
+                next[i]++;
+            inAll = next[i] < documents.size() && documents[next[i]] == document;
+        }
+        if (!inAll)
+            continue;
+
+        uint32_t frequency = 0;
+        const uint32_t* positions = &first.positions[first.firstPositions[j]];
+        for (uint32_t p = 0; p < first.frequencies[j]; p++) {
+            bool adjacent = true;
+            for (size_t i = 1; i < lists.size() && adjacent; i++) {
+                const uint32_t* begin
+                    = &lists[i].positions[lists[i].firstPositions[next[i]]];
+                const uint32_t* end = begin + lists[i].frequencies[next[i]];
+                adjacent = std::binary_search(begin, end, positions[p] + (uint32_t)i);
+            }
+            if (adjacent)
+                frequency++;
+        }
+
+        if (frequency > 0)
+            matches.push_back(std::make_pair(document, frequency));
+    }
+
+    for (size_t i = 0; i < matches.size(); i++) {
+        uint32_t document = matches[i].first;
+        matched[document] = clauseIndex + 1;
+        scores[document] += _Score(matches[i].second, matches.size(), document);
+    }
+}
+
+double SearchIndex::_Score(uint32_t termFrequency, uint32_t documentFrequency,
+                           uint32_t document) const
+{
+    double documents = fDocuments.size();
+    double averageLength = documents > 0 ? fTotalLength / documents : 1;
+    if (averageLength <= 0)
+        averageLength = 1;
+
+    double idf = log(1 + (documents - documentFrequency + 0.5)
+        / (documentFrequency + 0.5));
+    double length = fDocuments[document].length;
+    double frequency = termFrequency;
+    return idf * frequency * (kK1 + 1)
+        / (frequency + kK1 * (1 - kB + kB * length / averageLength));
+}
+
+void SearchIndex::_Expand(const Clause& clause, std::vector<std::string>* terms) const
+{
+    const std::string& word = clause.terms[0];
+    if (!clause.prefix) {
+        if (fPostings.find(word) != fPostings.end())
+            terms->push_back(word);
+        return;
+    }
+
+    typedef std::map<std::string, PostingList>::const_iterator Iterator;
+    std::vector<std::pair<uint32_t, Iterator> > found;
+    for (Iterator it = fPostings.lower_bound(word);
+            it != fPostings.end() && it->first.compare(0, word.size(), word) == 0;
+            it++) {
+        found.push_back(std::make_pair(it->second.documentCount, it));
+    }
+
+    // Only the terms in the most documents, when there are too many
+    if (found.size() > kMaxPrefixTerms) {
+        std::nth_element(found.begin(), found.begin() + kMaxPrefixTerms,
+            found.end(), [](const std::pair<uint32_t, Iterator>& a,
+                const std::pair<uint32_t, Iterator>& b) {
+                return a.first > b.first;
+            });
+        found.resize(kMaxPrefixTerms);
+    }
+
+    for (size_t i = 0; i < found.size(); i++)
+        terms->push_back(found[i].second->first);
+}
+
+void SearchIndex::_Postings(const std::string& term, bool withPositions,
+                            Postings* postings) const
+{
+    std::map<std::string, PostingList>::const_iterator found = fPostings.find(term);
+    if (found == fPostings.end())
+        return;
+
+    postings->documents.reserve(found->second.documentCount);
+    postings->frequencies.reserve(found->second.documentCount);
+    _DecodePostings(found->second.data.data(), found->second.data.size(),
+        withPositions, postings);
+}
+
+void SearchIndex::_AppendPosting(PostingList& list, uint32_t document,
+                                 const uint32_t* positions, size_t count)
+{
+    WriteVarint(list.data, list.documentCount == 0
+        ? document : document - list.lastDocument);
+    WriteVarint(list.data, count);
+
+    uint32_t last = 0;
+    for (size_t i = 0; i < count; i++) {
+        WriteVarint(list.data, positions[i] - last);
+        last = positions[i];
+    }
+
+    list.documentCount++;
+    list.lastDocument = document;
+}
+
+void SearchIndex::_DecodePostings(const uint8_t* data, size_t size,
+                                  bool withPositions, Postings* postings)
+{
+    const uint8_t* end = data + size;
+    uint32_t document = 0;
+    bool first = true;
+
+    while (data < end) {
+        uint64_t delta, frequency;
+        if (!ReadVarint(data, end, &delta) || !ReadVarint(data, end, &frequency))
+            return;
+
+        document = first ? delta : document + delta;
+        first = false;
+
+        postings->documents.push_back(document);
+        postings->frequencies.push_back(frequency);
+        postings->firstPositions.push_back(postings->positions.size());
+
+        uint32_t position = 0;
+        for (uint64_t i = 0; i < frequency; i++) {
+            uint64_t positionDelta;
+            if (!ReadVarint(data, end, &positionDelta)) {
+                postings->positions.resize(postings->firstPositions.back());
+                postings->documents.pop_back();
+                postings->frequencies.pop_back();
+                postings->firstPositions.pop_back();
+                return;
+            }
+            position += positionDelta;
+            if (withPositions)
+                postings->positions.push_back(position);
+        }
+    }
+}
+
+void SearchIndex::_Tokenize(const char* text, size_t length, std::vector<Token>* tokens)
+{
+    // Words are runs of ASCII letters and digits, or of any non-ASCII
+    // bytes; only ASCII is folded to lower case
+    size_t i = 0;
+    while (i < length) {
+        while (i < length && !isalnum((unsigned char)text[i])
+            && (unsigned char)text[i] < 0x80)
+            i++;
+
+        size_t start = i;
+        while (i < length && (isalnum((unsigned char)text[i])
+            || (unsigned char)text[i] >= 0x80))
+            i++;
+
+        if (i > start) {
+            Token token;
+            token.term.assign(text + start, i - start);
+            for (size_t j = 0; j < token.term.size(); j++)
+                token.term[j] = tolower((unsigned char)token.term[j]);
+            token.offset = start;
+            token.length = i - start;
+            tokens->push_back(token);
+        }
+    }
+}
+
+void SearchIndex::_ParseQuery(const std::string& query, std::vector<Clause>* clauses)
+{
+    size_t i = 0;
+    while (i < query.size()) {
+        if (query[i] == '"') {
+            // A phrase, up to the closing quote or the end of the query
+            size_t close = query.find('"', i + 1);
+            if (close == std::string::npos)
+                close = query.size();
+
+            std::vector<Token> tokens;
+            _Tokenize(query.data() + i + 1, close - i - 1, &tokens);
+
+            Clause clause;
+            clause.prefix = false;
+            clause.phrase = tokens.size() > 1;
+            for (size_t j = 0; j < tokens.size(); j++)
+                clause.terms.push_back(tokens[j].term);
+            if (!clause.terms.empty())
+                clauses->push_back(clause);
+
+            i = close + 1;
+            continue;
+        }
+
+        size_t end = query.find_first_of(" \t\n\"", i);
+        if (end == std::string::npos)
+            end = query.size();
+
+        std::string word = query.substr(i, end - i);
+        bool prefix = !word.empty() && word[word.size() - 1] == '*';
+
+        std::vector<Token> tokens;
+        _Tokenize(word.data(), word.size(), &tokens);
+
+        // "don't" searches like the phrase "don t"; only the last part
+        // of a word can be a prefix
+        for (size_t j = 0; j < tokens.size(); j++) {
+            Clause clause;
+            clause.terms.push_back(tokens[j].term);
+            clause.prefix = prefix && j == tokens.size() - 1;
+            clause.phrase = false;
+            clauses->push_back(clause);
+        }
+
+        i = end;
+        while (i < query.size() && (query[i] == ' ' || query[i] == '\t'
+            || query[i] == '\n'))
+            i++;
+    }
+}
+
+bool SearchIndex::_Matches(const Clause& clause, const std::string& term)
+{
+    for (size_t i = 0; i < clause.terms.size(); i++) {
+        const std::string& word = clause.terms[i];
+        if (clause.prefix ? term.compare(0, word.size(), word) == 0 : term == word)
+            return true;
+    }
+    return false;
+}
+
+std::string SearchIndex::Snippet(const char* text, size_t length,
+                                 const std::string& query, size_t width)
+{
+    std::vector<Clause> clauses;
+    _ParseQuery(query, &clauses);
+
+    std::vector<Token> tokens;
+    _Tokenize(text, length, &tokens);
+
+    // Matching tokens, and which clause they match
+    std::vector<std::pair<size_t, size_t> > matches;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        for (size_t c = 0; c < clauses.size(); c++) {
+            if (_Matches(clauses[c], tokens[i].term)) {
+                matches.push_back(std::make_pair(i, c));
+                break;
+            }
+        }
+    }
+
+    // The window that holds the most different clauses, then the most
+    // matches
+    size_t bestStart = 0;
+    size_t bestClauses = 0;
+    size_t bestMatches = 0;
+    for (size_t i = 0; i < matches.size(); i++) {
+        size_t windowStart = tokens[matches[i].first].offset;
+        std::vector<bool> seen(clauses.size(), false);
+        size_t clauseCount = 0;
+        size_t matchCount = 0;
+        for (size_t j = i; j < matches.size(); j++) {
+            const Token& token = tokens[matches[j].first];
+            if (token.offset + token.length > windowStart + width)
+                break;
+            if (!seen[matches[j].second]) {
+                seen[matches[j].second] = true;
+                clauseCount++;
+            }
+            matchCount++;
+        }
+
+        if (clauseCount > bestClauses
+            || (clauseCount == bestClauses && matchCount > bestMatches)) {
+            bestStart = windowStart;
+            bestClauses = clauseCount;
+            bestMatches = matchCount;
+        }
+    }
+
+    // Start a little before the first match, at the start of a word
+    size_t start = bestStart > width / 4 ? bestStart - width / 4 : 0;
+    while (start > 0 && start < bestStart && text[start - 1] != ' '
+        && text[start - 1] != '\n')
+        start++;
+    while (start > 0 && ((unsigned char)text[start] & 0xc0) == 0x80)
+        start--;
+
+    size_t end = std::min(length, start + width);
+    while (end < length && end > start && ((unsigned char)text[end] & 0xc0) == 0x80)
+        end--;
+
+    std::string snippet;
+    if (start > 0)
+        snippet = "…";
+    for (size_t i = start; i < end; i++)
+        snippet += (text[i] == '\n' || text[i] == '\t') ? ' ' : text[i];
+    if (end < length)
+        snippet += "…";
+
+    return snippet;
+}
@@ -0,0 +1,135 @@
+// SearchIndex.h
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+// Only standard C++ in here, so the index can be built and measured on
+// its own, away from Haiku
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Inverted index over the content of chat messages. Every message is a
+// document, known by its chat ID and its index in the chat. For every
+// term, the index keeps a posting list of the documents it occurs in,
+// with the positions of each occurrence; document numbers and positions
+// are stored as deltas, varint encoded.
+//
+// Documents are added in memory and written out by Save(), which merges
+// them into the file Load() read. Search() takes words, "word*" prefixes
+// and "quoted phrases", all of which must match, and ranks the messages
+// found by BM25. A prefix stands for the kMaxPrefixTerms terms it starts
+// that are in the most documents; a short one could otherwise take in
+// thousands of rare terms, each with a posting list to decode.
+class SearchIndex {
+public:
+    struct Hit {
+        std::string chatID;
+        int32_t message;
+        double score;
+    };
+
+    static const size_t kMaxPrefixTerms = 256;
+
+    SearchIndex();
+
+    // An index that is missing or damaged loads as an empty one
+    bool Load(const std::string& path);
+    bool Save(const std::string& path);
+
+    // Messages of a chat must be added in order, without gaps
+    void Add(const std::string& chatID, int32_t message, const char* text,
+             size_t length);
+    void RemoveChat(const std::string& chatID);
+
+    // Messages 0 to IndexedCount() - 1 of the chat are in the index
+    int32_t IndexedCount(const std::string& chatID) const;
+
+    // Documents added since the last Save()
+    size_t PendingDocuments() const { return fDocuments.size() - fSavedDocuments; }
+    size_t CountDocuments() const { return fDocuments.size(); }
+
+    void Search(const std::string& query, size_t maxHits,
+                std::vector<Hit>* hits) const;
+
+    // Up to about width bytes of text around where the query matches best
+    static std::string Snippet(const char* text, size_t length,
+                               const std::string& query, size_t width);
+
+private:
+    struct Token {
+        std::string term;
+        size_t offset;
+        size_t length;
+    };
+
+    struct Chat {
+        std::string id;
+        int32_t indexedCount;
+        bool removed;
+    };
+
+    struct Document {
+        uint32_t chat;
+        int32_t message;
+        uint32_t length;
+    };
+
+    // A posting list as stored, and the last document in it, so more can
+    // be appended
+    struct PostingList {
+        std::vector<uint8_t> data;
+        uint32_t documentCount;
+        uint32_t lastDocument;
+    };
+
+    // A decoded posting list; the positions of document i start at
+    // firstPositions[i], if they were decoded
+    struct Postings {
+        std::vector<uint32_t> documents;
+        std::vector<uint32_t> frequencies;
+        std::vector<uint32_t> firstPositions;
+        std::vector<uint32_t> positions;
+    };
+
+    struct Clause {
+        std::vector<std::string> terms;
+        bool prefix;
+        bool phrase;
+    };
+
+    void _Clear();
+
+    static void _Tokenize(const char* text, size_t length,
+                          std::vector<Token>* tokens);
+    static void _ParseQuery(const std::string& query,
+                            std::vector<Clause>* clauses);
+    static bool _Matches(const Clause& clause, const std::string& term);
+
+    static void _AppendPosting(PostingList& list, uint32_t document,
+                               const uint32_t* positions, size_t count);
+    static void _DecodePostings(const uint8_t* data, size_t size,
+                                bool withPositions, Postings* postings);
+
+    void _Postings(const std::string& term, bool withPositions,
+                   Postings* postings) const;
+    void _Expand(const Clause& clause, std::vector<std::string>* terms) const;
+    void _ScoreClause(const Clause& clause, uint16_t clauseIndex,
+                      std::vector<double>& scores,
+                      std::vector<uint16_t>& matched) const;
+    double _Score(uint32_t termFrequency, uint32_t documentFrequency,
+                  uint32_t document) const;
+
+    std::vector<Chat> fChats;
+    std::map<std::string, uint32_t> fChatsByID;
+    std::vector<Document> fDocuments;
+    size_t fSavedDocuments;
+    uint64_t fTotalLength;
+
+    // Terms in sorted order, so prefixes are a range
+    std::map<std::string, PostingList> fPostings;
+};
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,191 @@
+// SearchWindow.cpp
+#include "SearchWindow.h"
+#include <LayoutBuilder.h>
+#include <Catalog.h>
+#include <ScrollView.h>
+
+#include "BFSStorage.h"
+#include "MainWindow.h"
+
+#undef B_TRANSLATION_CONTEXT
+#define B_TRANSLATION_CONTEXT "SearchWindow"
+
+// A result, with what it takes to open its chat
+class SearchResultItem : public BStringItem {
+public:
+    SearchResultItem(const BString& label, const entry_ref& ref,
+        const BString& chatID)
+        : BStringItem(label.String())
+        , fRef(ref)
+        , fChatID(chatID)
+    {
+    }
+
+    const entry_ref& Ref() const { return fRef; }
+    const BString& ChatID() const { return fChatID; }
+
+private:
+    entry_ref fRef;
+    BString fChatID;
+};
+
+SearchWindow::SearchWindow(const BMessenger& chatWindow)
+    : BWindow(BRect(120, 120, 620, 520), B_TRANSLATE("Find in chats"),
+             B_TITLED_WINDOW, B_AUTO_UPDATE_SIZE_LIMITS)
+    , fChatWindow(chatWindow)
+    , fGeneration(0)
+{
+    _BuildLayout();
+
+    CenterOnScreen();
+}
+
+SearchWindow::~SearchWindow()
+{
+    // The list does not own its items
+    for (int32 i = 0; i < fResultsView->CountItems(); i++)
+        delete fResultsView->ItemAt(i);
+}
+
+void SearchWindow::MessageReceived(BMessage* message)
+{
+    switch (message->what) {
+        case MSG_SEARCH_CHATS:
+            _Search();
+            break;
+
+        case MSG_SEARCH_RESULTS:
+            _ShowResults(message);
+            break;
+
+        case MSG_OPEN_RESULT:
+            _OpenResult();
+            break;
+
+        default:
+            BWindow::MessageReceived(message);
+            break;
+    }
+}
+
+void SearchWindow::_BuildLayout()
+{
+    // Enter starts the search
+    fQueryControl = new BTextControl("query", B_TRANSLATE("Search:"), "",
+        new BMessage(MSG_SEARCH_CHATS));
+
+    fResultsView = new BListView("results");
+    fResultsView->SetInvocationMessage(new BMessage(MSG_OPEN_RESULT));
+    BScrollView* resultsScrollView = new BScrollView("resultsScrollView",
+        fResultsView, B_WILL_DRAW | B_FRAME_EVENTS, false, true);
+
+    fStatusView = new BStringView("statusView", "");
+
+    BLayoutBuilder::Group<>(this, B_VERTICAL)
+        .Add(fQueryControl)
+        .Add(resultsScrollView, 10.0)
+        .Add(fStatusView)
+        .SetInsets(B_USE_DEFAULT_SPACING)
+        .End();
+
+    fQueryControl->MakeFocus(true);
+}
+
+void SearchWindow::_Search()
+{
+    BString query = fQueryControl->Text();
+    query.Trim();
+    if (query.IsEmpty())
+        return;
+
+    SearchRequest* request = new SearchRequest;
+    request->target = BMessenger(this);
+    request->query = query;
+    request->generation = ++fGeneration;
+
+    thread_id thread = spawn_thread(_SearchThread, "chat search",
+        B_NORMAL_PRIORITY, request);
+    if (thread < 0) {
+        delete request;
+        fStatusView->SetText(B_TRANSLATE("Could not start the search."));
+        return;
+    }
+
+    fStatusView->SetText(B_TRANSLATE("Searching…"));
+    resume_thread(thread);
+}
+
+int32 SearchWindow::_SearchThread(void* data)
+{
+    SearchRequest* request = static_cast<SearchRequest*>(data);
+
+    BObjectList<SearchResult, true> results(kMaxResults);
+    status_t status = BFSStorage::GetInstance()->SearchMessages(request->query,
+        kMaxResults, &results);
+
+    BMessage reply(MSG_SEARCH_RESULTS);
+    reply.AddInt32("generation", request->generation);
+    reply.AddInt32("status", status);
+    for (int32 i = 0; i < results.CountItems(); i++) {
+        const SearchResult* result = results.ItemAt(i);
+        reply.AddRef("refs", &result->ref);
+        reply.AddString("id", result->chatID);
+        reply.AddString("title", result->title);
+        reply.AddString("snippet", result->snippet);
+    }
+    request->target.SendMessage(&reply);
+
+    delete request;
+    return 0;
+}
+
+void SearchWindow::_ShowResults(BMessage* message)
+{
+    int32 generation;
+    if (message->FindInt32("generation", &generation) != B_OK
+        || generation != fGeneration)
+        return;
+
+    for (int32 i = 0; i < fResultsView->CountItems(); i++)
+        delete fResultsView->ItemAt(i);
+    fResultsView->MakeEmpty();
+
+    status_t status = B_ERROR;
+    message->FindInt32("status", &status);
+    if (status != B_OK) {
+        fStatusView->SetText(B_TRANSLATE("The search failed."));
+        return;
+    }
+
+    entry_ref ref;
+    for (int32 i = 0; message->FindRef("refs", i, &ref) == B_OK; i++) {
+        BString chatID, title, snippet;
+        message->FindString("id", i, &chatID);
+        message->FindString("title", i, &title);
+        message->FindString("snippet", i, &snippet);
+        snippet.ReplaceAll('\n', ' ');
+
+        BString label(title);
+        label << ": " << snippet;
+        fResultsView->AddItem(new SearchResultItem(label, ref, chatID));
+    }
+
+    if (fResultsView->IsEmpty())
+        fStatusView->SetText(B_TRANSLATE("No messages found."));
+    else
+        fStatusView->SetText("");
+}
+
+void SearchWindow::_OpenResult()
+{
+    SearchResultItem* item = dynamic_cast<SearchResultItem*>(
+        fResultsView->ItemAt(fResultsView->CurrentSelection()));
+    if (item == NULL)
+        return;
+
+    // The chat window opens it, or brings its tab to the front
+    BMessage open(MSG_OPEN_CHAT);
+    open.AddRef("refs", &item->Ref());
+    open.AddString("id", item->ChatID());
+    fChatWindow.SendMessage(&open);
+}
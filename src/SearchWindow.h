@@ -0,0 +1,51 @@
+// SearchWindow.h
+#ifndef SEARCH_WINDOW_H
+#define SEARCH_WINDOW_H
+
+#include <Window.h>
+#include <ListView.h>
+#include <Messenger.h>
+#include <StringView.h>
+#include <TextControl.h>
+
+const uint32 MSG_SEARCH_CHATS = 'srch';
+const uint32 MSG_SEARCH_RESULTS = 'srsl';
+const uint32 MSG_OPEN_RESULT = 'oprs';
+
+// Finds messages in all saved chats; see SearchIndex for what a query can
+// hold. Searches run on a thread of their own, since the first one indexes
+// whatever the index is missing and wide prefixes take a while. Opening a
+// result sends MSG_OPEN_CHAT to the window that opened this one.
+class SearchWindow : public BWindow {
+public:
+    SearchWindow(const BMessenger& chatWindow);
+    virtual ~SearchWindow();
+
+    virtual void MessageReceived(BMessage* message);
+
+private:
+    struct SearchRequest {
+        BMessenger target;
+        BString query;
+        int32 generation;
+    };
+
+    void _BuildLayout();
+    void _Search();
+    void _ShowResults(BMessage* message);
+    void _OpenResult();
+
+    static int32 _SearchThread(void* data);
+
+    static const int32 kMaxResults = 50;
+
+    BTextControl* fQueryControl;
+    BListView* fResultsView;
+    BStringView* fStatusView;
+    BMessenger fChatWindow;
+
+    // Results of earlier searches that arrive late are dropped
+    int32 fGeneration;
+};
+
+#endif // SEARCH_WINDOW_H
@@ -145,3 +145,21 @@ void SettingsManager::SetToolsEnabled(bool enabled)
         fSettings.AddBool("ToolsEnabled", enabled);
 }
 
+bool SettingsManager::GetStreamingEnabled()
+{
+    bool enabled;
+
+    if (fSettings.FindBool("StreamingEnabled", &enabled) != B_OK)
+        return true;
+
+    return enabled;
+}
+
+void SettingsManager::SetStreamingEnabled(bool enabled)
+{
+    if (fSettings.HasBool("StreamingEnabled"))
+        fSettings.ReplaceBool("StreamingEnabled", enabled);
+    else
+        fSettings.AddBool("StreamingEnabled", enabled);
+}
+
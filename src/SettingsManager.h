@@ -24,6 +24,9 @@ public:
     bool GetToolsEnabled();
     void SetToolsEnabled(bool enabled);
 
+    bool GetStreamingEnabled();
+    void SetStreamingEnabled(bool enabled);
+
 	float GetTemperature();
 	void SetTemperature(float temperature);
 
@@ -53,12 +53,18 @@ void SettingsView::_BuildLayout()
         B_TRANSLATE("Enable MCP Tools Integration"),
         new BMessage(MSG_SETTINGS_CHANGED));
 
+    // Stream responses checkbox
+    fStreamingCheckbox = new BCheckBox("streamingEnabled",
+        B_TRANSLATE("Stream responses as they are generated"),
+        new BMessage(MSG_SETTINGS_CHANGED));
+
     // Layout model tab
     BLayoutBuilder::Group<>(modelTab, B_VERTICAL, B_USE_DEFAULT_SPACING)
         .Add(fTemperatureSlider)
         .Add(fMaxTokensSlider)
         .AddStrut(B_USE_DEFAULT_SPACING)
         .Add(fToolsEnabledCheckbox)
+        .Add(fStreamingCheckbox)
         .AddGlue()
         .SetInsets(B_USE_DEFAULT_SPACING);
 
@@ -126,10 +132,12 @@ void SettingsView::AttachedToWindow()
     fTemperatureSlider->SetTarget(this);
     fMaxTokensSlider->SetTarget(this);
     fToolsEnabledCheckbox->SetTarget(this);
+    fStreamingCheckbox->SetTarget(this);
     fAPISettingsButton->SetTarget(this);
     fResetStatsButton->SetTarget(this);
 
-    // Update usage stats
+    // Update usage stats, and keep them updated while the view is shown
+    BFSStorage::GetInstance()->StartWatchingUsage(BMessenger(this));
     _UpdateUsageStats();
 
     // Fix message handling for buttons
@@ -140,9 +148,26 @@ void SettingsView::AttachedToWindow()
     fResetStatsButton->Message()->AddString("name", "resetStatsButton");
 }
 
+void SettingsView::DetachedFromWindow()
+{
+    BFSStorage::GetInstance()->StopWatchingUsage(BMessenger(this));
+    BView::DetachedFromWindow();
+}
+
 void SettingsView::MessageReceived(BMessage* message)
 {
     switch (message->what) {
+        case MSG_USAGE_CHANGED: {
+            // New usage was saved, or the totals were added up
+            int64 inputTokens, outputTokens;
+            if (message->FindInt64("input", &inputTokens) == B_OK
+                && message->FindInt64("output", &outputTokens) == B_OK)
+                _ShowUsageStats(inputTokens, outputTokens);
+            else
+                _UpdateUsageStats();
+            break;
+        }
+
         case MSG_SETTINGS_CHANGED: {
             const char* name = NULL;
             if (message->FindString("name", &name) == B_OK) {
@@ -214,6 +239,10 @@ void SettingsView::_LoadSettings()
     bool toolsEnabled = settings->GetToolsEnabled();
     fToolsEnabledCheckbox->SetValue(toolsEnabled ? B_CONTROL_ON : B_CONTROL_OFF);
 
+    // Set streaming checkbox
+    bool streamingEnabled = settings->GetStreamingEnabled();
+    fStreamingCheckbox->SetValue(streamingEnabled ? B_CONTROL_ON : B_CONTROL_OFF);
+
     // Update API status
     _UpdateAPIStatus();
 }
@@ -234,6 +263,10 @@ void SettingsView::_SaveSettings()
     bool toolsEnabled = fToolsEnabledCheckbox->Value() == B_CONTROL_ON;
     settings->SetToolsEnabled(toolsEnabled);
 
+    // Save streaming enabled
+    bool streamingEnabled = fStreamingCheckbox->Value() == B_CONTROL_ON;
+    settings->SetStreamingEnabled(streamingEnabled);
+
     // Save all settings
     settings->SaveSettings();
 }
@@ -264,18 +297,45 @@ void SettingsView::_UpdateAPIStatus()
 
 void SettingsView::_UpdateUsageStats()
 {
-    // Get current month's usage
-    time_t now = time(NULL);
-    time_t monthStart = now; // In a real app, set to start of month
+    // Show the last known totals right away; adding them up happens on
+    // another thread, which posts the result back
+    int64 totalInputTokens, totalOutputTokens;
+    if (BFSStorage::GetInstance()->GetCachedMonthUsage(&totalInputTokens,
+            &totalOutputTokens)) {
+        _ShowUsageStats(totalInputTokens, totalOutputTokens);
+        return;
+    }
 
-    int32 totalInputTokens = 0;
-    int32 totalOutputTokens = 0;
+    fTotalUsageView->SetText(B_TRANSLATE("Calculating usage…"));
 
-    // Example of how to get usage stats
-    BFSStorage::GetInstance()->GetTotalUsage("", "",
-                                            monthStart, now,
-                                            &totalInputTokens, &totalOutputTokens);
+    BMessenger* messenger = new BMessenger(this);
+    thread_id thread = spawn_thread(_UsageStatsThread, "usage stats",
+        B_LOW_PRIORITY, messenger);
+    if (thread >= 0)
+        resume_thread(thread);
+    else
+        delete messenger;
+}
 
+int32 SettingsView::_UsageStatsThread(void* data)
+{
+    BMessenger* messenger = static_cast<BMessenger*>(data);
+
+    BMessage result(MSG_USAGE_CHANGED);
+    int64 totalInputTokens, totalOutputTokens;
+    if (BFSStorage::GetInstance()->GetMonthUsage(&totalInputTokens,
+            &totalOutputTokens) == B_OK) {
+        result.AddInt64("input", totalInputTokens);
+        result.AddInt64("output", totalOutputTokens);
+        messenger->SendMessage(&result);
+    }
+
+    delete messenger;
+    return 0;
+}
+
+void SettingsView::_ShowUsageStats(int64 totalInputTokens, int64 totalOutputTokens)
+{
     // Format and display usage
     BString usageText = B_TRANSLATE("Total tokens used this month:");
     usageText << "\n\n";
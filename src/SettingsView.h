@@ -18,6 +18,7 @@ public:
     virtual ~SettingsView();
 
     virtual void AttachedToWindow();
+    virtual void DetachedFromWindow();
     virtual void MessageReceived(BMessage* message);
 
 private:
@@ -26,6 +27,8 @@ private:
     void _SaveSettings();
     void _UpdateAPIStatus();
     void _UpdateUsageStats();
+    void _ShowUsageStats(int64 inputTokens, int64 outputTokens);
+    static int32 _UsageStatsThread(void* data);
 
     BTabView* fTabView;
 
@@ -33,6 +36,7 @@ private:
     BSlider* fTemperatureSlider;
     BSlider* fMaxTokensSlider;
     BCheckBox* fToolsEnabledCheckbox;
+    BCheckBox* fStreamingCheckbox;
 
     // API settings
     BButton* fAPISettingsButton;
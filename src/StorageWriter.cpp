@@ -0,0 +1,299 @@
+// StorageWriter.cpp
+#include "StorageWriter.h"
+
+#include <Autolock.h>
+#include <stdio.h>
+
+StorageWriter* StorageWriter::sInstance = NULL;
+
+StorageWriter* StorageWriter::GetInstance()
+{
+    if (sInstance == NULL)
+        sInstance = new StorageWriter();
+
+    return sInstance;
+}
+
+StorageWriter::StorageWriter()
+    : fLock("storage writer")
+    , fWakeSem(create_sem(0, "storage writer wake"))
+    , fRoomSem(create_sem(0, "storage writer room"))
+    , fWriteLock("storage writer batch")
+    , fOldestPending(0)
+    , fWaitingForRoom(0)
+    , fQuitting(false)
+    , fLastFlushLatency(0)
+    , fMaxFlushLatency(0)
+    , fCoalescedSaves(0)
+{
+    fThread = spawn_thread(_WriterThread, "storage writer", B_LOW_PRIORITY, this);
+    if (fThread >= 0)
+        resume_thread(fThread);
+    else
+        printf("Failed to spawn the storage writer, saving synchronously\n");
+}
+
+StorageWriter::~StorageWriter()
+{
+    Shutdown();
+}
+
+void StorageWriter::Shutdown()
+{
+    {
+        BAutolock lock(fLock);
+        if (fQuitting)
+            return;
+        fQuitting = true;
+    }
+
+    // Whatever is still queued is written once the thread is gone
+    release_sem(fWakeSem);
+    if (fThread >= 0) {
+        status_t result;
+        wait_for_thread(fThread, &result);
+    }
+
+    _WritePending();
+    BFSStorage::GetInstance()->Checkpoint();
+    BFSStorage::GetInstance()->CompactUsage();
+
+    delete_sem(fWakeSem);
+    delete_sem(fRoomSem);
+}
+
+void StorageWriter::SaveChat(Chat* chat)
+{
+    if (chat == NULL)
+        return;
+
+    ChatSnapshot snapshot;
+    BFSStorage::GetInstance()->PrepareSave(chat, &snapshot);
+
+    _WaitForRoom();
+
+    {
+        BAutolock lock(fLock);
+        if (!fQuitting && fThread >= 0) {
+            // A newer snapshot of a chat holds everything an older one does
+            std::map<BString, ChatSnapshot>::iterator found
+                = fPendingChats.find(snapshot.id);
+            if (found != fPendingChats.end()) {
+                found->second = snapshot;
+                fCoalescedSaves++;
+                return;
+            }
+
+            if (fPendingChats.empty() && fPendingUsage.empty())
+                fOldestPending = system_time();
+            fPendingChats[snapshot.id] = snapshot;
+            release_sem(fWakeSem);
+            return;
+        }
+    }
+
+    // No writer thread (any more)
+    BFSStorage::GetInstance()->SaveChat(snapshot);
+}
+
+void StorageWriter::SaveUsageStats(const BString& provider, const BString& model,
+                                   int32 inputTokens, int32 outputTokens)
+{
+    _WaitForRoom();
+
+    {
+        BAutolock lock(fLock);
+        if (!fQuitting && fThread >= 0) {
+            UsageRecord record;
+            record.provider = provider;
+            record.model = model;
+            record.inputTokens = inputTokens;
+            record.outputTokens = outputTokens;
+
+            if (fPendingChats.empty() && fPendingUsage.empty())
+                fOldestPending = system_time();
+            fPendingUsage.push_back(record);
+            release_sem(fWakeSem);
+            return;
+        }
+    }
+
+    BFSStorage::GetInstance()->SaveUsageStats(provider, model, inputTokens,
+        outputTokens);
+}
+
+void StorageWriter::LoadMessages(const BString& chatID, int32 offset,
+                                 int32 count, const BMessenger& target)
+{
+    LoadRequest request;
+    request.chatID = chatID;
+    request.offset = offset;
+    request.count = count;
+    request.target = target;
+
+    {
+        BAutolock lock(fLock);
+        if (!fQuitting && fThread >= 0) {
+            fPendingLoads.push_back(request);
+            release_sem(fWakeSem);
+            return;
+        }
+    }
+
+    _Load(request);
+}
+
+void StorageWriter::Flush()
+{
+    _WritePending();
+}
+
+int32 StorageWriter::QueueDepth()
+{
+    BAutolock lock(fLock);
+    return fPendingChats.size() + fPendingUsage.size();
+}
+
+void StorageWriter::_WaitForRoom()
+{
+    // Chat saves rarely count here, since they coalesce; this keeps a
+    // stalled disk from growing the usage backlog without limit
+    while (true) {
+        {
+            BAutolock lock(fLock);
+            if (fQuitting || fThread < 0
+                || (int32)(fPendingChats.size() + fPendingUsage.size())
+                    < kMaxQueueDepth) {
+                return;
+            }
+            fWaitingForRoom++;
+        }
+
+        release_sem(fWakeSem);
+        acquire_sem(fRoomSem);
+    }
+}
+
+int32 StorageWriter::_WriterThread(void* data)
+{
+    static_cast<StorageWriter*>(data)->_WriterLoop();
+    return 0;
+}
+
+void StorageWriter::_WriterLoop()
+{
+    while (true) {
+        bigtime_t timeout = B_INFINITE_TIMEOUT;
+        std::vector<LoadRequest> loads;
+        {
+            BAutolock lock(fLock);
+            if (fQuitting)
+                break;
+
+            // Somebody is waiting for these
+            loads.swap(fPendingLoads);
+
+            // Hold back until the oldest entry has waited out the delay,
+            // unless someone is blocked on a full queue
+            if (!fPendingChats.empty() || !fPendingUsage.empty()) {
+                timeout = fOldestPending + kCoalesceDelay - system_time();
+                if (fWaitingForRoom > 0 || timeout <= 0)
+                    timeout = 0;
+            }
+        }
+
+        if (!loads.empty()) {
+            for (size_t i = 0; i < loads.size(); i++)
+                _Load(loads[i]);
+            continue;
+        }
+
+        if (timeout != 0) {
+            status_t status = acquire_sem_etc(fWakeSem, 1, B_RELATIVE_TIMEOUT,
+                timeout);
+            if (status == B_OK)
+                continue;
+            if (status != B_TIMED_OUT && status != B_WOULD_BLOCK)
+                break;
+        }
+
+        _WritePending();
+    }
+}
+
+void StorageWriter::_WritePending()
+{
+    BAutolock writeLock(fWriteLock);
+
+    std::map<BString, ChatSnapshot> chats;
+    std::vector<UsageRecord> usage;
+    {
+        BAutolock lock(fLock);
+        chats.swap(fPendingChats);
+        usage.swap(fPendingUsage);
+
+        // Everybody waiting for room can go on
+        if (fWaitingForRoom > 0) {
+            release_sem_etc(fRoomSem, fWaitingForRoom, 0);
+            fWaitingForRoom = 0;
+        }
+    }
+
+    if (chats.empty() && usage.empty())
+        return;
+
+    bigtime_t start = system_time();
+    BFSStorage* storage = BFSStorage::GetInstance();
+
+    // One journal write covers all chats of the batch
+    if (!chats.empty()) {
+        std::vector<ChatSnapshot> snapshots;
+        snapshots.reserve(chats.size());
+        for (std::map<BString, ChatSnapshot>::iterator it = chats.begin();
+                it != chats.end(); it++) {
+            snapshots.push_back(it->second);
+        }
+        storage->SaveChats(snapshots);
+    }
+
+    for (size_t i = 0; i < usage.size(); i++) {
+        const UsageRecord& record = usage[i];
+        storage->SaveUsageStats(record.provider, record.model,
+            record.inputTokens, record.outputTokens);
+    }
+
+    // Fold the usage events into the rollups once enough have piled up
+    if (!usage.empty() && storage->PendingUsageEvents() >= kCompactThreshold)
+        storage->CompactUsage();
+
+    bigtime_t latency = system_time() - start;
+    fLastFlushLatency = latency;
+    if (latency > fMaxFlushLatency)
+        fMaxFlushLatency = latency;
+}
+
+void StorageWriter::_Load(const LoadRequest& request)
+{
+    BObjectList<ChatMessage>* messages
+        = new BObjectList<ChatMessage>(request.count);
+    status_t status = BFSStorage::GetInstance()->LoadMessages(request.chatID,
+        request.offset, request.count, messages);
+
+    BMessage reply(MSG_MESSAGES_LOADED);
+    reply.AddString("chat", request.chatID);
+    reply.AddInt32("offset", request.offset);
+    reply.AddInt32("status", status);
+    if (status == B_OK)
+        reply.AddPointer("messages", messages);
+    else {
+        delete messages;
+        messages = NULL;
+    }
+
+    // Nobody to hand the messages to
+    if (request.target.SendMessage(&reply) != B_OK && messages != NULL) {
+        for (int32 i = 0; i < messages->CountItems(); i++)
+            messages->ItemAt(i)->ReleaseReference();
+        delete messages;
+    }
+}
@@ -0,0 +1,109 @@
+// StorageWriter.h
+#ifndef STORAGE_WRITER_H
+#define STORAGE_WRITER_H
+
+#include <String.h>
+#include <Locker.h>
+#include <Messenger.h>
+#include <OS.h>
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include "BFSStorage.h"
+
+// Reply to StorageWriter::LoadMessages(), with the "chat" ID, the
+// "offset" and the "status" of the load. If that is B_OK, "messages" is a
+// BObjectList<ChatMessage>*, which the receiver takes over along with a
+// reference to every message in it.
+const uint32 MSG_MESSAGES_LOADED = 'mlod';
+
+// Moves BFSStorage writes off the window thread. Saves of the same chat
+// that arrive within the coalescing delay are written once, with the
+// newest snapshot, and usage records are written in batches. Messages a
+// chat has left on disk are read on the same thread, ahead of any write. The queue is
+// bounded: when it is full, callers wait for the writer to catch up.
+class StorageWriter {
+public:
+    static StorageWriter* GetInstance();
+
+    // Both take what they need right away and return without touching
+    // the disk
+    void SaveChat(Chat* chat);
+    void SaveUsageStats(const BString& provider, const BString& model,
+                        int32 inputTokens, int32 outputTokens);
+
+    // Reads count messages of a loaded chat, from the one at offset on,
+    // and sends them to target in a MSG_MESSAGES_LOADED
+    void LoadMessages(const BString& chatID, int32 offset, int32 count,
+                      const BMessenger& target);
+
+    // Writes everything queued before returning; call it before quitting
+    void Flush();
+
+    // Stops the writer thread after a final flush
+    void Shutdown();
+
+    // Chat saves plus usage records waiting to be written
+    int32 QueueDepth();
+
+    // Duration of the last and of the slowest batch write
+    bigtime_t LastFlushLatency() const { return fLastFlushLatency; }
+    bigtime_t MaxFlushLatency() const { return fMaxFlushLatency; }
+
+    // Saves that were folded into a later save of the same chat
+    int64 CoalescedSaves() const { return fCoalescedSaves; }
+
+private:
+    StorageWriter();
+    ~StorageWriter();
+
+    struct UsageRecord {
+        BString provider;
+        BString model;
+        int32 inputTokens;
+        int32 outputTokens;
+    };
+
+    struct LoadRequest {
+        BString chatID;
+        int32 offset;
+        int32 count;
+        BMessenger target;
+    };
+
+    static int32 _WriterThread(void* data);
+    void _WriterLoop();
+    void _WaitForRoom();
+    void _WritePending();
+    static void _Load(const LoadRequest& request);
+
+    static const int32 kMaxQueueDepth = 64;
+    static const bigtime_t kCoalesceDelay = 250000;
+    static const int32 kCompactThreshold = 256;
+
+    static StorageWriter* sInstance;
+
+    BLocker fLock;
+    sem_id fWakeSem;
+    sem_id fRoomSem;
+
+    // Serializes batch writes between the thread and Flush()
+    BLocker fWriteLock;
+
+    std::map<BString, ChatSnapshot> fPendingChats;
+    std::vector<UsageRecord> fPendingUsage;
+    std::vector<LoadRequest> fPendingLoads;
+    bigtime_t fOldestPending;
+    int32 fWaitingForRoom;
+
+    thread_id fThread;
+    bool fQuitting;
+
+    std::atomic<bigtime_t> fLastFlushLatency;
+    std::atomic<bigtime_t> fMaxFlushLatency;
+    std::atomic<int64> fCoalescedSaves;
+};
+
+#endif // STORAGE_WRITER_H
@@ -0,0 +1,182 @@
+// SyntaxHighlighter.cpp
+#include "SyntaxHighlighter.h"
+
+#include <Autolock.h>
+#include <Message.h>
+#include <stdio.h>
+
+SyntaxHighlighter* SyntaxHighlighter::sInstance = NULL;
+
+SyntaxHighlighter* SyntaxHighlighter::GetInstance()
+{
+    if (sInstance == NULL)
+        sInstance = new SyntaxHighlighter();
+
+    return sInstance;
+}
+
+SyntaxHighlighter::SyntaxHighlighter()
+    : fLock("syntax highlighter")
+    , fWakeSem(create_sem(0, "syntax highlighter wake"))
+    , fCachedTokens(0)
+    , fQuitting(false)
+{
+    fThread = spawn_thread(_HighlightThread, "syntax highlighter",
+        B_LOW_PRIORITY, this);
+    if (fThread >= 0)
+        resume_thread(fThread);
+    else
+        printf("Failed to spawn the syntax highlighter, code stays plain\n");
+}
+
+SyntaxHighlighter::~SyntaxHighlighter()
+{
+    Shutdown();
+}
+
+void SyntaxHighlighter::Shutdown()
+{
+    {
+        BAutolock lock(fLock);
+        if (fQuitting)
+            return;
+        fQuitting = true;
+        fJobs.clear();
+        fWaiting.clear();
+    }
+
+    release_sem(fWakeSem);
+    if (fThread >= 0) {
+        status_t result;
+        wait_for_thread(fThread, &result);
+    }
+
+    delete_sem(fWakeSem);
+}
+
+uint64 SyntaxHighlighter::Hash(const std::string& language, const std::string& code)
+{
+    // FNV-1a over the language, a separator and the code
+    uint64 hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < language.size(); i++)
+        hash = (hash ^ (uint8)language[i]) * 1099511628211ULL;
+    hash = (hash ^ 0) * 1099511628211ULL;
+    for (size_t i = 0; i < code.size(); i++)
+        hash = (hash ^ (uint8)code[i]) * 1099511628211ULL;
+    return hash;
+}
+
+bool SyntaxHighlighter::Lookup(uint64 hash, std::vector<CodeLexer::Token>* tokens)
+{
+    BAutolock lock(fLock);
+
+    std::map<uint64, Entry>::iterator found = fCache.find(hash);
+    if (found == fCache.end())
+        return false;
+
+    fRecent.splice(fRecent.begin(), fRecent, found->second.recent);
+    *tokens = found->second.tokens;
+    return true;
+}
+
+bool SyntaxHighlighter::Request(uint64 hash, const std::string& language,
+    const std::string& code, const BMessenger& target)
+{
+    const CodeLexer::Language* lexer = CodeLexer::FindLanguage(language);
+    if (lexer == NULL)
+        return false;
+
+    BAutolock lock(fLock);
+    if (fQuitting || fThread < 0)
+        return false;
+
+    if (fCache.find(hash) != fCache.end()) {
+        BMessage done(MSG_HIGHLIGHT_DONE);
+        done.AddUInt64("hash", hash);
+        target.SendMessage(&done);
+        return true;
+    }
+
+    // A block requested again before it is done is lexed once, and
+    // everyone who asked is told
+    std::vector<BMessenger>& waiting = fWaiting[hash];
+    if (waiting.empty()) {
+        Job job;
+        job.hash = hash;
+        job.language = lexer;
+        job.code = code;
+        fJobs.push_back(job);
+        release_sem(fWakeSem);
+    }
+    waiting.push_back(target);
+
+    return true;
+}
+
+int32 SyntaxHighlighter::_HighlightThread(void* data)
+{
+    static_cast<SyntaxHighlighter*>(data)->_HighlightLoop();
+    return 0;
+}
+
+void SyntaxHighlighter::_HighlightLoop()
+{
+    while (true) {
+        status_t status = acquire_sem(fWakeSem);
+        if (status == B_INTERRUPTED)
+            continue;
+        if (status != B_OK)
+            break;
+
+        Job job;
+        {
+            BAutolock lock(fLock);
+            if (fQuitting)
+                break;
+            if (fJobs.empty())
+                continue;
+            job = fJobs.front();
+            fJobs.pop_front();
+        }
+
+        std::vector<CodeLexer::Token> tokens;
+        CodeLexer::Lex(job.language, job.code.data(), job.code.size(), &tokens);
+
+        std::vector<BMessenger> waiting;
+        {
+            BAutolock lock(fLock);
+            _Store(job.hash, tokens);
+            std::map<uint64, std::vector<BMessenger> >::iterator found
+                = fWaiting.find(job.hash);
+            if (found != fWaiting.end()) {
+                waiting.swap(found->second);
+                fWaiting.erase(found);
+            }
+        }
+
+        BMessage done(MSG_HIGHLIGHT_DONE);
+        done.AddUInt64("hash", job.hash);
+        for (size_t i = 0; i < waiting.size(); i++)
+            waiting[i].SendMessage(&done);
+    }
+}
+
+void SyntaxHighlighter::_Store(uint64 hash, std::vector<CodeLexer::Token>& tokens)
+{
+    if (fCache.find(hash) != fCache.end())
+        return;
+
+    fRecent.push_front(hash);
+    Entry& entry = fCache[hash];
+    entry.tokens.swap(tokens);
+    entry.recent = fRecent.begin();
+    fCachedTokens += entry.tokens.size();
+
+    // The block just stored stays, however large it is
+    while (fCachedTokens > kMaxCachedTokens && fRecent.size() > 1) {
+        std::map<uint64, Entry>::iterator oldest = fCache.find(fRecent.back());
+        fCachedTokens -= oldest->second.tokens.size();
+        fCache.erase(oldest);
+        fRecent.pop_back();
+    }
+}
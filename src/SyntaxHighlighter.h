@@ -0,0 +1,83 @@
+// SyntaxHighlighter.h
+#ifndef SYNTAX_HIGHLIGHTER_H
+#define SYNTAX_HIGHLIGHTER_H
+
+#include <Locker.h>
+#include <Messenger.h>
+#include <OS.h>
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CodeLexer.h"
+
+// Sent to the requester once the tokens of a code block are in the cache,
+// with the block's hash as "hash"
+const uint32 MSG_HIGHLIGHT_DONE = 'hldn';
+
+// Lexes code blocks on a thread of its own, so that highlighting large
+// code never holds up the window thread. Tokens are cached by a hash of
+// the language and the code: a block that was highlighted once, in any
+// message of any chat, is not lexed again while it stays in the cache.
+class SyntaxHighlighter {
+public:
+    static SyntaxHighlighter* GetInstance();
+
+    static uint64 Hash(const std::string& language, const std::string& code);
+
+    // Copies the tokens of the block and returns true if they are cached
+    bool Lookup(uint64 hash, std::vector<CodeLexer::Token>* tokens);
+
+    // Queues the block for lexing; target gets MSG_HIGHLIGHT_DONE when it
+    // is done. Returns false if the language has no lexer.
+    bool Request(uint64 hash, const std::string& language,
+                 const std::string& code, const BMessenger& target);
+
+    // Stops the thread; requests after this are dropped
+    void Shutdown();
+
+private:
+    SyntaxHighlighter();
+    ~SyntaxHighlighter();
+
+    struct Job {
+        uint64 hash;
+        const CodeLexer::Language* language;
+        std::string code;
+    };
+
+    struct Entry {
+        std::vector<CodeLexer::Token> tokens;
+        std::list<uint64>::iterator recent;
+    };
+
+    static int32 _HighlightThread(void* data);
+    void _HighlightLoop();
+    void _Store(uint64 hash, std::vector<CodeLexer::Token>& tokens);
+
+    // Tokens kept before the least recently used blocks are dropped,
+    // about 12 bytes each
+    static const size_t kMaxCachedTokens = 1024 * 1024;
+
+    static SyntaxHighlighter* sInstance;
+
+    BLocker fLock;
+    sem_id fWakeSem;
+
+    std::deque<Job> fJobs;
+    // Who to tell about each block queued or being lexed
+    std::map<uint64, std::vector<BMessenger> > fWaiting;
+
+    // Most recently used first
+    std::map<uint64, Entry> fCache;
+    std::list<uint64> fRecent;
+    size_t fCachedTokens;
+
+    thread_id fThread;
+    bool fQuitting;
+};
+
+#endif // SYNTAX_HIGHLIGHTER_H
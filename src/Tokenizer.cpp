@@ -0,0 +1,856 @@
+// Tokenizer.cpp
+#include "Tokenizer.h"
+#include "LLMModel.h"
+
+#include <FindDirectory.h>
+#include <Path.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32 kNoRank = 0xffffffff;
+
+// Character classes of the pre-tokenizers. o200k_base tells upper and
+// lower case letters apart, cl100k_base only letters from the rest.
+enum {
+    CLASS_OTHER = 0,
+    CLASS_UPPER,
+    CLASS_LOWER,
+    // Letters without case, which go with either (\p{Lm}, \p{Lo})
+    CLASS_LETTER,
+    // Combining marks: letters to o200k_base, punctuation to cl100k_base
+    CLASS_MARK,
+    CLASS_DIGIT,
+    CLASS_SPACE,
+    CLASS_NEWLINE,
+
+    // Only in kCharRanges, for blocks where the case alternates
+    CLASS_EVEN_UPPER,
+    CLASS_ODD_UPPER
+};
+
+struct AsciiClasses {
+    uint8 table[128];
+
+    AsciiClasses()
+    {
+        for (int32 c = 0; c < 128; c++) {
+            if (c >= 'a' && c <= 'z')
+                table[c] = CLASS_LOWER;
+            else if (c >= 'A' && c <= 'Z')
+                table[c] = CLASS_UPPER;
+            else if (c >= '0' && c <= '9')
+                table[c] = CLASS_DIGIT;
+            else if (c == ' ' || c == '\t' || c == '\v' || c == '\f')
+                table[c] = CLASS_SPACE;
+            else if (c == '\r' || c == '\n')
+                table[c] = CLASS_NEWLINE;
+            else
+                table[c] = CLASS_OTHER;
+        }
+    }
+};
+
+static const AsciiClasses sAsciiClasses;
+
+struct CharRange {
+    uint32 first;
+    uint32 last;
+    uint8 charClass;
+};
+
+// Non-ASCII characters that are not caseless letters, by the Unicode
+// character database: the cased alphabets of Europe, marks, digits,
+// white space, punctuation and symbols. Anything not listed counts as a
+// caseless letter, which is right for CJK, Hangul and most other scripts;
+// rarer symbol blocks and cased alphabets come out close, not exact.
+static const CharRange kCharRanges[] = {
+    { 0x0085, 0x0085, CLASS_SPACE },
+    { 0x00a0, 0x00a0, CLASS_SPACE },
+    { 0x00a1, 0x00a9, CLASS_OTHER },
+    { 0x00ab, 0x00b1, CLASS_OTHER },
+    { 0x00b2, 0x00b3, CLASS_DIGIT },
+    { 0x00b4, 0x00b4, CLASS_OTHER },
+    { 0x00b5, 0x00b5, CLASS_LOWER },
+    { 0x00b6, 0x00b8, CLASS_OTHER },
+    { 0x00b9, 0x00b9, CLASS_DIGIT },
+    { 0x00bb, 0x00bb, CLASS_OTHER },
+    { 0x00bc, 0x00be, CLASS_DIGIT },
+    { 0x00bf, 0x00bf, CLASS_OTHER },
+    { 0x00c0, 0x00d6, CLASS_UPPER },
+    { 0x00d7, 0x00d7, CLASS_OTHER },
+    { 0x00d8, 0x00de, CLASS_UPPER },
+    { 0x00df, 0x00f6, CLASS_LOWER },
+    { 0x00f7, 0x00f7, CLASS_OTHER },
+    { 0x00f8, 0x00ff, CLASS_LOWER },
+    { 0x0100, 0x0137, CLASS_EVEN_UPPER },
+    { 0x0138, 0x0138, CLASS_LOWER },
+    { 0x0139, 0x0148, CLASS_ODD_UPPER },
+    { 0x0149, 0x0149, CLASS_LOWER },
+    { 0x014a, 0x0177, CLASS_EVEN_UPPER },
+    { 0x0178, 0x0178, CLASS_UPPER },
+    { 0x0179, 0x017e, CLASS_ODD_UPPER },
+    { 0x017f, 0x017f, CLASS_LOWER },
+    { 0x01c5, 0x01c5, CLASS_UPPER },
+    { 0x01c8, 0x01c8, CLASS_UPPER },
+    { 0x01cb, 0x01cb, CLASS_UPPER },
+    { 0x01f2, 0x01f2, CLASS_UPPER },
+    { 0x0250, 0x0293, CLASS_LOWER },
+    { 0x0295, 0x02af, CLASS_LOWER },
+    { 0x02c2, 0x02c5, CLASS_OTHER },
+    { 0x02d2, 0x02df, CLASS_OTHER },
+    { 0x02e5, 0x02eb, CLASS_OTHER },
+    { 0x02ed, 0x02ed, CLASS_OTHER },
+    { 0x02ef, 0x02ff, CLASS_OTHER },
+    { 0x0300, 0x036f, CLASS_MARK },
+    { 0x037e, 0x037e, CLASS_OTHER },
+    { 0x0384, 0x0385, CLASS_OTHER },
+    { 0x0386, 0x0386, CLASS_UPPER },
+    { 0x0387, 0x0387, CLASS_OTHER },
+    { 0x0388, 0x038f, CLASS_UPPER },
+    { 0x0390, 0x0390, CLASS_LOWER },
+    { 0x0391, 0x03ab, CLASS_UPPER },
+    { 0x03ac, 0x03ce, CLASS_LOWER },
+    { 0x0400, 0x042f, CLASS_UPPER },
+    { 0x0430, 0x045f, CLASS_LOWER },
+    { 0x0460, 0x0481, CLASS_EVEN_UPPER },
+    { 0x0482, 0x0482, CLASS_OTHER },
+    { 0x0483, 0x0489, CLASS_MARK },
+    { 0x048a, 0x04bf, CLASS_EVEN_UPPER },
+    { 0x04c0, 0x04c0, CLASS_UPPER },
+    { 0x04c1, 0x04ce, CLASS_ODD_UPPER },
+    { 0x04cf, 0x04cf, CLASS_LOWER },
+    { 0x04d0, 0x052f, CLASS_EVEN_UPPER },
+    { 0x0591, 0x05bd, CLASS_MARK },
+    { 0x05be, 0x05be, CLASS_OTHER },
+    { 0x05bf, 0x05bf, CLASS_MARK },
+    { 0x05c0, 0x05c0, CLASS_OTHER },
+    { 0x05c1, 0x05c2, CLASS_MARK },
+    { 0x05c3, 0x05c3, CLASS_OTHER },
+    { 0x05c4, 0x05c5, CLASS_MARK },
+    { 0x05c6, 0x05c6, CLASS_OTHER },
+    { 0x05c7, 0x05c7, CLASS_MARK },
+    { 0x0600, 0x060f, CLASS_OTHER },
+    { 0x0610, 0x061a, CLASS_MARK },
+    { 0x061b, 0x061f, CLASS_OTHER },
+    { 0x064b, 0x065f, CLASS_MARK },
+    { 0x0660, 0x0669, CLASS_DIGIT },
+    { 0x066a, 0x066d, CLASS_OTHER },
+    { 0x0670, 0x0670, CLASS_MARK },
+    { 0x06d4, 0x06d4, CLASS_OTHER },
+    { 0x06d6, 0x06dc, CLASS_MARK },
+    { 0x06dd, 0x06de, CLASS_OTHER },
+    { 0x06df, 0x06e4, CLASS_MARK },
+    { 0x06e7, 0x06e8, CLASS_MARK },
+    { 0x06e9, 0x06e9, CLASS_OTHER },
+    { 0x06ea, 0x06ed, CLASS_MARK },
+    { 0x06f0, 0x06f9, CLASS_DIGIT },
+    { 0x0900, 0x0903, CLASS_MARK },
+    { 0x093a, 0x093c, CLASS_MARK },
+    { 0x093e, 0x094f, CLASS_MARK },
+    { 0x0951, 0x0957, CLASS_MARK },
+    { 0x0962, 0x0963, CLASS_MARK },
+    { 0x0964, 0x0965, CLASS_OTHER },
+    { 0x0966, 0x096f, CLASS_DIGIT },
+    { 0x0970, 0x0970, CLASS_OTHER },
+    { 0x0e31, 0x0e31, CLASS_MARK },
+    { 0x0e34, 0x0e3a, CLASS_MARK },
+    { 0x0e3f, 0x0e3f, CLASS_OTHER },
+    { 0x0e47, 0x0e4e, CLASS_MARK },
+    { 0x0e4f, 0x0e4f, CLASS_OTHER },
+    { 0x0e50, 0x0e59, CLASS_DIGIT },
+    { 0x0e5a, 0x0e5b, CLASS_OTHER },
+    { 0x1680, 0x1680, CLASS_SPACE },
+    { 0x1ab0, 0x1aff, CLASS_MARK },
+    { 0x1dc0, 0x1dff, CLASS_MARK },
+    { 0x1e00, 0x1e95, CLASS_EVEN_UPPER },
+    { 0x1e96, 0x1e9d, CLASS_LOWER },
+    { 0x1e9e, 0x1e9e, CLASS_UPPER },
+    { 0x1e9f, 0x1e9f, CLASS_LOWER },
+    { 0x1ea0, 0x1eff, CLASS_EVEN_UPPER },
+    { 0x2000, 0x200a, CLASS_SPACE },
+    { 0x200b, 0x2027, CLASS_OTHER },
+    { 0x2028, 0x2029, CLASS_SPACE },
+    { 0x202a, 0x202e, CLASS_OTHER },
+    { 0x202f, 0x202f, CLASS_SPACE },
+    { 0x2030, 0x205e, CLASS_OTHER },
+    { 0x205f, 0x205f, CLASS_SPACE },
+    { 0x2060, 0x206f, CLASS_OTHER },
+    { 0x2070, 0x2070, CLASS_DIGIT },
+    { 0x2074, 0x2079, CLASS_DIGIT },
+    { 0x207a, 0x207e, CLASS_OTHER },
+    { 0x2080, 0x2089, CLASS_DIGIT },
+    { 0x208a, 0x208e, CLASS_OTHER },
+    { 0x20a0, 0x20cf, CLASS_OTHER },
+    { 0x20d0, 0x20ff, CLASS_MARK },
+    { 0x2122, 0x2122, CLASS_OTHER },
+    { 0x2150, 0x2182, CLASS_DIGIT },
+    { 0x2190, 0x245f, CLASS_OTHER },
+    { 0x2460, 0x249b, CLASS_DIGIT },
+    { 0x249c, 0x24e9, CLASS_OTHER },
+    { 0x24ea, 0x24ff, CLASS_DIGIT },
+    { 0x2500, 0x2775, CLASS_OTHER },
+    { 0x2776, 0x2793, CLASS_DIGIT },
+    { 0x2794, 0x2bff, CLASS_OTHER },
+    { 0x2e00, 0x2e7f, CLASS_OTHER },
+    { 0x2e80, 0x2fff, CLASS_OTHER },
+    { 0x3000, 0x3000, CLASS_SPACE },
+    { 0x3001, 0x3004, CLASS_OTHER },
+    { 0x3007, 0x3007, CLASS_DIGIT },
+    { 0x3008, 0x3020, CLASS_OTHER },
+    { 0x3021, 0x3029, CLASS_DIGIT },
+    { 0x302a, 0x302f, CLASS_MARK },
+    { 0x3030, 0x3030, CLASS_OTHER },
+    { 0x3099, 0x309a, CLASS_MARK },
+    { 0x309b, 0x309c, CLASS_OTHER },
+    { 0x30fb, 0x30fb, CLASS_OTHER },
+    { 0x3200, 0x321f, CLASS_OTHER },
+    { 0x3220, 0x3229, CLASS_DIGIT },
+    { 0x322a, 0x3247, CLASS_OTHER },
+    { 0x3248, 0x324f, CLASS_DIGIT },
+    { 0x3250, 0x3250, CLASS_OTHER },
+    { 0x3251, 0x325f, CLASS_DIGIT },
+    { 0x3260, 0x327f, CLASS_OTHER },
+    { 0x3280, 0x3289, CLASS_DIGIT },
+    { 0x328a, 0x32b0, CLASS_OTHER },
+    { 0x32b1, 0x32bf, CLASS_DIGIT },
+    { 0x32c0, 0x33ff, CLASS_OTHER },
+    { 0xe000, 0xf8ff, CLASS_OTHER },
+    { 0xfe00, 0xfe0f, CLASS_MARK },
+    { 0xfe10, 0xfe19, CLASS_OTHER },
+    { 0xfe20, 0xfe2f, CLASS_MARK },
+    { 0xfe30, 0xfe6f, CLASS_OTHER },
+    { 0xfeff, 0xfeff, CLASS_OTHER },
+    { 0xff01, 0xff0f, CLASS_OTHER },
+    { 0xff10, 0xff19, CLASS_DIGIT },
+    { 0xff1a, 0xff20, CLASS_OTHER },
+    { 0xff21, 0xff3a, CLASS_UPPER },
+    { 0xff3b, 0xff40, CLASS_OTHER },
+    { 0xff41, 0xff5a, CLASS_LOWER },
+    { 0xff5b, 0xff65, CLASS_OTHER },
+    { 0xffe0, 0xffee, CLASS_OTHER },
+    { 0xfff9, 0xfffd, CLASS_OTHER },
+    { 0x1d000, 0x1d24f, CLASS_OTHER },
+    { 0x1f000, 0x1f0ff, CLASS_OTHER },
+    { 0x1f100, 0x1f10c, CLASS_DIGIT },
+    { 0x1f10d, 0x1fbef, CLASS_OTHER },
+    { 0x1fbf0, 0x1fbf9, CLASS_DIGIT },
+    { 0xe0001, 0xe007f, CLASS_OTHER },
+    { 0xe0100, 0xe01ef, CLASS_MARK }
+};
+
+static uint8 CodePointClass(uint32 codePoint)
+{
+    const CharRange* end = kCharRanges
+        + sizeof(kCharRanges) / sizeof(kCharRanges[0]);
+    const CharRange* range = std::upper_bound(kCharRanges, end, codePoint,
+        [](uint32 codePoint, const CharRange& range) {
+            return codePoint < range.first;
+        });
+    if (range == kCharRanges || codePoint > (--range)->last)
+        return CLASS_LETTER;
+
+    if (range->charClass == CLASS_EVEN_UPPER)
+        return (codePoint & 1) == 0 ? CLASS_UPPER : CLASS_LOWER;
+    if (range->charClass == CLASS_ODD_UPPER)
+        return (codePoint & 1) != 0 ? CLASS_UPPER : CLASS_LOWER;
+    return range->charClass;
+}
+
+// Class of the character at text[i], and its length in bytes. ASCII is a
+// table lookup; broken UTF-8 counts as letters, a byte at a time.
+static inline uint8 ClassAt(const char* text, int32 length, int32 i,
+    int32* size)
+{
+    uint8 c = (uint8)text[i];
+    *size = 1;
+    if (c < 0x80)
+        return sAsciiClasses.table[c];
+
+    int32 extra;
+    uint32 codePoint;
+    if (c >= 0xc2 && c <= 0xdf) {
+        extra = 1;
+        codePoint = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        extra = 2;
+        codePoint = c & 0x0f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        extra = 3;
+        codePoint = c & 0x07;
+    } else
+        return CLASS_LETTER;
+
+    if (i + extra >= length)
+        return CLASS_LETTER;
+    for (int32 j = 1; j <= extra; j++) {
+        uint8 next = (uint8)text[i + j];
+        if ((next & 0xc0) != 0x80)
+            return CLASS_LETTER;
+        codePoint = (codePoint << 6) | (next & 0x3f);
+    }
+
+    *size = extra + 1;
+    return CodePointClass(codePoint);
+}
+
+static inline bool IsLetter(uint8 charClass)
+{
+    return charClass == CLASS_UPPER || charClass == CLASS_LOWER
+        || charClass == CLASS_LETTER;
+}
+
+static inline bool IsWhitespace(uint8 charClass)
+{
+    return charClass == CLASS_SPACE || charClass == CLASS_NEWLINE;
+}
+
+static inline bool IsPunctuation(uint8 charClass)
+{
+    return charClass == CLASS_OTHER || charClass == CLASS_MARK;
+}
+
+static inline char ToLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Length of the contraction ('s, 't, 're, 've, 'm, 'll or 'd, in any case)
+// at text[i], or 0
+static int32 ContractionLength(const char* text, int32 length, int32 i)
+{
+    if (i + 1 >= length || text[i] != '\'')
+        return 0;
+
+    char next = ToLower(text[i + 1]);
+    if (next == 's' || next == 't' || next == 'm' || next == 'd')
+        return 2;
+    if (i + 2 < length) {
+        char after = ToLower(text[i + 2]);
+        if ((next == 'r' && after == 'e') || (next == 'v' && after == 'e')
+            || (next == 'l' && after == 'l'))
+            return 3;
+    }
+
+    return 0;
+}
+
+// End of the run of up to three digits at text[i]
+static int32 NumberEnd(const char* text, int32 length, int32 i)
+{
+    int32 size;
+    for (int32 digits = 0; digits < 3 && i < length
+            && ClassAt(text, length, i, &size) == CLASS_DIGIT; digits++)
+        i += size;
+    return i;
+}
+
+static int32 DecodeBase64(const char* in, int32 length, char* out)
+{
+    int32 written = 0;
+    uint32 bits = 0;
+    int32 bitCount = 0;
+    for (int32 i = 0; i < length; i++) {
+        char c = in[i];
+        uint32 value;
+        if (c >= 'A' && c <= 'Z')
+            value = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            value = c - '0' + 52;
+        else if (c == '+')
+            value = 62;
+        else if (c == '/')
+            value = 63;
+        else if (c == '=')
+            break;
+        else
+            return -1;
+
+        bits = (bits << 6) | value;
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            out[written++] = (char)((bits >> bitCount) & 0xff);
+        }
+    }
+
+    return written;
+}
+
+
+// #pragma mark - Tokenizer
+
+
+static std::atomic<int32> sNextTokenizerID(0);
+
+Tokenizer::Tokenizer(const char* name)
+    : fName(name)
+    , fID(sNextTokenizerID++)
+{
+}
+
+Tokenizer::~Tokenizer()
+{
+}
+
+static const std::vector<const Tokenizer*>& AllTokenizers()
+{
+    // Ratios calibrated against the input_tokens reported for English
+    // prose and source code; the BPE tokenizers fall back to the OpenAI one
+    static EstimatingTokenizer sOpenAIEstimate("openai-estimate", 4.0f);
+    static EstimatingTokenizer sAnthropicEstimate("anthropic-estimate", 3.5f);
+    static EstimatingTokenizer sGenericEstimate("generic-estimate", 3.8f);
+    static BPETokenizer sCL100K("cl100k_base", "cl100k_base.tiktoken",
+        BPETokenizer::CL100K_PATTERN, &sOpenAIEstimate);
+    static BPETokenizer sO200K("o200k_base", "o200k_base.tiktoken",
+        BPETokenizer::O200K_PATTERN, &sOpenAIEstimate);
+
+    static const std::vector<const Tokenizer*> sTokenizers = {
+        &sOpenAIEstimate, &sAnthropicEstimate, &sGenericEstimate,
+        &sCL100K, &sO200K
+    };
+    return sTokenizers;
+}
+
+const Tokenizer* Tokenizer::ForModel(const LLMModel* model)
+{
+    return ForModelName(model != NULL ? model->Name() : BString());
+}
+
+const Tokenizer* Tokenizer::ForModelName(const BString& name)
+{
+    const char* tokenizerName = "generic-estimate";
+    if (name.StartsWith("gpt-4o") || name.StartsWith("gpt-4.1")
+        || name.StartsWith("gpt-5") || name.StartsWith("o1")
+        || name.StartsWith("o3") || name.StartsWith("o4")) {
+        tokenizerName = "o200k_base";
+    } else if (name.StartsWith("gpt-") || name.StartsWith("text-")) {
+        tokenizerName = "cl100k_base";
+    } else if (name.IFindFirst("claude") >= 0) {
+        tokenizerName = "anthropic-estimate";
+    }
+
+    const Tokenizer* tokenizer = ForName(tokenizerName);
+
+    // Until its merge table is loaded a BPE tokenizer can only estimate,
+    // and counts it made that way must not pass for exact ones
+    const BPETokenizer* bpe = dynamic_cast<const BPETokenizer*>(tokenizer);
+    if (bpe != NULL && !bpe->IsAvailable())
+        tokenizer = ForName("openai-estimate");
+
+    return tokenizer;
+}
+
+const Tokenizer* Tokenizer::ForName(const char* name)
+{
+    const std::vector<const Tokenizer*>& tokenizers = AllTokenizers();
+    for (size_t i = 0; i < tokenizers.size(); i++) {
+        if (tokenizers[i]->Name() == name)
+            return tokenizers[i];
+    }
+
+    return NULL;
+}
+
+const Tokenizer* Tokenizer::ForID(int32 id)
+{
+    const std::vector<const Tokenizer*>& tokenizers = AllTokenizers();
+    for (size_t i = 0; i < tokenizers.size(); i++) {
+        if (tokenizers[i]->ID() == id)
+            return tokenizers[i];
+    }
+
+    return NULL;
+}
+
+void Tokenizer::LoadAll()
+{
+    const std::vector<const Tokenizer*>& tokenizers = AllTokenizers();
+    for (size_t i = 0; i < tokenizers.size(); i++) {
+        const BPETokenizer* bpe = dynamic_cast<const BPETokenizer*>(tokenizers[i]);
+        if (bpe != NULL)
+            bpe->Load();
+    }
+}
+
+
+// #pragma mark - EstimatingTokenizer
+
+
+EstimatingTokenizer::EstimatingTokenizer(const char* name, float charsPerToken)
+    : Tokenizer(name)
+    , fCharsPerToken(charsPerToken)
+{
+}
+
+int32 EstimatingTokenizer::CountTokens(const char* text, int32 length) const
+{
+    int32 wordChars = 0;
+    int32 tokens = 0;
+    for (int32 i = 0; i < length; i++) {
+        uint8 c = (uint8)text[i];
+        if (c < 0x80) {
+            uint8 byteClass = sAsciiClasses.table[c];
+            if (IsLetter(byteClass) || byteClass == CLASS_DIGIT)
+                wordChars++;
+            else if (byteClass == CLASS_OTHER || byteClass == CLASS_NEWLINE)
+                tokens++;
+        } else if (c >= 0xe0) {
+            // CJK and other three and four byte characters are mostly a
+            // token each
+            tokens++;
+        } else if (c >= 0xc0) {
+            wordChars++;
+        }
+    }
+
+    return tokens + (int32)(wordChars / fCharsPerToken + 0.999f);
+}
+
+
+// #pragma mark - BPETokenizer
+
+
+BPETokenizer::BPETokenizer(const char* name, const char* fileName,
+    Pattern pattern, const Tokenizer* fallback)
+    : Tokenizer(name)
+    , fFileName(fileName)
+    , fNextPiece(pattern == O200K_PATTERN ? _NextPieceO200K : _NextPieceCL100K)
+    , fFallback(fallback)
+    , fLoadStatus(B_NO_INIT)
+    , fLoaded(false)
+{
+}
+
+BPETokenizer::~BPETokenizer()
+{
+}
+
+bool BPETokenizer::IsAvailable() const
+{
+    return fLoaded.load(std::memory_order_acquire);
+}
+
+status_t BPETokenizer::Load(const char* path) const
+{
+    // Workers count tokens while the table is read; they only look at it
+    // once fLoaded is set
+    std::call_once(fLoadOnce, [this, path]() {
+        BPETokenizer* self = const_cast<BPETokenizer*>(this);
+        self->fLoadStatus = path != NULL ? self->_LoadFile(path) : self->_Load();
+        if (fLoadStatus == B_OK) {
+            self->fLoaded.store(true, std::memory_order_release);
+        } else {
+            printf("Tokenizer %s: no data file (%s), estimating instead\n",
+                Name().String(), strerror(fLoadStatus));
+        }
+    });
+
+    return fLoadStatus;
+}
+
+int32 BPETokenizer::CountTokens(const char* text, int32 length) const
+{
+    if (!IsAvailable())
+        return fFallback->CountTokens(text, length);
+
+    int32 tokens = 0;
+    int32 start = 0;
+    while (start < length) {
+        int32 end = fNextPiece(text, length, start);
+        tokens += _CountPiece(text + start, end - start);
+        start = end;
+    }
+
+    return tokens;
+}
+
+status_t BPETokenizer::_Load()
+{
+    // The user's data directory comes first, so a newer table can be
+    // dropped in without touching the system one
+    const directory_which directories[] = {
+        B_USER_DATA_DIRECTORY,
+        B_SYSTEM_DATA_DIRECTORY
+    };
+
+    for (size_t i = 0; i < sizeof(directories) / sizeof(directories[0]); i++) {
+        BPath path;
+        if (find_directory(directories[i], &path) != B_OK)
+            continue;
+        path.Append("Otto/Tokenizers");
+        path.Append(fFileName.String());
+
+        if (_LoadFile(path.Path()) == B_OK)
+            return B_OK;
+    }
+
+    return B_ENTRY_NOT_FOUND;
+}
+
+status_t BPETokenizer::_LoadFile(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return B_ENTRY_NOT_FOUND;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return B_BAD_DATA;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return B_NO_MEMORY;
+
+    status_t status = _ParseRanks((const char*)data, st.st_size);
+    munmap(data, st.st_size);
+    return status;
+}
+
+status_t BPETokenizer::_ParseRanks(const char* data, size_t size)
+{
+    // Decoded tokens are shorter than their base64 form, so one buffer of
+    // the file's size holds them all and never moves
+    fTokenBytes.resize(size);
+    fRanks.reserve(size / 12);
+
+    char* out = fTokenBytes.data();
+    const char* end = data + size;
+    const char* line = data;
+    while (line < end) {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        const char* space = (const char*)memchr(line, ' ', lineEnd - line);
+        if (space != NULL) {
+            int32 length = DecodeBase64(line, space - line, out);
+            if (length <= 0) {
+                fRanks.clear();
+                return B_BAD_DATA;
+            }
+
+            uint32 rank = strtoul(space + 1, NULL, 10);
+            fRanks.emplace(std::string_view(out, length), rank);
+            out += length;
+        }
+
+        line = lineEnd + 1;
+    }
+
+    return fRanks.empty() ? B_BAD_DATA : B_OK;
+}
+
+uint32 BPETokenizer::_Rank(const char* bytes, int32 length) const
+{
+    auto found = fRanks.find(std::string_view(bytes, length));
+    return found != fRanks.end() ? found->second : kNoRank;
+}
+
+int32 BPETokenizer::_CountPiece(const char* piece, int32 length) const
+{
+    // Most words of ordinary text are a token of their own
+    if (length == 1 || _Rank(piece, length) != kNoRank)
+        return 1;
+
+    // Otherwise merge the adjacent parts with the lowest rank until no
+    // pair is in the table; parts holds the start of every part
+    std::vector<int32> parts(length + 1);
+    for (int32 i = 0; i <= length; i++)
+        parts[i] = i;
+
+    std::vector<uint32> ranks(length - 1);
+    for (int32 i = 0; i < length - 1; i++)
+        ranks[i] = _Rank(piece + i, 2);
+
+    while (!ranks.empty()) {
+        size_t best = 0;
+        for (size_t i = 1; i < ranks.size(); i++) {
+            if (ranks[i] < ranks[best])
+                best = i;
+        }
+        if (ranks[best] == kNoRank)
+            break;
+
+        // Merge parts best and best + 1, then rank the new neighbours
+        parts.erase(parts.begin() + best + 1);
+        ranks.erase(ranks.begin() + best);
+
+        if (best + 2 < parts.size()) {
+            ranks[best] = _Rank(piece + parts[best],
+                parts[best + 2] - parts[best]);
+        }
+        if (best > 0) {
+            ranks[best - 1] = _Rank(piece + parts[best - 1],
+                parts[best + 1] - parts[best - 1]);
+        }
+    }
+
+    return parts.size() - 1;
+}
+
+int32 BPETokenizer::_NextPieceCL100K(const char* text, int32 length,
+    int32 start)
+{
+    // Hand-written form of cl100k_base's pre-tokenizer pattern:
+    //   '(?i:[sdmt]|ll|ve|re) | [^\r\n\p{L}\p{N}]?+\p{L}++ | \p{N}{1,3}+
+    //   | ?[^\s\p{L}\p{N}]++[\r\n]*+ | \s++$ | \s*[\r\n] | \s+(?!\S) | \s
+    // The alternatives are tried in this order, like the regex does
+    int32 i = start;
+    int32 size;
+    uint8 charClass = ClassAt(text, length, i, &size);
+
+    // Contractions
+    int32 contraction = ContractionLength(text, length, i);
+    if (contraction > 0)
+        return i + contraction;
+
+    // Words, with one leading space or punctuation character
+    int32 word = i;
+    if (!IsLetter(charClass) && charClass != CLASS_DIGIT
+        && charClass != CLASS_NEWLINE)
+        word += size;
+    int32 end = word;
+    while (end < length && IsLetter(ClassAt(text, length, end, &size)))
+        end += size;
+    if (end > word)
+        return end;
+
+    // Numbers, up to three digits per piece
+    if (charClass == CLASS_DIGIT)
+        return NumberEnd(text, length, i);
+
+    // Punctuation runs, with one leading space and trailing line breaks
+    end = text[i] == ' ' ? i + 1 : i;
+    if (end < length && IsPunctuation(ClassAt(text, length, end, &size))) {
+        while (end < length && IsPunctuation(ClassAt(text, length, end, &size)))
+            end += size;
+        while (end < length && ClassAt(text, length, end, &size) == CLASS_NEWLINE)
+            end += size;
+        return end;
+    }
+
+    // Whitespace: all of it at the end of the text, else up to and
+    // including its last line break, else all but the character that
+    // leads the next word
+    end = i;
+    int32 last = i;
+    int32 lastNewline = -1;
+    while (end < length) {
+        charClass = ClassAt(text, length, end, &size);
+        if (!IsWhitespace(charClass))
+            break;
+        if (charClass == CLASS_NEWLINE)
+            lastNewline = end;
+        last = end;
+        end += size;
+    }
+
+    if (end == length)
+        return end;
+    if (lastNewline >= 0)
+        return lastNewline + 1;
+    return last > i ? last : end;
+}
+
+int32 BPETokenizer::_NextPieceO200K(const char* text, int32 length,
+    int32 start)
+{
+    // Hand-written form of o200k_base's pre-tokenizer pattern:
+    //   [^\r\n\p{L}\p{N}]?[\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}]*[\p{Ll}\p{Lm}\p{Lo}\p{M}]+C?
+    //   | [^\r\n\p{L}\p{N}]?[\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}]+[\p{Ll}\p{Lm}\p{Lo}\p{M}]*C?
+    //   | \p{N}{1,3} | ?[^\s\p{L}\p{N}]+[\r\n/]* | \s*[\r\n]+ | \s+(?!\S) | \s+
+    // where C is (?i:'s|'t|'re|'ve|'m|'ll|'d). Unlike cl100k_base, words
+    // split where lower case turns to upper case and keep their
+    // contraction: "don't" and "helloWorld" are "don't", "hello", "World".
+    int32 i = start;
+    int32 size;
+    uint8 charClass = ClassAt(text, length, i, &size);
+
+    // Words, with one leading space or punctuation character. Marks are
+    // part of words here, never the character that leads one.
+    int32 word = i;
+    if (charClass == CLASS_OTHER || charClass == CLASS_SPACE)
+        word += size;
+
+    // Upper case and caseless letters first
+    int32 end = word;
+    int32 caselessEnd = -1;
+    while (end < length) {
+        charClass = ClassAt(text, length, end, &size);
+        if (charClass != CLASS_UPPER && charClass != CLASS_LETTER
+            && charClass != CLASS_MARK)
+            break;
+        end += size;
+        if (charClass != CLASS_UPPER)
+            caselessEnd = end;
+    }
+
+    if (end < length && ClassAt(text, length, end, &size) == CLASS_LOWER) {
+        // Then lower case and caseless ones
+        end += size;
+        while (end < length) {
+            charClass = ClassAt(text, length, end, &size);
+            if (charClass != CLASS_LOWER && charClass != CLASS_LETTER
+                && charClass != CLASS_MARK)
+                break;
+            end += size;
+        }
+    } else if (caselessEnd > 0) {
+        // The first alternative needs a lower case letter at the end, and
+        // backs up to the last caseless one, which counts as lower case
+        end = caselessEnd;
+    }
+
+    if (end > word)
+        return end + ContractionLength(text, length, end);
+
+    // Numbers, up to three digits per piece
+    charClass = ClassAt(text, length, i, &size);
+    if (charClass == CLASS_DIGIT)
+        return NumberEnd(text, length, i);
+
+    // Punctuation runs, with one leading space and trailing line breaks
+    // and slashes
+    end = text[i] == ' ' ? i + 1 : i;
+    if (end < length && IsPunctuation(ClassAt(text, length, end, &size))) {
+        while (end < length && IsPunctuation(ClassAt(text, length, end, &size)))
+            end += size;
+        while (end < length && (text[end] == '/'
+                || ClassAt(text, length, end, &size) == CLASS_NEWLINE))
+            end++;
+        return end;
+    }
+
+    // Whitespace: up to and including the last line break of the run, or
+    // else all of it but the character that leads the next word
+    end = i;
+    int32 last = i;
+    int32 lastNewline = -1;
+    while (end < length) {
+        charClass = ClassAt(text, length, end, &size);
+        if (!IsWhitespace(charClass))
+            break;
+        if (charClass == CLASS_NEWLINE)
+            lastNewline = end;
+        last = end;
+        end += size;
+    }
+
+    if (lastNewline >= 0)
+        return lastNewline + 1;
+    if (end == length || last == i)
+        return end;
+    return last;
+}
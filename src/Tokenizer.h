@@ -0,0 +1,117 @@
+// Tokenizer.h
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <String.h>
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class LLMModel;
+
+// Counts the prompt tokens of a text the way one family of models does.
+// Tokenizers are created once and live for the whole run; their names are
+// stored with cached counts, so a count is only reused by the tokenizer
+// that produced it.
+class Tokenizer {
+public:
+    virtual ~Tokenizer();
+
+    const BString& Name() const { return fName; }
+
+    // Small per-run identifier, used to tag cached counts in memory
+    int32 ID() const { return fID; }
+
+    virtual int32 CountTokens(const char* text, int32 length) const = 0;
+
+    // The tokenizer for model; never NULL
+    static const Tokenizer* ForModel(const LLMModel* model);
+    static const Tokenizer* ForModelName(const BString& name);
+
+    // The tokenizer called name, or NULL if there is none
+    static const Tokenizer* ForName(const char* name);
+    static const Tokenizer* ForID(int32 id);
+
+    // Reads the data of every tokenizer that has some; takes a while
+    static void LoadAll();
+
+protected:
+    Tokenizer(const char* name);
+
+private:
+    BString fName;
+    int32 fID;
+};
+
+// Character based estimate, with a characters-per-token ratio that was
+// calibrated against the usage a provider reports. Punctuation and line
+// breaks are counted as tokens of their own, since BPE vocabularies rarely
+// merge them with their neighbours.
+class EstimatingTokenizer : public Tokenizer {
+public:
+    EstimatingTokenizer(const char* name, float charsPerToken);
+
+    virtual int32 CountTokens(const char* text, int32 length) const;
+
+private:
+    float fCharsPerToken;
+};
+
+// Byte pair encoding compatible with OpenAI's tiktoken. The merge ranks are
+// read from a .tiktoken file (one "<base64 token> <rank>" per line) by
+// Load(), which the application calls on a thread of its own at startup,
+// since the larger tables take a while to decode. Until they are there,
+// and without the file, counts come from the fallback estimator instead.
+class BPETokenizer : public Tokenizer {
+public:
+    // The pre-tokenizer that splits text into pieces before merging
+    enum Pattern {
+        CL100K_PATTERN,
+        O200K_PATTERN
+    };
+
+    BPETokenizer(const char* name, const char* fileName, Pattern pattern,
+        const Tokenizer* fallback);
+    virtual ~BPETokenizer();
+
+    // True once the ranks are loaded; never waits for them
+    bool IsAvailable() const;
+
+    // Reads the ranks from the data directories, or from path if given.
+    // Only the first call does anything; later ones return its result.
+    status_t Load(const char* path = NULL) const;
+
+    virtual int32 CountTokens(const char* text, int32 length) const;
+
+private:
+    typedef int32 (*PieceFunction)(const char* text, int32 length,
+        int32 start);
+
+    status_t _Load();
+    status_t _LoadFile(const char* path);
+    status_t _ParseRanks(const char* data, size_t size);
+    int32 _CountPiece(const char* piece, int32 length) const;
+    uint32 _Rank(const char* bytes, int32 length) const;
+
+    static int32 _NextPieceCL100K(const char* text, int32 length,
+        int32 start);
+    static int32 _NextPieceO200K(const char* text, int32 length,
+        int32 start);
+
+    BString fFileName;
+    PieceFunction fNextPiece;
+    const Tokenizer* fFallback;
+
+    mutable std::once_flag fLoadOnce;
+    status_t fLoadStatus;
+    std::atomic<bool> fLoaded;
+
+    // Decoded token bytes; fRanks keys point into it
+    std::vector<char> fTokenBytes;
+    std::unordered_map<std::string_view, uint32> fRanks;
+};
+
+#endif // TOKENIZER_H
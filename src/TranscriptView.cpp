@@ -0,0 +1,1144 @@
+// TranscriptView.cpp
+#include "TranscriptView.h"
+
+#include <Clipboard.h>
+#include <Message.h>
+#include <Messenger.h>
+#include <ScrollBar.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Space between the text and the sides of the view
+static const float kInset = 4.0f;
+
+// Indentation per level of lists and quotes
+static const float kIndent = 16.0f;
+
+// Size of headings of level 1 to 3 and below, relative to the text
+static const float kHeadingScale[3] = { 1.5f, 1.25f, 1.1f };
+
+TranscriptView::Item::Item()
+    : role(MESSAGE_ROLE_USER)
+    , document(NULL)
+    , width(-1)
+    , height(0)
+{
+}
+
+TranscriptView::Item::~Item()
+{
+    delete document;
+}
+
+TranscriptView::TranscriptView(const char* name)
+    : BView(name, B_WILL_DRAW | B_FRAME_EVENTS)
+    , fStreaming(false)
+    , fValidTops(1)
+    , fFont(be_plain_font)
+    , fBoldFont(be_plain_font)
+    , fItalicFont(be_plain_font)
+    , fBoldItalicFont(be_plain_font)
+    , fCodeFont(be_fixed_font)
+    , fLineHeight(0)
+    , fAscent(0)
+    , fLayoutWidth(0)
+    , fHighlightGeneration(0)
+    , fUpdatingScrollBar(false)
+    , fSelecting(false)
+{
+    fTops.push_back(0);
+    fSelectionAnchor = fSelectionEnd = Position{ 0, 0, 0 };
+
+    fBoldFont.SetFace(B_BOLD_FACE);
+    fItalicFont.SetFace(B_ITALIC_FACE);
+    fBoldItalicFont.SetFace(B_BOLD_FACE | B_ITALIC_FACE);
+    fCodeFont.SetSize(fFont.Size());
+    for (int32 level = 0; level < 3; level++) {
+        fHeadingFonts[level] = fBoldFont;
+        fHeadingFonts[level].SetSize(fFont.Size() * kHeadingScale[level]);
+    }
+
+    // Lines of text and of code are equally high
+    font_height height;
+    font_height codeHeight;
+    fFont.GetHeight(&height);
+    fCodeFont.GetHeight(&codeHeight);
+    fAscent = ceilf(std::max(height.ascent, codeHeight.ascent));
+    fLineHeight = fAscent + ceilf(std::max(height.descent + height.leading,
+        codeHeight.descent + codeHeight.leading));
+
+    for (int32 role = 0; role < 3; role++)
+        fPrefixWidths[role] = fFont.StringWidth(_RolePrefix((MessageRole)role));
+}
+
+TranscriptView::~TranscriptView()
+{
+    for (size_t i = 0; i < fItems.size(); i++)
+        delete fItems[i];
+}
+
+void TranscriptView::AttachedToWindow()
+{
+    BView::AttachedToWindow();
+
+    SetViewUIColor(B_DOCUMENT_BACKGROUND_COLOR);
+    SetLowUIColor(B_DOCUMENT_BACKGROUND_COLOR);
+
+    fLayoutWidth = Bounds().Width();
+    _LayoutVisible();
+    _UpdateScrollBar();
+}
+
+void TranscriptView::Draw(BRect updateRect)
+{
+    int32 count = fItems.size();
+    for (int32 i = _ItemAt(updateRect.top); i < count; i++) {
+        float top = _Top(i);
+        if (top > updateRect.bottom)
+            break;
+
+        // Normally done by _LayoutVisible() already
+        _Measure(i);
+
+        // Only the lines that need drawing are drawn; the line tops are
+        // relative to the item
+        Item& item = *fItems[i];
+        std::vector<Line>::const_iterator line = std::upper_bound(
+            item.lines.begin(), item.lines.end(), updateRect.top - top,
+            [](float y, const Line& line) { return y < line.top; });
+        if (line != item.lines.begin())
+            line--;
+
+        for (; line != item.lines.end(); line++) {
+            if (top + line->top > updateRect.bottom)
+                break;
+            _DrawLine(i, *line, top);
+        }
+    }
+}
+
+void TranscriptView::MessageReceived(BMessage* message)
+{
+    switch (message->what) {
+        case MSG_HIGHLIGHT_DONE:
+            // Code blocks waiting for tokens look them up when drawn
+            fHighlightGeneration++;
+            Invalidate();
+            break;
+
+        case B_COPY:
+            _CopySelection();
+            break;
+
+        case B_SELECT_ALL:
+            _SelectAll();
+            break;
+
+        default:
+            BView::MessageReceived(message);
+            break;
+    }
+}
+
+void TranscriptView::FrameResized(float width, float height)
+{
+    BView::FrameResized(width, height);
+
+    if (Bounds().Width() != fLayoutWidth) {
+        // Keep the view at the bottom, or else the item at the top in place
+        bool atBottom = Bounds().bottom >= ContentHeight() - 1;
+        int32 anchor = _ItemAt(Bounds().top);
+
+        // Every item breaks its lines anew at the new width
+        fLayoutWidth = Bounds().Width();
+        _InvalidateTops(0);
+
+        if (atBottom)
+            ScrollToBottom();
+        else if (anchor < (int32)fItems.size())
+            ScrollTo(0, _Top(anchor));
+        Invalidate();
+    }
+
+    _LayoutVisible();
+    _UpdateScrollBar();
+}
+
+void TranscriptView::MouseDown(BPoint where)
+{
+    MakeFocus(true);
+    SetMouseEventMask(B_POINTER_EVENTS, B_NO_POINTER_HISTORY);
+
+    // Shift extends the selection from where it started
+    Position position = _PositionAt(where);
+    if ((modifiers() & B_SHIFT_KEY) == 0)
+        fSelectionAnchor = position;
+    fSelectionEnd = position;
+    fSelecting = true;
+    Invalidate();
+}
+
+void TranscriptView::MouseMoved(BPoint where, uint32 transit,
+    const BMessage* dragMessage)
+{
+    if (!fSelecting) {
+        BView::MouseMoved(where, transit, dragMessage);
+        return;
+    }
+
+    // Dragging past the top or bottom scrolls that way
+    BRect bounds = Bounds();
+    if (where.y < bounds.top)
+        ScrollTo(0, where.y);
+    else if (where.y > bounds.bottom)
+        ScrollTo(0, bounds.top + where.y - bounds.bottom);
+
+    Position position = _PositionAt(where);
+    if (!(position == fSelectionEnd)) {
+        fSelectionEnd = position;
+        Invalidate();
+    }
+}
+
+void TranscriptView::MouseUp(BPoint where)
+{
+    fSelecting = false;
+}
+
+void TranscriptView::ScrollTo(BPoint where)
+{
+    float bottom = std::max(0.0f, ContentHeight() - Bounds().Height());
+    where.x = 0;
+    where.y = std::min(std::max(where.y, 0.0f), bottom);
+
+    BView::ScrollTo(where);
+    _LayoutVisible();
+    _UpdateScrollBar();
+}
+
+void TranscriptView::MakeEmpty()
+{
+    for (size_t i = 0; i < fItems.size(); i++)
+        delete fItems[i];
+    fItems.clear();
+    fStreaming = false;
+    fSelecting = false;
+    fSelectionAnchor = fSelectionEnd = Position{ 0, 0, 0 };
+    _InvalidateTops(0);
+
+    ScrollTo(0, 0);
+    _UpdateScrollBar();
+    Invalidate();
+}
+
+void TranscriptView::SetMessages(BObjectList<ChatMessage>* messages)
+{
+    MakeEmpty();
+
+    // Nothing is laid out here; the caller scrolls to where the chat
+    // should be shown, and only what is there is measured
+    fItems.reserve(messages->CountItems());
+    for (int32 i = 0; i < messages->CountItems(); i++)
+        _AddItem(messages->ItemAt(i));
+}
+
+void TranscriptView::AddMessage(ChatMessage* message)
+{
+    if (message == NULL)
+        return;
+
+    _AddItem(message);
+    _InvalidateItem(fItems.size() - 1);
+    _LayoutVisible();
+    _UpdateScrollBar();
+}
+
+void TranscriptView::_AddItem(ChatMessage* message)
+{
+    Item* item = new Item;
+    item->message.SetTo(message);
+    item->role = message->Role();
+    fItems.push_back(item);
+}
+
+void TranscriptView::BeginStreaming(MessageRole role)
+{
+    Item* item = new Item;
+    item->role = role;
+    item->document = new MarkdownDocument(role == MESSAGE_ROLE_ASSISTANT);
+    fItems.push_back(item);
+    fStreaming = true;
+
+    _InvalidateItem(fItems.size() - 1);
+    _LayoutVisible();
+    _UpdateScrollBar();
+}
+
+void TranscriptView::AppendStreamed(const BString& text)
+{
+    if (!fStreaming || text.IsEmpty())
+        return;
+
+    int32 index = fItems.size() - 1;
+    Item& item = *fItems[index];
+    const std::vector<MarkdownDocument::Block>& blocks = item.document->Blocks();
+
+    // The last block is the one that grows; keep it to see how much of
+    // it is still the same afterwards
+    size_t lastBlock = blocks.size() - 1;
+    MarkdownDocument::Block oldBlock;
+    bool measured = !blocks.empty() && lastBlock < item.metrics.size()
+        && item.metrics[lastBlock].valid;
+    if (measured)
+        oldBlock = blocks[lastBlock];
+
+    size_t first = item.document->Append(text.String(), text.Length());
+
+    // Only the blocks parsed again are measured again, and of the last
+    // one only what changed
+    item.metrics.resize(blocks.size());
+    int32 keptChars = 0;
+    for (size_t block = first; block < blocks.size(); block++) {
+        BlockMetrics& metrics = item.metrics[block];
+        size_t reuse = 0;
+        if (measured && block == lastBlock)
+            reuse = _ReusableChars(oldBlock, blocks[block], metrics);
+        if (block == first)
+            keptChars = reuse;
+        metrics.charOffsets.resize(reuse);
+        metrics.charWidths.resize(reuse);
+        metrics.valid = false;
+        metrics.highlight = HIGHLIGHT_NONE;
+        metrics.tokens.clear();
+    }
+
+    if (item.width == fLayoutWidth) {
+        float oldHeight = item.height;
+        _Layout(item, first, keptChars);
+        if (item.height != oldHeight)
+            _InvalidateTops(index + 1);
+    } else
+        _InvalidateTops(index);
+
+    _InvalidateItem(index);
+    _UpdateScrollBar();
+}
+
+void TranscriptView::EndStreaming()
+{
+    if (!fStreaming)
+        return;
+
+    // The last code block can be highlighted now
+    fStreaming = false;
+    _InvalidateItem(fItems.size() - 1);
+}
+
+void TranscriptView::ScrollToTop()
+{
+    ScrollTo(0, 0);
+}
+
+void TranscriptView::ScrollToBottom()
+{
+    // Measure the items that end up in view first, so the scroll range
+    // is exact at the bottom
+    float visible = Bounds().Height();
+    float height = 0;
+    for (int32 i = fItems.size() - 1; i >= 0 && height < visible; i--) {
+        _Measure(i);
+        height += _Height(i);
+    }
+
+    ScrollTo(0, ContentHeight() - visible);
+}
+
+float TranscriptView::ContentHeight()
+{
+    return _Top(fItems.size());
+}
+
+void TranscriptView::_Parse(Item& item)
+{
+    if (item.document != NULL)
+        return;
+
+    const BString& content = item.message->Content();
+    item.document = new MarkdownDocument(item.role == MESSAGE_ROLE_ASSISTANT);
+    item.document->SetText(content.String(), content.Length());
+}
+
+void TranscriptView::_Layout(Item& item, size_t firstBlock, int32 keptChars)
+{
+    _Parse(item);
+
+    const MarkdownDocument& document = *item.document;
+    const std::vector<MarkdownDocument::Block>& blocks = document.Blocks();
+    item.metrics.resize(blocks.size());
+
+    // Lines of the blocks before firstBlock stay as they are, and so do
+    // those of firstBlock where the break, and the one after it, fall on
+    // characters that were kept
+    size_t keep = item.lines.size();
+    while (keep > 0 && item.lines[keep - 1].block >= (int32)firstBlock)
+        keep--;
+    while (keep + 1 < item.lines.size()
+        && item.lines[keep + 1].block == (int32)firstBlock
+        && item.lines[keep + 1].endChar <= keptChars)
+        keep++;
+
+    int32 resumeChar = 0;
+    if (keep > 0 && keep < item.lines.size()
+        && item.lines[keep].block == item.lines[keep - 1].block)
+        resumeChar = item.lines[keep].firstChar;
+    item.lines.resize(keep);
+
+    // An empty line above the text keeps messages apart
+    float y = fLineHeight;
+    if (keep > 0) {
+        const Line& last = item.lines.back();
+        y = last.top + item.metrics[last.block].lineHeight;
+        firstBlock = resumeChar > 0 ? last.block : last.block + 1;
+    }
+
+    float available = std::max(fLayoutWidth - 2 * kInset, 1.0f);
+
+    // Lines break after the last space that fits, inside a word that is
+    // wider than the view, and at every newline of a code block
+    for (size_t b = firstBlock; b < blocks.size(); b++) {
+        const MarkdownDocument::Block& block = blocks[b];
+        BlockMetrics& metrics = item.metrics[b];
+        if (!metrics.valid)
+            _MeasureBlock(block, metrics, metrics.charOffsets.size());
+
+        int32 i = 0;
+        if (resumeChar > 0 && b == firstBlock)
+            i = resumeChar;
+        else if (b > 0)
+            y += _BlockSpacing(document, b);
+        float indent = _BlockIndent(block);
+
+        const char* text = block.text.c_str();
+        int32 count = metrics.charOffsets.size();
+        bool forced = false;
+        do {
+            float maxWidth = available - indent;
+            if (item.lines.empty())
+                maxWidth -= fPrefixWidths[item.role];
+
+            float width = 0;
+            int32 next = i;
+            int32 lastBreak = -1;
+            forced = false;
+            while (next < count) {
+                char c = text[metrics.charOffsets[next]];
+                if (c == '\n') {
+                    forced = true;
+                    break;
+                }
+                if (width + metrics.charWidths[next] > maxWidth)
+                    break;
+                width += metrics.charWidths[next];
+                if (c == ' ')
+                    lastBreak = next + 1;
+                next++;
+            }
+
+            int32 end = next;
+            if (forced)
+                next++;
+            else if (next < count) {
+                if (lastBreak > i)
+                    end = next = lastBreak;
+                else if (next == i)
+                    end = next = i + 1;
+            }
+
+            Line line;
+            line.block = b;
+            line.firstChar = i;
+            line.endChar = end;
+            line.top = y;
+            item.lines.push_back(line);
+            y += metrics.lineHeight;
+            i = next;
+        } while (i < count || (forced && i == count));
+    }
+
+    item.height = y;
+    item.width = fLayoutWidth;
+}
+
+void TranscriptView::_MeasureBlock(const MarkdownDocument::Block& block,
+    BlockMetrics& metrics, size_t reuse)
+{
+    const std::string& text = block.text;
+
+    // Start after the characters kept
+    size_t start = 0;
+    if (reuse > 0) {
+        start = metrics.charOffsets[reuse - 1] + 1;
+        while (start < text.size() && (text[start] & 0xc0) == 0x80)
+            start++;
+    }
+    metrics.charOffsets.resize(reuse);
+    metrics.charWidths.resize(reuse);
+
+    // One call per run, instead of one per word
+    for (size_t r = 0; r < block.runs.size(); r++) {
+        const MarkdownDocument::Run& run = block.runs[r];
+        size_t runStart = std::max<size_t>(run.offset, start);
+        size_t runEnd = run.offset + run.length;
+        if (runEnd <= runStart)
+            continue;
+
+        size_t first = metrics.charOffsets.size();
+        for (size_t i = runStart; i < runEnd; i++) {
+            if ((text[i] & 0xc0) != 0x80)
+                metrics.charOffsets.push_back(i);
+        }
+        size_t count = metrics.charOffsets.size() - first;
+        if (count == 0)
+            continue;
+
+        const BFont& font = _FontFor(block, run.style);
+        metrics.charWidths.resize(first + count);
+        font.GetEscapements(text.c_str() + runStart, count,
+            &metrics.charWidths[first]);
+
+        float size = font.Size();
+        for (size_t i = first; i < first + count; i++) {
+            if (text[metrics.charOffsets[i]] == '\n')
+                metrics.charWidths[i] = 0;
+            else
+                metrics.charWidths[i] *= size;
+        }
+    }
+
+    metrics.lineHeight = fLineHeight;
+    metrics.ascent = fAscent;
+    if (block.kind == MarkdownDocument::BLOCK_HEADING) {
+        font_height height;
+        _FontFor(block, 0).GetHeight(&height);
+        metrics.ascent = ceilf(height.ascent);
+        metrics.lineHeight = metrics.ascent
+            + ceilf(height.descent + height.leading);
+    }
+    metrics.valid = true;
+}
+
+size_t TranscriptView::_ReusableChars(const MarkdownDocument::Block& oldBlock,
+    const MarkdownDocument::Block& newBlock, const BlockMetrics& metrics) const
+{
+    if (oldBlock.kind != newBlock.kind || oldBlock.level != newBlock.level)
+        return 0;
+
+    // The text both have in common, as long as it keeps its runs
+    size_t common = 0;
+    size_t length = std::min(oldBlock.text.size(), newBlock.text.size());
+    while (common < length && oldBlock.text[common] == newBlock.text[common])
+        common++;
+
+    for (size_t r = 0; r < oldBlock.runs.size(); r++) {
+        const MarkdownDocument::Run& run = oldBlock.runs[r];
+        if (r >= newBlock.runs.size() || newBlock.runs[r].offset != run.offset
+            || newBlock.runs[r].style != run.style) {
+            common = std::min<size_t>(common, run.offset);
+            break;
+        }
+        if (newBlock.runs[r].length != run.length) {
+            common = std::min<size_t>(common, run.offset
+                + std::min(run.length, newBlock.runs[r].length));
+            break;
+        }
+    }
+
+    // Whole characters only
+    size_t count = std::upper_bound(metrics.charOffsets.begin(),
+        metrics.charOffsets.end(), (int32)common) - metrics.charOffsets.begin();
+    if (count > 0) {
+        size_t end = count < metrics.charOffsets.size()
+            ? metrics.charOffsets[count] : oldBlock.text.size();
+        if (end > common)
+            count--;
+    }
+    return std::min(count, metrics.charWidths.size());
+}
+
+void TranscriptView::_DrawLine(int32 index, const Line& line, float itemTop)
+{
+    Item& item = *fItems[index];
+    const MarkdownDocument::Block& block = item.document->Blocks()[line.block];
+    const BlockMetrics& metrics = item.metrics[line.block];
+    float top = itemTop + line.top;
+    float x = kInset + _BlockIndent(block);
+    float baseline = top + metrics.ascent;
+    BRect bounds = Bounds();
+
+    if (block.kind == MarkdownDocument::BLOCK_RULE) {
+        SetHighColor(tint_color(LowColor(), B_DARKEN_2_TINT));
+        float y = top + floorf(metrics.lineHeight / 2);
+        StrokeLine(BPoint(x, y), BPoint(bounds.right - kInset, y));
+        return;
+    }
+
+    rgb_color background = LowColor();
+    if (block.kind == MarkdownDocument::BLOCK_CODE) {
+        // Code sits on a shaded band
+        SetLowColor(tint_color(background, B_DARKEN_1_TINT));
+        FillRect(BRect(x - kInset, top, bounds.right - kInset,
+            top + metrics.lineHeight - 1), B_SOLID_LOW);
+    } else if (block.kind == MarkdownDocument::BLOCK_QUOTE) {
+        SetHighColor(tint_color(background, B_DARKEN_2_TINT));
+        StrokeLine(BPoint(x - kIndent / 2, top),
+            BPoint(x - kIndent / 2, top + metrics.lineHeight - 1));
+    }
+
+    SetHighColor(_RoleColor(item.role));
+
+    if (&line == &item.lines[0]) {
+        SetFont(&fFont);
+        DrawString(_RolePrefix(item.role), BPoint(x, baseline));
+        x += fPrefixWidths[item.role];
+    }
+
+    // The selection goes behind the text, which is then drawn over it
+    int32 selectionFirst;
+    int32 selectionEnd;
+    bool toEdge;
+    bool selected = _LineSelection(index, line, &selectionFirst,
+        &selectionEnd, &toEdge);
+    if (selected) {
+        float left = x;
+        for (int32 i = line.firstChar; i < selectionFirst; i++)
+            left += metrics.charWidths[i];
+        float right = left;
+        for (int32 i = selectionFirst; i < selectionEnd; i++)
+            right += metrics.charWidths[i];
+        if (toEdge)
+            right = bounds.right - kInset;
+
+        rgb_color highColor = HighColor();
+        SetHighColor(tint_color(background, B_HIGHLIGHT_BACKGROUND_TINT));
+        FillRect(BRect(left, top, std::max(left, right - 1),
+            top + metrics.lineHeight - 1));
+        SetHighColor(highColor);
+        SetDrawingMode(B_OP_OVER);
+    }
+
+    const std::string& text = block.text;
+    int32 count = metrics.charOffsets.size();
+    size_t lineStart = line.firstChar < count
+        ? metrics.charOffsets[line.firstChar] : text.size();
+    size_t lineEnd = line.endChar < count
+        ? metrics.charOffsets[line.endChar] : text.size();
+    int32 character = line.firstChar;
+
+    if (block.kind == MarkdownDocument::BLOCK_CODE) {
+        _Highlight(item, line.block);
+        if (metrics.highlight == HIGHLIGHT_DONE) {
+            _DrawCode(block, metrics, line, lineStart, lineEnd, x, baseline,
+                _RoleColor(item.role));
+            SetDrawingMode(B_OP_COPY);
+            SetLowColor(background);
+            return;
+        }
+    }
+
+    // The line run by run, each in its font
+    std::vector<MarkdownDocument::Run>::const_iterator run = std::upper_bound(
+        block.runs.begin(), block.runs.end(), lineStart,
+        [](size_t offset, const MarkdownDocument::Run& run) {
+            return offset < run.offset;
+        });
+    if (run != block.runs.begin())
+        run--;
+
+    for (; run != block.runs.end() && run->offset < lineEnd; run++) {
+        size_t start = std::max<size_t>(run->offset, lineStart);
+        size_t end = std::min<size_t>(run->offset + run->length, lineEnd);
+        if (end <= start)
+            continue;
+
+        SetFont(&_FontFor(block, run->style));
+        float width = _DrawSegment(text, start, end, metrics, &character, x,
+            baseline);
+        if ((run->style & MarkdownDocument::STYLE_LINK) != 0)
+            StrokeLine(BPoint(x, baseline + 1), BPoint(x + width, baseline + 1));
+        x += width;
+    }
+
+    SetDrawingMode(B_OP_COPY);
+    SetLowColor(background);
+}
+
+void TranscriptView::_DrawCode(const MarkdownDocument::Block& block,
+    const BlockMetrics& metrics, const Line& line, size_t lineStart,
+    size_t lineEnd, float x, float baseline, rgb_color plainColor)
+{
+    // The tokens are sorted and do not overlap; start with the first one
+    // that ends inside the line
+    const std::vector<CodeLexer::Token>& tokens = metrics.tokens;
+    std::vector<CodeLexer::Token>::const_iterator token = std::lower_bound(
+        tokens.begin(), tokens.end(), lineStart,
+        [](const CodeLexer::Token& token, size_t offset) {
+            return token.offset + token.length <= offset;
+        });
+
+    SetFont(&fCodeFont);
+    int32 character = line.firstChar;
+    size_t position = lineStart;
+    while (position < lineEnd) {
+        size_t end = lineEnd;
+        rgb_color color = plainColor;
+        if (token != tokens.end() && token->offset <= position) {
+            end = std::min<size_t>(token->offset + token->length, lineEnd);
+            color = _TokenColor(token->kind);
+        } else if (token != tokens.end())
+            end = std::min<size_t>(token->offset, lineEnd);
+
+        SetHighColor(color);
+        x += _DrawSegment(block.text, position, end, metrics, &character, x,
+            baseline);
+
+        position = end;
+        if (token != tokens.end() && token->offset + token->length <= position)
+            token++;
+    }
+}
+
+float TranscriptView::_DrawSegment(const std::string& text, size_t start,
+    size_t end, const BlockMetrics& metrics, int32* character, float x,
+    float baseline)
+{
+    // The width comes from the cached character widths, not the font
+    float width = 0;
+    int32 count = metrics.charOffsets.size();
+    while (*character < count && (size_t)metrics.charOffsets[*character] < end)
+        width += metrics.charWidths[(*character)++];
+
+    DrawString(text.c_str() + start, end - start, BPoint(x, baseline));
+    return width;
+}
+
+void TranscriptView::_Highlight(Item& item, size_t index)
+{
+    BlockMetrics& metrics = item.metrics[index];
+    const MarkdownDocument::Block& block = item.document->Blocks()[index];
+    SyntaxHighlighter* highlighter = SyntaxHighlighter::GetInstance();
+
+    switch (metrics.highlight) {
+        case HIGHLIGHT_NONE:
+            // A code block that is still streaming in waits until it is done
+            if (fStreaming && &item == fItems.back()
+                && index + 1 == item.document->Blocks().size())
+                break;
+
+            metrics.codeHash = SyntaxHighlighter::Hash(block.info, block.text);
+            metrics.highlightGeneration = fHighlightGeneration;
+            if (highlighter->Lookup(metrics.codeHash, &metrics.tokens))
+                metrics.highlight = HIGHLIGHT_DONE;
+            else if (highlighter->Request(metrics.codeHash, block.info,
+                    block.text, BMessenger(this)))
+                metrics.highlight = HIGHLIGHT_PENDING;
+            else
+                metrics.highlight = HIGHLIGHT_NEVER;
+            break;
+
+        case HIGHLIGHT_PENDING:
+            // Looked up again only after some block was done
+            if (metrics.highlightGeneration != fHighlightGeneration) {
+                metrics.highlightGeneration = fHighlightGeneration;
+                if (highlighter->Lookup(metrics.codeHash, &metrics.tokens))
+                    metrics.highlight = HIGHLIGHT_DONE;
+            }
+            break;
+    }
+}
+
+TranscriptView::Position TranscriptView::_PositionAt(BPoint where)
+{
+    Position position = { 0, 0, 0 };
+    if (fItems.empty())
+        return position;
+
+    int32 index = _ItemAt(where.y);
+    _Measure(index);
+    Item& item = *fItems[index];
+    position.item = index;
+    if (item.lines.empty())
+        return position;
+
+    // Above the first line of an item is its start, below the last line
+    // its end
+    float y = where.y - _Top(index);
+    std::vector<Line>::const_iterator line = std::upper_bound(
+        item.lines.begin(), item.lines.end(), y,
+        [](float y, const Line& line) { return y < line.top; });
+    bool above = line == item.lines.begin();
+    if (!above)
+        line--;
+
+    const MarkdownDocument::Block& block = item.document->Blocks()[line->block];
+    const BlockMetrics& metrics = item.metrics[line->block];
+    position.block = line->block;
+
+    int32 character = line->firstChar;
+    if (y >= item.height)
+        character = line->endChar;
+    else if (!above) {
+        // The character boundary nearest to where, on the line
+        float x = kInset + _BlockIndent(block);
+        if (line == item.lines.begin())
+            x += fPrefixWidths[item.role];
+        for (; character < line->endChar; character++) {
+            float width = metrics.charWidths[character];
+            if (where.x < x + width / 2)
+                break;
+            x += width;
+        }
+    }
+
+    position.offset = character < (int32)metrics.charOffsets.size()
+        ? metrics.charOffsets[character] : block.text.size();
+    return position;
+}
+
+void TranscriptView::_SelectionRange(Position* start, Position* end) const
+{
+    *start = std::min(fSelectionAnchor, fSelectionEnd);
+    *end = std::max(fSelectionAnchor, fSelectionEnd);
+}
+
+int32 TranscriptView::_SelectionChar(const Position& position, int32 index,
+    int32 block, const BlockMetrics& metrics) const
+{
+    // Before the block is its start; after it, past its end
+    int32 count = metrics.charOffsets.size();
+    if (position.item != index || position.block != block)
+        return position < Position{ index, block, 0 } ? 0 : count + 1;
+
+    return std::lower_bound(metrics.charOffsets.begin(),
+        metrics.charOffsets.end(), position.offset)
+        - metrics.charOffsets.begin();
+}
+
+bool TranscriptView::_LineSelection(int32 index, const Line& line,
+    int32* first, int32* end, bool* toEdge) const
+{
+    if (fSelectionAnchor == fSelectionEnd)
+        return false;
+
+    Position start;
+    Position stop;
+    _SelectionRange(&start, &stop);
+
+    // A selection that goes on past the line covers it to the right edge
+    const BlockMetrics& metrics = fItems[index]->metrics[line.block];
+    int32 startChar = _SelectionChar(start, index, line.block, metrics);
+    int32 stopChar = _SelectionChar(stop, index, line.block, metrics);
+    *first = std::max(startChar, line.firstChar);
+    *end = std::min(stopChar, line.endChar);
+    *toEdge = stopChar > line.endChar;
+
+    return *first < *end || (*toEdge && *first <= line.endChar);
+}
+
+void TranscriptView::_SelectAll()
+{
+    if (fItems.empty())
+        return;
+
+    // To the end of the last block of the last item
+    int32 last = fItems.size() - 1;
+    Item& item = *fItems[last];
+    _Parse(item);
+    const std::vector<MarkdownDocument::Block>& blocks = item.document->Blocks();
+
+    fSelectionAnchor = Position{ 0, 0, 0 };
+    fSelectionEnd = Position{ last, 0, 0 };
+    if (!blocks.empty()) {
+        fSelectionEnd.block = blocks.size() - 1;
+        fSelectionEnd.offset = blocks.back().text.size();
+    }
+    Invalidate();
+}
+
+void TranscriptView::_CopySelection()
+{
+    Position start;
+    Position end;
+    _SelectionRange(&start, &end);
+    if (start == end)
+        return;
+
+    // The text as shown; blocks set apart by space in the view are set
+    // apart by an empty line, and so are messages
+    BString text;
+    int32 count = fItems.size();
+    for (int32 i = start.item; i <= end.item && i < count; i++) {
+        Item& item = *fItems[i];
+        _Parse(item);
+        const MarkdownDocument& document = *item.document;
+        const std::vector<MarkdownDocument::Block>& blocks = document.Blocks();
+
+        if (i > start.item)
+            text << "\n\n";
+
+        int32 firstBlock = i == start.item ? start.block : 0;
+        int32 lastBlock = blocks.size() - 1;
+        if (i == end.item)
+            lastBlock = std::min(lastBlock, end.block);
+
+        for (int32 b = firstBlock; b <= lastBlock; b++) {
+            const std::string& blockText = blocks[b].text;
+            size_t from = 0;
+            size_t to = blockText.size();
+            if (i == start.item && b == start.block)
+                from = std::min<size_t>(start.offset, to);
+            if (i == end.item && b == end.block)
+                to = std::min<size_t>(end.offset, to);
+
+            if (b > firstBlock)
+                text << (_BlockSpacing(document, b) > 0 ? "\n\n" : "\n");
+            if (to > from)
+                text.Append(blockText.c_str() + from, to - from);
+        }
+    }
+
+    if (!be_clipboard->Lock())
+        return;
+
+    be_clipboard->Clear();
+    BMessage* clip = be_clipboard->Data();
+    if (clip != NULL) {
+        clip->AddData("text/plain", B_MIME_TYPE, text.String(), text.Length());
+        be_clipboard->Commit();
+    }
+    be_clipboard->Unlock();
+}
+
+const BFont& TranscriptView::_FontFor(const MarkdownDocument::Block& block,
+    uint8 style) const
+{
+    if (block.kind == MarkdownDocument::BLOCK_CODE
+        || (style & MarkdownDocument::STYLE_CODE) != 0)
+        return fCodeFont;
+
+    if (block.kind == MarkdownDocument::BLOCK_HEADING)
+        return fHeadingFonts[std::min(std::max(block.level, 1), 3) - 1];
+
+    bool bold = (style & MarkdownDocument::STYLE_BOLD) != 0;
+    bool italic = (style & MarkdownDocument::STYLE_ITALIC) != 0;
+    if (bold && italic)
+        return fBoldItalicFont;
+    if (bold)
+        return fBoldFont;
+    if (italic)
+        return fItalicFont;
+    return fFont;
+}
+
+float TranscriptView::_BlockIndent(const MarkdownDocument::Block& block) const
+{
+    switch (block.kind) {
+        case MarkdownDocument::BLOCK_LIST_ITEM:
+            return kIndent * block.level + kIndent / 2;
+
+        case MarkdownDocument::BLOCK_QUOTE:
+            return kIndent * block.level;
+
+        case MarkdownDocument::BLOCK_CODE:
+            return kIndent / 2;
+
+        default:
+            return 0;
+    }
+}
+
+float TranscriptView::_BlockSpacing(const MarkdownDocument& document,
+    size_t block) const
+{
+    // Plain text keeps its lines as they are, and list items stay together
+    if (!document.IsMarkdown())
+        return 0;
+    if (document.Blocks()[block].kind == MarkdownDocument::BLOCK_LIST_ITEM
+        && document.Blocks()[block - 1].kind == MarkdownDocument::BLOCK_LIST_ITEM)
+        return 0;
+
+    return ceilf(fLineHeight / 2);
+}
+
+void TranscriptView::_Measure(int32 index)
+{
+    Item& item = *fItems[index];
+    if (item.width == fLayoutWidth)
+        return;
+
+    float estimate = _Height(index);
+    _Layout(item, 0);
+    if (item.height != estimate)
+        _InvalidateTops(index + 1);
+}
+
+float TranscriptView::_Height(int32 index) const
+{
+    const Item& item = *fItems[index];
+    if (item.width == fLayoutWidth)
+        return item.height;
+
+    // Roughly half an em per character, and the text is at least one line
+    size_t length = item.document != NULL
+        ? item.document->Source().size() : item.message->Content().Length();
+    float available = std::max(fLayoutWidth - 2 * kInset, 1.0f);
+    float lines = ceilf(length * fFont.Size() * 0.5f / available);
+    return (std::max(lines, 1.0f) + 1) * fLineHeight;
+}
+
+float TranscriptView::_Top(int32 index)
+{
+    if ((int32)fTops.size() < (int32)fItems.size() + 1)
+        fTops.resize(fItems.size() + 1);
+
+    for (; fValidTops <= index; fValidTops++)
+        fTops[fValidTops] = fTops[fValidTops - 1] + _Height(fValidTops - 1);
+
+    return fTops[index];
+}
+
+int32 TranscriptView::_ItemAt(float y)
+{
+    int32 count = fItems.size();
+    _Top(count);
+
+    // The last item whose top is at or above y
+    std::vector<float>::iterator found = std::upper_bound(fTops.begin(),
+        fTops.begin() + count, y);
+    return std::max<int32>(found - fTops.begin() - 1, 0);
+}
+
+void TranscriptView::_InvalidateTops(int32 index)
+{
+    fValidTops = std::max(std::min(fValidTops, index + 1), 1);
+}
+
+void TranscriptView::_InvalidateItem(int32 index)
+{
+    BRect bounds = Bounds();
+    float top = _Top(index);
+    if (top <= bounds.bottom)
+        Invalidate(BRect(bounds.left, top, bounds.right, bounds.bottom));
+}
+
+void TranscriptView::_LayoutVisible()
+{
+    if (fLayoutWidth <= 0 || fItems.empty())
+        return;
+
+    // Measuring an item only moves the ones below it, so the first item
+    // in view stays where it is
+    BRect bounds = Bounds();
+    int32 count = fItems.size();
+    int32 i = _ItemAt(bounds.top);
+    float y = _Top(i);
+    for (; i < count && y <= bounds.bottom; i++) {
+        _Measure(i);
+        y += _Height(i);
+    }
+}
+
+void TranscriptView::_UpdateScrollBar()
+{
+    BScrollBar* scrollBar = ScrollBar(B_VERTICAL);
+    if (scrollBar == NULL || fUpdatingScrollBar)
+        return;
+
+    // Setting the range may scroll the view, which comes back here
+    fUpdatingScrollBar = true;
+
+    float visible = Bounds().Height();
+    float content = ContentHeight();
+    scrollBar->SetRange(0, std::max(0.0f, content - visible));
+    scrollBar->SetProportion(content > 0 ? std::min(1.0f, visible / content) : 1.0f);
+    scrollBar->SetSteps(fLineHeight, std::max(fLineHeight, visible - fLineHeight));
+
+    fUpdatingScrollBar = false;
+}
+
+rgb_color TranscriptView::_TokenColor(uint8 kind)
+{
+    rgb_color color;
+
+    switch (kind) {
+        case CodeLexer::TOKEN_KEYWORD:
+            color = {130, 0, 150};  // Purple for keywords
+            break;
+
+        case CodeLexer::TOKEN_TYPE:
+            color = {0, 110, 140};  // Teal for types
+            break;
+
+        case CodeLexer::TOKEN_STRING:
+            color = {170, 60, 0};  // Rust for strings
+            break;
+
+        case CodeLexer::TOKEN_NUMBER:
+            color = {0, 0, 200};  // Blue for numbers
+            break;
+
+        case CodeLexer::TOKEN_COMMENT:
+            color = {110, 110, 110};  // Grey for comments
+            break;
+
+        case CodeLexer::TOKEN_PREPROCESSOR:
+            color = {140, 90, 0};  // Brown for preprocessor lines
+            break;
+
+        default:
+            color = {0, 0, 0};  // Black default
+    }
+
+    return color;
+}
+
+rgb_color TranscriptView::_RoleColor(MessageRole role)
+{
+    rgb_color color;
+
+    switch (role) {
+        case MESSAGE_ROLE_USER:
+            color = {0, 0, 200};  // Blue for user
+            break;
+
+        case MESSAGE_ROLE_ASSISTANT:
+            color = {0, 130, 0};  // Green for assistant
+            break;
+
+        case MESSAGE_ROLE_SYSTEM:
+            color = {130, 60, 0};  // Brown for system
+            break;
+
+        default:
+            color = {0, 0, 0};  // Black default
+    }
+
+    return color;
+}
+
+const char* TranscriptView::_RolePrefix(MessageRole role)
+{
+    switch (role) {
+        case MESSAGE_ROLE_USER:
+            return "🧑 ";  // User emoji
+
+        case MESSAGE_ROLE_ASSISTANT:
+            return "🤖 ";  // AI emoji
+
+        case MESSAGE_ROLE_SYSTEM:
+            return "⚙️ ";  // System emoji
+    }
+
+    return "";
+}
@@ -0,0 +1,210 @@
+// TranscriptView.h
+#ifndef TRANSCRIPT_VIEW_H
+#define TRANSCRIPT_VIEW_H
+
+#include <View.h>
+#include <Font.h>
+#include <String.h>
+
+#include <vector>
+
+#include "ChatMessage.h"
+#include "MarkdownDocument.h"
+#include "SyntaxHighlighter.h"
+
+// The messages of a chat, one item per message, laid out only where they
+// come into view. An item is wrapped to the width of the view the first
+// time it is shown, and its lines and height are kept until the width
+// changes. Items that were never shown count with an estimate from the
+// length of their text, so opening a chat takes the same time however
+// long it is.
+//
+// Assistant messages are shown as Markdown. The parsed blocks and the
+// widths of their characters do not depend on the width of the view, so
+// they are kept along with the item; wrapping again after a resize only
+// breaks the lines anew.
+//
+// Text is selected with the mouse, across items, and copied as shown.
+class TranscriptView : public BView {
+public:
+    TranscriptView(const char* name);
+    virtual ~TranscriptView();
+
+    virtual void AttachedToWindow();
+    virtual void Draw(BRect updateRect);
+    virtual void MessageReceived(BMessage* message);
+    virtual void FrameResized(float width, float height);
+    virtual void MouseDown(BPoint where);
+    virtual void MouseMoved(BPoint where, uint32 transit,
+                            const BMessage* dragMessage);
+    virtual void MouseUp(BPoint where);
+
+    using BView::ScrollTo;
+    virtual void ScrollTo(BPoint where);
+
+    void MakeEmpty();
+    void SetMessages(BObjectList<ChatMessage>* messages);
+    void AddMessage(ChatMessage* message);
+
+    // A streamed reply is shown as an item of its own, that grows with
+    // every AppendStreamed() until EndStreaming()
+    void BeginStreaming(MessageRole role);
+    void AppendStreamed(const BString& text);
+    void EndStreaming();
+    bool IsStreaming() const { return fStreaming; }
+
+    void ScrollToTop();
+    void ScrollToBottom();
+
+    // Height of all items, estimated for those not laid out yet
+    float ContentHeight();
+
+private:
+    enum {
+        HIGHLIGHT_NONE,
+        HIGHLIGHT_PENDING,
+        HIGHLIGHT_DONE,
+        HIGHLIGHT_NEVER
+    };
+
+    // Widths of the characters of a block, in the fonts of their runs,
+    // and for code blocks, the tokens to color them by
+    struct BlockMetrics {
+        BlockMetrics()
+            : lineHeight(0), ascent(0), valid(false), codeHash(0),
+              highlight(HIGHLIGHT_NONE), highlightGeneration(0) {}
+
+        std::vector<int32> charOffsets;
+        std::vector<float> charWidths;
+        float lineHeight;
+        float ascent;
+        bool valid;
+
+        std::vector<CodeLexer::Token> tokens;
+        uint64 codeHash;
+        int32 highlight;
+        uint32 highlightGeneration;
+    };
+
+    // Characters firstChar to endChar - 1 of a block; top is relative to
+    // the item
+    struct Line {
+        int32 block;
+        int32 firstChar;
+        int32 endChar;
+        float top;
+    };
+
+    struct Item {
+        Item();
+        ~Item();
+
+        BReference<ChatMessage> message;
+        MessageRole role;
+        // Parsed the first time the item is laid out
+        MarkdownDocument* document;
+        std::vector<BlockMetrics> metrics;
+        // Width the lines were wrapped at, or -1
+        float width;
+        float height;
+        std::vector<Line> lines;
+    };
+
+    // A place in the text: a byte offset into a block of an item
+    struct Position {
+        int32 item;
+        int32 block;
+        int32 offset;
+
+        bool operator<(const Position& other) const
+        {
+            if (item != other.item)
+                return item < other.item;
+            if (block != other.block)
+                return block < other.block;
+            return offset < other.offset;
+        }
+        bool operator==(const Position& other) const
+        {
+            return item == other.item && block == other.block
+                && offset == other.offset;
+        }
+    };
+
+    void _AddItem(ChatMessage* message);
+    void _Parse(Item& item);
+    void _Layout(Item& item, size_t firstBlock, int32 keptChars = 0);
+    void _MeasureBlock(const MarkdownDocument::Block& block,
+                       BlockMetrics& metrics, size_t reuse);
+    size_t _ReusableChars(const MarkdownDocument::Block& oldBlock,
+                          const MarkdownDocument::Block& newBlock,
+                          const BlockMetrics& metrics) const;
+    void _DrawLine(int32 index, const Line& line, float itemTop);
+    void _DrawCode(const MarkdownDocument::Block& block,
+                   const BlockMetrics& metrics, const Line& line,
+                   size_t lineStart, size_t lineEnd, float x, float baseline,
+                   rgb_color plainColor);
+    float _DrawSegment(const std::string& text, size_t start, size_t end,
+                       const BlockMetrics& metrics, int32* character, float x,
+                       float baseline);
+    void _Highlight(Item& item, size_t index);
+
+    Position _PositionAt(BPoint where);
+    void _SelectionRange(Position* start, Position* end) const;
+    int32 _SelectionChar(const Position& position, int32 index, int32 block,
+                         const BlockMetrics& metrics) const;
+    bool _LineSelection(int32 index, const Line& line, int32* first,
+                        int32* end, bool* toEdge) const;
+    void _SelectAll();
+    void _CopySelection();
+
+    const BFont& _FontFor(const MarkdownDocument::Block& block, uint8 style) const;
+    float _BlockIndent(const MarkdownDocument::Block& block) const;
+    float _BlockSpacing(const MarkdownDocument& document, size_t block) const;
+
+    void _Measure(int32 index);
+    float _Height(int32 index) const;
+    float _Top(int32 index);
+    int32 _ItemAt(float y);
+    void _InvalidateTops(int32 index);
+    void _InvalidateItem(int32 index);
+
+    void _LayoutVisible();
+    void _UpdateScrollBar();
+
+    static rgb_color _TokenColor(uint8 kind);
+    static rgb_color _RoleColor(MessageRole role);
+    static const char* _RolePrefix(MessageRole role);
+
+    std::vector<Item*> fItems;
+    bool fStreaming;
+
+    // fTops[i] is the top of item i; the first fValidTops are up to date
+    std::vector<float> fTops;
+    int32 fValidTops;
+
+    BFont fFont;
+    BFont fBoldFont;
+    BFont fItalicFont;
+    BFont fBoldItalicFont;
+    BFont fCodeFont;
+    BFont fHeadingFonts[3];
+    float fLineHeight;
+    float fAscent;
+    float fPrefixWidths[3];
+    float fLayoutWidth;
+
+    // Counts MSG_HIGHLIGHT_DONE replies, so pending code blocks know
+    // when looking up their tokens again is worth it
+    uint32 fHighlightGeneration;
+
+    bool fUpdatingScrollBar;
+
+    // The selection runs from where the mouse went down to where it is
+    // now; it is empty when both are the same
+    Position fSelectionAnchor;
+    Position fSelectionEnd;
+    bool fSelecting;
+};
+
+#endif // TRANSCRIPT_VIEW_H
@@ -0,0 +1,275 @@
+// UsageRollup.cpp
+#include "UsageRollup.h"
+
+#include <Entry.h>
+#include <File.h>
+#include <Message.h>
+
+UsageRollup::UsageRollup()
+    : fHoursFoldedBefore(0)
+    , fPendingEvents(0)
+    , fLastSequence(0)
+    , fCompactedSequence(0)
+{
+}
+
+status_t UsageRollup::Load(const BPath& directory)
+{
+    fRollupsPath = directory;
+    fRollupsPath.Append("Rollups");
+    fEventsPath = directory;
+    fEventsPath.Append("Events");
+
+    for (int32 kind = 0; kind < BUCKET_KINDS; kind++)
+        fBuckets[kind].clear();
+    fHoursFoldedBefore = 0;
+    fPendingEvents = 0;
+    fLastSequence = 0;
+    fCompactedSequence = 0;
+
+    // Compacted buckets, as parallel arrays
+    status_t status = B_ENTRY_NOT_FOUND;
+    BFile file(fRollupsPath.Path(), B_READ_ONLY);
+    BMessage rollups;
+    if (file.InitCheck() == B_OK && rollups.Unflatten(&file) == B_OK) {
+        status = B_OK;
+        rollups.FindInt64("sequence", &fCompactedSequence);
+        fLastSequence = fCompactedSequence;
+
+        int64 foldedBefore = 0;
+        rollups.FindInt64("hours_folded_before", &foldedBefore);
+        fHoursFoldedBefore = (time_t)foldedBefore;
+
+        int32 kind;
+        for (int32 i = 0; rollups.FindInt32("kind", i, &kind) == B_OK; i++) {
+            int64 start = 0;
+            Source source;
+            Counters counters = { 0, 0 };
+            rollups.FindInt64("start", i, &start);
+            rollups.FindString("provider", i, &source.first);
+            rollups.FindString("model", i, &source.second);
+            rollups.FindInt64("input", i, &counters.input);
+            rollups.FindInt64("output", i, &counters.output);
+
+            if (kind >= 0 && kind < BUCKET_KINDS)
+                fBuckets[kind][(time_t)start][source] = counters;
+        }
+    }
+
+    _ReplayEvents();
+    return status;
+}
+
+status_t UsageRollup::_ReplayEvents()
+{
+    BFile events(fEventsPath.Path(), B_READ_ONLY);
+    if (events.InitCheck() != B_OK)
+        return events.InitCheck();
+
+    // One flattened message per event; a torn last one ends the log
+    BMessage event;
+    while (event.Unflatten(&events) == B_OK) {
+        int64 sequence = 0;
+        event.FindInt64("sequence", &sequence);
+        if (sequence > fLastSequence)
+            fLastSequence = sequence;
+
+        if (sequence > fCompactedSequence) {
+            Source source;
+            int64 when = 0, input = 0, output = 0;
+            event.FindString("provider", &source.first);
+            event.FindString("model", &source.second);
+            event.FindInt64("time", &when);
+            event.FindInt64("input", &input);
+            event.FindInt64("output", &output);
+            _AddToBuckets(source, (time_t)when, input, output);
+        }
+
+        fPendingEvents++;
+        event.MakeEmpty();
+    }
+
+    return B_OK;
+}
+
+status_t UsageRollup::Add(const BString& provider, const BString& model, time_t when,
+                          int64 inputTokens, int64 outputTokens, bool logEvent)
+{
+    _AddToBuckets(Source(provider, model), when, inputTokens, outputTokens);
+
+    if (!logEvent)
+        return B_OK;
+
+    BMessage event;
+    event.AddInt64("sequence", ++fLastSequence);
+    event.AddString("provider", provider);
+    event.AddString("model", model);
+    event.AddInt64("time", when);
+    event.AddInt64("input", inputTokens);
+    event.AddInt64("output", outputTokens);
+
+    BFile events(fEventsPath.Path(), B_WRITE_ONLY | B_CREATE_FILE | B_OPEN_AT_END);
+    if (events.InitCheck() != B_OK)
+        return events.InitCheck();
+
+    status_t status = event.Flatten(&events);
+    if (status == B_OK)
+        fPendingEvents++;
+    return status;
+}
+
+void UsageRollup::_AddToBuckets(const Source& source, time_t when,
+                                int64 inputTokens, int64 outputTokens)
+{
+    for (int32 kind = 0; kind < BUCKET_KINDS; kind++) {
+        Bucket& bucket = fBuckets[kind][_BucketStart(kind, when)];
+        Bucket::iterator found = bucket.find(source);
+        if (found == bucket.end()) {
+            Counters counters = { inputTokens, outputTokens };
+            bucket[source] = counters;
+        } else {
+            found->second.input += inputTokens;
+            found->second.output += outputTokens;
+        }
+    }
+}
+
+void UsageRollup::GetTotal(const BString& provider, const BString& model,
+                           time_t startTime, time_t endTime,
+                           int64* inputTokens, int64* outputTokens) const
+{
+    *inputTokens = 0;
+    *outputTokens = 0;
+
+    // Walk the range in the largest steps that stay inside it: hours up
+    // to the first whole day, days up to the first whole month, and so
+    // back down at the end. Where the hours have been folded, days are
+    // the smallest step.
+    int32 smallest = startTime < fHoursFoldedBefore ? BUCKET_DAY : BUCKET_HOUR;
+    time_t time = _BucketStart(smallest, startTime);
+    while (time <= endTime) {
+        int32 kind = time < fHoursFoldedBefore ? BUCKET_DAY : BUCKET_HOUR;
+        for (int32 larger = BUCKET_MONTH; larger > kind; larger--) {
+            if (_BucketStart(larger, time) == time
+                && _BucketEnd(larger, time) - 1 <= endTime) {
+                kind = larger;
+                break;
+            }
+        }
+
+        std::map<time_t, Bucket>::const_iterator found = fBuckets[kind].find(time);
+        if (found != fBuckets[kind].end()) {
+            for (Bucket::const_iterator it = found->second.begin();
+                    it != found->second.end(); it++) {
+                if ((provider.Length() == 0 || it->first.first == provider)
+                    && (model.Length() == 0 || it->first.second == model)) {
+                    *inputTokens += it->second.input;
+                    *outputTokens += it->second.output;
+                }
+            }
+        }
+
+        time = _BucketEnd(kind, time);
+    }
+}
+
+status_t UsageRollup::Compact()
+{
+    // Without this, the hour buckets would grow with every hour of use
+    _FoldHours(_BucketStart(BUCKET_DAY, time(NULL) - kHourRetention));
+
+    BMessage rollups;
+    rollups.AddInt64("sequence", fLastSequence);
+    rollups.AddInt64("hours_folded_before", fHoursFoldedBefore);
+
+    for (int32 kind = 0; kind < BUCKET_KINDS; kind++) {
+        for (std::map<time_t, Bucket>::const_iterator bucket = fBuckets[kind].begin();
+                bucket != fBuckets[kind].end(); bucket++) {
+            for (Bucket::const_iterator it = bucket->second.begin();
+                    it != bucket->second.end(); it++) {
+                rollups.AddInt32("kind", kind);
+                rollups.AddInt64("start", bucket->first);
+                rollups.AddString("provider", it->first.first);
+                rollups.AddString("model", it->first.second);
+                rollups.AddInt64("input", it->second.input);
+                rollups.AddInt64("output", it->second.output);
+            }
+        }
+    }
+
+    // Write a new file and move it over the old one, so there always is
+    // a complete one
+    BPath tempPath(fRollupsPath);
+    BString tempName(tempPath.Leaf());
+    tempName << ".new";
+    tempPath.GetParent(&tempPath);
+    tempPath.Append(tempName);
+
+    BFile file(tempPath.Path(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+    status_t status = file.InitCheck();
+    if (status == B_OK)
+        status = rollups.Flatten(&file);
+    if (status == B_OK)
+        status = file.Sync();
+    file.Unset();
+
+    BEntry entry(tempPath.Path());
+    if (status == B_OK)
+        status = entry.Rename(fRollupsPath.Leaf(), true);
+    if (status != B_OK) {
+        entry.Remove();
+        return status;
+    }
+
+    fCompactedSequence = fLastSequence;
+
+    // The events are in the buckets now
+    BFile events(fEventsPath.Path(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+    fPendingEvents = 0;
+    return events.InitCheck();
+}
+
+void UsageRollup::_FoldHours(time_t before)
+{
+    if (before <= fHoursFoldedBefore)
+        return;
+
+    // Every request was added to its day as well, so the hours can simply
+    // go; the day buckets hold their sums
+    std::map<time_t, Bucket>& hours = fBuckets[BUCKET_HOUR];
+    hours.erase(hours.begin(), hours.lower_bound(before));
+    fHoursFoldedBefore = before;
+}
+
+time_t UsageRollup::_BucketStart(int32 kind, time_t when)
+{
+    // Buckets follow local time, so "this month" is the user's month
+    struct tm date;
+    localtime_r(&when, &date);
+    date.tm_sec = 0;
+    date.tm_min = 0;
+    if (kind >= BUCKET_DAY)
+        date.tm_hour = 0;
+    if (kind >= BUCKET_MONTH)
+        date.tm_mday = 1;
+
+    // Midnight may fall on the other side of a daylight saving change
+    if (kind >= BUCKET_DAY)
+        date.tm_isdst = -1;
+    return mktime(&date);
+}
+
+time_t UsageRollup::_BucketEnd(int32 kind, time_t start)
+{
+    if (kind == BUCKET_HOUR)
+        return start + 3600;
+
+    struct tm date;
+    localtime_r(&start, &date);
+    if (kind == BUCKET_DAY)
+        date.tm_mday++;
+    else
+        date.tm_mon++;
+    date.tm_isdst = -1;
+    return mktime(&date);
+}
@@ -0,0 +1,90 @@
+// UsageRollup.h
+#ifndef USAGE_ROLLUP_H
+#define USAGE_ROLLUP_H
+
+#include <String.h>
+#include <Path.h>
+#include <time.h>
+
+#include <map>
+#include <utility>
+
+// Token usage summed into hourly, daily and monthly buckets per provider
+// and model. Every recorded request is added to the buckets in memory and
+// appended to an event log; compacting writes the buckets out in one file
+// and empties the log. Loading reads the buckets and replays the events
+// that were not compacted yet.
+//
+// Totals over a time range use the coarsest buckets that fit inside it,
+// so they take time in the number of buckets, not of requests. They are
+// exact to the hour: the hours the range starts and ends in count whole.
+// Compacting folds hours older than kHourRetention into their days, which
+// already hold their sums, so before that the days count whole instead.
+class UsageRollup {
+public:
+    UsageRollup();
+
+    // Returns B_ENTRY_NOT_FOUND if nothing was compacted in directory yet
+    status_t Load(const BPath& directory);
+
+    // Adds a request; with logEvent false it is only kept until the next
+    // compaction, for callers that keep the event themselves
+    status_t Add(const BString& provider, const BString& model, time_t when,
+                 int64 inputTokens, int64 outputTokens, bool logEvent = true);
+
+    // Empty provider or model match all
+    void GetTotal(const BString& provider, const BString& model,
+                  time_t startTime, time_t endTime,
+                  int64* inputTokens, int64* outputTokens) const;
+
+    // Events logged since the last compaction
+    int32 PendingEvents() const { return fPendingEvents; }
+
+    status_t Compact();
+
+private:
+    enum {
+        BUCKET_HOUR,
+        BUCKET_DAY,
+        BUCKET_MONTH,
+        BUCKET_KINDS
+    };
+
+    struct Counters {
+        int64 input;
+        int64 output;
+    };
+
+    // (provider, model)
+    typedef std::pair<BString, BString> Source;
+    typedef std::map<Source, Counters> Bucket;
+
+    void _AddToBuckets(const Source& source, time_t when, int64 inputTokens,
+                       int64 outputTokens);
+    status_t _ReplayEvents();
+
+    void _FoldHours(time_t before);
+
+    static time_t _BucketStart(int32 kind, time_t when);
+    static time_t _BucketEnd(int32 kind, time_t start);
+
+    // Hour buckets are kept this long, in seconds
+    static const time_t kHourRetention = 31 * 24 * 3600;
+
+    std::map<time_t, Bucket> fBuckets[BUCKET_KINDS];
+
+    // Start of the first day whose hours are kept; the hours of days
+    // before it have been folded
+    time_t fHoursFoldedBefore;
+
+    BPath fRollupsPath;
+    BPath fEventsPath;
+    int32 fPendingEvents;
+
+    // Events carry a sequence number, and the compacted buckets the last
+    // one they include, so a crash during compaction counts nothing twice
+    int64 fLastSequence;
+    int64 fCompactedSequence;
+};
+
+#endif // USAGE_ROLLUP_H
@@ -3,6 +3,8 @@
 #include "AnthropicProvider.h"
 
 #include <Application.h>
+#include <ErrorsExt.h>
+#include <ExclusiveBorrow.h>
 #include <HttpSession.h>
 #include <HttpRequest.h>
 #include <HttpResult.h>
@@ -11,36 +13,111 @@
 
 #include <memory>
 #include <stdlib.h>
-#include <Path.h>
-#include <File.h>
-#include <FindDirectory.h>
-#include <OS.h>
-#include <stdlib.h>
 
 #include "ChatView.h"
-#include "external/json.hpp"
+#include "HttpSessionPool.h"
+#include "JSONExtractor.h"
+#include "JSONWriter.h"
+#include "RequestExecutor.h"
 #include "SettingsManager.h"
 #include "ChatMessage.h"
-#include "ChatView.h"
+#include "StreamParser.h"
 
 using namespace BPrivate::Network;
 
-// Request thread struct
-struct RequestThreadData {
-    BObjectList<ChatMessage, true> history;
+// A single chat request, run on a RequestExecutor worker
+class AnthropicRequest : public LLMRequest {
+public:
+    AnthropicRequest()
+        : LLMRequest("Anthropic")
+    {
+    }
+
+    virtual void Run()
+    {
+        AnthropicProvider::_RequestThreadFunc(this);
+    }
+
     BString message;
     BString apiKey;
     BString apiBase;
     BString model;
-    BMessenger* messenger;
-    bool* cancelFlag;
+    bool stream;
+};
+
+// Parses Messages API stream events and forwards each text delta
+class AnthropicStream : public SSEStream {
+public:
+    AnthropicStream(LLMRequest* request)
+        : fRequest(request)
+        , fInputTokens(0)
+        , fOutputTokens(0)
+    {
+        fTypeField = fExtractor.AddString("delta.type", &fDeltaType);
+        fTextField = fExtractor.AddString("delta.text", &fDeltaText);
+        fErrorField = fExtractor.AddString("error.message", &fErrorMessage);
+
+        // Input tokens are known before generation starts ("message_start"),
+        // "message_delta" then carries the cumulative output token count.
+        // The paths only occur in their own events, so they can share targets.
+        fExtractor.AddInt("message.usage.input_tokens", &fInputTokens);
+        fExtractor.AddInt("message.usage.output_tokens", &fOutputTokens);
+        fExtractor.AddInt("usage.output_tokens", &fOutputTokens);
+    }
+
+    const BString& Content() const { return fContent; }
+    const BString& Error() const { return fError; }
+    int32 InputTokens() const { return (int32)fInputTokens; }
+    int32 OutputTokens() const { return (int32)fOutputTokens; }
+
+protected:
+    virtual status_t EventReceived(const BString& event, const BString& data)
+    {
+        // Failing the write aborts the transfer
+        if (fRequest->IsCancelled())
+            return B_CANCELED;
+
+        if (!fExtractor.Parse(data.String(), data.Length()))
+            return B_OK;
+
+        if (event == "content_block_delta") {
+            if (fExtractor.Found(fTypeField) && fDeltaType == "text_delta"
+                && fExtractor.Found(fTextField) && !fDeltaText.IsEmpty()) {
+                fContent << fDeltaText;
+
+                BMessage deltaMsg(MSG_MESSAGE_DELTA);
+                deltaMsg.AddString("content", fDeltaText);
+                fRequest->Post(&deltaMsg);
+            }
+        } else if (event == "error") {
+            fError = fExtractor.Found(fErrorField) ? fErrorMessage.String()
+                : "unknown error";
+        }
+
+        // "ping", "content_block_start", "content_block_stop" and
+        // "message_stop" carry nothing we need
+
+        return B_OK;
+    }
+
+private:
+    LLMRequest* fRequest;
+    JSONExtractor fExtractor;
+    int32 fTypeField;
+    int32 fTextField;
+    int32 fErrorField;
+    BString fDeltaType;
+    BString fDeltaText;
+    BString fErrorMessage;
+    BString fContent;
+    BString fError;
+    int64 fInputTokens;
+    int64 fOutputTokens;
 };
 
 AnthropicProvider::AnthropicProvider()
     : LLMProvider("Anthropic")
     , fModels(10)
-    , fRequestThread(-1)
-    , fCancelRequested(false)
 {
     // Set default API base
     fApiBase = "https://api.anthropic.com/v1";
@@ -51,7 +128,7 @@ AnthropicProvider::AnthropicProvider()
 
 AnthropicProvider::~AnthropicProvider()
 {
-    CancelRequest();
+    CancelAllRequests();
 }
 
 void AnthropicProvider::_InitModels()
@@ -84,16 +161,10 @@ BObjectList<LLMModel>* AnthropicProvider::GetModels()
     return &fModels;
 }
 
-void AnthropicProvider::SendMessage(const BObjectList<ChatMessage, true>& history,
+request_id AnthropicProvider::SendMessage(const ChatHistory& history,
                                const BString& message,
                                BMessenger* messenger)
 {
-    // Cancel any existing request
-    CancelRequest();
-
-    // Reset cancel flag
-    fCancelRequested = false;
-
     // Get API key and model from settings
     SettingsManager* settings = SettingsManager::GetInstance();
     BString apiKey = settings->GetApiKey("Anthropic");
@@ -105,14 +176,13 @@ void AnthropicProvider::SendMessage(const BObjectList<ChatMessage, true>& histor
         int32 pathPos = apiBase.FindLast("/v1");
         apiBase.Truncate(pathPos + 3); // Keep up to "/v1"
     }
-    printf("Using API base: %s\n", apiBase.String());
 
     if (apiKey.IsEmpty()) {
         // Notify about missing API key
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
         errorMsg.AddString("content", "Error: Please set an Anthropic API key in settings.");
         messenger->SendMessage(&errorMsg);
-        return;
+        return B_NOT_ALLOWED;
     }
 
     if (apiBase.IsEmpty()) {
@@ -124,219 +194,214 @@ void AnthropicProvider::SendMessage(const BObjectList<ChatMessage, true>& histor
     }
 
     // Prepare thread data
-    RequestThreadData* threadData = new RequestThreadData();
-
-    // Copy history
-    for (int32 i = 0; i < history.CountItems(); i++) {
-        ChatMessage* msg = new ChatMessage(
-            history.ItemAt(i)->Content(),
-            history.ItemAt(i)->Role()
-        );
-        threadData->history.AddItem(msg);
-    }
+    AnthropicRequest* threadData = new AnthropicRequest();
+
+    // Share the history; only references are taken
+    threadData->history = history;
 
     threadData->message = message;
     threadData->apiKey = apiKey;
     threadData->apiBase = apiBase;
     threadData->model = model;
-    threadData->messenger = messenger;
-    threadData->cancelFlag = &fCancelRequested;
-
-    // Start request thread
-    fRequestThread = spawn_thread(_RequestThreadFunc, "Anthropic Request",
-                                 B_NORMAL_PRIORITY, threadData);
-
-    if (fRequestThread >= 0) {
-        resume_thread(fRequestThread);
-    } else {
-        // Thread creation failed
-        delete threadData;
+    threadData->stream = settings->GetStreamingEnabled();
+    threadData->messenger = *messenger;
 
+    // Queue the request on the shared worker pool
+    request_id id = _SubmitRequest(threadData);
+    if (id < 0) {
+        // The executor has already disposed of the job
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", "Error: Failed to create request thread.");
+        errorMsg.AddString("content", "Error: Failed to queue request.");
         messenger->SendMessage(&errorMsg);
     }
-}
-
-void AnthropicProvider::CancelRequest()
-{
-    if (fRequestThread >= 0) {
-        fCancelRequested = true;
-
-        // Wait for thread to terminate
-        status_t result;
-        wait_for_thread(fRequestThread, &result);
 
-        fRequestThread = -1;
-    }
+    return id;
 }
 
 int32 AnthropicProvider::_RequestThreadFunc(void* data)
 {
-    RequestThreadData* threadData = static_cast<RequestThreadData*>(data);
+    AnthropicRequest* threadData = static_cast<AnthropicRequest*>(data);
 
     // Convenience aliases
     const BString& apiKey = threadData->apiKey;
     const BString& apiBase = threadData->apiBase;
     const BString& model = threadData->model;
-    BMessenger* messenger = threadData->messenger;
-    bool* cancelFlag = threadData->cancelFlag;
-
-    // Prepare request body
-    using json = nlohmann::json;
-    json requestBody;
-    requestBody["model"] = model.String();
-    requestBody["messages"] = json::array();
 
-    // Add history messages
+    // Cancelled while still queued behind other requests
+    if (threadData->IsCancelled())
+        return 0;
+
+    // Write the request body straight into the upload buffer; each
+    // message contributes its cached JSON fragment
+    auto bodyInput = std::make_unique<BMallocIO>();
+    JSONWriter writer(bodyInput.get());
+    writer.BeginObject();
+    writer.String("model", model.String(), model.Length());
+
+    // The Messages API takes system prompts as a top-level field rather
+    // than as a message role
+    BString systemPrompt;
+    writer.BeginArray("messages");
     for (int32 i = 0; i < threadData->history.CountItems(); i++) {
-        ChatMessage* msg = threadData->history.ItemAt(i);
-
-        json messageObj;
-
-        switch (msg->Role()) {
-            case MESSAGE_ROLE_USER:
-                messageObj["role"] = "user";
-                break;
-            case MESSAGE_ROLE_ASSISTANT:
-                messageObj["role"] = "assistant";
-                break;
-            case MESSAGE_ROLE_SYSTEM:
-                messageObj["role"] = "system";
-                break;
+        const ChatMessage* msg = threadData->history.ItemAt(i);
+
+        if (msg->Role() == MESSAGE_ROLE_SYSTEM) {
+            if (!systemPrompt.IsEmpty())
+                systemPrompt << "\n\n";
+            systemPrompt << msg->Content();
+            continue;
         }
 
-        messageObj["content"] = msg->Content().String();
-        requestBody["messages"].push_back(messageObj);
+        writer.Raw(NULL, msg->JSONFragment());
     }
+    writer.EndArray();
+
+    if (!systemPrompt.IsEmpty())
+        writer.String("system", systemPrompt.String(), systemPrompt.Length());
 
     // Set additional parameters
-    requestBody["temperature"] = 0.7;
-    requestBody["max_tokens"] = 1000;
-
-    // Convert JSON to string
-    std::string requestBodyStr = requestBody.dump();
-
-    // Create a temporary file for the response
-    BPath tempPath;
-    find_directory(B_SYSTEM_TEMP_DIRECTORY, &tempPath);
-    tempPath.Append("otto_response.json");
-
-    // Sanitize the request body for command line usage
-    std::string sanitizedRequest = requestBodyStr;
-    // Replace single quotes with escaped single quotes for shell command
-    size_t pos = 0;
-    while ((pos = sanitizedRequest.find("'", pos)) != std::string::npos) {
-        sanitizedRequest.replace(pos, 1, "'\\''");
-        pos += 4; // Move past the replacement
-    }
+    writer.Double("temperature", 0.7);
+    writer.Int("max_tokens", threadData->history.ReplyTokens());
 
-    // Build the curl command
-    BString curlCmd;
-    curlCmd << "curl -s -X POST ";
-    curlCmd << "-H \"Content-Type: application/json\" ";
-    curlCmd << "-H \"x-api-key: " << apiKey << "\" ";
-    curlCmd << "-H \"anthropic-version: 2023-06-01\" ";
-    curlCmd << "-d '" << sanitizedRequest.c_str() << "' ";
-    curlCmd << "\"" << apiBase << "/messages\" ";
-    curlCmd << "> " << tempPath.Path();
-
-    // Print debug info
-    printf("Executing curl command:\n%s\n", curlCmd.String());
-    printf("API Base: %s, Model: %s\n", apiBase.String(), model.String());
-
-    // Execute the command
-    int result = system(curlCmd.String());
-    if (result != 0) {
-        printf("Error executing curl command: %d\n", result);
-        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", BString("Error: Failed to execute API request. Check that curl is installed."));
-        messenger->SendMessage(&errorMsg);
-        return -1;
+    if (threadData->stream)
+        writer.Bool("stream", true);
+
+    writer.EndObject();
+    size_t bodyLength = writer.Length();
+
+    // Create URL
+    BString urlString(apiBase);
+    urlString << "/messages";
+    BUrl url(urlString.String());
+
+    // Prepare HTTP request
+    BHttpRequest request(url);
+    request.SetMethod(BHttpMethod::Post);
+
+    // Set headers
+    BHttpFields fields;
+    fields.AddField("Content-Type", "application/json");
+    fields.AddField(std::string_view("x-api-key"), std::string_view(apiKey.String()));
+    fields.AddField("anthropic-version", "2023-06-01");
+    request.SetFields(fields);
+
+    // Set request body
+    bodyInput->Seek(0, SEEK_SET);
+    request.SetRequestBody(std::move(bodyInput), "application/json", bodyLength);
+
+    // Execute request on the shared session for this host
+    BHttpSession session = HttpSessionPool::GetInstance()->SessionFor(url);
+
+    if (threadData->stream) {
+        return _ExecuteStreaming(threadData, session, std::move(request));
     }
 
-    // Read the response from the temp file
-    BFile responseFile(tempPath.Path(), B_READ_ONLY);
-    if (responseFile.InitCheck() != B_OK) {
+    BString responseStr;
+    try {
+        BHttpResult result = threadData->Execute(session, std::move(request));
+
+        // Check result
+        const BHttpStatus& status = result.Status();
+        if (status.code != 200) {
+            BString body = result.Body().text.value_or(BString());
+            BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+            errorMsg.AddString("content", _HTTPError(status.code, body));
+            threadData->Post(&errorMsg);
+            return -1;
+        }
+
+        responseStr = result.Body().text.value_or(BString());
+    } catch (const BError& e) {
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", "Error: Failed to read API response");
-        messenger->SendMessage(&errorMsg);
+        errorMsg.AddString("content", BString("Network error: ") << e.Message());
+        threadData->Post(&errorMsg);
         return -1;
     }
 
-    // Get file size
-    off_t fileSize;
-    responseFile.GetSize(&fileSize);
-    if (fileSize == 0) {
+    if (responseStr.IsEmpty()) {
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
         errorMsg.AddString("content", "Error: Empty response from API");
-        messenger->SendMessage(&errorMsg);
+        threadData->Post(&errorMsg);
         return -1;
     }
-    printf("Response file size: %lld bytes\n", fileSize);
 
-    // Read content
-    char* buffer = new char[fileSize + 1];
-    responseFile.Read(buffer, fileSize);
-    buffer[fileSize] = '\0';
+    // Extract completion text and token usage
+    BString completionText;
+    int64 inputTokens = 0, outputTokens = 0;
 
-    // Parse response
-    try {
-        std::string responseStr(buffer);
-        json responseJson = json::parse(responseStr);
+    JSONExtractor extractor;
+    int32 contentField = extractor.AddString("content.0.text", &completionText);
+    extractor.AddInt("usage.input_tokens", &inputTokens);
+    extractor.AddInt("usage.output_tokens", &outputTokens);
 
-        BString completionText;
-        int32 inputTokens = 0, outputTokens = 0;
+    if (!extractor.Parse(responseStr.String(), responseStr.Length())) {
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", "JSON parsing error: invalid response");
+        threadData->Post(&errorMsg);
+        return 0;
+    }
 
-        printf("Successfully parsed JSON response\n");
+    if (extractor.Found(contentField)) {
+        // Send response
+        BMessage responseMsg(MSG_MESSAGE_RECEIVED);
+        responseMsg.AddString("content", completionText);
+        responseMsg.AddInt32("input_tokens", (int32)inputTokens);
+        responseMsg.AddInt32("output_tokens", (int32)outputTokens);
+        threadData->Post(&responseMsg);
+    } else {
+        // Send an error message to the UI
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", "Error: Unexpected API response format.");
+        threadData->Post(&errorMsg);
+    }
 
-        // Extract completion text and token usage
-        if (responseJson.contains("content") &&
-            !responseJson["content"].empty() &&
-            responseJson["content"][0].contains("text")) {
-            printf("Found content in response\n");
+    return 0;
+}
 
-            completionText = responseJson["content"][0]["text"].get<std::string>().c_str();
-            printf("Completion text length: %ld\n", completionText.Length());
+int32 AnthropicProvider::_ExecuteStreaming(LLMRequest* threadData, BHttpSession& session,
+                                           BHttpRequest&& request)
+{
+    // The body is parsed chunk by chunk on the session's data thread
+    auto target = make_exclusive_borrow<AnthropicStream>(threadData);
 
-            if (responseJson.contains("usage")) {
-                inputTokens = responseJson["usage"]["input_tokens"].get<int>();
-                outputTokens = responseJson["usage"]["output_tokens"].get<int>();
-            }
-            printf("Tokens - Input: %d, Output: %d\n", inputTokens, outputTokens);
-
-            // Send response
-            BMessage responseMsg(MSG_MESSAGE_RECEIVED);
-            responseMsg.AddString("content", completionText);
-            responseMsg.AddInt32("input_tokens", inputTokens);
-            responseMsg.AddInt32("output_tokens", outputTokens);
-            messenger->SendMessage(&responseMsg);
-            printf("Response message sent via messenger\n");
-        }
-        else {
-            printf("Content structure not found in response\n");
-            printf("Raw response: %s\n", buffer);
+    try {
+        BHttpResult result = threadData->Execute(session, std::move(request), BBorrow<BDataIO>(target));
 
-            // Send an error message to the UI
+        const BHttpStatus& status = result.Status();
+        if (status.code != 200) {
+            // Error bodies are plain JSON, without event framing
+            result.Body();
             BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-            errorMsg.AddString("content", "Error: Unexpected API response format. Check console for details.");
-            messenger->SendMessage(&errorMsg);
+            errorMsg.AddString("content", _HTTPError(status.code, target->Body()));
+            threadData->Post(&errorMsg);
+            return -1;
         }
-    } catch (const std::exception& e) {
-        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
 
-        // Print the raw response for debugging
-        printf("JSON parsing error: %s\n", e.what());
-        printf("Raw response: %s\n", buffer);
-        messenger->SendMessage(&errorMsg);
+        // Wait until message_stop has been delivered
+        result.Body();
+    } catch (const BError& e) {
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", BString("Network error: ") << e.Message());
+        threadData->Post(&errorMsg);
+        return -1;
     }
 
-    // Delete buffer
-    delete[] buffer;
+    target->Flush();
+
+    if (!target->Error().IsEmpty()) {
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", BString("API Error: ") << target->Error());
+        threadData->Post(&errorMsg);
+        return -1;
+    }
 
-    // Optionally remove the temporary file
-    BEntry tempEntry(tempPath.Path());
-    tempEntry.Remove();
+    // Final message with the complete text and the usage
+    BMessage responseMsg(MSG_MESSAGE_RECEIVED);
+    responseMsg.AddString("content", target->Content());
+    responseMsg.AddInt32("input_tokens", target->InputTokens());
+    responseMsg.AddInt32("output_tokens", target->OutputTokens());
+    responseMsg.AddBool("streamed", true);
+    threadData->Post(&responseMsg);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,6 +1,8 @@
 // providers/OllamaProvider.cpp
 #include "OllamaProvider.h"
 
+#include <ErrorsExt.h>
+#include <ExclusiveBorrow.h>
 #include <HttpSession.h>
 #include <HttpRequest.h>
 #include <HttpResult.h>
@@ -12,39 +14,82 @@
 
 #include "ChatView.h"
 #include "SettingsManager.h"
-#include "external/json.hpp"
-#include "SettingsManager.h"
+#include "HttpSessionPool.h"
+#include "JSONExtractor.h"
+#include "JSONWriter.h"
+#include "RequestExecutor.h"
 #include "ChatMessage.h"
-#include "ChatView.h"
+#include "OllamaStream.h"
 
 using namespace BPrivate::Network;
 
-// Request thread struct
-struct RequestThreadData {
-    BObjectList<ChatMessage, true> history;
+// A single chat request, run on a RequestExecutor worker
+class OllamaRequest : public LLMRequest {
+public:
+    OllamaRequest()
+        : LLMRequest("Ollama")
+    {
+    }
+
+    virtual void Run()
+    {
+        OllamaProvider::_RequestThreadFunc(this);
+    }
+
     BString message;
     BString apiBase;
     BString model;
-    BMessenger* messenger;
-    bool* cancelFlag;
+    bool stream;
+};
+
+// Forwards the deltas of a streamed reply as they arrive
+class OllamaRequestStream : public OllamaStream {
+public:
+    OllamaRequestStream(LLMRequest* request)
+        : fRequest(request)
+    {
+    }
+
+protected:
+    virtual status_t LineReceived(const char* line, size_t length)
+    {
+        // Failing the write aborts the transfer
+        if (fRequest->IsCancelled())
+            return B_CANCELED;
+
+        return OllamaStream::LineReceived(line, length);
+    }
+
+    virtual status_t DeltaReceived(const BString& delta)
+    {
+        BMessage deltaMsg(MSG_MESSAGE_DELTA);
+        deltaMsg.AddString("content", delta);
+        fRequest->Post(&deltaMsg);
+        return B_OK;
+    }
+
+private:
+    LLMRequest* fRequest;
 };
 
 OllamaProvider::OllamaProvider()
     : LLMProvider("Ollama")
     , fModels(10)
-    , fRequestThread(-1)
-    , fCancelRequested(false)
 {
     // Set default API base
     fApiBase = "http://localhost:11434";
 
+    // A local server generates one reply at a time anyway; requests of
+    // other chats wait in the queue
+    RequestExecutor::GetInstance()->SetConcurrencyLimit(fName, 1);
+
     // Init models
     _InitModels();
 }
 
 OllamaProvider::~OllamaProvider()
 {
-    CancelRequest();
+    CancelAllRequests();
 }
 
 void OllamaProvider::_InitModels()
@@ -76,16 +121,10 @@ BObjectList<LLMModel>* OllamaProvider::GetModels()
     return &fModels;
 }
 
-void OllamaProvider::SendMessage(const BObjectList<ChatMessage, true>& history,
+request_id OllamaProvider::SendMessage(const ChatHistory& history,
                              const BString& message,
                              BMessenger* messenger)
 {
-    // Cancel any existing request
-    CancelRequest();
-
-    // Reset cancel flag
-    fCancelRequested = false;
-
     // Get API base and model from settings
     SettingsManager* settings = SettingsManager::GetInstance();
     BString apiBase = settings->GetApiBase("Ollama");
@@ -100,98 +139,64 @@ void OllamaProvider::SendMessage(const BObjectList<ChatMessage, true>& history,
     }
 
     // Prepare thread data
-    RequestThreadData* threadData = new RequestThreadData();
-
-    // Copy history
-    for (int32 i = 0; i < history.CountItems(); i++) {
-        ChatMessage* msg = new ChatMessage(
-            history.ItemAt(i)->Content(),
-            history.ItemAt(i)->Role()
-        );
-        threadData->history.AddItem(msg);
-    }
+    OllamaRequest* threadData = new OllamaRequest();
+
+    // Share the history; only references are taken
+    threadData->history = history;
 
     threadData->message = message;
     threadData->apiBase = apiBase;
     threadData->model = model;
-    threadData->messenger = messenger;
-    threadData->cancelFlag = &fCancelRequested;
-
-    // Start request thread
-    fRequestThread = spawn_thread(_RequestThreadFunc, "Ollama Request",
-                                B_NORMAL_PRIORITY, threadData);
-
-    if (fRequestThread >= 0) {
-        resume_thread(fRequestThread);
-    } else {
-        // Thread creation failed
-        delete threadData;
+    threadData->stream = settings->GetStreamingEnabled();
+    threadData->messenger = *messenger;
 
+    // Queue the request on the shared worker pool
+    request_id id = _SubmitRequest(threadData);
+    if (id < 0) {
+        // The executor has already disposed of the job
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", "Error: Failed to create request thread.");
+        errorMsg.AddString("content", "Error: Failed to queue request.");
         messenger->SendMessage(&errorMsg);
     }
-}
-
-void OllamaProvider::CancelRequest()
-{
-    if (fRequestThread >= 0) {
-        fCancelRequested = true;
-
-        // Wait for thread to terminate
-        status_t result;
-        wait_for_thread(fRequestThread, &result);
 
-        fRequestThread = -1;
-    }
+    return id;
 }
 
 int32 OllamaProvider::_RequestThreadFunc(void* data)
 {
-    RequestThreadData* threadData = static_cast<RequestThreadData*>(data);
+    OllamaRequest* threadData = static_cast<OllamaRequest*>(data);
 
     // Convenience aliases
     const BString& apiBase = threadData->apiBase;
     const BString& model = threadData->model;
-    BMessenger* messenger = threadData->messenger;
-    bool* cancelFlag = threadData->cancelFlag;
-
-    // Prepare request body
-    using json = nlohmann::json;
-    json requestBody;
-    requestBody["model"] = model.String();
-    requestBody["messages"] = json::array();
-
-    // Add history messages
-    for (int32 i = 0; i < threadData->history.CountItems(); i++) {
-        ChatMessage* msg = threadData->history.ItemAt(i);
-
-        json messageObj;
-
-        switch (msg->Role()) {
-            case MESSAGE_ROLE_USER:
-                messageObj["role"] = "user";
-                break;
-            case MESSAGE_ROLE_ASSISTANT:
-                messageObj["role"] = "assistant";
-                break;
-            case MESSAGE_ROLE_SYSTEM:
-                messageObj["role"] = "system";
-                break;
-        }
 
-        messageObj["content"] = msg->Content().String();
-        requestBody["messages"].push_back(messageObj);
-    }
+    // Cancelled while still queued behind other requests
+    if (threadData->IsCancelled())
+        return 0;
 
-    // Add current message
-    json userMsg;
-    userMsg["role"] = "user";
-    userMsg["content"] = threadData->message.String();
-    requestBody["messages"].push_back(userMsg);
+    // Write the request body straight into the upload buffer; each
+    // message contributes its cached JSON fragment (the history already
+    // ends with the new message)
+    auto bodyInput = std::make_unique<BMallocIO>();
+    JSONWriter writer(bodyInput.get());
+    writer.BeginObject();
+    writer.String("model", model.String(), model.Length());
+
+    writer.BeginArray("messages");
+    for (int32 i = 0; i < threadData->history.CountItems(); i++)
+        writer.Raw(NULL, threadData->history.ItemAt(i)->JSONFragment());
+    writer.EndArray();
+
+    // Ollama streams by default; be explicit either way
+    writer.Bool("stream", threadData->stream);
+
+    // The reply is limited to what the context planner reserved for it
+    writer.BeginObject("options");
+    writer.Int("num_predict", threadData->history.ReplyTokens());
+    writer.EndObject();
 
-    // Convert JSON to string
-    std::string requestBodyStr = requestBody.dump();
+    writer.EndObject();
+    size_t bodyLength = writer.Length();
 
     // Create URL
     BUrl url(apiBase.String());
@@ -207,60 +212,121 @@ int32 OllamaProvider::_RequestThreadFunc(void* data)
     request.SetFields(fields);
 
     // Set request body
-    auto bodyInput = std::make_unique<BMallocIO>();
-    bodyInput->Write(requestBodyStr.c_str(), requestBodyStr.length());
     bodyInput->Seek(0, SEEK_SET);
-    request.SetRequestBody(std::move(bodyInput), "application/json", requestBodyStr.length());
+    request.SetRequestBody(std::move(bodyInput), "application/json", bodyLength);
+
+    // Execute request on the shared session for this host
+    BHttpSession session = HttpSessionPool::GetInstance()->SessionFor(url);
 
-    // Execute request
-    BHttpSession session;
-    BHttpResult result = session.Execute(std::move(request));
+    if (threadData->stream) {
+        return _ExecuteStreaming(threadData, session, std::move(request));
+    }
 
-    // Check result
-    const BHttpStatus& status = result.Status();
-    if (status.code != 200) {
-        // Handle error
+    BString responseStr;
+    try {
+        BHttpResult result = threadData->Execute(session, std::move(request));
+
+        // Check result
+        const BHttpStatus& status = result.Status();
+        if (status.code != 200) {
+            // Handle error
+            BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+            errorMsg.AddString("content", BString("HTTP Error: ") << status.code);
+            threadData->Post(&errorMsg);
+            return -1;
+        }
+
+        responseStr = result.Body().text.value_or(BString());
+    } catch (const BError& e) {
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", BString("HTTP Error: ") << status.code);
-        messenger->SendMessage(&errorMsg);
+        errorMsg.AddString("content", BString("Network error: ") << e.Message());
+        threadData->Post(&errorMsg);
         return -1;
     }
 
-    // Parse response
-    try {
-        std::string responseStr = result.Body().text.value().String();
-        json responseJson = json::parse(responseStr);
+    // Extract completion text and token usage; Ollama reports its own
+    // evaluation counters instead of a usage object
+    BString completionText;
+    int64 inputTokens = 0, outputTokens = 0, evalDuration = 0;
 
-        BString completionText;
-        int32 inputTokens = 0, outputTokens = 0;
+    JSONExtractor extractor;
+    int32 contentField = extractor.AddString("message.content", &completionText);
+    extractor.AddInt("prompt_eval_count", &inputTokens);
+    extractor.AddInt("eval_count", &outputTokens);
+    int32 durationField = extractor.AddInt("eval_duration", &evalDuration);
 
-        // Extract completion text and token usage
-        if (responseJson.contains("message") &&
-            responseJson["message"].contains("content")) {
+    if (!extractor.Parse(responseStr.String(), responseStr.Length())) {
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", "JSON parsing error: invalid response");
+        threadData->Post(&errorMsg);
+        return 0;
+    }
 
-            completionText = responseJson["message"]["content"].get<std::string>().c_str();
+    if (extractor.Found(contentField)) {
+        // Send response
+        BMessage responseMsg(MSG_MESSAGE_RECEIVED);
+        responseMsg.AddString("content", completionText);
+        responseMsg.AddInt32("input_tokens", (int32)inputTokens);
+        responseMsg.AddInt32("output_tokens", (int32)outputTokens);
+        if (extractor.Found(durationField))
+            responseMsg.AddInt64("eval_duration", evalDuration);
+        threadData->Post(&responseMsg);
+    }
 
-            // Ollama provides different token counting
-            if (responseJson.contains("prompt_eval_count")) {
-                inputTokens = responseJson["prompt_eval_count"].get<int>();
-            }
+    return 0;
+}
 
-            if (responseJson.contains("eval_count")) {
-                outputTokens = responseJson["eval_count"].get<int>();
-            }
+int32 OllamaProvider::_ExecuteStreaming(LLMRequest* threadData, BHttpSession& session,
+                                        BHttpRequest&& request)
+{
+    // The body is parsed line by line on the session's data thread
+    auto target = make_exclusive_borrow<OllamaRequestStream>(threadData);
 
-            // Send response
-            BMessage responseMsg(MSG_MESSAGE_RECEIVED);
-            responseMsg.AddString("content", completionText);
-            responseMsg.AddInt32("input_tokens", inputTokens);
-            responseMsg.AddInt32("output_tokens", outputTokens);
-            messenger->SendMessage(&responseMsg);
+    try {
+        BHttpResult result = threadData->Execute(session, std::move(request), BBorrow<BDataIO>(target));
+
+        const BHttpStatus& status = result.Status();
+        if (status.code != 200) {
+            // Ollama reports errors as a single {"error": ...} line, which
+            // has no newline to end it
+            result.Body();
+            target->Flush();
+            BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+            BString error("HTTP Error: ");
+            error << status.code;
+            if (!target->Error().IsEmpty())
+                error << " (" << target->Error() << ")";
+            errorMsg.AddString("content", error);
+            threadData->Post(&errorMsg);
+            return -1;
         }
-    } catch (const std::exception& e) {
+
+        // Wait until the "done" line has been delivered
+        result.Body();
+    } catch (const BError& e) {
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", BString("JSON parsing error: ") << e.what());
-        messenger->SendMessage(&errorMsg);
+        errorMsg.AddString("content", BString("Network error: ") << e.Message());
+        threadData->Post(&errorMsg);
+        return -1;
     }
 
+    target->Flush();
+
+    if (!target->Error().IsEmpty()) {
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", BString("Ollama error: ") << target->Error());
+        threadData->Post(&errorMsg);
+        return -1;
+    }
+
+    // Final message with the complete text and the counters from the done line
+    BMessage responseMsg(MSG_MESSAGE_RECEIVED);
+    responseMsg.AddString("content", target->Content());
+    responseMsg.AddInt32("input_tokens", target->InputTokens());
+    responseMsg.AddInt32("output_tokens", target->OutputTokens());
+    responseMsg.AddInt64("eval_duration", target->EvalDuration());
+    responseMsg.AddBool("streamed", true);
+    threadData->Post(&responseMsg);
+
     return 0;
-}
\ No newline at end of file
+}
@@ -6,6 +6,8 @@
 #include <ObjectList.h>
 #include <Messenger.h>
 #include <NetEndpoint.h>
+#include <HttpRequest.h>
+#include <HttpSession.h>
 #include "LLMProvider.h"
 
 class OllamaProvider : public LLMProvider {
@@ -14,21 +16,22 @@ public:
     virtual ~OllamaProvider();
 
     virtual BObjectList<LLMModel>* GetModels();
-    virtual void SendMessage(const BObjectList<ChatMessage, true>& history,
+    virtual request_id SendMessage(const ChatHistory& history,
                             const BString& message,
                             BMessenger* messenger);
 
-    virtual void CancelRequest();
-
     status_t FetchAvailableModels();
 
 private:
+    friend class OllamaRequest;
+
     void _InitModels();
     static int32 _RequestThreadFunc(void* data);
+    static int32 _ExecuteStreaming(LLMRequest* threadData,
+                                   BPrivate::Network::BHttpSession& session,
+                                   BPrivate::Network::BHttpRequest&& request);
 
     BObjectList<LLMModel> fModels;
-    thread_id fRequestThread;
-    bool fCancelRequested;
 };
 
 #endif // OLLAMA_PROVIDER_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+// providers/OllamaStream.cpp
+#include "OllamaStream.h"
+
+OllamaStream::OllamaStream()
+    : fInputTokens(0)
+    , fOutputTokens(0)
+    , fEvalDuration(0)
+{
+    fErrorField = fExtractor.AddString("error", &fErrorMessage);
+    fContentField = fExtractor.AddString("message.content", &fDelta);
+
+    // eval_duration is in nanoseconds
+    fExtractor.AddInt("prompt_eval_count", &fInputTokens);
+    fExtractor.AddInt("eval_count", &fOutputTokens);
+    fExtractor.AddInt("eval_duration", &fEvalDuration);
+}
+
+OllamaStream::~OllamaStream()
+{
+}
+
+status_t OllamaStream::LineReceived(const char* line, size_t length)
+{
+    if (length == 0)
+        return B_OK;
+
+    if (!fExtractor.Parse(line, length))
+        return B_OK;
+
+    if (fExtractor.Found(fErrorField)) {
+        fError = fErrorMessage;
+        return B_OK;
+    }
+
+    if (fExtractor.Found(fContentField) && !fDelta.IsEmpty()) {
+        fContent << fDelta;
+        return DeltaReceived(fDelta);
+    }
+
+    return B_OK;
+}
+
+status_t OllamaStream::DeltaReceived(const BString& delta)
+{
+    return B_OK;
+}
@@ -0,0 +1,45 @@
+// providers/OllamaStream.h
+#ifndef OLLAMA_STREAM_H
+#define OLLAMA_STREAM_H
+
+#include <String.h>
+
+#include "JSONExtractor.h"
+#include "StreamParser.h"
+
+// Parses the NDJSON chunks of /api/chat. The text of every delta goes to
+// DeltaReceived() and is collected for Content(); the last line, the one
+// with "done": true, carries the evaluation counters. Errors come as a
+// single {"error": ...} line, usually without a newline after it, so the
+// body must be flushed before Error() is read.
+class OllamaStream : public LineStream {
+public:
+    OllamaStream();
+    virtual ~OllamaStream();
+
+    const BString& Content() const { return fContent; }
+    const BString& Error() const { return fError; }
+    int32 InputTokens() const { return (int32)fInputTokens; }
+    int32 OutputTokens() const { return (int32)fOutputTokens; }
+    int64 EvalDuration() const { return fEvalDuration; }
+
+protected:
+    virtual status_t LineReceived(const char* line, size_t length);
+
+    // Returning an error aborts the transfer
+    virtual status_t DeltaReceived(const BString& delta);
+
+private:
+    JSONExtractor fExtractor;
+    int32 fErrorField;
+    int32 fContentField;
+    BString fErrorMessage;
+    BString fDelta;
+    BString fContent;
+    BString fError;
+    int64 fInputTokens;
+    int64 fOutputTokens;
+    int64 fEvalDuration;
+};
+
+#endif // OLLAMA_STREAM_H
@@ -1,6 +1,8 @@
 // providers/OpenAIProvider.cpp
 #include "OpenAIProvider.h"
 #include <Application.h>
+#include <ErrorsExt.h>
+#include <ExclusiveBorrow.h>
 #include <HttpFields.h>
 #include <HttpSession.h>
 #include <HttpRequest.h>
@@ -10,29 +12,70 @@
 #include <memory>
 #include <stdlib.h>
 
-#include "external/json.hpp"
+#include "HttpSessionPool.h"
+#include "JSONExtractor.h"
+#include "JSONWriter.h"
+#include "OpenAIStream.h"
+#include "RequestExecutor.h"
 #include "SettingsManager.h"
 #include "ChatMessage.h"
 #include "ChatView.h"
 
 using namespace BPrivate::Network;
 
-// Request thread struct
-struct RequestThreadData {
-    BObjectList<ChatMessage> history;
+// A single chat request, run on a RequestExecutor worker
+class OpenAIRequest : public LLMRequest {
+public:
+    OpenAIRequest()
+        : LLMRequest("OpenAI")
+    {
+    }
+
+    virtual void Run()
+    {
+        OpenAIProvider::_RequestThreadFunc(this);
+    }
+
     BString message;
     BString apiKey;
     BString apiBase;
     BString model;
-    BMessenger* messenger;
-    bool* cancelFlag;
+    bool stream;
+};
+
+// Forwards the deltas of a streamed reply as they arrive
+class OpenAIRequestStream : public OpenAIStream {
+public:
+    OpenAIRequestStream(LLMRequest* request)
+        : fRequest(request)
+    {
+    }
+
+protected:
+    virtual status_t EventReceived(const BString& event, const BString& data)
+    {
+        // Failing the write aborts the transfer
+        if (fRequest->IsCancelled())
+            return B_CANCELED;
+
+        return OpenAIStream::EventReceived(event, data);
+    }
+
+    virtual status_t DeltaReceived(const BString& delta)
+    {
+        BMessage deltaMsg(MSG_MESSAGE_DELTA);
+        deltaMsg.AddString("content", delta);
+        fRequest->Post(&deltaMsg);
+        return B_OK;
+    }
+
+private:
+    LLMRequest* fRequest;
 };
 
 OpenAIProvider::OpenAIProvider()
     : LLMProvider("OpenAI")
     , fModels(10)
-    , fRequestThread(-1)
-    , fCancelRequested(false)
 {
     // Set default API base
     fApiBase = "https://api.openai.com/v1";
@@ -43,7 +86,7 @@ OpenAIProvider::OpenAIProvider()
 
 OpenAIProvider::~OpenAIProvider()
 {
-    CancelRequest();
+    CancelAllRequests();
 }
 
 void OpenAIProvider::_InitModels()
@@ -74,16 +117,10 @@ BObjectList<LLMModel>* OpenAIProvider::GetModels()
     return &fModels;
 }
 
-void OpenAIProvider::SendMessage(const BObjectList<ChatMessage>& history,
+request_id OpenAIProvider::SendMessage(const ChatHistory& history,
                                const BString& message,
                                BMessenger* messenger)
 {
-    // Cancel any existing request
-    CancelRequest();
-
-    // Reset cancel flag
-    fCancelRequested = false;
-
     // Get API key and model from settings
     SettingsManager* settings = SettingsManager::GetInstance();
     BString apiKey = settings->GetApiKey("OpenAI");
@@ -95,7 +132,7 @@ void OpenAIProvider::SendMessage(const BObjectList<ChatMessage>& history,
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
         errorMsg.AddString("content", "Error: Please set an OpenAI API key in settings.");
         messenger->SendMessage(&errorMsg);
-        return;
+        return B_NOT_ALLOWED;
     }
 
     if (apiBase.IsEmpty()) {
@@ -107,102 +144,77 @@ void OpenAIProvider::SendMessage(const BObjectList<ChatMessage>& history,
     }
 
     // Prepare thread data
-    RequestThreadData* threadData = new RequestThreadData();
-
-    // Copy history
-    for (int32 i = 0; i < history.CountItems(); i++) {
-        ChatMessage* msg = new ChatMessage(
-            history.ItemAt(i)->Content(),
-            history.ItemAt(i)->Role()
-        );
-        threadData->history.AddItem(msg);
-    }
+    OpenAIRequest* threadData = new OpenAIRequest();
+
+    // Share the history; only references are taken
+    threadData->history = history;
 
     threadData->message = message;
     threadData->apiKey = apiKey;
     threadData->apiBase = apiBase;
     threadData->model = model;
-    threadData->messenger = messenger;
-    threadData->cancelFlag = &fCancelRequested;
-
-    // Start request thread
-    fRequestThread = spawn_thread(_RequestThreadFunc, "OpenAI Request",
-                                 B_NORMAL_PRIORITY, threadData);
-
-    if (fRequestThread >= 0) {
-        resume_thread(fRequestThread);
-    } else {
-        // Thread creation failed
-        delete threadData;
+    threadData->stream = settings->GetStreamingEnabled();
+    threadData->messenger = *messenger;
 
+    // Queue the request on the shared worker pool
+    request_id id = _SubmitRequest(threadData);
+    if (id < 0) {
+        // The executor has already disposed of the job
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", "Error: Failed to create request thread.");
+        errorMsg.AddString("content", "Error: Failed to queue request.");
         messenger->SendMessage(&errorMsg);
     }
-}
-
-void OpenAIProvider::CancelRequest()
-{
-    if (fRequestThread >= 0) {
-        fCancelRequested = true;
-
-        // Wait for thread to terminate
-        status_t result;
-        wait_for_thread(fRequestThread, &result);
 
-        fRequestThread = -1;
-    }
+    return id;
 }
 
 int32 OpenAIProvider::_RequestThreadFunc(void* data)
 {
-    RequestThreadData* threadData = static_cast<RequestThreadData*>(data);
+    OpenAIRequest* threadData = static_cast<OpenAIRequest*>(data);
 
     // Convenience aliases
     const BString& apiKey = threadData->apiKey;
     const BString& apiBase = threadData->apiBase;
     const BString& model = threadData->model;
-    BMessenger* messenger = threadData->messenger;
-    bool* cancelFlag = threadData->cancelFlag;
-
-    // Prepare request body
-    using json = nlohmann::json;
-    json requestBody;
-    requestBody["model"] = model.String();
-    requestBody["messages"] = json::array();
-
-    // Add history messages
-    for (int32 i = 0; i < threadData->history.CountItems(); i++) {
-        ChatMessage* msg = threadData->history.ItemAt(i);
-
-        json messageObj;
-
-        switch (msg->Role()) {
-            case MESSAGE_ROLE_USER:
-                messageObj["role"] = "user";
-                break;
-            case MESSAGE_ROLE_ASSISTANT:
-                messageObj["role"] = "assistant";
-                break;
-            case MESSAGE_ROLE_SYSTEM:
-                messageObj["role"] = "system";
-                break;
-        }
 
-        messageObj["content"] = msg->Content().String();
-        requestBody["messages"].push_back(messageObj);
-    }
+    // Cancelled while still queued behind other requests
+    if (threadData->IsCancelled())
+        return 0;
+
+    // Write the request body straight into the upload buffer; each
+    // message contributes its cached JSON fragment
+    auto bodyInput = std::make_unique<BMallocIO>();
+    JSONWriter writer(bodyInput.get());
+    writer.BeginObject();
+    writer.String("model", model.String(), model.Length());
+
+    writer.BeginArray("messages");
+    for (int32 i = 0; i < threadData->history.CountItems(); i++)
+        writer.Raw(NULL, threadData->history.ItemAt(i)->JSONFragment());
+    writer.EndArray();
 
     // Set additional parameters
-    requestBody["temperature"] = 0.7;
-    requestBody["max_tokens"] = 1000;
+    writer.Double("temperature", 0.7);
+    writer.Int("max_tokens", threadData->history.ReplyTokens());
+
+    // Ask for server-sent events, including a final usage chunk
+    if (threadData->stream) {
+        writer.Bool("stream", true);
+        writer.BeginObject("stream_options");
+        writer.Bool("include_usage", true);
+        writer.EndObject();
+    }
 
-    // Convert JSON to string
-    std::string requestBodyStr = requestBody.dump();
+    writer.EndObject();
+    size_t bodyLength = writer.Length();
 
     // Create URL
     BUrl url(apiBase.String());
-    url.SetPath("/chat/completions");
+    BString path(url.Path());
+    if (path.EndsWith("/"))
+        path.Truncate(path.Length() - 1);
+    path << "/chat/completions";
+    url.SetPath(path);
 
     // Prepare HTTP request
     BHttpRequest request(url);
@@ -215,58 +227,104 @@ int32 OpenAIProvider::_RequestThreadFunc(void* data)
     request.SetFields(fields);
 
     // Set request body
-    auto bodyInput = std::make_unique<BMallocIO>();
-    bodyInput->Write(requestBodyStr.c_str(), requestBodyStr.length());
     bodyInput->Seek(0, SEEK_SET);
-    request.SetRequestBody(std::move(bodyInput), "application/json", requestBodyStr.length());
+    request.SetRequestBody(std::move(bodyInput), "application/json", bodyLength);
+
+    // Execute request on the shared session for this host
+    BHttpSession session = HttpSessionPool::GetInstance()->SessionFor(url);
 
-    // Execute request
-    BHttpSession session;
-    BHttpResult result = session.Execute(std::move(request));
+    if (threadData->stream) {
+        return _ExecuteStreaming(threadData, session, std::move(request));
+    }
+
+    BString responseStr;
+    try {
+        BHttpResult result = threadData->Execute(session, std::move(request));
+
+        // Check result
+        const BHttpStatus& status = result.Status();
+        if (status.code != 200) {
+            BString body = result.Body().text.value_or(BString());
+            BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+            errorMsg.AddString("content", _HTTPError(status.code, body));
+            threadData->Post(&errorMsg);
+            return -1;
+        }
 
-    // Check result
-    const BHttpStatus& status = result.Status();
-    if (status.code != 200) {
-        // Handle error
+        responseStr = result.Body().text.value_or(BString());
+    } catch (const BError& e) {
+        // Also how a cancelled transfer ends; Post() drops the message then
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", BString("HTTP Error: ") << status.code);
-        messenger->SendMessage(&errorMsg);
+        errorMsg.AddString("content", BString("Network error: ") << e.Message());
+        threadData->Post(&errorMsg);
         return -1;
     }
 
-    // Parse response
+    // Extract completion text and token usage
+    BString completionText;
+    int64 inputTokens = 0, outputTokens = 0;
+
+    JSONExtractor extractor;
+    int32 contentField = extractor.AddString("choices.0.message.content", &completionText);
+    extractor.AddInt("usage.prompt_tokens", &inputTokens);
+    extractor.AddInt("usage.completion_tokens", &outputTokens);
+
+    if (!extractor.Parse(responseStr.String(), responseStr.Length())) {
+        BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+        errorMsg.AddString("content", "JSON parsing error: invalid response");
+        threadData->Post(&errorMsg);
+        return 0;
+    }
+
+    if (extractor.Found(contentField)) {
+        // Send response
+        BMessage responseMsg(MSG_MESSAGE_RECEIVED);
+        responseMsg.AddString("content", completionText);
+        responseMsg.AddInt32("input_tokens", (int32)inputTokens);
+        responseMsg.AddInt32("output_tokens", (int32)outputTokens);
+        threadData->Post(&responseMsg);
+    }
+
+    return 0;
+}
+
+int32 OpenAIProvider::_ExecuteStreaming(LLMRequest* threadData, BHttpSession& session,
+                                        BHttpRequest&& request)
+{
+    // The body is parsed chunk by chunk on the session's data thread
+    auto target = make_exclusive_borrow<OpenAIRequestStream>(threadData);
+
     try {
-        std::string responseStr = result.Body().text.value().String();
-        json responseJson = json::parse(responseStr);
-
-        BString completionText;
-        int32 inputTokens = 0, outputTokens = 0;
-
-        // Extract completion text and token usage
-        if (responseJson.contains("choices") &&
-            !responseJson["choices"].empty() &&
-            responseJson["choices"][0].contains("message") &&
-            responseJson["choices"][0]["message"].contains("content")) {
-
-            completionText = responseJson["choices"][0]["message"]["content"].get<std::string>().c_str();
-
-            if (responseJson.contains("usage")) {
-                inputTokens = responseJson["usage"]["prompt_tokens"].get<int>();
-                outputTokens = responseJson["usage"]["completion_tokens"].get<int>();
-            }
-
-            // Send response
-            BMessage responseMsg(MSG_MESSAGE_RECEIVED);
-            responseMsg.AddString("content", completionText);
-            responseMsg.AddInt32("input_tokens", inputTokens);
-            responseMsg.AddInt32("output_tokens", outputTokens);
-            messenger->SendMessage(&responseMsg);
+        BHttpResult result = threadData->Execute(session, std::move(request), BBorrow<BDataIO>(target));
+
+        const BHttpStatus& status = result.Status();
+        if (status.code != 200) {
+            // Error bodies are plain JSON, without event framing
+            result.Body();
+            BMessage errorMsg(MSG_MESSAGE_RECEIVED);
+            errorMsg.AddString("content", _HTTPError(status.code, target->Body()));
+            threadData->Post(&errorMsg);
+            return -1;
         }
-    } catch (const std::exception& e) {
+
+        // Wait until the last event has been delivered
+        result.Body();
+    } catch (const BError& e) {
         BMessage errorMsg(MSG_MESSAGE_RECEIVED);
-        errorMsg.AddString("content", BString("JSON parsing error: ") << e.what());
-        messenger->SendMessage(&errorMsg);
+        errorMsg.AddString("content", BString("Network error: ") << e.Message());
+        threadData->Post(&errorMsg);
+        return -1;
     }
 
+    target->Flush();
+
+    // Final message with the complete text and the usage
+    BMessage responseMsg(MSG_MESSAGE_RECEIVED);
+    responseMsg.AddString("content", target->Content());
+    responseMsg.AddInt32("input_tokens", target->InputTokens());
+    responseMsg.AddInt32("output_tokens", target->OutputTokens());
+    responseMsg.AddBool("streamed", true);
+    threadData->Post(&responseMsg);
+
     return 0;
-}
\ No newline at end of file
+}
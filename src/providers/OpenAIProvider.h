@@ -6,6 +6,8 @@
 #include <ObjectList.h>
 #include <Messenger.h>
 #include <NetEndpoint.h>
+#include <HttpRequest.h>
+#include <HttpSession.h>
 #include "LLMProvider.h"
 
 class OpenAIProvider : public LLMProvider {
@@ -14,19 +16,20 @@ public:
     virtual ~OpenAIProvider();
     
     virtual BObjectList<LLMModel>* GetModels();
-    virtual void SendMessage(const BObjectList<ChatMessage>& history, 
+    virtual request_id SendMessage(const ChatHistory& history,
                             const BString& message,
                             BMessenger* messenger);
-    
-    virtual void CancelRequest();
-    
+        
 private:
+    friend class OpenAIRequest;
+
     void _InitModels();
     static int32 _RequestThreadFunc(void* data);
+    static int32 _ExecuteStreaming(LLMRequest* threadData,
+                                   BPrivate::Network::BHttpSession& session,
+                                   BPrivate::Network::BHttpRequest&& request);
     
     BObjectList<LLMModel> fModels;
-    thread_id fRequestThread;
-    bool fCancelRequested;
 };
 
 #endif // OPENAI_PROVIDER_H
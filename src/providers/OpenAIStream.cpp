@@ -0,0 +1,41 @@
+// providers/OpenAIStream.cpp
+#include "OpenAIStream.h"
+
+OpenAIStream::OpenAIStream()
+    : fInputTokens(0)
+    , fOutputTokens(0)
+    , fDone(false)
+{
+    fDeltaField = fExtractor.AddString("choices.0.delta.content", &fDelta);
+    fExtractor.AddInt("usage.prompt_tokens", &fInputTokens);
+    fExtractor.AddInt("usage.completion_tokens", &fOutputTokens);
+}
+
+OpenAIStream::~OpenAIStream()
+{
+}
+
+status_t OpenAIStream::EventReceived(const BString& event, const BString& data)
+{
+    if (data == "[DONE]") {
+        fDone = true;
+        return B_OK;
+    }
+
+    // The extractor fills the token counts in directly
+    if (!fExtractor.Parse(data.String(), data.Length()))
+        return B_OK;
+
+    // Content delta
+    if (fExtractor.Found(fDeltaField) && !fDelta.IsEmpty()) {
+        fContent << fDelta;
+        return DeltaReceived(fDelta);
+    }
+
+    return B_OK;
+}
+
+status_t OpenAIStream::DeltaReceived(const BString& delta)
+{
+    return B_OK;
+}
@@ -0,0 +1,40 @@
+// providers/OpenAIStream.h
+#ifndef OPENAI_STREAM_H
+#define OPENAI_STREAM_H
+
+#include <String.h>
+
+#include "JSONExtractor.h"
+#include "StreamParser.h"
+
+// Parses the chat.completion.chunk events of an OpenAI stream. The text
+// of every delta goes to DeltaReceived() and is collected for Content();
+// the usage arrives with the last chunk when stream_options.include_usage
+// is set, and "[DONE]" ends the stream.
+class OpenAIStream : public SSEStream {
+public:
+    OpenAIStream();
+    virtual ~OpenAIStream();
+
+    const BString& Content() const { return fContent; }
+    int32 InputTokens() const { return (int32)fInputTokens; }
+    int32 OutputTokens() const { return (int32)fOutputTokens; }
+    bool IsDone() const { return fDone; }
+
+protected:
+    virtual status_t EventReceived(const BString& event, const BString& data);
+
+    // Returning an error aborts the transfer
+    virtual status_t DeltaReceived(const BString& delta);
+
+private:
+    JSONExtractor fExtractor;
+    int32 fDeltaField;
+    BString fDelta;
+    BString fContent;
+    int64 fInputTokens;
+    int64 fOutputTokens;
+    bool fDone;
+};
+
+#endif // OPENAI_STREAM_H
@@ -0,0 +1,121 @@
+// providers/StreamParser.cpp
+#include "StreamParser.h"
+
+#include <string.h>
+
+// SSEStream::Body() keeps this much of the body
+static const int32 kMaxBodySize = 16 * 1024;
+
+LineStream::LineStream()
+{
+}
+
+LineStream::~LineStream()
+{
+}
+
+ssize_t LineStream::Write(const void* buffer, size_t size)
+{
+    const char* data = static_cast<const char*>(buffer);
+    const char* end = data + size;
+
+    while (data < end) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (newline == NULL) {
+            // Keep the partial line until the rest of it arrives
+            fPending.Append(data, end - data);
+            break;
+        }
+
+        size_t length = newline - data;
+        status_t status;
+        if (fPending.IsEmpty()) {
+            // Fast path: the whole line is inside this chunk
+            if (length > 0 && data[length - 1] == '\r')
+                length--;
+            status = LineReceived(data, length);
+        } else {
+            fPending.Append(data, length);
+            if (fPending.EndsWith("\r"))
+                fPending.Truncate(fPending.Length() - 1);
+            status = LineReceived(fPending.String(), fPending.Length());
+            fPending.Truncate(0);
+        }
+
+        if (status != B_OK)
+            return status;
+
+        data = newline + 1;
+    }
+
+    return size;
+}
+
+status_t LineStream::Flush()
+{
+    if (fPending.IsEmpty())
+        return B_OK;
+
+    BString line(fPending);
+    fPending.Truncate(0);
+    return LineReceived(line.String(), line.Length());
+}
+
+SSEStream::SSEStream()
+    : fHasData(false)
+{
+}
+
+SSEStream::~SSEStream()
+{
+}
+
+ssize_t SSEStream::Write(const void* buffer, size_t size)
+{
+    if (fBody.Length() < kMaxBodySize) {
+        size_t room = kMaxBodySize - fBody.Length();
+        fBody.Append(static_cast<const char*>(buffer), size < room ? size : room);
+    }
+
+    return LineStream::Write(buffer, size);
+}
+
+status_t SSEStream::LineReceived(const char* line, size_t length)
+{
+    // An empty line dispatches the event collected so far
+    if (length == 0) {
+        status_t status = B_OK;
+        if (fHasData)
+            status = EventReceived(fEvent, fData);
+
+        fEvent.Truncate(0);
+        fData.Truncate(0);
+        fHasData = false;
+        return status;
+    }
+
+    // Comment line (used as keep-alive by some servers)
+    if (line[0] == ':')
+        return B_OK;
+
+    // Split "field: value"
+    const char* colon = static_cast<const char*>(memchr(line, ':', length));
+    size_t fieldLength = colon != NULL ? colon - line : length;
+    const char* value = colon != NULL ? colon + 1 : line + length;
+    if (value < line + length && *value == ' ')
+        value++;
+    size_t valueLength = line + length - value;
+
+    if (fieldLength == 4 && strncmp(line, "data", 4) == 0) {
+        if (fHasData)
+            fData.Append('\n', 1);
+        fData.Append(value, valueLength);
+        fHasData = true;
+    } else if (fieldLength == 5 && strncmp(line, "event", 5) == 0) {
+        fEvent.SetTo(value, valueLength);
+    }
+
+    // "id" and "retry" are not used by any of our providers
+
+    return B_OK;
+}
@@ -0,0 +1,55 @@
+// providers/StreamParser.h
+#ifndef STREAM_PARSER_H
+#define STREAM_PARSER_H
+
+#include <DataIO.h>
+#include <String.h>
+
+// BDataIO sink that splits a streamed HTTP body into lines as it arrives.
+// Subclasses get one LineReceived() call per complete line; returning an
+// error from it aborts the transfer.
+class LineStream : public BDataIO {
+public:
+    LineStream();
+    virtual ~LineStream();
+
+    virtual ssize_t Write(const void* buffer, size_t size);
+
+    // Hands a trailing line without terminator to LineReceived()
+    status_t Flush();
+
+protected:
+    virtual status_t LineReceived(const char* line, size_t length) = 0;
+
+private:
+    BString fPending;
+};
+
+// Server-Sent Events parser (text/event-stream), as used by the OpenAI
+// and Anthropic streaming APIs.
+class SSEStream : public LineStream {
+public:
+    SSEStream();
+    virtual ~SSEStream();
+
+    virtual ssize_t Write(const void* buffer, size_t size);
+
+    // The first 16 KB of the body as received. Both APIs answer a failed
+    // request with plain JSON rather than events, which only shows here.
+    const BString& Body() const { return fBody; }
+
+protected:
+    virtual status_t LineReceived(const char* line, size_t length);
+
+    // Called once per dispatched event; event is empty if the server did
+    // not send an "event:" field.
+    virtual status_t EventReceived(const BString& event, const BString& data) = 0;
+
+private:
+    BString fEvent;
+    BString fData;
+    BString fBody;
+    bool fHasData;
+};
+
+#endif // STREAM_PARSER_H
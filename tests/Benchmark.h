@@ -0,0 +1,42 @@
+// Benchmark.h
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+
+#include <chrono>
+
+// Runs function iterations times and prints the time per run, and the
+// throughput if bytes is the amount of input one run handles. Returns the
+// microseconds per run.
+template<typename Function>
+double Measure(const char* name, int iterations, size_t bytes,
+    Function function)
+{
+    // One run first, so caches and allocations are warm
+    function();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        function();
+    std::chrono::duration<double, std::micro> elapsed
+        = std::chrono::steady_clock::now() - start;
+
+    double perRun = elapsed.count() / iterations;
+    if (bytes > 0) {
+        printf("  %-44s %10.2f us  %8.1f MB/s\n", name, perRun,
+            bytes / perRun);
+    } else
+        printf("  %-44s %10.2f us\n", name, perRun);
+
+    return perRun;
+}
+
+// Keeps the compiler from optimizing a result away
+template<typename Type>
+void KeepResult(const Type& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+#endif // BENCHMARK_H
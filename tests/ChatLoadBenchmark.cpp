@@ -0,0 +1,276 @@
+// ChatLoadBenchmark.cpp
+//
+// Opens a chat of 10,000 messages both ways storage has kept them: as a
+// packed ChatLog, in full and by the page the chat view opens with, and
+// as separate message files, whose order attributes are put in order.
+#include "ChatLog.h"
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+static const int32 kMessageCount = 10000;
+
+// ChatView::kHistoryPageSize
+static const int32 kPageSize = 50;
+
+static int sFailures = 0;
+
+static void Check(bool condition, const char* what)
+{
+    if (!condition) {
+        fprintf(stderr, "ChatLoadBenchmark: %s\n", what);
+        sFailures++;
+    }
+}
+
+// Short questions and longer answers, some of them very long
+static ChatMessage* Message(int32 index, std::mt19937& random)
+{
+    bool user = index % 2 == 0;
+    size_t length = user ? 40 + random() % 400 : 200 + random() % 3000;
+    if (!user && random() % 50 == 0)
+        length *= 10;
+
+    std::string text;
+    while (text.size() < length)
+        text += "Message " + std::to_string(index) + " goes on a while. ";
+
+    return new ChatMessage(BString(text.c_str()),
+        user ? MESSAGE_ROLE_USER : MESSAGE_ROLE_ASSISTANT,
+        1700000000 + index * 30);
+}
+
+static void Release(BObjectList<ChatMessage>& messages)
+{
+    for (int32 i = 0; i < messages.CountItems(); i++)
+        messages.ItemAt(i)->ReleaseReference();
+    messages.MakeEmpty();
+}
+
+static long FileSize(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static void BenchLog(const ChatHistory& history)
+{
+    char path[] = "/tmp/ChatLoadBenchmarkXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("ChatLoadBenchmark");
+        sFailures++;
+        return;
+    }
+    close(fd);
+
+    entry_ref ref;
+    get_ref_for_path(path, &ref);
+
+    printf("ChatLog, %d messages\n", kMessageCount);
+    status_t status = B_OK;
+    Measure("Append all", 5, 0, [&]() {
+        truncate(path, 0);
+        status = ChatLog::Append(ref, history, 0);
+    });
+    Check(status == B_OK, "Append failed");
+    long size = FileSize(path);
+    printf("  %-44s %10.1f MB\n", "file", size / 1e6);
+
+    BObjectList<ChatMessage> messages(kMessageCount);
+    Measure("Read all", 20, size, [&]() {
+        Release(messages);
+        status = ChatLog::Read(ref, &messages);
+    });
+    Check(status == B_OK && messages.CountItems() == kMessageCount,
+        "Read all did not read every message");
+    Release(messages);
+
+    Measure("Read last page", 2000, 0, [&]() {
+        Release(messages);
+        status = ChatLog::Read(ref, &messages, kMessageCount - kPageSize,
+            kPageSize);
+    });
+    Check(status == B_OK && messages.CountItems() == kPageSize
+        && messages.ItemAt(kPageSize - 1)->Content()
+            == history.ItemAt(kMessageCount - 1)->Content(),
+        "Read last page did not read the newest messages");
+    Release(messages);
+
+    int32 count = 0;
+    Measure("CountMessages", 2000, 0, [&]() {
+        status = ChatLog::CountMessages(ref, &count);
+    });
+    Check(status == B_OK && count == kMessageCount, "CountMessages is off");
+
+    // A torn append leaves no index, so the records are walked instead
+    truncate(path, size - 1);
+    Measure("Read last page, without index", 200, 0, [&]() {
+        Release(messages);
+        status = ChatLog::Read(ref, &messages, kMessageCount - kPageSize,
+            kPageSize);
+    });
+    Check(status == B_OK && messages.CountItems() == kPageSize,
+        "Reading without index failed");
+    Release(messages);
+
+    // The next append indexes every record again
+    ChatHistory one;
+    one.AddItem(const_cast<ChatMessage*>(history.ItemAt(0)));
+    status = ChatLog::Append(ref, one, 0);
+    count = 0;
+    ChatLog::CountMessages(ref, &count);
+    Check(status == B_OK && count == kMessageCount + 1,
+        "Appending after a torn append is off");
+
+    unlink(path);
+}
+
+// A chat grows by a message or two at a time; each append only writes
+// those and an index block for them
+static void BenchIncremental(const ChatHistory& history)
+{
+    char path[] = "/tmp/ChatLoadBenchmarkXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("ChatLoadBenchmark");
+        sFailures++;
+        return;
+    }
+    close(fd);
+
+    entry_ref ref;
+    get_ref_for_path(path, &ref);
+
+    printf("ChatLog, appended 2 messages at a time\n");
+    status_t status = B_OK;
+    auto start = std::chrono::steady_clock::now();
+    for (int32 i = 0; i < kMessageCount && status == B_OK; i += 2) {
+        ChatHistory pair;
+        for (int32 j = i; j < i + 2 && j < kMessageCount; j++)
+            pair.AddItem(const_cast<ChatMessage*>(history.ItemAt(j)));
+        status = ChatLog::Append(ref, pair, 0);
+    }
+    std::chrono::duration<double, std::micro> elapsed
+        = std::chrono::steady_clock::now() - start;
+    printf("  %-44s %10.2f us\n", "Append all, per append",
+        elapsed.count() / (kMessageCount / 2));
+    Check(status == B_OK, "Appending in pairs failed");
+    long size = FileSize(path);
+    printf("  %-44s %10.1f MB\n", "file", size / 1e6);
+
+    BObjectList<ChatMessage> messages(kMessageCount);
+    status = ChatLog::Read(ref, &messages);
+    bool same = status == B_OK && messages.CountItems() == kMessageCount;
+    for (int32 i = 0; same && i < kMessageCount; i++)
+        same = messages.ItemAt(i)->Content() == history.ItemAt(i)->Content();
+    Check(same, "Appending in pairs lost or reordered messages");
+    Release(messages);
+
+    Measure("Read last page", 2000, 0, [&]() {
+        Release(messages);
+        status = ChatLog::Read(ref, &messages, kMessageCount - kPageSize,
+            kPageSize);
+    });
+    Check(status == B_OK && messages.CountItems() == kPageSize
+        && messages.ItemAt(kPageSize - 1)->Content()
+            == history.ItemAt(kMessageCount - 1)->Content(),
+        "Read last page did not read the newest messages");
+    Release(messages);
+
+    // Appending to a chat of this size costs no more than to a short one
+    ChatHistory one;
+    one.AddItem(const_cast<ChatMessage*>(history.ItemAt(0)));
+    Measure("Append one message", 200, 0, [&]() {
+        status = ChatLog::Append(ref, one, 0);
+    });
+    Check(status == B_OK, "Appending one message failed");
+
+    // A torn append leaves the records before it, index blocks and all
+    int32 count = 0;
+    ChatLog::CountMessages(ref, &count);
+    truncate(path, FileSize(path) - 1);
+    status = ChatLog::Read(ref, &messages);
+    Check(status == B_OK && messages.CountItems() == count,
+        "Reading past index blocks without index failed");
+    Release(messages);
+
+    unlink(path);
+}
+
+static void BenchSort(const char* name, const ChatHistory& history,
+    const std::vector<int32>& orders, std::mt19937& random)
+{
+    std::vector<ChatLog::OrderedMessage> files;
+    for (int32 i = 0; i < history.CountItems(); i++) {
+        ChatLog::OrderedMessage file
+            = { orders[i], const_cast<ChatMessage*>(history.ItemAt(i)) };
+        files.push_back(file);
+    }
+    // A query returns the files in no particular order
+    std::shuffle(files.begin(), files.end(), random);
+
+    std::vector<ChatLog::OrderedMessage> sorted;
+    Measure(name, 500, 0, [&]() {
+        sorted = files;
+        ChatLog::SortByOrder(sorted);
+        KeepResult(sorted);
+    });
+
+    bool inOrder = true;
+    for (size_t i = 1; i < sorted.size(); i++) {
+        inOrder = inOrder && (sorted[i - 1].order < sorted[i].order
+            || (sorted[i - 1].order == sorted[i].order
+                && sorted[i - 1].message->Timestamp()
+                    <= sorted[i].message->Timestamp()));
+    }
+    Check(inOrder && sorted.size() == files.size(), "SortByOrder is off");
+}
+
+int main()
+{
+    std::mt19937 random(42);
+
+    ChatHistory history;
+    for (int32 i = 0; i < kMessageCount; i++) {
+        ChatMessage* message = Message(i, random);
+        history.AddItem(message);
+        message->ReleaseReference();
+    }
+
+    BenchLog(history);
+    BenchIncremental(history);
+
+    printf("Message files, %d messages\n", kMessageCount);
+    std::vector<int32> orders(kMessageCount);
+    for (int32 i = 0; i < kMessageCount; i++)
+        orders[i] = i;
+    BenchSort("SortByOrder", history, orders, random);
+
+    // After a crash, some orders are missing and some taken twice
+    for (int32 i = 0; i < kMessageCount; i++)
+        orders[i] = i + i / 100 + (i % 250 == 249 ? 1 : 0);
+    BenchSort("SortByOrder, gaps and duplicates", history, orders, random);
+
+    // Orders far apart are sorted instead of counted
+    for (int32 i = 0; i < kMessageCount; i++)
+        orders[i] = i * 1000;
+    BenchSort("SortByOrder, sparse", history, orders, random);
+
+    return sFailures > 0 ? 1 : 0;
+}
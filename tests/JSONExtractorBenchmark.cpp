@@ -0,0 +1,209 @@
+// JSONExtractorBenchmark.cpp
+//
+// Reads the fields the providers need from recorded responses, once with
+// JSONExtractor's SAX pass and once through a nlohmann::json DOM, as the
+// providers did before.
+#include "JSONExtractor.h"
+
+#include "Benchmark.h"
+#include "json.hpp"
+
+#include <stdio.h>
+
+#include <string>
+
+using json = nlohmann::json;
+
+// Reply text of the given length, with the escapes real replies have
+static std::string ReplyText(size_t length)
+{
+    static const char* kWords[] = { "The", "buffer", "is", "copied",
+        "\\\"once\\\"", "per", "request,", "then", "shared.\\n", "`int32`",
+        "caf\\u00e9", "and", "\\tindented", "code", "follows:\\n\\n" };
+
+    std::string text;
+    for (size_t i = 0; text.size() < length; i++) {
+        text += kWords[(i * 7) % (sizeof(kWords) / sizeof(kWords[0]))];
+        text += ' ';
+    }
+    return text;
+}
+
+static std::string OpenAIResponse(size_t length)
+{
+    return "{\"id\":\"chatcmpl-9\",\"object\":\"chat.completion\","
+        "\"created\":1718000000,\"model\":\"gpt-4o-2024-05-13\","
+        "\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\","
+        "\"content\":\"" + ReplyText(length) + "\"},\"logprobs\":null,"
+        "\"finish_reason\":\"stop\"}],\"usage\":{\"prompt_tokens\":1234,"
+        "\"completion_tokens\":567,\"total_tokens\":1801},"
+        "\"system_fingerprint\":\"fp_abc123\"}";
+}
+
+static const char* kOpenAIChunk =
+    "{\"id\":\"chatcmpl-9\",\"object\":\"chat.completion.chunk\","
+    "\"created\":1718000000,\"model\":\"gpt-4o-2024-05-13\","
+    "\"system_fingerprint\":\"fp_abc123\",\"choices\":[{\"index\":0,"
+    "\"delta\":{\"content\":\" shared\"},\"logprobs\":null,"
+    "\"finish_reason\":null}]}";
+
+static const char* kAnthropicDelta =
+    "{\"type\":\"content_block_delta\",\"index\":0,"
+    "\"delta\":{\"type\":\"text_delta\",\"text\":\" per request\"}}";
+
+static const char* kOllamaFinal =
+    "{\"model\":\"llama3\",\"created_at\":\"2024-06-10T12:00:00.000Z\","
+    "\"message\":{\"role\":\"assistant\",\"content\":\"\"},"
+    "\"done_reason\":\"stop\",\"done\":true,\"total_duration\":5191566416,"
+    "\"load_duration\":2154458,\"prompt_eval_count\":26,"
+    "\"prompt_eval_duration\":383809000,\"eval_count\":298,"
+    "\"eval_duration\":4799921000}";
+
+static int sFailures = 0;
+
+static void Compare(const char* name, double sax, double dom)
+{
+    printf("  %-44s %10.2fx\n", name, dom / sax);
+}
+
+static void Check(bool condition, const char* what)
+{
+    if (!condition) {
+        fprintf(stderr, "JSONExtractorBenchmark: %s differs\n", what);
+        sFailures++;
+    }
+}
+
+static void BenchOpenAIResponse(size_t length, int iterations)
+{
+    std::string data = OpenAIResponse(length);
+    printf("chat.completion, %zu bytes\n", data.size());
+
+    BString content;
+    int64 inputTokens = 0;
+    int64 outputTokens = 0;
+    JSONExtractor extractor;
+    extractor.AddString("choices.0.message.content", &content);
+    extractor.AddInt("usage.prompt_tokens", &inputTokens);
+    extractor.AddInt("usage.completion_tokens", &outputTokens);
+
+    double sax = Measure("JSONExtractor", iterations, data.size(), [&]() {
+        extractor.Parse(data.data(), data.size());
+        KeepResult(content);
+    });
+
+    std::string domContent;
+    int64 domInput = 0;
+    int64 domOutput = 0;
+    double dom = Measure("json::parse", iterations, data.size(), [&]() {
+        json document = json::parse(data);
+        domContent = document["choices"][0]["message"]["content"]
+            .get<std::string>();
+        domInput = document["usage"]["prompt_tokens"].get<int64>();
+        domOutput = document["usage"]["completion_tokens"].get<int64>();
+        KeepResult(domContent);
+    });
+
+    Compare("speedup", sax, dom);
+    Check(domContent == content.String(), "content");
+    Check(domInput == inputTokens && domOutput == outputTokens, "usage");
+}
+
+static void BenchOpenAIChunk(int iterations)
+{
+    std::string data(kOpenAIChunk);
+    printf("chat.completion.chunk, %zu bytes\n", data.size());
+
+    // Stream sinks keep one extractor for the whole transfer
+    BString delta;
+    int64 inputTokens = 0;
+    JSONExtractor extractor;
+    extractor.AddString("choices.0.delta.content", &delta);
+    extractor.AddInt("usage.prompt_tokens", &inputTokens);
+
+    double sax = Measure("JSONExtractor", iterations, data.size(), [&]() {
+        extractor.Parse(data.data(), data.size());
+        KeepResult(delta);
+    });
+
+    std::string domDelta;
+    double dom = Measure("json::parse", iterations, data.size(), [&]() {
+        json document = json::parse(data);
+        const json& choice = document["choices"][0];
+        if (choice.contains("delta") && choice["delta"].contains("content"))
+            domDelta = choice["delta"]["content"].get<std::string>();
+        KeepResult(domDelta);
+    });
+
+    Compare("speedup", sax, dom);
+    Check(domDelta == delta.String(), "delta");
+}
+
+static void BenchAnthropicDelta(int iterations)
+{
+    std::string data(kAnthropicDelta);
+    printf("content_block_delta, %zu bytes\n", data.size());
+
+    BString type;
+    BString text;
+    JSONExtractor extractor;
+    extractor.AddString("delta.type", &type);
+    extractor.AddString("delta.text", &text);
+
+    double sax = Measure("JSONExtractor", iterations, data.size(), [&]() {
+        extractor.Parse(data.data(), data.size());
+        KeepResult(text);
+    });
+
+    std::string domText;
+    double dom = Measure("json::parse", iterations, data.size(), [&]() {
+        json document = json::parse(data);
+        if (document["delta"]["type"] == "text_delta")
+            domText = document["delta"]["text"].get<std::string>();
+        KeepResult(domText);
+    });
+
+    Compare("speedup", sax, dom);
+    Check(domText == text.String(), "text");
+}
+
+static void BenchOllamaFinal(int iterations)
+{
+    std::string data(kOllamaFinal);
+    printf("Ollama final line, %zu bytes\n", data.size());
+
+    bool done = false;
+    int64 promptCount = 0;
+    int64 evalCount = 0;
+    JSONExtractor extractor;
+    extractor.AddBool("done", &done);
+    extractor.AddInt("prompt_eval_count", &promptCount);
+    extractor.AddInt("eval_count", &evalCount);
+
+    double sax = Measure("JSONExtractor", iterations, data.size(), [&]() {
+        extractor.Parse(data.data(), data.size());
+        KeepResult(evalCount);
+    });
+
+    int64 domEvalCount = 0;
+    double dom = Measure("json::parse", iterations, data.size(), [&]() {
+        json document = json::parse(data);
+        if (document["done"].get<bool>())
+            domEvalCount = document["eval_count"].get<int64>();
+        KeepResult(domEvalCount);
+    });
+
+    Compare("speedup", sax, dom);
+    Check(done && domEvalCount == evalCount, "eval_count");
+}
+
+int main()
+{
+    BenchOpenAIChunk(200000);
+    BenchAnthropicDelta(200000);
+    BenchOllamaFinal(200000);
+    BenchOpenAIResponse(4 * 1024, 20000);
+    BenchOpenAIResponse(64 * 1024, 2000);
+
+    return sFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+// MarkdownBenchmark.cpp
+//
+// Parses a 100 KB reply with MarkdownDocument, at once and as it streams
+// in, against parsing all of it again on every delta, as the transcript
+// did before. Streaming must end with the blocks a full parse gives.
+#include "MarkdownDocument.h"
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+
+static const size_t kReplySize = 100 * 1024;
+
+static int sFailures = 0;
+
+// A long reply of the usual mix: headings, paragraphs with inline styles,
+// lists and code blocks
+static std::string Reply()
+{
+    std::string text;
+    for (int32_t section = 1; text.size() < kReplySize; section++) {
+        text += "## Section " + std::to_string(section) + "\n"
+            "Some text with **bold** and `code` spans, *italics* and a "
+            "[link](http://example.com) in a paragraph that goes on for a "
+            "while.\n"
+            "\n"
+            "- a list item\n"
+            "- another one\n"
+            "\n"
+            "```cpp\n"
+            "for (int i = 0; i < 10; i++)\n"
+            "    printf(\"%d\\n\", i);\n"
+            "```\n"
+            "\n";
+    }
+    return text;
+}
+
+// A reply that is one long code block
+static std::string CodeReply()
+{
+    std::string text = "```\n";
+    while (text.size() < kReplySize)
+        text += "    x = compute(x, y) + 42;  // comment\n";
+    return text;
+}
+
+static bool SameBlocks(const MarkdownDocument& a, const MarkdownDocument& b)
+{
+    const std::vector<MarkdownDocument::Block>& x = a.Blocks();
+    const std::vector<MarkdownDocument::Block>& y = b.Blocks();
+    if (x.size() != y.size())
+        return false;
+
+    for (size_t i = 0; i < x.size(); i++) {
+        if (x[i].kind != y[i].kind || x[i].level != y[i].level
+            || x[i].info != y[i].info || x[i].text != y[i].text
+            || x[i].sourceStart != y[i].sourceStart
+            || x[i].runs.size() != y[i].runs.size())
+            return false;
+        for (size_t j = 0; j < x[i].runs.size(); j++) {
+            if (x[i].runs[j].offset != y[i].runs[j].offset
+                || x[i].runs[j].length != y[i].runs[j].length
+                || x[i].runs[j].style != y[i].runs[j].style)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void BenchReply(const char* title, const std::string& reply)
+{
+    printf("%s, %zu bytes\n", title, reply.size());
+
+    MarkdownDocument full;
+    Measure("SetText", 50, reply.size(), [&]() {
+        full.SetText(reply.data(), reply.size());
+        KeepResult(full);
+    });
+
+    for (size_t delta : { 20, 200 }) {
+        std::string name = "Append, " + std::to_string(delta) + "-byte deltas";
+        MarkdownDocument streamed;
+        Measure(name.c_str(), 5, reply.size(), [&]() {
+            streamed = MarkdownDocument();
+            for (size_t i = 0; i < reply.size(); i += delta) {
+                streamed.Append(reply.data() + i,
+                    std::min(delta, reply.size() - i));
+            }
+            KeepResult(streamed);
+        });
+
+        if (!SameBlocks(streamed, full)) {
+            fprintf(stderr, "MarkdownBenchmark: %s differs from SetText\n",
+                name.c_str());
+            sFailures++;
+        }
+    }
+
+    // What every delta cost when the whole reply was parsed again; a
+    // delta of 2 KB keeps this from taking minutes
+    MarkdownDocument reparsed;
+    Measure("SetText after each 2 KB delta", 1, reply.size(), [&]() {
+        for (size_t end = 2048; end < reply.size() + 2048; end += 2048) {
+            reparsed.SetText(reply.data(), std::min(end, reply.size()));
+            KeepResult(reparsed);
+        }
+    });
+}
+
+int main()
+{
+    BenchReply("Mixed reply", Reply());
+    BenchReply("Code block reply", CodeReply());
+
+    return sFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+// MarkdownDocumentTest.cpp
+//
+// Appending a reply in pieces, cut at every possible byte, must give the
+// blocks that parsing it at once does.
+#include "MarkdownDocument.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+static int sFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, \
+                #condition); \
+            sFailures++; \
+        } \
+    } while (false)
+
+static const char* kSources[] = {
+    // Every kind of block
+    "# Title ##\n"
+    "Some **bold** and *it* and `code` with [a link](http://x) and "
+        "snake_case_word.\n"
+    "continued line\n"
+    "\n"
+    "- item one\n"
+    "- item **two**\n"
+    "  1. nested\n"
+    "> quoted\n"
+    "> more\n"
+    "\n"
+    "---\n"
+    "```cpp\n"
+    "int main() {\n"
+    "  return 0;\n"
+    "}\n"
+    "```\n"
+    "after 2 * 3 = 6\n"
+    "```\n"
+    "unclosed",
+
+    // Code blocks with blank lines, fences that do not close them and
+    // one that does
+    "```python\n"
+    "\n"
+    "def f(x):\n"
+    "\n"
+    "    return x\n"
+    "````not a close\n"
+    "``\n"
+    "   ```\n"
+    "text after\n",
+
+    // Blocks around code, an empty code block and a tilde fence
+    "Before\n"
+    "```\n"
+    "```\n"
+    "~~~\n"
+    "a\n"
+    "```\n"
+    "~~~\n"
+    "After\n"
+    "```sh\n"
+    "ls\n"
+    "\n",
+
+    // CRLF line ends and a fence line cut off at the end
+    "```c\r\n"
+    "x = 1;\r\n"
+    "```\r\n"
+    "done\r\n"
+    "``",
+};
+
+static bool SameBlocks(const MarkdownDocument& a, const MarkdownDocument& b)
+{
+    const std::vector<MarkdownDocument::Block>& x = a.Blocks();
+    const std::vector<MarkdownDocument::Block>& y = b.Blocks();
+    if (x.size() != y.size())
+        return false;
+
+    for (size_t i = 0; i < x.size(); i++) {
+        if (x[i].kind != y[i].kind || x[i].level != y[i].level
+            || x[i].info != y[i].info || x[i].text != y[i].text
+            || x[i].sourceStart != y[i].sourceStart
+            || x[i].runs.size() != y[i].runs.size())
+            return false;
+        for (size_t j = 0; j < x[i].runs.size(); j++) {
+            if (x[i].runs[j].offset != y[i].runs[j].offset
+                || x[i].runs[j].length != y[i].runs[j].length
+                || x[i].runs[j].style != y[i].runs[j].style)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void CheckSource(const char* source)
+{
+    size_t length = strlen(source);
+
+    // Every prefix, as the reply stands after each delta
+    for (size_t step = 1; step <= 7; step++) {
+        MarkdownDocument streamed;
+        for (size_t i = 0; i < length; i += step) {
+            size_t end = std::min(i + step, length);
+            streamed.Append(source + i, end - i);
+
+            MarkdownDocument full;
+            full.SetText(source, end);
+            CHECK(SameBlocks(streamed, full));
+        }
+    }
+
+    // Cut in two at every byte
+    MarkdownDocument full;
+    full.SetText(source, length);
+    for (size_t cut = 1; cut < length; cut++) {
+        MarkdownDocument streamed;
+        streamed.Append(source, cut);
+        streamed.Append(source + cut, length - cut);
+        CHECK(SameBlocks(streamed, full));
+    }
+}
+
+int main()
+{
+    for (size_t i = 0; i < sizeof(kSources) / sizeof(kSources[0]); i++)
+        CheckSource(kSources[i]);
+
+    // Text after the last appended block only ever changes that block
+    MarkdownDocument document;
+    document.Append("Intro\n\n```\n", 11);
+    size_t codeBlock = document.Blocks().size() - 1;
+    CHECK(document.Append("line one\n", 9) == codeBlock);
+    CHECK(document.Append("line two", 8) == codeBlock);
+    CHECK(document.Blocks()[codeBlock].text == "line one\nline two");
+
+    if (sFailures > 0) {
+        fprintf(stderr, "MarkdownDocumentTest: %d checks failed\n", sFailures);
+        return 1;
+    }
+
+    printf("MarkdownDocumentTest: passed\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+// SearchIndexBenchmark.cpp
+//
+// Indexes a few hundred thousand generated messages, the history of a
+// heavy user, then times queries of each kind and a Save and Load of the
+// index file.
+#include "SearchIndex.h"
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+static const int32_t kChats = 3000;
+static const int32_t kMessagesPerChat = 100;
+
+// Words drawn with a skewed distribution, so a few are in most messages
+// and most are in a few, as in real text
+static std::vector<std::string> Vocabulary()
+{
+    static const char* kStems[] = { "buffer", "thread", "config", "window",
+        "message", "request", "layout", "render", "parse", "token", "cache",
+        "socket", "stream", "query", "index", "record", "schema", "signal" };
+    static const char* kSuffixes[] = { "", "s", "ed", "ing", "er", "ure",
+        "ation", "able", "ize", "ment" };
+
+    std::vector<std::string> words = { "the", "a", "is", "to", "and", "of",
+        "in", "it", "that", "for" };
+    for (const char* stem : kStems) {
+        for (const char* suffix : kSuffixes)
+            words.push_back(std::string(stem) + suffix);
+    }
+    for (int32_t i = 0; i < 20000; i++)
+        words.push_back("term" + std::to_string(i));
+    return words;
+}
+
+class Generator {
+public:
+    Generator() : fState(42) {}
+
+    uint32_t Next()
+    {
+        fState ^= fState << 13;
+        fState ^= fState >> 17;
+        fState ^= fState << 5;
+        return fState;
+    }
+
+    // Index below count, small ones far more often than large ones
+    size_t Skewed(size_t count)
+    {
+        double unit = (Next() & 0xffffff) / double(0x1000000);
+        return size_t(count * unit * unit * unit) % count;
+    }
+
+private:
+    uint32_t fState;
+};
+
+static std::string Message(Generator& generator,
+    const std::vector<std::string>& words)
+{
+    size_t count = 5 + generator.Next() % 60;
+    std::string text;
+    for (size_t i = 0; i < count; i++) {
+        text += words[generator.Skewed(words.size())];
+        text += i % 12 == 11 ? ". " : " ";
+    }
+    return text;
+}
+
+static void Build(SearchIndex& index, const std::vector<std::string>& words,
+    size_t* bytes)
+{
+    Generator generator;
+    *bytes = 0;
+    for (int32_t chat = 0; chat < kChats; chat++) {
+        std::string chatID = "chat-" + std::to_string(chat);
+        for (int32_t message = 0; message < kMessagesPerChat; message++) {
+            std::string text = Message(generator, words);
+            index.Add(chatID, message, text.data(), text.size());
+            *bytes += text.size();
+        }
+    }
+}
+
+static void BenchQuery(const SearchIndex& index, const char* query,
+    int iterations)
+{
+    std::vector<SearchIndex::Hit> hits;
+    std::string name = std::string("Search ") + query;
+    Measure(name.c_str(), iterations, 0, [&]() {
+        hits.clear();
+        index.Search(query, 50, &hits);
+        KeepResult(hits);
+    });
+}
+
+static long FileSize(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+int main()
+{
+    std::vector<std::string> words = Vocabulary();
+
+    std::unique_ptr<SearchIndex> index;
+    size_t bytes = 0;
+    printf("%d messages\n", kChats * kMessagesPerChat);
+    Measure("Add", 1, 0, [&]() {
+        index.reset(new SearchIndex);
+        Build(*index, words, &bytes);
+    });
+    printf("  %-44s %10.1f MB\n", "text", bytes / 1e6);
+
+    BenchQuery(*index, "the", 20);
+    BenchQuery(*index, "buffer thread", 100);
+    BenchQuery(*index, "term19000", 10000);
+    BenchQuery(*index, "term15000 term16000", 10000);
+    BenchQuery(*index, "config*", 100);
+    BenchQuery(*index, "term1*", 100);
+    BenchQuery(*index, "\"the buffer\"", 50);
+    BenchQuery(*index, "\"term9000 term9001\"", 10000);
+
+    char path[] = "/tmp/SearchIndexBenchmarkXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("SearchIndexBenchmark");
+        return 1;
+    }
+    close(fd);
+
+    // Save writes the whole index each time, with an fsync
+    bool saved = true;
+    Measure("Save", 3, 0, [&]() {
+        saved = index->Save(path) && saved;
+    });
+    printf("  %-44s %10.1f MB\n", "file", FileSize(path) / 1e6);
+
+    SearchIndex loaded;
+    bool read = true;
+    Measure("Load", 5, 0, [&]() {
+        read = loaded.Load(path) && read;
+    });
+    unlink(path);
+
+    if (!saved || !read || loaded.CountDocuments() != index->CountDocuments()) {
+        fprintf(stderr, "SearchIndexBenchmark: index did not round-trip\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+// SearchIndexTest.cpp
+//
+// Word, prefix and phrase queries, prefixes of too many terms, and
+// posting lists whose document numbers and positions need varints of
+// several bytes, before and after a round trip through the index file.
+#include "SearchIndex.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static int sFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, \
+                #condition); \
+            sFailures++; \
+        } \
+    } while (false)
+
+static void Add(SearchIndex& index, const char* chatID, int32_t message,
+    const std::string& text)
+{
+    index.Add(chatID, message, text.data(), text.size());
+}
+
+// "chat/message" of every hit, sorted
+static std::vector<std::string> Find(const SearchIndex& index,
+    const char* query)
+{
+    std::vector<SearchIndex::Hit> hits;
+    index.Search(query, 1000000, &hits);
+
+    std::vector<std::string> found;
+    for (size_t i = 0; i < hits.size(); i++)
+        found.push_back(hits[i].chatID + "/" + std::to_string(hits[i].message));
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+static std::vector<std::string> List(std::initializer_list<const char*> items)
+{
+    std::vector<std::string> list(items.begin(), items.end());
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+static void CheckQueries(const SearchIndex& index)
+{
+    // Words must all match, in any order and case
+    CHECK(Find(index, "quick fox") == List({ "a/0", "a/1" }));
+    CHECK(Find(index, "QUICK") == List({ "a/0", "a/1", "b/0" }));
+    CHECK(Find(index, "fox thinking").empty());
+
+    // Prefixes expand to every term they start
+    CHECK(Find(index, "config*") == List({ "b/1", "b/2" }));
+    CHECK(Find(index, "conf*") == List({ "b/1", "b/2", "b/3" }));
+    CHECK(Find(index, "configuration*") == List({ "b/2" }));
+    CHECK(Find(index, "zzz*").empty());
+
+    // A prefix of more terms than that stands for those in the most
+    // messages
+    std::vector<std::string> wide = Find(index, "wide*");
+    CHECK(wide.size() == 10 + SearchIndex::kMaxPrefixTerms - 1);
+    for (int32_t i = 0; i < 10; i++) {
+        std::string hit = "e/" + std::to_string(1000 + i);
+        CHECK(std::binary_search(wide.begin(), wide.end(), hit));
+    }
+
+    // Phrases match consecutive words only
+    CHECK(Find(index, "\"quick brown\"") == List({ "a/0" }));
+    CHECK(Find(index, "\"brown quick\"") == List({ "a/1" }));
+    CHECK(Find(index, "\"quick brown fox\"") == List({ "a/0" }));
+    CHECK(Find(index, "\"the fox\"").empty());
+    CHECK(Find(index, "\"quick brown\" fox") == List({ "a/0" }));
+
+    // A word far into a long message, and one in the first and the last
+    // of many messages: positions and document gaps of three bytes
+    CHECK(Find(index, "\"needle haystack\"") == List({ "c/0" }));
+    CHECK(Find(index, "bookend") == List({ "d/0", "d/19999" }));
+    CHECK(Find(index, "filler16 filler22").size() == 20000 / (17 * 23));
+}
+
+int main()
+{
+    SearchIndex index;
+    Add(index, "a", 0, "The quick brown fox jumps over the lazy dog.");
+    Add(index, "a", 1, "A brown, quick fox.");
+    Add(index, "b", 0, "Quick thinking.");
+    Add(index, "b", 1, "Configure the compiler first.");
+    Add(index, "b", 2, "The configuration file is read at start.");
+    Add(index, "b", 3, "I am confident it works.");
+
+    std::string longText;
+    for (int32_t i = 0; i < 30000; i++)
+        longText += "word" + std::to_string(i % 97) + " ";
+    longText += "needle haystack";
+    Add(index, "c", 0, longText);
+
+    for (int32_t i = 0; i < 20000; i++) {
+        std::string text = "filler" + std::to_string(i % 17) + " filler"
+            + std::to_string(i % 23);
+        if (i == 0 || i == 19999)
+            text += " bookend";
+        Add(index, "d", i, text);
+    }
+
+    for (int32_t i = 0; i < 1000; i++)
+        Add(index, "e", i, "wide" + std::to_string(i));
+    for (int32_t i = 1000; i < 1010; i++)
+        Add(index, "e", i, "widely known");
+
+    CHECK(index.IndexedCount("a") == 2);
+    CHECK(index.IndexedCount("d") == 20000);
+    CHECK(index.IndexedCount("missing") == 0);
+    CheckQueries(index);
+
+    // Everything decodes the same from the file
+    char path[] = "/tmp/SearchIndexTestXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    CHECK(index.Save(path));
+    SearchIndex loaded;
+    CHECK(loaded.Load(path));
+    CHECK(loaded.CountDocuments() == index.CountDocuments());
+    CHECK(loaded.PendingDocuments() == 0);
+    CheckQueries(loaded);
+
+    // Scores do not change either
+    std::vector<SearchIndex::Hit> before;
+    std::vector<SearchIndex::Hit> after;
+    index.Search("quick fox*", 10, &before);
+    loaded.Search("quick fox*", 10, &after);
+    CHECK(before.size() == after.size());
+    for (size_t i = 0; i < before.size() && i < after.size(); i++) {
+        CHECK(before[i].chatID == after[i].chatID);
+        CHECK(before[i].message == after[i].message);
+        CHECK(before[i].score == after[i].score);
+    }
+
+    // Appending to lists that came from the file
+    Add(loaded, "a", 2, "quick brown bookend");
+    CHECK(Find(loaded, "\"quick brown\"") == List({ "a/0", "a/2" }));
+    CHECK(Find(loaded, "bookend") == List({ "a/2", "d/0", "d/19999" }));
+
+    loaded.RemoveChat("a");
+    CHECK(Find(loaded, "quick") == List({ "b/0" }));
+
+    // A damaged file loads as an empty index
+    FILE* file = fopen(path, "r+b");
+    CHECK(file != NULL);
+    if (file != NULL) {
+        fseek(file, 64, SEEK_SET);
+        fputc(0xff, file);
+        fclose(file);
+    }
+    SearchIndex damaged;
+    CHECK(!damaged.Load(path));
+    CHECK(damaged.CountDocuments() == 0);
+    unlink(path);
+
+    if (sFailures > 0) {
+        fprintf(stderr, "SearchIndexTest: %d checks failed\n", sFailures);
+        return 1;
+    }
+
+    printf("SearchIndexTest: passed\n");
+    return 0;
+}
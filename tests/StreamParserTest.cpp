@@ -0,0 +1,283 @@
+// StreamParserTest.cpp
+//
+// Feeds recorded streams into SSEStream, OpenAIStream and OllamaStream,
+// cut into chunks at every possible byte boundary, the way a socket may
+// hand them over.
+#include "OllamaStream.h"
+#include "OpenAIStream.h"
+#include "StreamParser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static int sFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, \
+                #condition); \
+            sFailures++; \
+        } \
+    } while (false)
+
+// A chat.completion stream as the API sends it, with a keep-alive comment,
+// the usage chunk of stream_options.include_usage and CRLF line ends
+static const char* kOpenAIStream =
+    ": keep-alive\r\n"
+    "\r\n"
+    "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+        "\"choices\":[{\"index\":0,\"delta\":{\"role\":\"assistant\","
+        "\"content\":\"\"},\"finish_reason\":null}]}\r\n"
+    "\r\n"
+    "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+        "\"choices\":[{\"index\":0,\"delta\":{\"content\":\"Hel\"},"
+        "\"finish_reason\":null}]}\r\n"
+    "\r\n"
+    "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+        "\"choices\":[{\"index\":0,\"delta\":{\"content\":\"lo, \\\"w\\u00f6rld\\\"\\n\"},"
+        "\"finish_reason\":null}]}\r\n"
+    "\r\n"
+    "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+        "\"choices\":[{\"index\":0,\"delta\":{},\"finish_reason\":\"stop\"}]}\r\n"
+    "\r\n"
+    "data: {\"id\":\"chatcmpl-1\",\"object\":\"chat.completion.chunk\","
+        "\"choices\":[],\"usage\":{\"prompt_tokens\":12,"
+        "\"completion_tokens\":5,\"total_tokens\":17}}\r\n"
+    "\r\n"
+    "data: [DONE]\r\n"
+    "\r\n";
+
+// Events with names, multi-line data, a field without a value and no
+// blank line after the last one
+static const char* kNamedEvents =
+    "event: message_start\n"
+    "data: {\"a\":1}\n"
+    "\n"
+    "id: 7\n"
+    "data: first\n"
+    "data: second\n"
+    "\n"
+    "event: ping\n"
+    "\n"
+    "data\n"
+    "\n"
+    "event: message_stop\n"
+    "data: {}";
+
+// What a 401 has as its body: plain JSON, no events
+static const char* kOpenAIError =
+    "{\n"
+    "    \"error\": {\n"
+    "        \"message\": \"Incorrect API key provided: sk-xxxx.\",\n"
+    "        \"type\": \"invalid_request_error\",\n"
+    "        \"param\": null,\n"
+    "        \"code\": \"invalid_api_key\"\n"
+    "    }\n"
+    "}\n";
+
+// An /api/chat stream: one JSON object per line, the counters on the last
+static const char* kOllamaStream =
+    "{\"model\":\"llama3\",\"message\":{\"role\":\"assistant\","
+        "\"content\":\"Hel\"},\"done\":false}\n"
+    "{\"model\":\"llama3\",\"message\":{\"role\":\"assistant\","
+        "\"content\":\"lo\\n\"},\"done\":false}\n"
+    "{\"model\":\"llama3\",\"message\":{\"role\":\"assistant\","
+        "\"content\":\"\"},\"done\":true,\"prompt_eval_count\":26,"
+        "\"eval_count\":2,\"eval_duration\":41000000}\n";
+
+// What a 404 for a missing model has as its body, with no newline at the end
+static const char* kOllamaError =
+    "{\"error\":\"model \\\"llama9\\\" not found, try pulling it first\"}";
+
+class RecordingOpenAIStream : public OpenAIStream {
+public:
+    std::vector<std::string> deltas;
+
+protected:
+    virtual status_t DeltaReceived(const BString& delta)
+    {
+        deltas.push_back(delta.String());
+        return B_OK;
+    }
+};
+
+class RecordingOllamaStream : public OllamaStream {
+public:
+    std::vector<std::string> deltas;
+
+protected:
+    virtual status_t DeltaReceived(const BString& delta)
+    {
+        deltas.push_back(delta.String());
+        return B_OK;
+    }
+};
+
+class RecordingSSEStream : public SSEStream {
+public:
+    std::vector<std::string> events;
+
+protected:
+    virtual status_t EventReceived(const BString& event, const BString& data)
+    {
+        events.push_back(std::string(event.String()) + "|" + data.String());
+        return B_OK;
+    }
+};
+
+// Writes data in pieces of the given sizes, then the rest in one piece
+static void Feed(BDataIO& stream, const char* data,
+    const std::vector<size_t>& cuts)
+{
+    size_t length = strlen(data);
+    size_t position = 0;
+    for (size_t i = 0; i < cuts.size() && position < length; i++) {
+        size_t size = cuts[i] < length - position ? cuts[i] : length - position;
+        CHECK(stream.Write(data + position, size) == (ssize_t)size);
+        position += size;
+    }
+    if (position < length)
+        CHECK(stream.Write(data + position, length - position)
+            == (ssize_t)(length - position));
+}
+
+static void CheckOpenAI(const std::vector<size_t>& cuts)
+{
+    RecordingOpenAIStream stream;
+    Feed(stream, kOpenAIStream, cuts);
+    CHECK(stream.Flush() == B_OK);
+
+    CHECK(stream.deltas.size() == 2);
+    if (stream.deltas.size() == 2) {
+        CHECK(stream.deltas[0] == "Hel");
+        CHECK(stream.deltas[1] == "lo, \"w\xc3\xb6rld\"\n");
+    }
+    CHECK(stream.Content() == "Hello, \"w\xc3\xb6rld\"\n");
+    CHECK(stream.IsDone());
+    CHECK(stream.InputTokens() == 12);
+    CHECK(stream.OutputTokens() == 5);
+}
+
+static void CheckOpenAIError(const std::vector<size_t>& cuts)
+{
+    // The body is kept as it came, for the error message
+    RecordingOpenAIStream stream;
+    Feed(stream, kOpenAIError, cuts);
+    CHECK(stream.Flush() == B_OK);
+    CHECK(stream.deltas.empty());
+    CHECK(stream.Body() == kOpenAIError);
+}
+
+static void CheckOllama(const std::vector<size_t>& cuts)
+{
+    RecordingOllamaStream stream;
+    Feed(stream, kOllamaStream, cuts);
+    CHECK(stream.Flush() == B_OK);
+
+    CHECK(stream.deltas.size() == 2);
+    if (stream.deltas.size() == 2) {
+        CHECK(stream.deltas[0] == "Hel");
+        CHECK(stream.deltas[1] == "lo\n");
+    }
+    CHECK(stream.Content() == "Hello\n");
+    CHECK(stream.Error().IsEmpty());
+    CHECK(stream.InputTokens() == 26);
+    CHECK(stream.OutputTokens() == 2);
+    CHECK(stream.EvalDuration() == 41000000);
+}
+
+static void CheckOllamaError(const std::vector<size_t>& cuts)
+{
+    RecordingOllamaStream stream;
+    Feed(stream, kOllamaError, cuts);
+
+    // The line only ends with the body
+    CHECK(stream.Error().IsEmpty());
+    CHECK(stream.Flush() == B_OK);
+    CHECK(stream.Error() == "model \"llama9\" not found, try pulling it first");
+    CHECK(stream.deltas.empty());
+}
+
+static void CheckNamedEvents(const std::vector<size_t>& cuts)
+{
+    RecordingSSEStream stream;
+    Feed(stream, kNamedEvents, cuts);
+
+    // The last event is only complete once the body has ended
+    CHECK(stream.events.size() == 3);
+    CHECK(stream.Flush() == B_OK);
+    CHECK(stream.Write("\n", 1) == 1);
+
+    CHECK(stream.events.size() == 4);
+    if (stream.events.size() == 4) {
+        CHECK(stream.events[0] == "message_start|{\"a\":1}");
+        CHECK(stream.events[1] == "|first\nsecond");
+        CHECK(stream.events[2] == "|");
+        CHECK(stream.events[3] == "message_stop|{}");
+    }
+}
+
+static void CheckStream(void (*check)(const std::vector<size_t>&),
+    const char* data)
+{
+    size_t length = strlen(data);
+
+    // In one piece, and cut in two at every byte
+    check(std::vector<size_t>());
+    for (size_t cut = 1; cut < length; cut++)
+        check(std::vector<size_t>(1, cut));
+
+    // Byte by byte
+    check(std::vector<size_t>(length, 1));
+
+    // In pieces of random sizes
+    srand(42);
+    for (int32 round = 0; round < 200; round++) {
+        std::vector<size_t> cuts;
+        for (size_t total = 0; total < length; total += cuts.back())
+            cuts.push_back(1 + rand() % 24);
+        check(cuts);
+    }
+}
+
+class AbortingOpenAIStream : public OpenAIStream {
+protected:
+    virtual status_t DeltaReceived(const BString& delta)
+    {
+        return B_CANCELED;
+    }
+};
+
+int main()
+{
+    CheckStream(CheckOpenAI, kOpenAIStream);
+    CheckStream(CheckNamedEvents, kNamedEvents);
+    CheckStream(CheckOpenAIError, kOpenAIError);
+    CheckStream(CheckOllama, kOllamaStream);
+    CheckStream(CheckOllamaError, kOllamaError);
+
+    // An error from a delta fails the write, which aborts the transfer
+    AbortingOpenAIStream aborting;
+    CHECK(aborting.Write(kOpenAIStream, strlen(kOpenAIStream)) == B_CANCELED);
+
+    // Only the start of a long body is kept
+    RecordingSSEStream large;
+    std::string line = std::string("data: ") + std::string(1000, 'x') + "\n\n";
+    for (int32 i = 0; i < 100; i++)
+        CHECK(large.Write(line.data(), line.size()) == (ssize_t)line.size());
+    CHECK(large.Body().Length() == 16 * 1024);
+    CHECK(large.events.size() == 100);
+
+    if (sFailures > 0) {
+        fprintf(stderr, "StreamParserTest: %d checks failed\n", sFailures);
+        return 1;
+    }
+
+    printf("StreamParserTest: passed\n");
+    return 0;
+}
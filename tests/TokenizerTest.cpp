@@ -0,0 +1,143 @@
+// TokenizerTest.cpp
+//
+// Counts texts with both BPE pre-tokenizers and compares them with what
+// tiktoken counts. TokenizerTest.tiktoken is a small merge table: a few
+// hundred merges trained on prose and code, plus every piece of the texts
+// below as cut by either pattern, so counts differ wherever the two
+// patterns cut differently. The expected counts are what
+// tiktoken.Encoding gives with that table and the pat_str of cl100k_base
+// and o200k_base.
+#include "Tokenizer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int sFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, \
+                #condition); \
+            sFailures++; \
+        } \
+    } while (false)
+
+struct Case {
+    const char* text;
+    int32 cl100k;
+    int32 o200k;
+};
+
+static const Case kCases[] = {
+    { "The quick brown fox jumps over the lazy dog.",
+        10, 10 },
+    { "I'M sure they're here, DON'T you think? We'll see; it's fine.",
+        20, 15 },
+    { "'sup 'S 'll ' ve",
+        8, 7 },
+    { "HTTPRequest parseJSONValue XMLHttpRequest helloWorld ABCdef getID",
+        6, 10 },
+    { "Numbers: 1234567 and 3.14159, 2024-10-17.",
+        21, 21 },
+    { "Wow!!! Really?!\nYes...\r\n\r\nok",
+        7, 7 },
+    { "</div>\n<a href=\"/docs/index.html\">x</a>//comment\n",
+        16, 16 },
+    { "path/to//file and a // b and ***/\n",
+        10, 10 },
+    { "if (x) {\n    return y;\n}\n\n\tint  z = 0;   \n",
+        18, 18 },
+    { "trailing spaces   ",
+        3, 3 },
+    { "end \n  ",
+        2, 3 },
+    { "a  \n\n  b",
+        4, 4 },
+    // "Ça a été très étrange. ÉCOLE Straße ÜBER Œuvre"
+    { "\xc3\x87" "a a \xc3\xa9t\xc3\xa9 tr\xc3\xa8s \xc3\xa9trange. "
+        "\xc3\x89" "COLE Stra\xc3\x9f" "e \xc3\x9c" "BER \xc5\x92uvre",
+        10, 10 },
+    // "Привет, МИР! Καλημέρα ΚΌΣΜΕ."
+    { "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82, "
+        "\xd0\x9c\xd0\x98\xd0\xa0! "
+        "\xce\x9a\xce\xb1\xce\xbb\xce\xb7\xce\xbc\xce\xad\xcf\x81\xce\xb1 "
+        "\xce\x9a\xce\x8c\xce\xa3\xce\x9c\xce\x95.",
+        7, 7 },
+    // "東京は日本の首都です。"
+    { "\xe6\x9d\xb1\xe4\xba\xac\xe3\x81\xaf\xe6\x97\xa5\xe6\x9c\xac"
+        "\xe3\x81\xae\xe9\xa6\x96\xe9\x83\xbd\xe3\x81\xa7\xe3\x81\x99"
+        "\xe3\x80\x82",
+        2, 2 },
+    // "don’t “quote” a—b … 👍🏽 €5"
+    { "don\xe2\x80\x99t \xe2\x80\x9cquote\xe2\x80\x9d a\xe2\x80\x94" "b "
+        "\xe2\x80\xa6 \xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd \xe2\x82\xac" "5",
+        11, 11 },
+    // No-break, em and ideographic spaces
+    { "a\xc2\xa0" "b\xe2\x80\x83" "c\xe3\x80\x80" "d",
+        4, 4 },
+    // "été cafés" with combining accents
+    { "e\xcc\x81te\xcc\x81 cafe\xcc\x81s",
+        5, 2 },
+    // "नमस्ते दुनिया ٣٤٥ ½ ²"
+    { "\xe0\xa4\xa8\xe0\xa4\xae\xe0\xa4\xb8\xe0\xa5\x8d\xe0\xa4\xa4"
+        "\xe0\xa5\x87 \xe0\xa4\xa6\xe0\xa5\x81\xe0\xa4\xa8\xe0\xa4\xbf"
+        "\xe0\xa4\xaf\xe0\xa4\xbe \xd9\xa3\xd9\xa4\xd9\xa5 \xc2\xbd \xc2\xb2",
+        13, 8 },
+    // "ＡＢＣａｂｃ１２３"
+    { "\xef\xbc\xa1\xef\xbc\xa2\xef\xbc\xa3\xef\xbd\x81\xef\xbd\x82"
+        "\xef\xbd\x83\xef\xbc\x91\xef\xbc\x92\xef\xbc\x93",
+        2, 2 },
+    // "ǅemal ǈ", title case letters
+    { "\xc7\x85" "emal \xc7\x88",
+        2, 2 },
+    { "it's IT'S It'S can'T",
+        8, 4 },
+};
+
+int main()
+{
+    EstimatingTokenizer estimate("test-estimate", 4.0f);
+    BPETokenizer cl100k("test-cl100k", "TokenizerTest.tiktoken",
+        BPETokenizer::CL100K_PATTERN, &estimate);
+    BPETokenizer o200k("test-o200k", "TokenizerTest.tiktoken",
+        BPETokenizer::O200K_PATTERN, &estimate);
+
+    // Until the table is loaded, counts are estimates
+    const char* text = kCases[0].text;
+    CHECK(!o200k.IsAvailable());
+    CHECK(o200k.CountTokens(text, strlen(text))
+        == estimate.CountTokens(text, strlen(text)));
+
+    CHECK(cl100k.Load("TokenizerTest.tiktoken") == B_OK);
+    CHECK(o200k.Load("TokenizerTest.tiktoken") == B_OK);
+    CHECK(cl100k.IsAvailable() && o200k.IsAvailable());
+
+    for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); i++) {
+        int32 length = strlen(kCases[i].text);
+        int32 cl100kCount = cl100k.CountTokens(kCases[i].text, length);
+        int32 o200kCount = o200k.CountTokens(kCases[i].text, length);
+        if (cl100kCount != kCases[i].cl100k || o200kCount != kCases[i].o200k) {
+            fprintf(stderr, "case %d: %d and %d tokens, tiktoken has %d and %d\n",
+                (int)i, (int)cl100kCount, (int)o200kCount,
+                (int)kCases[i].cl100k, (int)kCases[i].o200k);
+            sFailures++;
+        }
+    }
+
+    // A missing table leaves the estimate in place
+    BPETokenizer missing("test-missing", "missing.tiktoken",
+        BPETokenizer::O200K_PATTERN, &estimate);
+    CHECK(missing.Load("missing.tiktoken") != B_OK);
+    CHECK(!missing.IsAvailable());
+    CHECK(missing.CountTokens(text, strlen(text))
+        == estimate.CountTokens(text, strlen(text)));
+
+    if (sFailures > 0) {
+        fprintf(stderr, "TokenizerTest: %d checks failed\n", sFailures);
+        return 1;
+    }
+
+    printf("TokenizerTest: passed\n");
+    return 0;
+}
@@ -0,0 +1,16 @@
+// compat/ByteOrder.h
+#ifndef COMPAT_BYTE_ORDER_H
+#define COMPAT_BYTE_ORDER_H
+
+#include <SupportDefs.h>
+
+#include <endian.h>
+
+#define B_LENDIAN_TO_HOST_INT16(value) le16toh(value)
+#define B_LENDIAN_TO_HOST_INT32(value) le32toh(value)
+#define B_LENDIAN_TO_HOST_INT64(value) le64toh(value)
+#define B_HOST_TO_LENDIAN_INT16(value) htole16(value)
+#define B_HOST_TO_LENDIAN_INT32(value) htole32(value)
+#define B_HOST_TO_LENDIAN_INT64(value) htole64(value)
+
+#endif // COMPAT_BYTE_ORDER_H
@@ -0,0 +1,33 @@
+// compat/DataIO.h
+#ifndef COMPAT_DATA_IO_H
+#define COMPAT_DATA_IO_H
+
+#include <SupportDefs.h>
+
+#include <string>
+
+class BDataIO {
+public:
+    virtual ~BDataIO() {}
+
+    virtual ssize_t Read(void* buffer, size_t size) { return B_ERROR; }
+    virtual ssize_t Write(const void* buffer, size_t size) { return B_ERROR; }
+};
+
+class BMallocIO : public BDataIO {
+public:
+    virtual ssize_t Write(const void* buffer, size_t size)
+    {
+        fData.append((const char*)buffer, size);
+        return size;
+    }
+
+    void SetBlockSize(size_t blockSize) { fData.reserve(blockSize); }
+    const void* Buffer() const { return fData.data(); }
+    size_t BufferLength() const { return fData.size(); }
+
+private:
+    std::string fData;
+};
+
+#endif // COMPAT_DATA_IO_H
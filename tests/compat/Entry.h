@@ -0,0 +1,21 @@
+// compat/Entry.h
+#ifndef COMPAT_ENTRY_H
+#define COMPAT_ENTRY_H
+
+#include <SupportDefs.h>
+
+#include <string>
+
+// Stands for a file by its path, where Haiku uses device, directory and
+// name
+struct entry_ref {
+    std::string path;
+};
+
+inline status_t get_ref_for_path(const char* path, entry_ref* ref)
+{
+    ref->path = path;
+    return B_OK;
+}
+
+#endif // COMPAT_ENTRY_H
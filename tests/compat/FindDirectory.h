@@ -0,0 +1,19 @@
+// compat/FindDirectory.h
+#ifndef COMPAT_FIND_DIRECTORY_H
+#define COMPAT_FIND_DIRECTORY_H
+
+#include <Path.h>
+
+enum directory_which {
+    B_USER_DATA_DIRECTORY,
+    B_SYSTEM_DATA_DIRECTORY
+};
+
+// There are no Haiku data directories here, so nothing is found in them
+inline status_t find_directory(directory_which which, BPath* path,
+    bool create = false)
+{
+    return B_ENTRY_NOT_FOUND;
+}
+
+#endif // COMPAT_FIND_DIRECTORY_H
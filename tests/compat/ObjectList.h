@@ -0,0 +1,69 @@
+// compat/ObjectList.h
+#ifndef COMPAT_OBJECT_LIST_H
+#define COMPAT_OBJECT_LIST_H
+
+#include <SupportDefs.h>
+
+#include <vector>
+
+template<class T, bool Owning = false>
+class BObjectList {
+public:
+    BObjectList(int32 itemsPerBlock = 20) { fItems.reserve(itemsPerBlock); }
+
+    ~BObjectList()
+    {
+        if (Owning) {
+            for (size_t i = 0; i < fItems.size(); i++)
+                delete fItems[i];
+        }
+    }
+
+    int32 CountItems() const { return (int32)fItems.size(); }
+    T* ItemAt(int32 index) const
+    {
+        return index >= 0 && index < CountItems() ? fItems[index] : NULL;
+    }
+
+    bool AddItem(T* item)
+    {
+        fItems.push_back(item);
+        return true;
+    }
+
+    bool AddItem(T* item, int32 index)
+    {
+        if (index < 0 || index > CountItems())
+            return false;
+        fItems.insert(fItems.begin() + index, item);
+        return true;
+    }
+
+    bool AddList(BObjectList* list)
+    {
+        fItems.insert(fItems.end(), list->fItems.begin(), list->fItems.end());
+        return true;
+    }
+
+    T* RemoveItemAt(int32 index)
+    {
+        T* item = ItemAt(index);
+        if (item != NULL)
+            fItems.erase(fItems.begin() + index);
+        return item;
+    }
+
+    void MakeEmpty()
+    {
+        if (Owning) {
+            for (size_t i = 0; i < fItems.size(); i++)
+                delete fItems[i];
+        }
+        fItems.clear();
+    }
+
+private:
+    std::vector<T*> fItems;
+};
+
+#endif // COMPAT_OBJECT_LIST_H
@@ -0,0 +1,30 @@
+// compat/Path.h
+#ifndef COMPAT_PATH_H
+#define COMPAT_PATH_H
+
+#include <Entry.h>
+
+#include <string>
+
+class BPath {
+public:
+    BPath() {}
+    BPath(const char* path) : fPath(path) {}
+    BPath(const entry_ref* ref) : fPath(ref->path) {}
+
+    const char* Path() const { return fPath.c_str(); }
+
+    status_t Append(const char* leaf)
+    {
+        fPath += "/";
+        fPath += leaf;
+        return B_OK;
+    }
+
+    void SetTo(const char* path) { fPath = path; }
+
+private:
+    std::string fPath;
+};
+
+#endif // COMPAT_PATH_H
@@ -0,0 +1,75 @@
+// compat/Referenceable.h
+#ifndef COMPAT_REFERENCEABLE_H
+#define COMPAT_REFERENCEABLE_H
+
+#include <SupportDefs.h>
+
+#include <atomic>
+#include <utility>
+
+class BReferenceable {
+public:
+    BReferenceable() : fReferenceCount(1) {}
+    virtual ~BReferenceable() {}
+
+    int32 AcquireReference() { return fReferenceCount++; }
+
+    int32 ReleaseReference()
+    {
+        int32 previous = fReferenceCount--;
+        if (previous == 1)
+            delete this;
+        return previous;
+    }
+
+    int32 CountReferences() const { return fReferenceCount; }
+
+private:
+    std::atomic<int32> fReferenceCount;
+};
+
+template<typename Type>
+class BReference {
+public:
+    BReference() : fObject(NULL) {}
+
+    BReference(Type* object, bool alreadyHasReference = false)
+        : fObject(object)
+    {
+        if (fObject != NULL && !alreadyHasReference)
+            fObject->AcquireReference();
+    }
+
+    BReference(const BReference& other) : BReference(other.fObject) {}
+
+    BReference(BReference&& other) : fObject(other.fObject)
+    {
+        other.fObject = NULL;
+    }
+
+    ~BReference()
+    {
+        if (fObject != NULL)
+            fObject->ReleaseReference();
+    }
+
+    BReference& operator=(const BReference& other)
+    {
+        BReference copy(other);
+        std::swap(fObject, copy.fObject);
+        return *this;
+    }
+
+    BReference& operator=(BReference&& other)
+    {
+        std::swap(fObject, other.fObject);
+        return *this;
+    }
+
+    Type* Get() const { return fObject; }
+
+private:
+    Type* fObject;
+};
+
+#endif // COMPAT_REFERENCEABLE_H
@@ -0,0 +1,122 @@
+// compat/String.h
+#ifndef COMPAT_STRING_H
+#define COMPAT_STRING_H
+
+#include <SupportDefs.h>
+
+#include <string.h>
+
+#include <string>
+
+// The part of BString the tested sources use, on top of std::string
+class BString {
+public:
+    BString() {}
+    BString(const char* string) : fString(string != NULL ? string : "") {}
+    BString(const char* string, int32 length) : fString(string, length) {}
+
+    const char* String() const { return fString.c_str(); }
+    int32 Length() const { return (int32)fString.size(); }
+    bool IsEmpty() const { return fString.empty(); }
+
+    BString& SetTo(const char* string, int32 length)
+    {
+        fString.assign(string, length);
+        return *this;
+    }
+
+    BString& Append(const char* string, int32 length)
+    {
+        fString.append(string, length);
+        return *this;
+    }
+
+    BString& Append(char c, int32 count)
+    {
+        fString.append(count, c);
+        return *this;
+    }
+
+    BString& Truncate(int32 newLength)
+    {
+        if (newLength < Length())
+            fString.resize(newLength);
+        return *this;
+    }
+
+    bool StartsWith(const char* prefix) const
+    {
+        return fString.compare(0, strlen(prefix), prefix) == 0;
+    }
+
+    int32 IFindFirst(const char* string) const
+    {
+        std::string lower = _Lower(fString);
+        size_t found = lower.find(_Lower(string));
+        return found == std::string::npos ? -1 : (int32)found;
+    }
+
+    // Room for maxLength bytes; UnlockBuffer() sets the length written
+    char* LockBuffer(int32 maxLength)
+    {
+        if ((size_t)maxLength > fString.size())
+            fString.resize(maxLength);
+        return &fString[0];
+    }
+
+    BString& UnlockBuffer(int32 length = -1)
+    {
+        fString.resize(length < 0 ? strlen(fString.c_str()) : length);
+        return *this;
+    }
+
+    bool EndsWith(const char* suffix) const
+    {
+        size_t length = strlen(suffix);
+        return fString.size() >= length
+            && fString.compare(fString.size() - length, length, suffix) == 0;
+    }
+
+    BString& operator<<(const BString& string)
+    {
+        fString += string.fString;
+        return *this;
+    }
+
+    BString& operator<<(const char* string)
+    {
+        fString += string;
+        return *this;
+    }
+
+    BString& operator<<(char c)
+    {
+        fString += c;
+        return *this;
+    }
+
+    BString& operator<<(int32 value)
+    {
+        fString += std::to_string(value);
+        return *this;
+    }
+
+    bool operator==(const BString& other) const { return fString == other.fString; }
+    bool operator==(const char* other) const { return fString == other; }
+    bool operator!=(const char* other) const { return fString != other; }
+    bool operator<(const BString& other) const { return fString < other.fString; }
+
+private:
+    static std::string _Lower(std::string string)
+    {
+        for (size_t i = 0; i < string.size(); i++) {
+            if (string[i] >= 'A' && string[i] <= 'Z')
+                string[i] += 'a' - 'A';
+        }
+        return string;
+    }
+
+    std::string fString;
+};
+
+#endif // COMPAT_STRING_H
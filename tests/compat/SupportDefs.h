@@ -0,0 +1,37 @@
+// compat/SupportDefs.h
+#ifndef COMPAT_SUPPORT_DEFS_H
+#define COMPAT_SUPPORT_DEFS_H
+
+// The few Support Kit types and codes the tests need, so they also build
+// where there is no Haiku
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+
+typedef int32 status_t;
+typedef int64 bigtime_t;
+
+#define B_OK 0
+#define B_ERROR (-1)
+#define B_NO_MEMORY ENOMEM
+#define B_BAD_VALUE EINVAL
+#define B_BAD_DATA (-2147483632)
+#define B_CANCELED ECANCELED
+#define B_NO_INIT (-2147483631)
+#define B_IO_ERROR EIO
+#define B_ENTRY_NOT_FOUND ENOENT
+
+#define B_PRId64 PRId64
+
+#endif // COMPAT_SUPPORT_DEFS_H